@@ -0,0 +1,309 @@
+#include "AABBTree.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+//surface area (well, half of it) of a box; insertion keeps the total of these small:
+static float area(glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 size = max - min;
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+uint32_t AABBTree::allocate_node() {
+	if (free_list == Null) {
+		nodes.emplace_back();
+		return uint32_t(nodes.size()) - 1;
+	}
+	uint32_t index = free_list;
+	free_list = nodes[index].parent;
+	nodes[index] = Node();
+	return index;
+}
+
+void AABBTree::free_node(uint32_t index) {
+	nodes[index].parent = free_list;
+	nodes[index].height = -1;
+	free_list = index;
+}
+
+void AABBTree::fatten(uint32_t leaf, glm::vec3 const &min, glm::vec3 const &max) {
+	assert(nodes[leaf].leaf());
+	glm::vec3 grow = margin * (max - min) + glm::vec3(min_margin);
+	nodes[leaf].min = min - grow;
+	nodes[leaf].max = max + grow;
+}
+
+uint32_t AABBTree::insert(glm::vec3 const &min, glm::vec3 const &max, uint32_t data) {
+	uint32_t leaf = allocate_node();
+	nodes[leaf].data = data;
+	fatten(leaf, min, max);
+	insert_leaf(leaf);
+	leaves += 1;
+	return leaf;
+}
+
+void AABBTree::remove(uint32_t proxy) {
+	assert(proxy < nodes.size() && nodes[proxy].leaf() && nodes[proxy].height == 0);
+	remove_leaf(proxy);
+	free_node(proxy);
+	leaves -= 1;
+}
+
+bool AABBTree::move(uint32_t proxy, glm::vec3 const &min, glm::vec3 const &max) {
+	assert(proxy < nodes.size() && nodes[proxy].leaf() && nodes[proxy].height == 0);
+	Node const &node = nodes[proxy];
+	if (contains(node.min, node.max, min, max)) return false;
+	remove_leaf(proxy);
+	fatten(proxy, min, max);
+	insert_leaf(proxy);
+	return true;
+}
+
+void AABBTree::set_leaf(uint32_t proxy, glm::vec3 const &min, glm::vec3 const &max) {
+	assert(proxy < nodes.size() && nodes[proxy].leaf() && nodes[proxy].height == 0);
+	fatten(proxy, min, max);
+}
+
+void AABBTree::insert_leaf(uint32_t leaf) {
+	if (root == Null) {
+		root = leaf;
+		nodes[root].parent = Null;
+		return;
+	}
+
+	//walk down to the sibling that makes the cheapest tree:
+	// (cost of a choice = area of the new parent + growth of every ancestor above it)
+	glm::vec3 leaf_min = nodes[leaf].min, leaf_max = nodes[leaf].max;
+	uint32_t index = root;
+	while (!nodes[index].leaf()) {
+		Node const &node = nodes[index];
+		float combined = area(glm::min(node.min, leaf_min), glm::max(node.max, leaf_max));
+		float here = 2.0f * combined; //(cost of making a new parent for leaf and this node)
+		float inheritance = 2.0f * (combined - area(node.min, node.max)); //(growth of this node if we descend)
+
+		float child_cost[2];
+		for (uint32_t c = 0; c < 2; ++c) {
+			Node const &child = nodes[node.children[c]];
+			child_cost[c] = area(glm::min(child.min, leaf_min), glm::max(child.max, leaf_max)) + inheritance;
+			if (!child.leaf()) child_cost[c] -= area(child.min, child.max);
+		}
+		if (here < child_cost[0] && here < child_cost[1]) break;
+		index = node.children[child_cost[0] < child_cost[1] ? 0 : 1];
+	}
+	uint32_t sibling = index;
+
+	//new parent for sibling and leaf:
+	uint32_t old_parent = nodes[sibling].parent;
+	uint32_t new_parent = allocate_node();
+	nodes[new_parent].parent = old_parent;
+	nodes[new_parent].min = glm::min(nodes[sibling].min, leaf_min);
+	nodes[new_parent].max = glm::max(nodes[sibling].max, leaf_max);
+	nodes[new_parent].height = nodes[sibling].height + 1;
+	nodes[new_parent].children[0] = sibling;
+	nodes[new_parent].children[1] = leaf;
+	if (old_parent != Null) {
+		Node &parent = nodes[old_parent];
+		parent.children[parent.children[0] == sibling ? 0 : 1] = new_parent;
+	} else {
+		root = new_parent;
+	}
+	nodes[sibling].parent = new_parent;
+	nodes[leaf].parent = new_parent;
+
+	//grow and rebalance ancestors:
+	for (index = new_parent; index != Null; index = nodes[index].parent) {
+		index = balance(index);
+		Node &node = nodes[index];
+		Node const &a = nodes[node.children[0]], &b = nodes[node.children[1]];
+		node.height = 1 + std::max(a.height, b.height);
+		node.min = glm::min(a.min, b.min);
+		node.max = glm::max(a.max, b.max);
+	}
+}
+
+void AABBTree::remove_leaf(uint32_t leaf) {
+	if (leaf == root) {
+		root = Null;
+		return;
+	}
+
+	//replace leaf's parent with leaf's sibling:
+	uint32_t parent = nodes[leaf].parent;
+	uint32_t grandparent = nodes[parent].parent;
+	uint32_t sibling = nodes[parent].children[nodes[parent].children[0] == leaf ? 1 : 0];
+	free_node(parent);
+	nodes[sibling].parent = grandparent;
+	if (grandparent == Null) {
+		root = sibling;
+		return;
+	}
+	Node &node = nodes[grandparent];
+	node.children[node.children[0] == parent ? 0 : 1] = sibling;
+
+	//shrink and rebalance ancestors:
+	for (uint32_t index = grandparent; index != Null; index = nodes[index].parent) {
+		index = balance(index);
+		Node &node = nodes[index];
+		Node const &a = nodes[node.children[0]], &b = nodes[node.children[1]];
+		node.height = 1 + std::max(a.height, b.height);
+		node.min = glm::min(a.min, b.min);
+		node.max = glm::max(a.max, b.max);
+	}
+}
+
+uint32_t AABBTree::balance(uint32_t ia) {
+	Node &a = nodes[ia];
+	if (a.leaf() || a.height < 2) return ia;
+
+	uint32_t ib = a.children[0], ic = a.children[1];
+	Node &b = nodes[ib], &c = nodes[ic];
+	int32_t imbalance = c.height - b.height;
+
+	//rotate the taller child ('up', with children f and g) into a's place:
+	// a keeps its other child and takes the shorter of up's children; up keeps the taller one
+	auto rotate = [&](uint32_t iup, uint32_t up_slot) {
+		Node &up = nodes[iup];
+		Node &other = nodes[a.children[1 - up_slot]];
+		uint32_t iff = up.children[0], ig = up.children[1];
+		Node &f = nodes[iff], &g = nodes[ig];
+
+		up.children[0] = ia;
+		up.parent = a.parent;
+		a.parent = iup;
+		if (up.parent != Null) {
+			Node &parent = nodes[up.parent];
+			parent.children[parent.children[0] == ia ? 0 : 1] = iup;
+		} else {
+			root = iup;
+		}
+
+		uint32_t keep = (f.height > g.height ? iff : ig);
+		uint32_t give = (f.height > g.height ? ig : iff);
+		up.children[1] = keep;
+		a.children[up_slot] = give;
+		nodes[give].parent = ia;
+		a.min = glm::min(other.min, nodes[give].min);
+		a.max = glm::max(other.max, nodes[give].max);
+		a.height = 1 + std::max(other.height, nodes[give].height);
+		up.min = glm::min(a.min, nodes[keep].min);
+		up.max = glm::max(a.max, nodes[keep].max);
+		up.height = 1 + std::max(a.height, nodes[keep].height);
+		return iup;
+	};
+
+	if (imbalance > 1) return rotate(ic, 1);
+	if (imbalance < -1) return rotate(ib, 0);
+	return ia;
+}
+
+//recompute internal boxes below 'index' (children first), returning their total area:
+static float refit_node(std::vector< AABBTree::Node > &nodes, uint32_t index) {
+	AABBTree::Node &node = nodes[index];
+	if (node.leaf()) return 0.0f;
+	float below = refit_node(nodes, node.children[0]) + refit_node(nodes, node.children[1]);
+	AABBTree::Node const &a = nodes[node.children[0]], &b = nodes[node.children[1]];
+	node.min = glm::min(a.min, b.min);
+	node.max = glm::max(a.max, b.max);
+	return below + area(node.min, node.max);
+}
+
+float AABBTree::refit() {
+	if (root == Null) return 0.0f;
+	return refit_node(nodes, root);
+}
+
+uint32_t AABBTree::insert_unlinked(glm::vec3 const &min, glm::vec3 const &max, uint32_t data) {
+	uint32_t leaf = allocate_node();
+	nodes[leaf].data = data;
+	fatten(leaf, min, max);
+	leaves += 1;
+	return leaf;
+}
+
+void AABBTree::rebuild() {
+	//keep the leaves, free everything else:
+	std::vector< uint32_t > leaf_list;
+	leaf_list.reserve(leaves);
+	for (uint32_t i = 0; i < nodes.size(); ++i) {
+		if (nodes[i].height == 0) leaf_list.emplace_back(i);
+		else if (nodes[i].height > 0) free_node(i);
+	}
+	assert(leaf_list.size() == leaves);
+
+	if (leaf_list.empty()) {
+		root = Null;
+		return;
+	}
+	root = build(leaf_list.data(), leaf_list.data() + leaf_list.size());
+	nodes[root].parent = Null;
+}
+
+uint32_t AABBTree::build(uint32_t *begin, uint32_t *end) {
+	assert(begin < end);
+	if (end - begin == 1) return *begin;
+
+	//split at the median center along the axis the centers are most spread out on:
+	glm::vec3 lo = glm::vec3(std::numeric_limits< float >::infinity());
+	glm::vec3 hi = -lo;
+	for (uint32_t *i = begin; i != end; ++i) {
+		glm::vec3 center = nodes[*i].min + nodes[*i].max;
+		lo = glm::min(lo, center);
+		hi = glm::max(hi, center);
+	}
+	glm::vec3 spread = hi - lo;
+	uint32_t axis = (spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2));
+	uint32_t *mid = begin + (end - begin) / 2;
+	std::nth_element(begin, mid, end, [&](uint32_t a, uint32_t b) {
+		return nodes[a].min[axis] + nodes[a].max[axis] < nodes[b].min[axis] + nodes[b].max[axis];
+	});
+
+	uint32_t left = build(begin, mid);
+	uint32_t right = build(mid, end);
+	uint32_t index = allocate_node();
+	Node &node = nodes[index];
+	node.children[0] = left;
+	node.children[1] = right;
+	node.min = glm::min(nodes[left].min, nodes[right].min);
+	node.max = glm::max(nodes[left].max, nodes[right].max);
+	node.height = 1 + std::max(nodes[left].height, nodes[right].height);
+	nodes[left].parent = index;
+	nodes[right].parent = index;
+	return index;
+}
+
+float AABBTree::cost() const {
+	float total = 0.0f;
+	for (Node const &node : nodes) {
+		if (node.height > 0) total += area(node.min, node.max);
+	}
+	return total;
+}
+
+void AABBTree::validate() const {
+	if (root == Null) {
+		assert(leaves == 0);
+		return;
+	}
+	assert(nodes[root].parent == Null);
+	size_t found = 0;
+	std::vector< uint32_t > todo(1, root);
+	while (!todo.empty()) {
+		uint32_t index = todo.back();
+		todo.pop_back();
+		Node const &node = nodes[index];
+		if (node.leaf()) {
+			assert(node.height == 0);
+			found += 1;
+			continue;
+		}
+		Node const &a = nodes[node.children[0]], &b = nodes[node.children[1]];
+		assert(a.parent == index && b.parent == index);
+		assert(node.height == 1 + std::max(a.height, b.height));
+		assert(contains(node.min, node.max, a.min, a.max) && contains(node.min, node.max, b.min, b.max));
+		todo.emplace_back(node.children[0]);
+		todo.emplace_back(node.children[1]);
+	}
+	assert(found == leaves);
+	(void)found;
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+/*
+ * An "AABBTree" is a bounding volume hierarchy of axis-aligned boxes that can
+ *  be changed one box at a time -- e.g., for "what is in the view?",
+ *  "what is under the cursor?", or "what is near this point?" over objects
+ *  that come, go, and move.
+ *
+ * Leaves ("proxies") store a "fat" box: the box they were given, grown by a
+ *  margin. A moving box only touches the tree when it leaves its fat box, so
+ *  small motions (bobbing, idling) cost nothing. Leaves are inserted next to
+ *  the sibling that grows the tree's total surface area least, and ancestors
+ *  are rebalanced by rotations on the way back up (as in Box2D's
+ *  b2DynamicTree), so the tree stays shallow however boxes are added.
+ *
+ * When many boxes move at once, it can be cheaper to set the leaves and then
+ *  refit() every ancestor in one pass (the tree's shape gets worse as boxes
+ *  drift) or to rebuild() it from scratch; scene-bench compares the three.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+struct AABBTree {
+	enum : uint32_t { Null = -1U };
+
+	//fat boxes are grown by this fraction of their size (plus min_margin) on each side:
+	float margin = 0.1f;
+	float min_margin = 0.01f;
+
+	//add a box, with 'data' to identify it; returns its proxy id:
+	uint32_t insert(glm::vec3 const &min, glm::vec3 const &max, uint32_t data);
+	//remove a proxy (its id may be reused by a later insert):
+	void remove(uint32_t proxy);
+	//update a proxy's box: if it still fits in the fat box nothing happens (returns false);
+	// otherwise the proxy is reinserted with a new fat box (returns true)
+	bool move(uint32_t proxy, glm::vec3 const &min, glm::vec3 const &max);
+
+	//for moving many boxes at once: set a proxy's (fat) box without updating its ancestors...
+	void set_leaf(uint32_t proxy, glm::vec3 const &min, glm::vec3 const &max);
+	//...then recompute every internal box from its children (returns the new cost()):
+	float refit();
+	//rebuild the tree from its current leaves, splitting at the median along the widest axis:
+	// (proxy ids and data are kept)
+	void rebuild();
+	//for adding many boxes at once: add a proxy without linking it into the tree; call rebuild() before querying:
+	uint32_t insert_unlinked(glm::vec3 const &min, glm::vec3 const &max, uint32_t data);
+
+	uint32_t data(uint32_t proxy) const { return nodes[proxy].data; }
+	glm::vec3 const &fat_min(uint32_t proxy) const { return nodes[proxy].min; }
+	glm::vec3 const &fat_max(uint32_t proxy) const { return nodes[proxy].max; }
+
+	size_t size() const { return leaves; }
+	uint32_t height() const { return (root == Null ? 0 : uint32_t(nodes[root].height)); }
+	//total surface area of internal boxes (lower is better for queries):
+	float cost() const;
+
+	//Queries call 'fn(data)' for every proxy whose fat box passes the test
+	// (fat boxes are loose, so callers check their own exact bounds):
+
+	//..boxes overlapping [min, max]:
+	template< typename F >
+	void query_box(glm::vec3 const &min, glm::vec3 const &max, F const &fn) const;
+
+	//..boxes hit by the ray origin + t * direction, for t in [0, max_t]:
+	// fn returns a (possibly shorter) max_t, so searches for the nearest hit can prune as they go
+	template< typename F >
+	void query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, F const &fn) const;
+
+	//..boxes not entirely behind any of the planes (dot(plane, vec4(p,1)) >= 0 is in front):
+	// fn(data, inside) is told whether the fat box is entirely in front of every plane
+	template< typename F >
+	void query_planes(glm::vec4 const *planes, uint32_t plane_count, F const &fn) const;
+
+	//check parent links, heights, and that every box contains its children's (for debugging; asserts):
+	void validate() const;
+
+	//--- internals ---
+	struct Node {
+		glm::vec3 min, max;
+		uint32_t parent = Null; //(next free node, for free nodes)
+		uint32_t children[2] = {Null, Null}; //(leaves have none)
+		uint32_t data = 0;
+		int32_t height = 0; //leaves are 0; free nodes are -1
+		bool leaf() const { return children[0] == Null; }
+	};
+	std::vector< Node > nodes;
+	uint32_t root = Null;
+	uint32_t free_list = Null;
+	size_t leaves = 0;
+
+	uint32_t allocate_node();
+	void free_node(uint32_t index);
+	void insert_leaf(uint32_t leaf);
+	void remove_leaf(uint32_t leaf);
+	uint32_t balance(uint32_t index); //rotate a grandchild up if index's children differ in height by more than one
+	void fatten(uint32_t leaf, glm::vec3 const &min, glm::vec3 const &max);
+	uint32_t build(uint32_t *begin, uint32_t *end); //(for rebuild)
+	static bool overlaps(glm::vec3 const &min0, glm::vec3 const &max0, glm::vec3 const &min1, glm::vec3 const &max1) {
+		return min0.x <= max1.x && min1.x <= max0.x && min0.y <= max1.y && min1.y <= max0.y && min0.z <= max1.z && min1.z <= max0.z;
+	}
+	static bool contains(glm::vec3 const &outer_min, glm::vec3 const &outer_max, glm::vec3 const &min, glm::vec3 const &max) {
+		return outer_min.x <= min.x && outer_min.y <= min.y && outer_min.z <= min.z && max.x <= outer_max.x && max.y <= outer_max.y && max.z <= outer_max.z;
+	}
+
+	//queries walk the tree with a fixed-size stack (the tree is kept balanced, so it never gets near this deep):
+	// (so queries allocate nothing and can run on several threads at once)
+	enum : uint32_t { MaxStack = 128 };
+};
+
+//------------------------------------------
+
+template< typename F >
+void AABBTree::query_box(glm::vec3 const &min, glm::vec3 const &max, F const &fn) const {
+	if (root == Null) return;
+	assert(height() + 2 < MaxStack);
+	uint32_t stack[MaxStack];
+	uint32_t top = 0;
+	stack[top++] = root;
+	while (top > 0) {
+		Node const &node = nodes[stack[--top]];
+		if (!overlaps(node.min, node.max, min, max)) continue;
+		if (node.leaf()) {
+			fn(node.data);
+		} else {
+			stack[top++] = node.children[0];
+			stack[top++] = node.children[1];
+		}
+	}
+}
+
+template< typename F >
+void AABBTree::query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, F const &fn) const {
+	if (root == Null) return;
+	glm::vec3 inv_direction = 1.0f / direction; //(infinite for axis-aligned rays, which the slab test handles)
+	assert(height() + 2 < MaxStack);
+	uint32_t stack[MaxStack];
+	uint32_t top = 0;
+	stack[top++] = root;
+	while (top > 0) {
+		Node const &node = nodes[stack[--top]];
+		//slab test:
+		glm::vec3 t0 = (node.min - origin) * inv_direction;
+		glm::vec3 t1 = (node.max - origin) * inv_direction;
+		glm::vec3 t_near = glm::min(t0, t1), t_far = glm::max(t0, t1);
+		float enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+		float exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, max_t));
+		if (!(enter <= exit)) continue; //(also rejects NaN from 0 * infinity)
+		if (node.leaf()) {
+			max_t = fn(node.data);
+		} else {
+			stack[top++] = node.children[0];
+			stack[top++] = node.children[1];
+		}
+	}
+}
+
+template< typename F >
+void AABBTree::query_planes(glm::vec4 const *planes, uint32_t plane_count, F const &fn) const {
+	if (root == Null) return;
+	//stack entries carry a flag (high bit) for "entirely inside", so those subtrees skip the plane tests:
+	enum : uint32_t { Inside = 0x80000000U };
+	assert(height() + 2 < MaxStack);
+	uint32_t stack[MaxStack];
+	uint32_t top = 0;
+	stack[top++] = root;
+	while (top > 0) {
+		uint32_t entry = stack[--top];
+		Node const &node = nodes[entry & ~Inside];
+		bool inside = (entry & Inside) != 0;
+		if (!inside) {
+			glm::vec3 center = 0.5f * (node.max + node.min);
+			glm::vec3 extent = 0.5f * (node.max - node.min);
+			bool outside = false;
+			inside = true;
+			for (uint32_t p = 0; p < plane_count; ++p) {
+				glm::vec4 const &plane = planes[p];
+				float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+				float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+				if (distance + radius < 0.0f) { outside = true; break; }
+				if (distance - radius < 0.0f) inside = false;
+			}
+			if (outside) continue;
+		}
+		if (node.leaf()) {
+			fn(node.data, inside);
+		} else {
+			stack[top++] = node.children[0] | (inside ? uint32_t(Inside) : 0U);
+			stack[top++] = node.children[1] | (inside ? uint32_t(Inside) : 0U);
+		}
+	}
+}
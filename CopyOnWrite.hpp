@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * A "CopyOnWrite< T >" holds a T that is shared between copies until one of
+ *  them is changed; copying one just copies a pointer (and bumps a count).
+ *
+ * - read with * or ->, which never copy;
+ * - change with write(), which first gives this holder its own T if the
+ *   current one is shared (so other holders never see the change);
+ * - assigning a T replaces the value (in place, if it isn't shared).
+ *
+ * Used, e.g., for Scene::Drawable::pipeline, so copies of a scene (and
+ *  drawables of the same mesh) share one Pipeline instead of each holding its own.
+ *
+ * (Like the rest of Scene, not meant for changing a value on one thread while
+ *  copying its holder on another.)
+ *
+ */
+
+#include <memory>
+
+template< typename T >
+struct CopyOnWrite {
+	//default values are shared by every default-constructed holder (so making one allocates nothing):
+	CopyOnWrite() : value(default_value()) { }
+	CopyOnWrite(T const &value_) : value(std::make_shared< T >(value_)) { }
+
+	CopyOnWrite &operator=(T const &value_) {
+		if (value.use_count() == 1) *value = value_;
+		else value = std::make_shared< T >(value_);
+		return *this;
+	}
+
+	T const &operator*() const { return *value; }
+	T const *operator->() const { return value.get(); }
+
+	//the value, made unshared first if needed (so only this holder sees changes):
+	// (references returned by write() are good until this holder is next copied)
+	T &write() {
+		if (value.use_count() != 1) value = std::make_shared< T >(*value);
+		return *value;
+	}
+
+	//do two holders share the same value?
+	bool shares_with(CopyOnWrite const &other) const { return value == other.value; }
+
+	//--- internals ---
+	std::shared_ptr< T > value; //(never null)
+	static std::shared_ptr< T > const &default_value() {
+		static std::shared_ptr< T > const shared = std::make_shared< T >();
+		return shared;
+	}
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+/*
+ * "Float4" and "Mask4" hold four float lanes and four lane masks, for code
+ *  that does the same math on four things at once (e.g., WalkMesh::walk_batch).
+ *
+ * They are SSE2 registers on x86-64, NEON registers on 64-bit ARM, and plain
+ *  arrays (the scalar fallback) anywhere else. The instructions are written out
+ *  explicitly, so this doesn't depend on the compiler vectorizing anything.
+ *  The wrappers do need to be inlined to pay off, though, so the Jamfile builds
+ *  the files that use them with optimization on.
+ *
+ * Each operation rounds exactly like the same scalar float operation, so code
+ *  written with these gets bit-for-bit the results of the scalar code it
+ *  mirrors, as long as it does the operations in the same order.
+ *  (there is deliberately no min/max: SSE and NEON disagree with std::min and
+ *   each other about NaNs, so write those with a comparison and select())
+ *
+ */
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LANES4_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define LANES4_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(LANES4_SSE2)
+
+struct Mask4 {
+	__m128 v;
+};
+inline Mask4 operator&(Mask4 a, Mask4 b) { return Mask4{ _mm_and_ps(a.v, b.v) }; }
+inline Mask4 operator|(Mask4 a, Mask4 b) { return Mask4{ _mm_or_ps(a.v, b.v) }; }
+inline Mask4 operator~(Mask4 a) { return Mask4{ _mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1))) }; }
+//lane i's mask in bit i:
+inline uint32_t bits(Mask4 a) { return uint32_t(_mm_movemask_ps(a.v)); }
+
+struct Float4 {
+	__m128 v;
+	Float4() = default;
+	explicit Float4(__m128 v_) : v(v_) { }
+	Float4(float f) : v(_mm_set1_ps(f)) { }
+	static Float4 load(float const *from) { return Float4(_mm_loadu_ps(from)); }
+	void store(float *to) const { _mm_storeu_ps(to, v); }
+};
+inline Float4 operator+(Float4 a, Float4 b) { return Float4(_mm_add_ps(a.v, b.v)); }
+inline Float4 operator-(Float4 a, Float4 b) { return Float4(_mm_sub_ps(a.v, b.v)); }
+inline Float4 operator*(Float4 a, Float4 b) { return Float4(_mm_mul_ps(a.v, b.v)); }
+inline Float4 operator/(Float4 a, Float4 b) { return Float4(_mm_div_ps(a.v, b.v)); }
+inline Float4 operator-(Float4 a) { return Float4(_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))); }
+inline Float4 sqrt(Float4 a) { return Float4(_mm_sqrt_ps(a.v)); }
+inline Mask4 operator<(Float4 a, Float4 b) { return Mask4{ _mm_cmplt_ps(a.v, b.v) }; }
+inline Mask4 operator<=(Float4 a, Float4 b) { return Mask4{ _mm_cmple_ps(a.v, b.v) }; }
+inline Mask4 operator>(Float4 a, Float4 b) { return Mask4{ _mm_cmpgt_ps(a.v, b.v) }; }
+inline Mask4 operator>=(Float4 a, Float4 b) { return Mask4{ _mm_cmpge_ps(a.v, b.v) }; }
+inline Mask4 operator==(Float4 a, Float4 b) { return Mask4{ _mm_cmpeq_ps(a.v, b.v) }; }
+inline Mask4 operator!=(Float4 a, Float4 b) { return Mask4{ _mm_cmpneq_ps(a.v, b.v) }; }
+//m ? a : b, lane by lane:
+inline Float4 select(Mask4 m, Float4 a, Float4 b) { return Float4(_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))); }
+
+#elif defined(LANES4_NEON)
+
+struct Mask4 {
+	uint32x4_t v;
+};
+inline Mask4 operator&(Mask4 a, Mask4 b) { return Mask4{ vandq_u32(a.v, b.v) }; }
+inline Mask4 operator|(Mask4 a, Mask4 b) { return Mask4{ vorrq_u32(a.v, b.v) }; }
+inline Mask4 operator~(Mask4 a) { return Mask4{ vmvnq_u32(a.v) }; }
+inline uint32_t bits(Mask4 a) {
+	uint32_t const weights[4] = { 1, 2, 4, 8 };
+	return vaddvq_u32(vandq_u32(a.v, vld1q_u32(weights)));
+}
+
+struct Float4 {
+	float32x4_t v;
+	Float4() = default;
+	explicit Float4(float32x4_t v_) : v(v_) { }
+	Float4(float f) : v(vdupq_n_f32(f)) { }
+	static Float4 load(float const *from) { return Float4(vld1q_f32(from)); }
+	void store(float *to) const { vst1q_f32(to, v); }
+};
+inline Float4 operator+(Float4 a, Float4 b) { return Float4(vaddq_f32(a.v, b.v)); }
+inline Float4 operator-(Float4 a, Float4 b) { return Float4(vsubq_f32(a.v, b.v)); }
+inline Float4 operator*(Float4 a, Float4 b) { return Float4(vmulq_f32(a.v, b.v)); }
+inline Float4 operator/(Float4 a, Float4 b) { return Float4(vdivq_f32(a.v, b.v)); }
+inline Float4 operator-(Float4 a) { return Float4(vnegq_f32(a.v)); }
+inline Float4 sqrt(Float4 a) { return Float4(vsqrtq_f32(a.v)); }
+inline Mask4 operator<(Float4 a, Float4 b) { return Mask4{ vcltq_f32(a.v, b.v) }; }
+inline Mask4 operator<=(Float4 a, Float4 b) { return Mask4{ vcleq_f32(a.v, b.v) }; }
+inline Mask4 operator>(Float4 a, Float4 b) { return Mask4{ vcgtq_f32(a.v, b.v) }; }
+inline Mask4 operator>=(Float4 a, Float4 b) { return Mask4{ vcgeq_f32(a.v, b.v) }; }
+inline Mask4 operator==(Float4 a, Float4 b) { return Mask4{ vceqq_f32(a.v, b.v) }; }
+inline Mask4 operator!=(Float4 a, Float4 b) { return Mask4{ vmvnq_u32(vceqq_f32(a.v, b.v)) }; }
+inline Float4 select(Mask4 m, Float4 a, Float4 b) { return Float4(vbslq_f32(m.v, a.v, b.v)); }
+
+#else //scalar fallback
+
+#include <cmath>
+
+struct Mask4 {
+	bool v[4];
+};
+inline Mask4 operator&(Mask4 a, Mask4 b) { return Mask4{{ a.v[0] && b.v[0], a.v[1] && b.v[1], a.v[2] && b.v[2], a.v[3] && b.v[3] }}; }
+inline Mask4 operator|(Mask4 a, Mask4 b) { return Mask4{{ a.v[0] || b.v[0], a.v[1] || b.v[1], a.v[2] || b.v[2], a.v[3] || b.v[3] }}; }
+inline Mask4 operator~(Mask4 a) { return Mask4{{ !a.v[0], !a.v[1], !a.v[2], !a.v[3] }}; }
+inline uint32_t bits(Mask4 a) { return uint32_t(a.v[0]) | (uint32_t(a.v[1]) << 1) | (uint32_t(a.v[2]) << 2) | (uint32_t(a.v[3]) << 3); }
+
+struct Float4 {
+	float v[4];
+	Float4() = default;
+	Float4(float f) : v{ f, f, f, f } { }
+	static Float4 load(float const *from) { Float4 ret; for (uint32_t i = 0; i < 4; ++i) ret.v[i] = from[i]; return ret; }
+	void store(float *to) const { for (uint32_t i = 0; i < 4; ++i) to[i] = v[i]; }
+};
+#define LANES4_BINARY(OP) \
+	inline Float4 operator OP(Float4 a, Float4 b) { Float4 ret; for (uint32_t i = 0; i < 4; ++i) ret.v[i] = a.v[i] OP b.v[i]; return ret; }
+LANES4_BINARY(+)
+LANES4_BINARY(-)
+LANES4_BINARY(*)
+LANES4_BINARY(/)
+#undef LANES4_BINARY
+#define LANES4_COMPARE(OP) \
+	inline Mask4 operator OP(Float4 a, Float4 b) { Mask4 ret; for (uint32_t i = 0; i < 4; ++i) ret.v[i] = (a.v[i] OP b.v[i]); return ret; }
+LANES4_COMPARE(<)
+LANES4_COMPARE(<=)
+LANES4_COMPARE(>)
+LANES4_COMPARE(>=)
+LANES4_COMPARE(==)
+LANES4_COMPARE(!=)
+#undef LANES4_COMPARE
+inline Float4 operator-(Float4 a) { Float4 ret; for (uint32_t i = 0; i < 4; ++i) ret.v[i] = -a.v[i]; return ret; }
+inline Float4 sqrt(Float4 a) { Float4 ret; for (uint32_t i = 0; i < 4; ++i) ret.v[i] = std::sqrt(a.v[i]); return ret; }
+inline Float4 select(Mask4 m, Float4 a, Float4 b) { Float4 ret; for (uint32_t i = 0; i < 4; ++i) ret.v[i] = (m.v[i] ? a.v[i] : b.v[i]); return ret; }
+
+#endif
@@ -11,9 +11,8 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	//----- build the pipeline template -----
 	lit_color_texture_program_pipeline.program = ret->program;
 
-	lit_color_texture_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+	//(matrices come from Scene's Frame and Object uniform blocks)
+	lit_color_texture_program_pipeline.uniform_blocks = true;
 
 	/* This will be used later if/when we build a light loop into the Scene:
 	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
@@ -43,14 +42,28 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	return ret;
 });
 
-LitColorTextureProgram::LitColorTextureProgram() {
+Load< LitColorTextureProgram > lit_color_texture_program_instanced(LoadTagEarly, []() -> LitColorTextureProgram const * {
+	LitColorTextureProgram *ret = new LitColorTextureProgram(LitColorTextureProgram::Instanced);
+
+	//----- fill in the instanced part of the pipeline template -----
+	lit_color_texture_program_pipeline.instanced.program = ret->program;
+	lit_color_texture_program_pipeline.instanced.buffer = ret->instance_buffer;
+
+	return ret;
+});
+
+LitColorTextureProgram::LitColorTextureProgram(Variant variant) {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		std::string("#version 330\n")
+		+ Scene::FrameBlockGLSL
+		//..matrices are per-instance attributes in the instanced variant, and in the Object block otherwise:
+		+ (variant == Instanced ?
+			"in mat4x3 OBJECT_TO_WORLD;\n"
+			"in mat3 NORMAL_TO_WORLD;\n"
+			: Scene::ObjectBlockGLSL)
+		+
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -60,9 +73,10 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
 		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	vec4 world = vec4(OBJECT_TO_WORLD * Position, Position.w);\n"
+		"	gl_Position = WORLD_TO_CLIP * world;\n"
+		"	position = WORLD_TO_LIGHT * world;\n"
+		"	normal = NORMAL_WORLD_TO_LIGHT * (NORMAL_TO_WORLD * Normal);\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
@@ -115,11 +129,10 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
-	//look up the locations of uniforms:
-	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
-	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
-	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	//point the Frame and Object uniform blocks at the buffers Scene::draw fills:
+	Scene::bind_uniform_blocks(program);
 
+	//look up the locations of uniforms:
 	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
 	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
 	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
@@ -135,9 +148,17 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
 
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
+
+	if (variant == Instanced) {
+		glGenBuffers(1, &instance_buffer);
+	}
 }
 
 LitColorTextureProgram::~LitColorTextureProgram() {
+	if (instance_buffer != 0) {
+		glDeleteBuffers(1, &instance_buffer);
+		instance_buffer = 0;
+	}
 	glDeleteProgram(program);
 	program = 0;
 }
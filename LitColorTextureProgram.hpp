@@ -6,7 +6,11 @@
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
 struct LitColorTextureProgram {
-	LitColorTextureProgram();
+	//reads camera and light-space matrices from Scene's Frame uniform block, and object matrices from its Object block;
+	//the 'Instanced' variant reads object matrices from per-instance attributes instead
+	// (OBJECT_TO_WORLD, NORMAL_TO_WORLD; see Scene::Instance), for Scene::draw's instanced draws:
+	enum Variant { Plain, Instanced };
+	LitColorTextureProgram(Variant variant = Plain);
 	~LitColorTextureProgram();
 
 	GLuint program = 0;
@@ -18,9 +22,7 @@ struct LitColorTextureProgram {
 	GLuint TexCoord_vec2 = -1U;
 
 	//Uniform (per-invocation variable) locations:
-	GLuint OBJECT_TO_CLIP_mat4 = -1U;
-	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
-	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+	// (transformation matrices are in the uniform blocks)
 
 	//lighting:
 	GLuint LIGHT_TYPE_int = -1U;
@@ -31,10 +33,17 @@ struct LitColorTextureProgram {
 	
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
+
+	//Per-instance data buffer (instanced variant only; Scene::draw fills it):
+	GLuint instance_buffer = 0;
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
+extern Load< LitColorTextureProgram > lit_color_texture_program_instanced;
 
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+// NOTE: 'instanced' is filled in except for instanced.vao -- set it (from MeshBuffer::make_vao_for_program with
+//  lit_color_texture_program_instanced's program and instance_buffer) to let Scene::draw instance copies of a mesh.
+// NOTE: set lighting uniforms on both lit_color_texture_program and lit_color_texture_program_instanced.
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+ * A "MappedFile" maps a whole file into (read-only) memory.
+ *
+ * Nothing is copied when the file is opened; pages are read in by the OS the
+ *  first time they are touched, and can be shared with other processes mapping
+ *  the same file. Loaders can point straight into 'data' (see view_chunk in
+ *  read_write_chunk.hpp) as long as the MappedFile outlives those pointers.
+ *
+ */
+
+#include <string>
+#include <cstddef>
+
+struct MappedFile {
+	//map 'filename' (throws std::runtime_error if it can't be opened or mapped):
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	std::string filename;
+	char const *data = nullptr; //nullptr for empty files
+	size_t size = 0;
+
+	//--- internals ---
+#if defined(_WIN32)
+	void *file = nullptr; //HANDLE from CreateFile
+	void *mapping = nullptr; //HANDLE from CreateFileMapping
+#endif
+};
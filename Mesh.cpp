@@ -1,5 +1,6 @@
 #include "Mesh.hpp"
 #include "read_write_chunk.hpp"
+#include "Scene.hpp"
 
 #include <glm/glm.hpp>
 
@@ -106,7 +107,7 @@ const Mesh &MeshBuffer::lookup(std::string const &name) const {
 	return f->second;
 }
 
-GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
+GLuint MeshBuffer::make_vao_for_program(GLuint program, GLuint instance_buffer) const {
 	//create a new vertex array object:
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
@@ -127,6 +128,23 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	bind_attribute("Normal", Normal);
 	bind_attribute("Color", Color);
 	bind_attribute("TexCoord", TexCoord);
+
+	//matrix attributes take one location per column, and advance once per instance:
+	auto bind_instance_attribute = [&](char const *name, GLint rows, GLint columns, size_t offset) {
+		GLint location = glGetAttribLocation(program, name);
+		if (location == -1) return; //can't bind missing attribs
+		for (GLint c = 0; c < columns; ++c) {
+			glVertexAttribPointer(location + c, rows, GL_FLOAT, GL_FALSE, sizeof(Scene::Instance), (GLbyte *)0 + offset + c * rows * sizeof(float));
+			glEnableVertexAttribArray(location + c);
+			glVertexAttribDivisor(location + c, 1);
+		}
+		bound.insert(location);
+	};
+	if (instance_buffer != 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+		bind_instance_attribute("OBJECT_TO_WORLD", 3, 4, offsetof(Scene::Instance, OBJECT_TO_WORLD));
+		bind_instance_attribute("NORMAL_TO_WORLD", 3, 3, offsetof(Scene::Instance, NORMAL_TO_WORLD));
+	}
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 
@@ -40,7 +40,9 @@ struct MeshBuffer {
 	
 	//build a vertex array object that links this vbo to attributes to a program:
 	// note: will throw if program defines attributes not contained in this buffer
-	GLuint make_vao_for_program(GLuint program) const;
+	// if 'instance_buffer' is given, the program's per-instance attributes (OBJECT_TO_WORLD, NORMAL_TO_WORLD)
+	//  are also linked to it, laid out as Scene::Instance (for Drawable::Pipeline::Instanced::vao)
+	GLuint make_vao_for_program(GLuint program, GLuint instance_buffer = 0) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
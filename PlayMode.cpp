@@ -16,27 +16,42 @@
 #include <glm/gtx/quaternion.hpp>
 
 #include <random>
+#include <unordered_map>
 
 GLuint phonebank_meshes_for_lit_color_texture_program = 0;
+GLuint phonebank_meshes_for_lit_color_texture_program_instanced = 0;
 Load< MeshBuffer > phonebank_meshes(LoadTagDefault, []() -> MeshBuffer const * {
 	MeshBuffer const *ret = new MeshBuffer(data_path("ring.pnct"));
 	phonebank_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+	phonebank_meshes_for_lit_color_texture_program_instanced = ret->make_vao_for_program(lit_color_texture_program_instanced->program, lit_color_texture_program_instanced->instance_buffer);
 	return ret;
 });
 
 Load< Scene > phonebank_scene(LoadTagDefault, []() -> Scene const * {
+	//drawables of the same mesh share one pipeline:
+	std::unordered_map< std::string, CopyOnWrite< Scene::Drawable::Pipeline > > mesh_pipelines;
 	return new Scene(data_path("ring.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 		Mesh const &mesh = phonebank_meshes->lookup(mesh_name);
 
 		scene.drawables.emplace_back(transform);
 		Scene::Drawable &drawable = scene.drawables.back();
 
-		drawable.pipeline = lit_color_texture_program_pipeline;
+		auto f = mesh_pipelines.find(mesh_name);
+		if (f == mesh_pipelines.end()) {
+			Scene::Drawable::Pipeline pipeline = lit_color_texture_program_pipeline;
 
-		drawable.pipeline.vao = phonebank_meshes_for_lit_color_texture_program;
-		drawable.pipeline.type = mesh.type;
-		drawable.pipeline.start = mesh.start;
-		drawable.pipeline.count = mesh.count;
+			pipeline.vao = phonebank_meshes_for_lit_color_texture_program;
+			pipeline.instanced.vao = phonebank_meshes_for_lit_color_texture_program_instanced;
+			pipeline.type = mesh.type;
+			pipeline.start = mesh.start;
+			pipeline.count = mesh.count;
+
+			f = mesh_pipelines.emplace(mesh_name, pipeline).first;
+		}
+		drawable.pipeline = f->second;
+
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
 
 	});
 });
@@ -68,7 +83,9 @@ Load< Sound::Sample > phone4sample(LoadTagDefault, []() -> Sound::Sample const *
 	return new Sound::Sample(data_path("sounds/5.wav"));
 });
 
-PlayMode::PlayMode() : scene(*phonebank_scene) {
+PlayMode::PlayMode(WorkerPool *workers) : scene(*phonebank_scene) {
+	scene.workers = workers;
+
 	//create a player transform:
 	scene.transforms.emplace_back();
 	player.transform = &scene.transforms.back();
@@ -87,17 +104,17 @@ PlayMode::PlayMode() : scene(*phonebank_scene) {
 	player.camera = &scene.cameras.back();
 	player.camera->fovy = glm::radians(60.0f);
 	player.camera->near = 0.01f;
-	player.camera->transform->parent = player.transform;
+	player.camera->transform->set_parent(player.transform);
 
 	//player's eyes are 1.8 units above the ground:
-	player.camera->transform->position = glm::vec3(0.0f, 0.0f, 1.8f);
+	player.camera->transform->set_position(glm::vec3(0.0f, 0.0f, 1.8f));
 
 	//rotate camera facing direction (-z) to player facing direction (+y):
-	player.camera->transform->rotation = glm::angleAxis(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	player.camera->transform->set_rotation(glm::angleAxis(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
 
 	//start player walking at nearest walk point:
-	player.at = walkmesh->nearest_walk_point(player.transform->position);
-	player.transform->position = walkmesh->to_world_point(player.at);
+	player.at = walkmesh->nearest_walk_point(player.transform->get_position());
+	player.transform->set_position(walkmesh->to_world_point(player.at));
 
 	// play the phone message
 	auto play_sound = [](Load<Sound::Sample> smpl, glm::vec3 pos)
@@ -130,35 +147,35 @@ PlayMode::PlayMode() : scene(*phonebank_scene) {
 		if (line == "0")
 		{
 			time_until_kill = 62.0f;
-			play_sound(phone0sample, phone0->position);
+			play_sound(phone0sample, phone0->get_position());
 			myfile.clear();
 			myfile << "1";
 		}
 		else if (line == "01")
 		{
 			time_until_kill = 46.0f;
-			play_sound(phone1sample, phone0->position);
+			play_sound(phone1sample, phone0->get_position());
 			myfile.clear();
 			myfile << "2";
 		}	
 		else if (line == "012")
 		{
 			time_until_kill = 30.0f;
-			play_sound(phone2sample, phone0->position);
+			play_sound(phone2sample, phone0->get_position());
 			myfile.clear();
 			myfile << "3";
 		}
 		else if (line == "0123")
 		{
 			time_until_kill = 7.0f;
-			play_sound(phone3sample, phone0->position);
+			play_sound(phone3sample, phone0->get_position());
 			myfile.clear();
 			myfile << "4";
 		}
 		else
 		{
 			time_until_kill = 2.0f;
-			play_sound(phone4sample, phone0->position);
+			play_sound(phone4sample, phone0->get_position());
 			myfile.clear();
 		}
 	}
@@ -431,14 +448,14 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 				-evt.motion.yrel / float(window_size.y)
 			);
 			glm::vec3 up = walkmesh->to_world_smooth_normal(player.at);
-			player.transform->rotation = glm::angleAxis(-motion.x * player.camera->fovy, up) * player.transform->rotation;
+			player.transform->set_rotation(glm::angleAxis(-motion.x * player.camera->fovy, up) * player.transform->get_rotation());
 
-			float pitch = glm::pitch(player.camera->transform->rotation);
+			float pitch = glm::pitch(player.camera->transform->get_rotation());
 			pitch += motion.y * player.camera->fovy;
 			//camera looks down -z (basically at the player's feet) when pitch is at zero.
 			pitch = std::min(pitch, 0.95f * 3.1415926f);
 			pitch = std::max(pitch, 0.05f * 3.1415926f);
-			player.camera->transform->rotation = glm::angleAxis(pitch, glm::vec3(1.0f, 0.0f, 0.0f));
+			player.camera->transform->set_rotation(glm::angleAxis(pitch, glm::vec3(1.0f, 0.0f, 0.0f)));
 
 			return true;
 		}
@@ -464,67 +481,24 @@ void PlayMode::update(float elapsed) {
 		//get move in world coordinate system:
 		glm::vec3 remain = player.transform->make_local_to_world() * glm::vec4(move.x, move.y, 0.0f, 0.0f);
 
-		//using a for() instead of a while() here so that if walkpoint gets stuck in
-		// some awkward case, code will not infinite loop:
-		for (uint32_t iter = 0; iter < 10; ++iter) {
-			if (remain == glm::vec3(0.0f)) break;
-			WalkPoint end;
-			float time;
-			walkmesh->walk_in_triangle(player.at, remain, &end, &time);
-			player.at = end;
-			if (time == 1.0f) {
-				//finished within triangle:
-				remain = glm::vec3(0.0f);
-				break;
-			}
-			//some step remains:
-			remain *= (1.0f - time);
-			//try to step over edge:
-			glm::quat rotation;
-			if (walkmesh->cross_edge(player.at, &end, &rotation)) {
-				//stepped to a new triangle:
-				player.at = end;
-				//std::cout << "player at " << player.at.x << ", " << player.at.y << ", " << player.at.z << std::endl;
-				//rotate step to follow surface:
-				remain = rotation * remain;
-			} else {
-				//ran into a wall, bounce / slide along it:
-				glm::vec3 const &a = walkmesh->vertices[player.at.indices.x];
-				glm::vec3 const &b = walkmesh->vertices[player.at.indices.y];
-				glm::vec3 const &c = walkmesh->vertices[player.at.indices.z];
-				glm::vec3 along = glm::normalize(b-a);
-				glm::vec3 normal = glm::normalize(glm::cross(b-a, c-a));
-				glm::vec3 in = glm::cross(normal, along);
-
-				//check how much 'remain' is pointing out of the triangle:
-				float d = glm::dot(remain, in);
-				if (d < 0.0f) {
-					//bounce off of the wall:
-					remain += (-1.25f * d) * in;
-				} else {
-					//if it's just pointing along the edge, bend slightly away from wall:
-					remain += 0.01f * d * in;
-				}
-			}
-		}
-
-		if (remain != glm::vec3(0.0f)) {
+		//walk along the mesh (crossing edges and sliding along walls):
+		if (!walkmesh->walk(&player.at, remain)) {
 			std::cout << "NOTE: code used full iteration budget for walking." << std::endl;
 		}
 
-		//  std::cout << "Before update position " << player.transform->position.x << ", " << player.transform->position.y << ", " << player.transform->position.z << std::endl;
+		//  std::cout << "Before update position " << player.transform->get_position().x << ", " << player.transform->get_position().y << ", " << player.transform->get_position().z << std::endl;
 		//update player's position to respect walking:
-		player.transform->position = walkmesh->to_world_point(player.at);
-		// std::cout << "After update position " << player.transform->position.x << ", " << player.transform->position.y << ", " << player.transform->position.z << std::endl;
+		player.transform->set_position(walkmesh->to_world_point(player.at));
+		// std::cout << "After update position " << player.transform->get_position().x << ", " << player.transform->get_position().y << ", " << player.transform->get_position().z << std::endl;
 
 
 		{ //update player's rotation to respect local (smooth) up-vector:
 			
 			glm::quat adjust = glm::rotation(
-				player.transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f), //current up vector
+				player.transform->get_rotation() * glm::vec3(0.0f, 0.0f, 1.0f), //current up vector
 				walkmesh->to_world_smooth_normal(player.at) //smoothed up vector at walk location
 			);
-			player.transform->rotation = glm::normalize(adjust * player.transform->rotation);
+			player.transform->set_rotation(glm::normalize(adjust * player.transform->get_rotation()));
 		}
 
 		/*
@@ -533,7 +507,7 @@ void PlayMode::update(float elapsed) {
 		//glm::vec3 up = frame[1];
 		glm::vec3 forward = -frame[2];
 
-		camera->transform->position += move.x * right + move.y * forward;
+		camera->transform->set_position(camera->transform->get_position() + move.x * right + move.y * forward);
 		*/
 	}
 
@@ -547,7 +521,7 @@ void PlayMode::update(float elapsed) {
 	float speed = 0.2f;
 	float amp = 2.0f;
 	t += elapsed;
-	phone0->position = glm::vec3(0, 0, amp * cos(M_2_PI * 2 * speed * t));
+	phone0->set_position(glm::vec3(0, 0, amp * cos(M_2_PI * 2 * speed * t)));
 
 	// quit the application after time_to_kill seconds
 	if (t > time_until_kill && time_until_kill > 0)
@@ -561,12 +535,14 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	player.camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
 	
-	//set up light type and position for lit_color_texture_program:
+	//set up light type and position for lit_color_texture_program (and its instanced variant):
 	// TODO: consider using the Light(s) in the scene to do this
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
+	for (LitColorTextureProgram const *program : { &*lit_color_texture_program, &*lit_color_texture_program_instanced }) {
+		glUseProgram(program->program);
+		glUniform1i(program->LIGHT_TYPE_int, 1);
+		glUniform3fv(program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
+		glUniform3fv(program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
+	}
 	glUseProgram(0);
 
 	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
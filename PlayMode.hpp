@@ -16,7 +16,8 @@
 #include <string>
 
 struct PlayMode : Mode {
-	PlayMode();
+	//(workers, if given, are used to update and draw the scene; they must outlive the mode)
+	PlayMode(WorkerPool *workers = nullptr);
 	virtual ~PlayMode() {};
 
 	//functions called by main loop:
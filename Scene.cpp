@@ -2,10 +2,17 @@
 
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
+#include "WorkerPool.hpp"
+#include "MappedFile.hpp"
+#include "Lanes4.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <sstream>
 
 //-------------------------
 
@@ -56,18 +63,46 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 	);
 }
 
-glm::mat4x3 Scene::Transform::make_local_to_world() const {
+void Scene::Transform::recompute_world() const {
 	if (!parent) {
-		return make_local_to_parent();
+		local_to_world = make_local_to_parent();
+		world_to_local = make_parent_to_local();
 	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		parent->update_world();
+		local_to_world = parent->local_to_world * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		world_to_local = make_parent_to_local() * glm::mat4(parent->world_to_local);
 	}
+	dirty = false;
+	revision += 1;
 }
-glm::mat4x3 Scene::Transform::make_world_to_local() const {
-	if (!parent) {
-		return make_parent_to_local();
-	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+
+void Scene::Transform::mark_dirty() {
+	if (dirty) return; //(descendants are already dirty)
+	dirty = true;
+	for (Transform *child : children) {
+		child->mark_dirty();
+	}
+}
+
+void Scene::Transform::set_parent(Transform *parent_) {
+	if (parent == parent_) return;
+	if (parent) {
+		auto f = std::find(parent->children.begin(), parent->children.end(), this);
+		assert(f != parent->children.end());
+		parent->children.erase(f);
+	}
+	parent = parent_;
+	if (parent) {
+		parent->children.emplace_back(this);
+	}
+	mark_dirty();
+}
+
+Scene::Transform::~Transform() {
+	set_parent(nullptr);
+	for (Transform *child : children) {
+		child->parent = nullptr;
+		child->mark_dirty();
 	}
 }
 
@@ -87,78 +122,683 @@ void Scene::draw(Camera const &camera) const {
 	draw(world_to_clip, world_to_light);
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+//call fn(begin, end) on ranges of [0, count): split across workers if there are any, else all at once:
+static void split(WorkerPool *workers, uint32_t count, std::function< void(uint32_t, uint32_t) > const &fn, uint32_t grain = 0) {
+	if (workers) workers->parallel_for(count, fn, grain);
+	else fn(0, count);
+}
+
+void Scene::update_transforms() const {
+	if (!workers) {
+		for (auto const &transform : transforms) {
+			transform.update_world();
+		}
+		update_drawable_tree();
+		return;
+	}
+
+	//sort changed transforms into levels by how many changed ancestors they have:
+	// (descendants of a changed transform are all changed, so a changed transform's parent is either
+	//  up to date already or one level up)
+	for (auto &level : transform_levels) {
+		level.clear();
+	}
+	for (auto const &transform : transforms) {
+		if (!transform.dirty) continue;
+		uint32_t depth = 0;
+		for (Transform const *parent = transform.parent; parent && parent->dirty; parent = parent->parent) {
+			++depth;
+		}
+		if (depth >= transform_levels.size()) transform_levels.resize(depth + 1);
+		transform_levels[depth].emplace_back(&transform);
+	}
+
+	//..and recompute each level at once:
+	for (auto const &level : transform_levels) {
+		workers->parallel_for(uint32_t(level.size()), [&level](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) {
+				level[i]->recompute_world();
+			}
+		});
+	}
+
+	update_drawable_tree();
+}
+
+//world-space bounding box of a drawable (Arvo's method: the extent of a transformed box is |M| * extent):
+// (culling and the drawable tree both use this, so they agree exactly on what is in view)
+static void world_box(Scene::Drawable const &drawable, glm::vec3 *center, glm::vec3 *extent) {
+	glm::mat4x3 const &m = drawable.transform->local_to_world;
+	*center = m * glm::vec4(0.5f * (drawable.max + drawable.min), 1.0f);
+	glm::vec3 local = 0.5f * (drawable.max - drawable.min);
+	*extent = glm::abs(m[0]) * local.x + glm::abs(m[1]) * local.y + glm::abs(m[2]) * local.z;
+}
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+void Scene::WorldBoxes::resize(uint32_t slots) {
+	size_t padded = (size_t(slots) + CullLanes - 1) / CullLanes * CullLanes;
+	for (std::vector< float > *array : { &center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z }) {
+		array->resize(padded, 0.0f);
+	}
+}
+
+void Scene::update_drawable_tree() const {
+	uint32_t slots = drawables.slots();
+	//(slots past the end of the map -- it was reassigned -- leave the tree)
+	for (uint32_t slot = slots; slot < tree_entries.size(); ++slot) {
+		if (tree_entries[slot].proxy != AABBTree::Null) drawable_tree.remove(tree_entries[slot].proxy);
+	}
+	tree_entries.resize(slots);
+	world_boxes.resize(slots);
+
+	//find drawables whose world box changed, compute their new boxes, and note the ones the tree needs to hear about:
+	std::atomic< uint32_t > pending(0);
+	split(workers, slots, [&](uint32_t begin, uint32_t end) {
+		uint32_t range_pending = 0;
+		for (uint32_t slot = begin; slot < end; ++slot) {
+			TreeEntry &entry = tree_entries[slot];
+			Drawable const *drawable = drawables.slot(slot);
+			uint32_t generation = drawables.handle_at(slot).generation;
+			if (!drawable || !drawable->has_bounds()) {
+				entry.generation = generation;
+				continue;
+			}
+			if (entry.proxy != AABBTree::Null
+			 && entry.generation == generation
+			 && transforms.get(entry.transform) == drawable->transform
+			 && entry.revision == drawable->transform->revision
+			 && entry.min == drawable->min && entry.max == drawable->max) continue;
+
+			if (transforms.get(entry.transform) != drawable->transform) {
+				entry.transform = transforms.handle_of(drawable->transform);
+			}
+			entry.generation = generation;
+			entry.revision = drawable->transform->revision;
+			entry.min = drawable->min;
+			entry.max = drawable->max;
+			glm::vec3 center, extent;
+			world_box(*drawable, &center, &extent);
+			world_boxes.set(slot, center, extent);
+			entry.changed = (entry.proxy == AABBTree::Null
+				|| !AABBTree::contains(drawable_tree.fat_min(entry.proxy), drawable_tree.fat_max(entry.proxy), center - extent, center + extent));
+			range_pending += uint32_t(entry.changed);
+		}
+		pending += range_pending;
+	}, 1024);
+	//(reinserting boxes one at a time costs about as much as a refit by the time a thirty-second of the tree moves)
+	bool bulk = pending > std::max(64U, uint32_t(drawable_tree.size() / 32));
+	bool added = false;
+
+	//..and move them in the tree:
+	tree_unbounded.clear();
+	tree_drawables = 0;
+	for (uint32_t slot = 0; slot < slots; ++slot) {
+		TreeEntry &entry = tree_entries[slot];
+		Drawable const *drawable = drawables.slot(slot);
+		if (!drawable || !drawable->has_bounds()) {
+			if (entry.proxy != AABBTree::Null) {
+				drawable_tree.remove(entry.proxy);
+				entry.proxy = AABBTree::Null;
+			}
+			if (drawable) tree_unbounded.emplace_back(slot);
+			continue;
+		}
+		if (drawable->pipeline->program != 0 && drawable->pipeline->vao != 0 && drawable->pipeline->count != 0) tree_drawables += 1;
+		if (!entry.changed) continue;
+		entry.changed = false;
+		glm::vec3 min = world_boxes.center(slot) - world_boxes.extent(slot);
+		glm::vec3 max = world_boxes.center(slot) + world_boxes.extent(slot);
+		if (entry.proxy == AABBTree::Null && bulk) {
+			entry.proxy = drawable_tree.insert_unlinked(min, max, slot);
+			added = true;
+		} else if (entry.proxy == AABBTree::Null) {
+			entry.proxy = drawable_tree.insert(min, max, slot);
+		} else if (bulk) {
+			drawable_tree.set_leaf(entry.proxy, min, max);
+		} else {
+			drawable_tree.move(entry.proxy, min, max);
+		}
+	}
 
+	//many changes: refit the tree, or rebuild it if there are new leaves or refitting has made it much worse:
+	if (bulk) {
+		float cost = (added ? 0.0f : drawable_tree.refit());
+		if (added || cost > 2.0f * tree_built_cost) {
+			drawable_tree.rebuild();
+			tree_built_cost = drawable_tree.cost();
+		}
+	}
+}
+
+//drawable in 'slot' if the drawable tree is up to date with it (else nullptr):
+static Scene::Drawable const *tree_drawable(Scene const &scene, uint32_t slot) {
+	if (slot >= scene.tree_entries.size() || slot >= scene.drawables.slots()) return nullptr;
+	if (scene.tree_entries[slot].generation != scene.drawables.handle_at(slot).generation) return nullptr;
+	return scene.drawables.slot(slot);
+}
+
+Scene::Drawable const *Scene::pick(glm::vec3 const &origin, glm::vec3 const &direction, float *t_, float max_t) const {
+	Drawable const *hit = nullptr;
+	drawable_tree.query_ray(origin, direction, max_t, [&](uint32_t slot) {
+		Drawable const *drawable = tree_drawable(*this, slot);
+		if (!drawable) return max_t;
+		//slab test against the local bounding box, with the ray in local space (t is the same in both spaces):
+		glm::mat4x3 const &world_to_local = drawable->transform->world_to_local;
+		glm::vec3 local_origin = world_to_local * glm::vec4(origin, 1.0f);
+		glm::vec3 local_direction = world_to_local * glm::vec4(direction, 0.0f);
+		glm::vec3 t0 = (drawable->min - local_origin) / local_direction;
+		glm::vec3 t1 = (drawable->max - local_origin) / local_direction;
+		glm::vec3 t_near = glm::min(t0, t1), t_far = glm::max(t0, t1);
+		float enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+		float exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, max_t));
+		if (enter <= exit) {
+			hit = drawable;
+			max_t = enter;
+		}
+		return max_t;
+	});
+	if (hit && t_) *t_ = max_t;
+	return hit;
+}
+
+void Scene::drawables_near(glm::vec3 const &center, float radius, std::vector< Drawable const * > *found_) const {
+	assert(found_);
+	auto &found = *found_;
+	found.clear();
+
+	std::vector< uint32_t > slots;
+	drawable_tree.query_box(center - glm::vec3(radius), center + glm::vec3(radius), [&](uint32_t slot) {
+		if (!tree_drawable(*this, slot)) return;
+		//distance from center to the closest point of the world box:
+		glm::vec3 outside = glm::max(glm::abs(center - world_boxes.center(slot)) - world_boxes.extent(slot), glm::vec3(0.0f));
+		if (glm::dot(outside, outside) <= radius * radius) slots.emplace_back(slot);
+	});
+	std::sort(slots.begin(), slots.end());
+	for (uint32_t slot : slots) {
+		found.emplace_back(drawables.slot(slot));
+	}
+}
+
+void Scene::cull_drawables(glm::mat4 const &world_to_clip, std::vector< Drawable const * > *visible_, DrawCounters *counters_) const {
+	assert(visible_);
+	auto &visible = *visible_;
+	assert(counters_);
+	auto &counters = *counters_;
+	visible.clear();
+	counters.tested = 0;
+	counters.culled = 0;
+
+	//frustum planes (a point p is inside if dot(plane, vec4(p,1)) >= 0 for all of them), from the rows of world_to_clip:
+	// (Gribb and Hartmann's method; an infinite far plane comes out as (0,0,0,+) and so never culls anything)
+	glm::mat4 rows = glm::transpose(world_to_clip);
+	glm::vec4 planes[6] = {
+		rows[3] + rows[0], rows[3] - rows[0], //left, right
+		rows[3] + rows[1], rows[3] - rows[1], //bottom, top
+		rows[3] + rows[2], rows[3] - rows[2], //near, far
+	};
+
+	//each slot's drawable if it is visible (nullptr if not), so ranges of slots can be tested independently:
+	uint32_t slots = drawables.slots();
+	visible.assign(slots, nullptr);
+
+	auto has_something_to_draw = [](Drawable const &drawable) {
 		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
+		if (drawable.pipeline->program == 0) return false;
 		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
+		if (drawable.pipeline->vao == 0) return false;
 		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+		if (drawable.pipeline->count == 0) return false;
+		return true;
+	};
 
+	//a box is outside if it is entirely behind any plane:
+	auto outside = [&planes](glm::vec3 const &center, glm::vec3 const &extent) {
+		for (glm::vec4 const &plane : planes) {
+			glm::vec3 abs_plane = glm::abs(glm::vec3(plane));
+			float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+			float radius = abs_plane.x * extent.x + abs_plane.y * extent.y + abs_plane.z * extent.z;
+			if (distance + radius < 0.0f) return true;
+		}
+		return false;
+	};
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+	if (cull && cull_with_tree) {
+		//drawables without bounds are always visible; the tree finds the rest:
+		for (uint32_t slot : tree_unbounded) {
+			Drawable const *drawable = tree_drawable(*this, slot);
+			if (drawable && has_something_to_draw(*drawable)) visible[slot] = drawable;
+		}
+		uint32_t visible_bounded = 0;
+		drawable_tree.query_planes(planes, 6, [&](uint32_t slot, bool inside) {
+			Drawable const *drawable = tree_drawable(*this, slot);
+			if (!drawable || !has_something_to_draw(*drawable)) return;
+			//(the same test as the blocks below, so the results are the same)
+			if (!inside && outside(world_boxes.center(slot), world_boxes.extent(slot))) return;
+			visible[slot] = drawable;
+			visible_bounded += 1;
+		});
+		visible.erase(std::remove(visible.begin(), visible.end(), nullptr), visible.end());
+		counters.tested = tree_drawables;
+		counters.culled = tree_drawables - visible_bounded;
+		return;
+	}
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+	std::atomic< uint32_t > tested(0), culled(0);
+
+	static_assert(CullLanes % 4 == 0 && CullLanes <= 32, "CullLanes must be whole sets of four lanes, with a bit each in a uint32_t");
+	split(workers, slots, [&](uint32_t slot_begin, uint32_t slot_end) {
+		uint32_t range_tested = 0, range_culled = 0;
+
+		for (uint32_t base = slot_begin; base < slot_end; base += CullLanes) {
+			//test the world boxes of a whole block of slots at once, four at a time with Lanes4.hpp:
+			// (only plane math, since update_transforms() already laid the boxes out in world_boxes;
+			//  the operations are in the same order as outside(), so the results are the same)
+			uint32_t block_outside = 0; //bit per slot in the block
+			bool block_tested = (cull && base + CullLanes <= world_boxes.center_x.size());
+			if (block_tested) {
+				for (uint32_t l = 0; l < CullLanes; l += 4) {
+					Float4 cx = Float4::load(&world_boxes.center_x[base + l]);
+					Float4 cy = Float4::load(&world_boxes.center_y[base + l]);
+					Float4 cz = Float4::load(&world_boxes.center_z[base + l]);
+					Float4 ex = Float4::load(&world_boxes.extent_x[base + l]);
+					Float4 ey = Float4::load(&world_boxes.extent_y[base + l]);
+					Float4 ez = Float4::load(&world_boxes.extent_z[base + l]);
+					for (glm::vec4 const &plane : planes) {
+						glm::vec3 abs_plane = glm::abs(glm::vec3(plane));
+						Float4 distance = Float4(plane.x) * cx + Float4(plane.y) * cy + Float4(plane.z) * cz + Float4(plane.w);
+						Float4 radius = Float4(abs_plane.x) * ex + Float4(abs_plane.y) * ey + Float4(abs_plane.z) * ez;
+						block_outside |= bits(distance + radius < Float4(0.0f)) << l;
+					}
+				}
+			}
 
-		//Configure program uniforms:
+			uint32_t block_end = std::min(base + CullLanes, slot_end);
+			for (uint32_t slot = base; slot < block_end; ++slot) {
+				Drawable const *drawable = drawables.slot(slot);
+				if (!drawable || !has_something_to_draw(*drawable)) continue;
+
+				if (!cull || !drawable->has_bounds()) {
+					visible[slot] = drawable;
+					continue;
+				}
+				range_tested += 1;
+				bool out;
+				if (block_tested && tree_drawable(*this, slot)) {
+					out = (block_outside >> (slot - base)) & 1;
+				} else {
+					//(added since the last update_transforms(), so its box isn't in world_boxes yet)
+					glm::vec3 center, extent;
+					world_box(*drawable, &center, &extent);
+					out = outside(center, extent);
+				}
+				if (out) range_culled += 1;
+				else visible[slot] = drawable;
+			}
+		}
+
+		tested += range_tested;
+		culled += range_culled;
+	}, 1024);
+
+	visible.erase(std::remove(visible.begin(), visible.end(), nullptr), visible.end());
+	counters.tested = tested;
+	counters.culled = culled;
+}
+
+uint64_t Scene::draw_key(Drawable const &drawable, glm::mat4 const &world_to_clip) {
+	Drawable::Pipeline const &pipeline = *drawable.pipeline;
+
+	//textures are keyed by a hash of all of them, so drawables with the same textures get the same bits:
+	uint32_t texture_hash = 0;
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		texture_hash = texture_hash * 31 + pipeline.textures[i].texture;
+	}
+
+	//depth (view-space distance, from clip w) of the bounding box center, or of the transform origin if no bounds:
+	// (front-to-back within a state, so early depth testing rejects more fragments)
+	glm::vec3 center = (drawable.has_bounds() ? 0.5f * (drawable.min + drawable.max) : glm::vec3(0.0f));
+	glm::vec3 world = drawable.transform->local_to_world * glm::vec4(center, 1.0f);
+	float w = world_to_clip[0][3] * world.x + world_to_clip[1][3] * world.y + world_to_clip[2][3] * world.z + world_to_clip[3][3];
+	//positive floats order the same as their bit patterns, so the top 16 bits make a coarse depth:
+	uint32_t depth_bits = 0;
+	if (w > 0.0f) std::memcpy(&depth_bits, &w, sizeof(w));
+	uint32_t low_bits = depth_bits >> 16;
+
+	//..but instanceable drawables are grouped by vertex range instead:
+	if (pipeline.instanced.program != 0 && pipeline.instanced.vao != 0) {
+		low_bits = (pipeline.start * 0x9e3779b1U) ^ (pipeline.count * 0x85ebca6bU) ^ pipeline.type;
+		low_bits = (low_bits ^ (low_bits >> 16)) & 0xffff;
+	}
+
+	return (uint64_t(pipeline.program & 0xfff) << 52)
+	     | (uint64_t(pipeline.vao & 0xffff) << 36)
+	     | (uint64_t(texture_hash & 0xfffff) << 16)
+	     | uint64_t(low_bits);
+}
+
+bool Scene::same_instance(Drawable const &a, Drawable const &b) {
+	Drawable::Pipeline const &pa = *a.pipeline;
+	Drawable::Pipeline const &pb = *b.pipeline;
+	if (pa.instanced.program == 0 || pa.instanced.vao == 0) return false;
+	if (pa.set_uniforms || pb.set_uniforms) return false; //(per-drawable uniforms can't be shared)
+	if (&pa == &pb) return true; //(drawables sharing a pipeline)
+	if (pa.program != pb.program || pa.vao != pb.vao) return false;
+	if (pa.type != pb.type || pa.start != pb.start || pa.count != pb.count) return false;
+	if (pa.instanced.program != pb.instanced.program || pa.instanced.vao != pb.instanced.vao || pa.instanced.buffer != pb.instanced.buffer) return false;
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (pa.textures[i].texture != pb.textures[i].texture) return false;
+		if (pa.textures[i].texture != 0 && pa.textures[i].target != pb.textures[i].target) return false;
+	}
+	return true;
+}
+
+void Scene::queue_drawables(glm::mat4 const &world_to_clip, std::vector< Drawable const * > const &visible, std::vector< DrawItem > *queue_) const {
+	assert(queue_);
+	auto &queue = *queue_;
+	uint32_t count = uint32_t(visible.size());
+	queue.resize(count);
+	auto by_key = [](DrawItem const &a, DrawItem const &b) {
+		return a.key < b.key;
+	};
+
+	//key and sort ranges of the queue, then merge them pairwise:
+	// (stable sorts and merges, so drawables with equal keys stay in visible order however the work is split)
+	uint32_t grain = std::max(1U, count);
+	if (workers) grain = std::max(1024U, (count + workers->size() * 4 - 1) / (workers->size() * 4));
+	split(workers, count, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			queue[i] = DrawItem{draw_key(*visible[i], world_to_clip), visible[i]};
+		}
+		std::stable_sort(queue.begin() + begin, queue.begin() + end, by_key);
+	}, grain);
+	for (uint32_t width = grain; width < count; width *= 2) {
+		uint32_t pairs = (count + 2 * width - 1) / (2 * width);
+		split(workers, pairs, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t p = begin; p < end; ++p) {
+				uint32_t first = p * 2 * width;
+				uint32_t middle = std::min(count, first + width);
+				uint32_t last = std::min(count, first + 2 * width);
+				std::inplace_merge(queue.begin() + first, queue.begin() + middle, queue.begin() + last, by_key);
+			}
+		}, 1);
+	}
+}
+
+char const *Scene::FrameBlockGLSL =
+	"layout(std140) uniform Frame {\n"
+	"	mat4 WORLD_TO_CLIP;\n"
+	"	mat4x3 WORLD_TO_LIGHT;\n"
+	"	mat3 NORMAL_WORLD_TO_LIGHT;\n"
+	"};\n";
+
+char const *Scene::ObjectBlockGLSL =
+	"layout(std140) uniform Object {\n"
+	"	mat4x3 OBJECT_TO_WORLD;\n"
+	"	mat3 NORMAL_TO_WORLD;\n"
+	"};\n";
+
+void Scene::bind_uniform_blocks(GLuint program) {
+	GLuint frame = glGetUniformBlockIndex(program, "Frame");
+	if (frame != GL_INVALID_INDEX) glUniformBlockBinding(program, frame, FrameBinding);
+	GLuint object = glGetUniformBlockIndex(program, "Object");
+	if (object != GL_INVALID_INDEX) glUniformBlockBinding(program, object, ObjectBinding);
+}
+
+//Uniform buffers shared by every scene's draw() (created on first use):
+//n.b. declared static so they don't conflict with similarly named global variables elsewhere:
+static GLuint frame_buffer = 0;
+static GLuint object_buffer = 0; //ring buffer of ObjectBlocks
+static GLsizeiptr object_buffer_size = 0;
+static GLintptr object_buffer_head = 0; //where the next draw()'s blocks go
+static GLsizeiptr object_stride = 0; //sizeof(ObjectBlock), rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+
+//copy matrix columns into std140 (vec4-padded) columns:
+template< size_t N, typename M >
+static void std140_columns(glm::vec4 (&columns)[N], M const &m) {
+	for (uint32_t c = 0; c < N; ++c) {
+		columns[c] = glm::vec4(m[c], 0.0f);
+	}
+}
+
+void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	update_transforms();
+	record(world_to_clip, world_to_light, &draw_list);
+	execute(draw_list);
+}
 
-		//the object-to-world matrix is used in all three of these uniforms:
+void Scene::record(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, DrawList *list_) const {
+	assert(list_);
+	auto &list = *list_;
+	list.commands.clear();
+	list.uniforms.clear();
+	list.objects.clear();
+	list.instances.clear();
+	list.counters = DrawCounters();
+
+	cull_drawables(world_to_clip, &list.visible, &list.counters);
+	queue_drawables(world_to_clip, list.visible, &list.queue);
+
+	//normals go from world to light space by the inverse transpose of world_to_light:
+	// (so, with per-transform normal_to_world matrices, no per-drawable inverse is needed)
+	glm::mat3 normal_world_to_light = glm::inverse(glm::transpose(glm::mat3(world_to_light)));
+
+	list.frame.WORLD_TO_CLIP = world_to_clip;
+	std140_columns(list.frame.WORLD_TO_LIGHT, world_to_light);
+	std140_columns(list.frame.NORMAL_WORLD_TO_LIGHT, normal_world_to_light);
+
+	//commands, and where their matrices will go:
+	std::vector< DrawItem > const &queue = list.queue;
+	list.command_items.clear();
+	uint32_t uniform_count = 0, object_count = 0, instance_count = 0;
+	for (uint32_t begin = 0; begin < queue.size(); /* later */) {
+		Drawable const &drawable = *queue[begin].drawable;
 		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+		Drawable::Pipeline const &pipeline = *drawable.pipeline;
+
+		//copies of this drawable that follow it in the queue:
+		uint32_t end = begin + 1;
+		while (end < queue.size() && same_instance(drawable, *queue[end].drawable)) ++end;
+
+		list.command_items.emplace_back(begin);
+		if (end - begin >= MinInstances) {
+			//a run of copies, drawn by one instanced draw call:
+			list.commands.emplace_back(DrawList::Command{&pipeline, DrawList::Command::Instances, instance_count, end - begin});
+			instance_count += end - begin;
+			list.counters.instances += end - begin;
+		} else if (pipeline.uniform_blocks) {
+			//matrices for the Object block:
+			end = begin + 1;
+			list.commands.emplace_back(DrawList::Command{&pipeline, DrawList::Command::Objects, object_count, 1});
+			object_count += 1;
+		} else {
+			//matrices for the pipeline's uniforms:
+			end = begin + 1;
+			list.commands.emplace_back(DrawList::Command{&pipeline, DrawList::Command::Uniforms, uniform_count, 1});
+			uniform_count += 1;
+		}
+		list.counters.drawn += 1;
+		begin = end;
+	}
 
-		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+	//..then fill in the matrices:
+	list.uniforms.resize(uniform_count);
+	list.objects.resize(object_count);
+	list.instances.resize(instance_count);
+	split(workers, uint32_t(list.commands.size()), [&](uint32_t begin, uint32_t end) {
+		for (uint32_t c = begin; c < end; ++c) {
+			DrawList::Command const &command = list.commands[c];
+			uint32_t item = list.command_items[c];
+			if (command.matrices == DrawList::Command::Instances) {
+				for (uint32_t i = 0; i < command.count; ++i) {
+					Transform const &transform = *queue[item + i].drawable->transform;
+					list.instances[command.first + i] = Instance{
+						transform.make_local_to_world(),
+						transform.make_normal_to_world()
+					};
+				}
+			} else if (command.matrices == DrawList::Command::Objects) {
+				Transform const &transform = *queue[item].drawable->transform;
+				ObjectBlock &object = list.objects[command.first];
+				std140_columns(object.OBJECT_TO_WORLD, transform.make_local_to_world());
+				std140_columns(object.NORMAL_TO_WORLD, transform.make_normal_to_world());
+			} else {
+				Transform const &transform = *queue[item].drawable->transform;
+				glm::mat4x3 object_to_world = transform.make_local_to_world();
+				DrawList::Uniforms &uniforms = list.uniforms[command.first];
+				//OBJECT_TO_CLIP takes vertices from object space to clip space:
+				uniforms.OBJECT_TO_CLIP = world_to_clip * glm::mat4(object_to_world);
+				//OBJECT_TO_LIGHT takes vertices from object space to light space:
+				uniforms.OBJECT_TO_LIGHT = world_to_light * glm::mat4(object_to_world);
+				//NORMAL_TO_LIGHT takes normals from object space to light space:
+				uniforms.NORMAL_TO_LIGHT = normal_world_to_light * transform.make_normal_to_world();
+			}
 		}
+	});
+}
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+void Scene::execute(DrawList const &list) const {
+	draw_counters = list.counters;
+	draw_counters.state_changes = 0;
+
+	//Upload the per-frame block:
+	if (frame_buffer == 0) glGenBuffers(1, &frame_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, frame_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(list.frame), &list.frame, GL_STREAM_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FrameBinding, frame_buffer);
+
+	//Upload per-object blocks to the next free part of the ring buffer:
+	GLintptr objects_offset = 0;
+	if (!list.objects.empty()) {
+		if (object_buffer == 0) {
+			glGenBuffers(1, &object_buffer);
+			GLint alignment = 1;
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+			alignment = std::max(alignment, 1);
+			object_stride = (sizeof(ObjectBlock) + alignment - 1) / alignment * alignment;
+		}
+		GLsizeiptr size = GLsizeiptr(list.objects.size()) * object_stride;
+		glBindBuffer(GL_UNIFORM_BUFFER, object_buffer);
+		if (object_buffer_head + size > object_buffer_size) {
+			//out of room: wrap around into a fresh data store (the driver keeps the old one until draws using it are
+			// done), sized for several lists like this one:
+			object_buffer_size = std::max(object_buffer_size, 4 * size);
+			glBufferData(GL_UNIFORM_BUFFER, object_buffer_size, nullptr, GL_STREAM_DRAW);
+			object_buffer_head = 0;
+		}
+		//nothing issued so far reads this range (it is past everything written since the data store was made),
+		// so it can be written without waiting for the GPU:
+		unsigned char *mapped = reinterpret_cast< unsigned char * >(glMapBufferRange(GL_UNIFORM_BUFFER, object_buffer_head, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+		assert(mapped);
+		for (uint32_t i = 0; i < list.objects.size(); ++i) {
+			std::memcpy(mapped + i * object_stride, &list.objects[i], sizeof(ObjectBlock));
+		}
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		objects_offset = object_buffer_head;
+		object_buffer_head += size;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	//state set by earlier draws (so matching state isn't set again):
+	GLuint current_program = 0;
+	GLuint current_vao = 0;
+	Drawable::Pipeline::TextureInfo current_textures[Drawable::Pipeline::TextureCount];
+	uint32_t current_unit = -1U; //active texture unit (not known until first set)
+
+	auto use = [&](GLuint program, GLuint vao) {
+		if (program != current_program) {
+			glUseProgram(program);
+			current_program = program;
+			draw_counters.state_changes += 1;
+		}
+		if (vao != current_vao) {
+			glBindVertexArray(vao);
+			current_vao = vao;
+			draw_counters.state_changes += 1;
+		}
+	};
 
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+	auto bind_texture = [&](uint32_t unit, GLenum target, GLuint texture) {
+		if (current_unit != unit) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			current_unit = unit;
+		}
+		glBindTexture(target, texture);
+		draw_counters.state_changes += 1;
+	};
+	//(units a drawable doesn't use are left empty, as if every draw started from scratch)
+	auto set_textures = [&](Drawable::Pipeline const &pipeline) {
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			Drawable::Pipeline::TextureInfo const &want = pipeline.textures[i];
+			Drawable::Pipeline::TextureInfo &have = current_textures[i];
+			if (want.texture == have.texture && (want.texture == 0 || want.target == have.target)) continue;
+			//un-bind the old texture if the new one won't replace it:
+			if (have.texture != 0 && (want.texture == 0 || want.target != have.target)) {
+				bind_texture(i, have.target, 0);
+			}
+			if (want.texture != 0) {
+				bind_texture(i, want.target, want.texture);
+			}
+			have = want;
 		}
+	};
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+	//Replay the commands:
+	for (DrawList::Command const &command : list.commands) {
+		Scene::Drawable::Pipeline const &pipeline = *command.pipeline;
+
+		if (command.matrices == DrawList::Command::Instances) {
+			use(pipeline.instanced.program, pipeline.instanced.vao);
+
+			glBindBuffer(GL_ARRAY_BUFFER, pipeline.instanced.buffer);
+			glBufferData(GL_ARRAY_BUFFER, command.count * sizeof(Instance), &list.instances[command.first], GL_STREAM_DRAW); //(re-specifying the data store lets the driver avoid waiting on the previous run)
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			set_textures(pipeline);
+
+			glDrawArraysInstanced(pipeline.type, pipeline.start, pipeline.count, GLsizei(command.count));
+			continue;
+		}
+
+		//Set shader program and attribute sources:
+		use(pipeline.program, pipeline.vao);
+
+		//Configure program uniforms:
+		if (command.matrices == DrawList::Command::Objects) {
+			//point the Object block at this drawable's matrices:
+			glBindBufferRange(GL_UNIFORM_BUFFER, ObjectBinding, object_buffer, objects_offset + command.first * object_stride, sizeof(ObjectBlock));
+		} else {
+			DrawList::Uniforms const &uniforms = list.uniforms[command.first];
+			if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
+				glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(uniforms.OBJECT_TO_CLIP));
+			}
+			if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
+				glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(uniforms.OBJECT_TO_LIGHT));
+			}
+			if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
+				glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(uniforms.NORMAL_TO_LIGHT));
+			}
 		}
 
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
 		//set up textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
-			}
-		}
+		set_textures(pipeline);
 
 		//draw the object:
 		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+	}
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
-			}
+	//un-bind textures:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (current_textures[i].texture != 0) {
+			bind_texture(i, current_textures[i].target, 0);
 		}
-		glActiveTexture(GL_TEXTURE0);
-
 	}
+	glActiveTexture(GL_TEXTURE0);
 
+	glBindBufferBase(GL_UNIFORM_BUFFER, FrameBinding, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, ObjectBinding, 0);
 	glUseProgram(0);
 	glBindVertexArray(0);
 
@@ -168,12 +808,37 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
+	load(filename, [&on_drawable](Scene &scene, std::vector< MeshInstance > const &instances) {
+		if (!on_drawable) return;
+		std::string name; //(reused, so each call doesn't allocate a new string)
+		for (MeshInstance const &instance : instances) {
+			name.assign(instance.mesh_name);
+			on_drawable(scene, instance.transform, name);
+		}
+	});
+}
+
+void Scene::load(std::string const &filename,
+	std::function< void(Scene &, std::vector< MeshInstance > const &) > const &on_drawables) {
+
+	load_times = LoadTimes();
+	auto load_start = std::chrono::high_resolution_clock::now();
+	auto lap = [before = load_start](double *time) mutable {
+		auto after = std::chrono::high_resolution_clock::now();
+		*time = std::chrono::duration< double >(after - before).count();
+		before = after;
+	};
 
-	std::ifstream file(filename, std::ios::binary);
+	//map the file and find every chunk (checking headers and sizes) before changing the scene:
+	auto mapped = std::make_shared< MappedFile const >(filename);
+	lap(&load_times.map);
+	char const *at = mapped->data;
+	char const *end = mapped->data + mapped->size;
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	size_t names_count = 0;
+	char const *names = view_unaligned_chunk< char >(&at, end, "str0", &names_count);
 
+	//(str0 isn't padded, so the chunks after it might not be aligned; entries are copied out with memcpy)
 	struct HierarchyEntry {
 		uint32_t parent;
 		uint32_t name_begin;
@@ -183,8 +848,8 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	size_t hierarchy_count = 0;
+	char const *hierarchy = view_unaligned_chunk< HierarchyEntry >(&at, end, "xfh0", &hierarchy_count);
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +857,8 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	size_t meshes_count = 0;
+	char const *meshes = view_unaligned_chunk< MeshEntry >(&at, end, "msh0", &meshes_count);
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +867,8 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
+	size_t cameras_count = 0;
+	char const *cameras = view_unaligned_chunk< CameraEntry >(&at, end, "cam0", &cameras_count);
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,56 +879,75 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lights;
-	read_chunk(file, "lmp0", &lights);
+	size_t lights_count = 0;
+	char const *lights = view_unaligned_chunk< LightEntry >(&at, end, "lmp0", &lights_count);
 
+	//copy out entry i of a chunk:
+	auto entry = [](auto *entry_, char const *chunk, size_t i) {
+		std::memcpy(entry_, chunk + i * sizeof(*entry_), sizeof(*entry_));
+	};
+
+	//names point into the mapping, so keep it:
+	name_storage.emplace_back(mapped);
+
+	lap(&load_times.chunks);
 
 	//--------------------------------
-	//Now that file is loaded, create transforms for hierarchy entries:
+	//Now that the chunks are found, create transforms for hierarchy entries:
 
 	std::vector< Transform * > hierarchy_transforms;
-	hierarchy_transforms.reserve(hierarchy.size());
+	hierarchy_transforms.reserve(hierarchy_count);
 
-	for (auto const &h : hierarchy) {
+	for (size_t i = 0; i < hierarchy_count; ++i) {
+		HierarchyEntry h;
+		entry(&h, hierarchy, i);
 		transforms.emplace_back();
 		Transform *t = &transforms.back();
 		if (h.parent != -1U) {
 			if (h.parent >= hierarchy_transforms.size()) {
 				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
 			}
-			t->parent = hierarchy_transforms[h.parent];
+			t->set_parent(hierarchy_transforms[h.parent]);
 		}
 
-		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+		if (h.name_begin <= h.name_end && h.name_end <= names_count) {
+			t->name = std::string_view(names + h.name_begin, h.name_end - h.name_begin);
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
 
-		t->position = h.position;
-		t->rotation = h.rotation;
-		t->scale = h.scale;
+		t->set_position(h.position);
+		t->set_rotation(h.rotation);
+		t->set_scale(h.scale);
 
 		hierarchy_transforms.emplace_back(t);
 	}
-	assert(hierarchy_transforms.size() == hierarchy.size());
-
-	for (auto const &m : meshes) {
+	assert(hierarchy_transforms.size() == hierarchy_count);
+	lap(&load_times.xfh0);
+
+	std::vector< MeshInstance > instances;
+	instances.reserve(meshes_count);
+	for (size_t i = 0; i < meshes_count; ++i) {
+		MeshEntry m;
+		entry(&m, meshes, i);
 		if (m.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
 		}
-		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
+		if (!(m.name_begin <= m.name_end && m.name_end <= names_count)) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
 		}
-		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
-
-		if (on_drawable) {
-			on_drawable(*this, hierarchy_transforms[m.transform], name);
-		}
+		instances.emplace_back(MeshInstance{hierarchy_transforms[m.transform], std::string_view(names + m.name_begin, m.name_end - m.name_begin)});
+	}
+	lap(&load_times.msh0);
 
+	if (on_drawables) {
+		on_drawables(*this, instances);
 	}
+	lap(&load_times.drawables);
 
-	for (auto const &c : cameras) {
+	for (size_t i = 0; i < cameras_count; ++i) {
+		CameraEntry c;
+		entry(&c, cameras, i);
 		if (c.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains camera entry with invalid transform index (" + std::to_string(c.transform) + ")");
 		}
@@ -277,8 +961,11 @@ void Scene::load(std::string const &filename,
 		camera->near = c.clip_near;
 		//N.b. far plane is ignored because cameras use infinite perspective matrices.
 	}
+	lap(&load_times.cam0);
 
-	for (auto const &l : lights) {
+	for (size_t i = 0; i < lights_count; ++i) {
+		LightEntry l;
+		entry(&l, lights, i);
 		if (l.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains lamp entry with invalid transform index (" + std::to_string(l.transform) + ")");
 		}
@@ -300,16 +987,27 @@ void Scene::load(std::string const &filename,
 		light->energy = glm::vec3(l.color) / 255.0f * l.energy;
 		light->spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
 	}
+	lap(&load_times.lmp0);
 
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	// (load_extra reads streams, so it gets one over a copy of whatever follows the main chunks -- usually nothing)
+	{
+		std::istringstream extra(std::string(at, end));
+		load_extra(extra, std::vector< char >(names, names + names_count), hierarchy_transforms);
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
+		if (extra.peek() != EOF) {
+			std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
+		}
 	}
+	lap(&load_times.extra);
 
+	load_times.total = std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - load_start).count();
+}
 
-
+std::string_view Scene::keep_name(std::string_view name) {
+	auto kept = std::make_shared< std::string const >(name);
+	name_storage.emplace_back(kept);
+	return *kept;
 }
 
 //-------------------------
@@ -328,50 +1026,74 @@ Scene &Scene::operator=(Scene const &other) {
 }
 
 void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map_) {
-
-	std::unordered_map< Transform const *, Transform * > t2t_temp;
-	std::unordered_map< Transform const *, Transform * > &transform_to_transform = *(transform_map_ ? transform_map_ : &t2t_temp);
-
-	transform_to_transform.clear();
-
-	//null transform maps to itself:
-	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
-
-	//Copy transforms and store mapping:
-	transforms.clear();
-	for (auto const &t : other.transforms) {
-		transforms.emplace_back();
-		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
-
-		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
-		assert(ret.second);
-	}
-
-	//update transform parents:
-	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
-	}
-
-	//copy other's drawables, updating transform pointers:
-	drawables = other.drawables;
-	for (auto &d : drawables) {
-		d.transform = transform_to_transform.at(d.transform);
+	if (this == &other) {
+		if (transform_map_) {
+			transform_map_->clear();
+			for (auto const &t : transforms) transform_map_->emplace(&t, const_cast< Transform * >(&t));
+		}
+		return;
 	}
 
-	//copy other's cameras, updating transform pointers:
-	cameras = other.cameras;
-	for (auto &c : cameras) {
-		c.transform = transform_to_transform.at(c.transform);
+	//Every object is copied into the same slot it has in other, so pointers between objects are relocated by
+	// slot index (SlotMap::relocate) rather than looked up, and handles work the same in both scenes:
+
+	//copy transforms, with parent and children pointers relocated and cached world matrices copied:
+	// (children stay in the same order, and nothing is marked dirty that wasn't dirty in other)
+	transforms.assign(other.transforms, [this,&other](void *place, Transform const &o) {
+		Transform *t = new (place) Transform();
+		t->name = o.name;
+		t->set_position(o.get_position());
+		t->set_rotation(o.get_rotation());
+		t->set_scale(o.get_scale());
+		t->parent = transforms.relocate(other.transforms, o.parent);
+		t->children.reserve(o.children.size());
+		for (Transform *child : o.children) {
+			t->children.emplace_back(transforms.relocate(other.transforms, child));
+		}
+		t->local_to_world = o.local_to_world;
+		t->world_to_local = o.world_to_local;
+		t->dirty = o.dirty;
+		t->revision = o.revision;
+	});
+
+	if (transform_map_) {
+		auto &transform_to_transform = *transform_map_;
+		transform_to_transform.clear();
+		transform_to_transform.reserve(transforms.size() + 1);
+		//null transform maps to itself:
+		transform_to_transform.emplace(nullptr, nullptr);
+		for (auto const &t : other.transforms) {
+			transform_to_transform.emplace(&t, transforms.relocate(other.transforms, &t));
+		}
 	}
 
-	//copy other's lights, updating transform pointers:
-	lights = other.lights;
-	for (auto &l : lights) {
-		l.transform = transform_to_transform.at(l.transform);
-	}
+	//(names are views, so the copy shares whatever they point into)
+	name_storage = other.name_storage;
+
+	cull = other.cull;
+	cull_with_tree = other.cull_with_tree;
+	workers = other.workers;
+
+	//copy other's drawables (sharing their pipelines), cameras, and lights, relocating transform pointers:
+	drawables.assign(other.drawables, [this,&other](void *place, Drawable const &o) {
+		Drawable *d = new (place) Drawable(o);
+		d->transform = transforms.relocate(other.transforms, o.transform);
+	});
+	cameras.assign(other.cameras, [this,&other](void *place, Camera const &o) {
+		Camera *c = new (place) Camera(o);
+		c->transform = transforms.relocate(other.transforms, o.transform);
+	});
+	lights.assign(other.lights, [this,&other](void *place, Light const &o) {
+		Light *l = new (place) Light(o);
+		l->transform = transforms.relocate(other.transforms, o.transform);
+	});
+
+	//the drawable tree only refers to slots, handles, and revisions, which are all the same in the copy:
+	// (so the copy doesn't have to rebuild it on its first update_transforms())
+	drawable_tree = other.drawable_tree;
+	tree_entries = other.tree_entries;
+	world_boxes = other.world_boxes;
+	tree_unbounded = other.tree_unbounded;
+	tree_drawables = other.tree_drawables;
+	tree_built_cost = other.tree_built_cost;
 }
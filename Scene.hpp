@@ -11,42 +11,82 @@
  */
 
 #include "GL.hpp"
+#include "SlotMap.hpp"
+#include "AABBTree.hpp"
+#include "CopyOnWrite.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
-#include <list>
 #include <memory>
 #include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
+#include <limits>
+
+struct WorkerPool;
 
 struct Scene {
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
-		std::string name;
+		// (a view, so names aren't copied: loaded names point into the scene file, which the scene keeps mapped;
+		//  name transforms with string literals or Scene::keep_name(), not strings that might go away first)
+		std::string_view name;
 
 		//The core function of a transform is to store a transformation in the world:
-		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
-		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //n.b. wxyz init order
-		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
+		// (private, so every change goes through the setters below and cached world matrices can't go stale)
+		glm::vec3 const &get_position() const { return position; }
+		glm::quat const &get_rotation() const { return rotation; }
+		glm::vec3 const &get_scale() const { return scale; }
 
 		//The transform above may be relative to some parent transform:
-		Transform *parent = nullptr;
+		Transform *parent = nullptr; //(change with set_parent)
+		std::vector< Transform * > children; //transforms whose parent is this one (kept up to date by set_parent)
+
+		//Change the transformation (these keep cached world matrices up to date):
+		void set_position(glm::vec3 const &position_) { position = position_; mark_dirty(); }
+		void set_rotation(glm::quat const &rotation_) { rotation = rotation_; mark_dirty(); }
+		void set_scale(glm::vec3 const &scale_) { scale = scale_; mark_dirty(); }
+		void set_parent(Transform *parent_);
+		//mark cached world matrices of this transform and everything below it as out of date:
+		// (the setters call this)
+		void mark_dirty();
 
 		//It is often convenient to construct matrices representing this transformation:
 		// ..relative to its parent:
 		glm::mat4x3 make_local_to_parent() const;
 		glm::mat4x3 make_parent_to_local() const;
-		// ..relative to the world:
-		glm::mat4x3 make_local_to_world() const;
-		glm::mat4x3 make_world_to_local() const;
+		// ..relative to the world (cached; recomputed only if this transform or an ancestor changed):
+		glm::mat4x3 make_local_to_world() const { update_world(); return local_to_world; }
+		glm::mat4x3 make_world_to_local() const { update_world(); return world_to_local; }
+		// ..for normals (the inverse transpose of local_to_world, read off the cached world_to_local, so no inverse is computed):
+		glm::mat3 make_normal_to_world() const { update_world(); return glm::transpose(glm::mat3(world_to_local)); }
 
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
 		Transform() = default;
+		//(detaches from parent and children, so neither is left pointing at a deleted transform)
+		~Transform();
+
+		//Cached world matrices:
+		// (a dirty transform's descendants are always dirty too, so mark_dirty can stop at dirty transforms)
+		mutable glm::mat4x3 local_to_world = glm::mat4x3(1.0f);
+		mutable glm::mat4x3 world_to_local = glm::mat4x3(1.0f);
+		mutable bool dirty = true;
+		mutable uint32_t revision = 0; //counts recomputes, so caches of things below this transform can tell it moved
+		//recompute cached matrices if dirty (updating ancestors first):
+		void update_world() const {
+			if (dirty) recompute_world();
+		}
+		void recompute_world() const;
+
+	private:
+		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
+		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //n.b. wxyz init order
+		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
 	};
 
 	struct Drawable {
@@ -54,7 +94,15 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//Bounding box of the drawn vertices, in the transform's local space (e.g., copied from Mesh::min, Mesh::max):
+		// (used to skip drawables outside the view; the default, empty, box means "always draw")
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		bool has_bounds() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+
 		//Contains all the data needed to run the OpenGL pipeline:
+		// (shared, copy-on-write: read with drawable.pipeline->..., change with drawable.pipeline.write()...,
+		//  so copies of a drawable -- e.g., in copies of a scene -- share one Pipeline until they change it)
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
 
@@ -66,19 +114,29 @@ struct Scene {
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
 
 			//uniforms:
+			bool uniform_blocks = false; //program reads the Frame and Object uniform blocks (see Scene::FrameBlock) instead of the uniforms below
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
 			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
 
 			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
 
+			//instanced variant (optional): draw() draws runs of drawables with the same pipeline and vertex range
+			// (and no set_uniforms) as one glDrawArraysInstanced through this program instead of one glDrawArrays each:
+			struct Instanced {
+				GLuint program = 0; //reads the Frame uniform block and per-instance OBJECT_TO_WORLD and NORMAL_TO_WORLD attributes (see Scene::Instance)
+				GLuint vao = 0; //like 'vao', plus the per-instance attributes sourced from 'buffer'
+				GLuint buffer = 0; //per-instance data; draw() fills it
+			} instanced;
+
 			//texture objects to bind for the first TextureCount textures:
 			enum : uint32_t { TextureCount = 4 };
 			struct TextureInfo {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
-		} pipeline;
+		};
+		CopyOnWrite< Pipeline > pipeline;
 	};
 
 	struct Camera {
@@ -117,28 +175,240 @@ struct Scene {
 	};
 
 	//Scenes, of course, may have many of the above objects:
-	std::list< Transform > transforms;
-	std::list< Drawable > drawables;
-	std::list< Camera > cameras;
-	std::list< Light > lights;
+	// (stored in slot maps: objects are contiguous in memory and never move, so pointers to them stay valid
+	//  until they are erased; handles -- e.g., transforms.handle_of(transform) -- also detect erased objects)
+	// (transforms loaded from a file are stored parents-first, so update_transforms visits them in one pass)
+	SlotMap< Transform > transforms;
+	SlotMap< Drawable > drawables;
+	SlotMap< Camera > cameras;
+	SlotMap< Light > lights;
+	using TransformHandle = SlotMap< Transform >::Handle;
+	using DrawableHandle = SlotMap< Drawable >::Handle;
+	using CameraHandle = SlotMap< Camera >::Handle;
+	using LightHandle = SlotMap< Light >::Handle;
+
+	//Bring every transform's cached world matrices up to date:
+	// (only transforms that changed, or are below one that changed, are recomputed; draw() calls this,
+	//  but call it yourself before reading world matrices from several threads at once)
+	// (with workers, changed transforms are recomputed level by level: all of those at the same depth below
+	//  an unchanged transform at once, since their parents are already done)
+	void update_transforms() const;
+
+	//threads for update_transforms() and record() to split their work across (if set; the scene doesn't own them):
+	// (results are the same, in the same order, with or without workers)
+	// (a pool runs one loop at a time, so don't record() views of a scene with workers on several threads at once)
+	WorkerPool *workers = nullptr;
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+	// (draw() is update_transforms(), then record() into draw_list, then execute(draw_list); see DrawList below)
+
+	//draw() skips drawables whose world-space bounding box is entirely outside the view (if 'cull' is set):
+	bool cull = true;
+	//what the most recent draw() (or execute()) did:
+	struct DrawCounters {
+		uint32_t tested = 0; //drawables with bounds that were checked against the view
+		uint32_t culled = 0; //..of which were outside it
+		uint32_t drawn = 0; //draw calls issued
+		uint32_t instances = 0; //..drawables drawn by instanced draw calls among them
+		uint32_t state_changes = 0; //program, vertex array, and texture binds issued (counted by execute())
+	};
+	mutable DrawCounters draw_counters;
+
+	//list the drawables draw() would draw (those with something to draw that aren't outside the view):
+	// - with cull_with_tree, the drawable tree (below) is walked and only drawables in partly-visible leaves are tested
+	// - otherwise, the world boxes update_transforms() stored in world_boxes are tested against the frustum planes of
+	//   world_to_clip in blocks of CullLanes slots, four slots at a time (with Lanes4.hpp)
+	//   (with workers, ranges of drawable slots are tested at once)
+	// - call update_transforms() first
+	// - visible drawables are listed in slot order either way
+	// (sets counters->tested and ->culled)
+	enum : uint32_t { CullLanes = 8 };
+	void cull_drawables(glm::mat4 const &world_to_clip, std::vector< Drawable const * > *visible, DrawCounters *counters) const;
+
+	//Drawables' world-space bounding boxes are kept in a dynamic AABB tree (see AABBTree.hpp) for culling and queries:
+	// - update_transforms() brings it up to date: drawables whose transform was recomputed since the last update
+	//   (per Transform::revision), or whose bounds, transform, or slot changed, are moved in the tree; boxes are
+	//   fattened, so most small motions don't change the tree at all
+	// - when few boxes leave their fat boxes they are reinserted one at a time; when many do (or many drawables are
+	//   added), leaves are set and the tree is refit in one pass, or rebuilt once refitting has made it much worse
+	// - drawables without bounds aren't in it
+	// - drawables added since the last update_transforms() aren't found by queries (or, with cull_with_tree, drawn)
+	//cull_drawables() walks the tree (if set) instead of testing every drawable:
+	// (same results; fat boxes entirely inside the view skip testing the drawables below them)
+	bool cull_with_tree = true;
+	mutable AABBTree drawable_tree; //(proxy data is the drawable's slot index)
+	//what the tree knows about each drawable slot:
+	struct TreeEntry {
+		uint32_t generation = 0; //slot generation when last seen
+		uint32_t proxy = AABBTree::Null; //(Null if not in the tree)
+		TransformHandle transform; //..and its revision when bounds were computed:
+		uint32_t revision = 0;
+		glm::vec3 min, max; //local bounds
+		bool changed = false; //(world box left its fat box, or isn't in the tree yet)
+	};
+	mutable std::vector< TreeEntry > tree_entries;
+	//world bounding box of the drawable in each slot (the tree's leaves are these, fattened), as arrays for culling:
+	// (sized to whole blocks of CullLanes slots; boxes of slots without a bounded drawable are left as they were)
+	struct WorldBoxes {
+		std::vector< float > center_x, center_y, center_z;
+		std::vector< float > extent_x, extent_y, extent_z;
+		void resize(uint32_t slots);
+		glm::vec3 center(uint32_t slot) const { return glm::vec3(center_x[slot], center_y[slot], center_z[slot]); }
+		glm::vec3 extent(uint32_t slot) const { return glm::vec3(extent_x[slot], extent_y[slot], extent_z[slot]); }
+		void set(uint32_t slot, glm::vec3 const &center, glm::vec3 const &extent) {
+			center_x[slot] = center.x; center_y[slot] = center.y; center_z[slot] = center.z;
+			extent_x[slot] = extent.x; extent_y[slot] = extent.y; extent_z[slot] = extent.z;
+		}
+	};
+	mutable WorldBoxes world_boxes;
+	mutable std::vector< uint32_t > tree_unbounded; //slots of drawables without bounds
+	mutable uint32_t tree_drawables = 0; //drawables with bounds and something to draw (as cull_drawables() counts them)
+	mutable float tree_built_cost = 0.0f; //drawable_tree.cost() when last rebuilt
+	void update_drawable_tree() const; //(called by update_transforms())
+
+	//the drawable whose (transformed) bounding box the ray origin + t * direction hits first, for t in [0, max_t]:
+	// returns nullptr if none; sets *t (if given) to the hit's t
+	// (boxes are tested in the drawable's local space, so rotated boxes are hit exactly)
+	Drawable const *pick(glm::vec3 const &origin, glm::vec3 const &direction, float *t = nullptr, float max_t = std::numeric_limits< float >::infinity()) const;
+	//drawables whose world-space bounding box comes within 'radius' of 'center', in slot order:
+	void drawables_near(glm::vec3 const &center, float radius, std::vector< Drawable const * > *found) const;
+
+	//draw() submits drawables sorted by a 64-bit key, so drawables sharing state are drawn together, and only
+	// binds the program, vertex array, and textures that differ from the previous draw:
+	// key bits, most significant first: program (12) | vertex array (16) | textures (20) | depth (16)
+	// (drawables with an instanced variant put a hash of their vertex range in place of depth, so copies of a mesh end
+	//  up next to each other and can be drawn together)
+	// (GL names are small integers in practice; names that collide in the key cost extra binds, never wrong state)
+	// (so pipeline.set_uniforms should only set uniforms, not change bindings)
+	struct DrawItem {
+		uint64_t key;
+		Drawable const *drawable;
+	};
+	static uint64_t draw_key(Drawable const &drawable, glm::mat4 const &world_to_clip);
+	//sort (visible) drawables into the order draw() submits them:
+	// (equal keys stay in visible -- i.e., slot -- order, so the order doesn't depend on how the sort was split across workers)
+	void queue_drawables(glm::mat4 const &world_to_clip, std::vector< Drawable const * > const &visible, std::vector< DrawItem > *queue) const;
+
+	//per-instance data for instanced draws (the layout of Pipeline::Instanced::buffer):
+	struct Instance {
+		glm::mat4x3 OBJECT_TO_WORLD;
+		glm::mat3 NORMAL_TO_WORLD;
+	};
+	static_assert(sizeof(Instance) == 4*12 + 4*9, "Instance is packed.");
+	//can 'a' and 'b' be drawn by the same instanced draw call?
+	static bool same_instance(Drawable const &a, Drawable const &b);
+	//fewest drawables worth an instanced draw call:
+	enum : uint32_t { MinInstances = 2 };
+
+	//Uniform blocks, for programs that set pipeline.uniform_blocks:
+	// draw() uploads one FrameBlock per draw() and one ObjectBlock per (non-instanced) drawable; the object blocks
+	// are packed into a ring buffer and each draw binds its own range, instead of making a glUniform* call per matrix.
+	// Programs declare the blocks with FrameBlockGLSL / ObjectBlockGLSL and call bind_uniform_blocks() after linking.
+	// (matrices are stored as std140 columns: each column padded to a vec4)
+	enum : GLuint { FrameBinding = 0, ObjectBinding = 1 }; //uniform buffer binding points
+	struct FrameBlock {
+		glm::mat4 WORLD_TO_CLIP;
+		glm::vec4 WORLD_TO_LIGHT[4]; //mat4x3
+		glm::vec4 NORMAL_WORLD_TO_LIGHT[3]; //mat3
+	};
+	static_assert(sizeof(FrameBlock) == 4*16 + 4*16 + 4*12, "FrameBlock matches std140 layout.");
+	struct ObjectBlock {
+		glm::vec4 OBJECT_TO_WORLD[4]; //mat4x3
+		glm::vec4 NORMAL_TO_WORLD[3]; //mat3
+	};
+	static_assert(sizeof(ObjectBlock) == 4*16 + 4*12, "ObjectBlock matches std140 layout.");
+	static char const *FrameBlockGLSL;
+	static char const *ObjectBlockGLSL;
+	//point 'program's Frame and Object blocks (if it declares them) at FrameBinding and ObjectBinding:
+	static void bind_uniform_blocks(GLuint program);
+
+	//A "DrawList" is everything one view of the scene sends to OpenGL, worked out ahead of time:
+	// - record() fills it (culling, sorting, instancing, matrices) without making any GL calls, so it can run on a
+	//   worker thread (after update_transforms(); the scene must not change meanwhile), or once per view
+	//   (with workers, each step is split across them; commands come out in the same order regardless)
+	// - execute() replays it: binds state that changed, uploads blocks and instances, and issues the draws
+	// commands point at drawables' pipelines, so a list is only good until those drawables change or are erased.
+	struct DrawList {
+		FrameBlock frame;
+		struct Command {
+			Drawable::Pipeline const *pipeline; //state to draw with
+			enum Matrices : uint32_t {
+				Uniforms, //uniforms[first] (pipelines with OBJECT_TO_CLIP_mat4 etc.)
+				Objects, //objects[first] (pipelines with uniform_blocks)
+				Instances, //instances[first, first+count) (drawn with pipeline->instanced)
+			} matrices;
+			uint32_t first;
+			uint32_t count; //instances to draw (1 unless matrices is Instances)
+		};
+		std::vector< Command > commands;
+		struct Uniforms {
+			glm::mat4 OBJECT_TO_CLIP;
+			glm::mat4x3 OBJECT_TO_LIGHT;
+			glm::mat3 NORMAL_TO_LIGHT;
+		};
+		std::vector< Uniforms > uniforms;
+		std::vector< ObjectBlock > objects;
+		std::vector< Instance > instances;
+		DrawCounters counters; //what executing the list will do (except state_changes)
+
+		//scratch space for record() (kept between frames to avoid reallocating):
+		std::vector< Drawable const * > visible;
+		std::vector< DrawItem > queue;
+		std::vector< uint32_t > command_items; //queue index of each command's first drawable
+	};
+	void record(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, DrawList *list) const;
+	void execute(DrawList const &list) const;
+	//(the list draw() uses, kept between frames to avoid reallocating)
+	mutable DrawList draw_list;
+	//(scratch space for update_transforms() with workers: changed transforms, by level)
+	mutable std::vector< std::vector< Transform const * > > transform_levels;
 
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
+	// (the file is memory-mapped and its chunks are read in place; the mapping is kept -- in name_storage --
+	//  for transform names to point into, so don't overwrite a scene file while a scene loaded from it exists)
 	void load(std::string const &filename,
 		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
 	);
+	//..or make all of the drawables in one call, given every mesh entry in the file (in file order):
+	// (e.g., to look up each distinct mesh once, and share one pipeline between its drawables)
+	struct MeshInstance {
+		Transform *transform;
+		std::string_view mesh_name; //(points into the mapped file)
+	};
+	void load(std::string const &filename,
+		std::function< void(Scene &, std::vector< MeshInstance > const &) > const &on_drawables
+	);
+
+	//how long the most recent load() spent on each part of the file (in seconds):
+	struct LoadTimes {
+		double map = 0.0; //opening and mapping the file
+		double chunks = 0.0; //finding and checking the header of every chunk (str0's names are used in place)
+		double xfh0 = 0.0; //making transforms
+		double msh0 = 0.0; //checking mesh entries and listing them for the callback
+		double cam0 = 0.0; //making cameras
+		double lmp0 = 0.0; //making lights
+		double drawables = 0.0; //running on_drawable(s)
+		double extra = 0.0; //load_extra()
+		double total = 0.0;
+	};
+	LoadTimes load_times;
 
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
+	// (from reads the rest of the mapped file; str0 is a copy of the names chunk)
 	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
 
+	//keep a copy of 'name' for as long as this scene (or a copy of it) exists, for naming transforms:
+	std::string_view keep_name(std::string_view name);
+	//whatever transform names point into (mapped scene files, kept names); shared with copies of the scene:
+	std::vector< std::shared_ptr< void const > > name_storage;
+
 	//empty scene:
 	Scene() = default;
 
@@ -146,6 +416,8 @@ struct Scene {
 	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
 
 	//copy a scene (with proper pointer fixup):
+	// (every object lands in the same slot as in the original, so handles from one scene work in the other,
+	//  and drawables share the original's pipelines until either changes them)
 	Scene(Scene const &); //...as a constructor
 	Scene &operator=(Scene const &); //...as scene = scene
 	//... as a set() function that optionally returns the transform->transform mapping:
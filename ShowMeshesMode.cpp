@@ -23,11 +23,12 @@ ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
 		scene_drawable = &scene.drawables.back();
 
 		scene_drawable->pipeline = show_meshes_program_pipeline;
-		scene_drawable->pipeline.vao = vao;
+		Scene::Drawable::Pipeline &pipeline = scene_drawable->pipeline.write();
+		pipeline.vao = vao;
 		//these will be updated by the mesh selection code:
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
+		pipeline.type = GL_TRIANGLES;
+		pipeline.start = 0;
+		pipeline.count = 0;
 	}
 
 	//select first mesh in buffer:
@@ -69,7 +70,7 @@ bool ShowMeshesMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window
 			if (SDL_GetModState() & KMOD_SHIFT) {
 				//shift: pan
 
-				glm::mat3 frame = glm::mat3_cast(scene_camera->transform->rotation);
+				glm::mat3 frame = glm::mat3_cast(scene_camera->transform->get_rotation());
 				camera.target -= frame[0] * (delta.x * camera.radius) + frame[1] * (delta.y * camera.radius);
 			} else {
 				//no shift: tumble
@@ -104,12 +105,12 @@ bool ShowMeshesMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window
 void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 	//--- use camera structure to set up scene camera ---
 
-	scene_camera->transform->rotation =
+	scene_camera->transform->set_rotation(
 		glm::angleAxis(camera.azimuth, glm::vec3(0.0f, 0.0f, 1.0f))
 		* glm::angleAxis(0.5f * 3.1415926f + -camera.elevation, glm::vec3(1.0f, 0.0f, 0.0f))
-	;
-	scene_camera->transform->position = camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f));
-	scene_camera->transform->scale = glm::vec3(1.0f);
+	);
+	scene_camera->transform->set_position(camera.target + camera.radius * (scene_camera->transform->get_rotation() * glm::vec3(0.0f, 0.0f, 1.0f)));
+	scene_camera->transform->set_scale(glm::vec3(1.0f));
 	scene_camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
 
@@ -158,16 +159,18 @@ void ShowMeshesMode::select_prev_mesh() {
 
 	if (f != buffer.meshes.end()) {
 		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
+		scene_drawable->pipeline.write().type = f->second.type;
+		scene_drawable->pipeline.write().start = f->second.start;
+		scene_drawable->pipeline.write().count = f->second.count;
+		scene_drawable->min = f->second.min;
+		scene_drawable->max = f->second.max;
 		current_mesh_min = f->second.min;
 		current_mesh_max = f->second.max;
 	} else {
 		current_mesh_name = "";
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.write().type = GL_TRIANGLES;
+		scene_drawable->pipeline.write().start = 0;
+		scene_drawable->pipeline.write().count = 0;
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
@@ -187,16 +190,18 @@ void ShowMeshesMode::select_next_mesh() {
 
 	if (f != buffer.meshes.end()) {
 		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
+		scene_drawable->pipeline.write().type = f->second.type;
+		scene_drawable->pipeline.write().start = f->second.start;
+		scene_drawable->pipeline.write().count = f->second.count;
+		scene_drawable->min = f->second.min;
+		scene_drawable->max = f->second.max;
 		current_mesh_min = f->second.min;
 		current_mesh_max = f->second.max;
 	} else {
 		current_mesh_name = "";
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.write().type = GL_TRIANGLES;
+		scene_drawable->pipeline.write().start = 0;
+		scene_drawable->pipeline.write().count = 0;
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
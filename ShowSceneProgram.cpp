@@ -10,9 +10,8 @@ Load< ShowSceneProgram > show_scene_program(LoadTagEarly, []() -> ShowSceneProgr
 
 	show_scene_program_pipeline.program = ret->program;
 
-	show_scene_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	show_scene_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	show_scene_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+	//(matrices come from Scene's Frame and Object uniform blocks)
+	show_scene_program_pipeline.uniform_blocks = true;
 
 	return ret;
 });
@@ -21,10 +20,10 @@ ShowSceneProgram::ShowSceneProgram() {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		std::string("#version 330\n")
+		+ Scene::FrameBlockGLSL
+		+ Scene::ObjectBlockGLSL
+		+
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -34,9 +33,10 @@ ShowSceneProgram::ShowSceneProgram() {
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
 		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	vec4 world = vec4(OBJECT_TO_WORLD * Position, Position.w);\n"
+		"	gl_Position = WORLD_TO_CLIP * world;\n"
+		"	position = WORLD_TO_LIGHT * world;\n"
+		"	normal = NORMAL_WORLD_TO_LIGHT * (NORMAL_TO_WORLD * Normal);\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
@@ -79,11 +79,10 @@ ShowSceneProgram::ShowSceneProgram() {
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
-	//look up the locations of uniforms:
-	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
-	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
-	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	//point the Frame and Object uniform blocks at the buffers Scene::draw fills:
+	Scene::bind_uniform_blocks(program);
 
+	//look up the locations of uniforms:
 	INSPECT_MODE_int = glGetUniformLocation(program, "INSPECT_MODE");
 }
 
@@ -0,0 +1,233 @@
+#pragma once
+
+/*
+ * A "SlotMap" stores objects in fixed-size pages of contiguous slots and hands
+ *  out generation-checked handles to them.
+ *
+ * - Objects never move once added, so plain pointers to them stay valid until
+ *   they are erased (existing code that holds, e.g., a Transform * keeps working).
+ * - Handles remember the slot's generation, which changes whenever the slot's
+ *   object is erased, so a handle to an erased object is detected (get() returns
+ *   nullptr) instead of silently referring to whatever reused the slot.
+ * - Iteration walks slots in index order, skipping empty ones; erased slots are
+ *   reused lowest-index-first, so objects added in some order (e.g., parents
+ *   before children) are iterated in that order unless slots were freed in between.
+ *
+ * The interface mirrors the parts of std::list that Scene used (emplace_back,
+ *  back, iteration, size), so code written against the old lists still compiles.
+ *
+ */
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <queue>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+template< typename T >
+struct SlotMap {
+	enum : uint32_t { PageSize = 256 }; //slots per page
+
+	struct Handle {
+		uint32_t index = -1U;
+		uint32_t generation = 0;
+		bool operator==(Handle const &other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(Handle const &other) const { return !(*this == other); }
+	};
+
+	SlotMap() = default;
+	~SlotMap() { clear(); }
+	//copies keep every object in the same slot with the same generation, so handles work on both:
+	SlotMap(SlotMap const &other) { *this = other; }
+	SlotMap &operator=(SlotMap const &other);
+	//..or construct each copy yourself, with construct(place, other_object) doing a placement new at 'place':
+	// (every slot's memory exists before the first construct() call, so construct() may relocate() pointers)
+	template< typename Construct >
+	void assign(SlotMap const &other, Construct const &construct);
+
+	//construct a new object (in the lowest free slot) and return it:
+	template< typename... Args >
+	T &emplace_back(Args &&... args);
+	//object most recently added by emplace_back:
+	T &back() { assert(last != -1U && alive(last)); return *element(last); }
+	T const &back() const { assert(last != -1U && alive(last)); return *element(last); }
+
+	//destroy an object (other objects don't move):
+	void erase(Handle const &handle) { assert(get(handle)); erase_index(handle.index); }
+	void erase(T const *object) { erase(handle_of(object)); }
+	//destroy every object (pages are kept for reuse):
+	void clear();
+
+	//look up a handle (nullptr if its object was erased):
+	T *get(Handle const &handle) {
+		return (handle.index < generations.size() && generations[handle.index] == handle.generation ? element(handle.index) : nullptr);
+	}
+	T const *get(Handle const &handle) const { return const_cast< SlotMap * >(this)->get(handle); }
+	//handle for an object stored in this map:
+	Handle handle_of(T const *object) const { uint32_t index = index_of(object); return Handle{index, generations[index]}; }
+	//slot index of an object stored in this map:
+	uint32_t index_of(T const *object) const;
+	//for maps copied slot-for-slot (see assign()): the object in this map in the same slot as 'object' in 'from':
+	// (nullptr for nullptr; the object needn't be constructed yet)
+	T *relocate(SlotMap const &from, T const *object) const {
+		return (object ? element(from.index_of(object)) : nullptr);
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	//slots by index, for splitting a walk over the map into ranges (e.g., across threads):
+	uint32_t slots() const { return uint32_t(generations.size()); }
+	T *slot(uint32_t index) { return (alive(index) ? element(index) : nullptr); } //(nullptr if the slot is free)
+	T const *slot(uint32_t index) const { return (alive(index) ? element(index) : nullptr); }
+	Handle handle_at(uint32_t index) const { return Handle{index, generations[index]}; } //(a dead handle if the slot is free)
+
+	//iterate over objects in slot order:
+	template< typename Map, typename Value >
+	struct Iterator {
+		Map *map;
+		uint32_t index;
+		Value &operator*() const { return *map->element(index); }
+		Value *operator->() const { return map->element(index); }
+		Iterator &operator++() {
+			do { ++index; } while (index < map->generations.size() && !map->alive(index));
+			return *this;
+		}
+		bool operator==(Iterator const &other) const { return index == other.index; }
+		bool operator!=(Iterator const &other) const { return index != other.index; }
+	};
+	using iterator = Iterator< SlotMap, T >;
+	using const_iterator = Iterator< SlotMap const, T const >;
+	iterator begin() { return iterator{this, first_alive()}; }
+	iterator end() { return iterator{this, uint32_t(generations.size())}; }
+	const_iterator begin() const { return const_iterator{this, first_alive()}; }
+	const_iterator end() const { return const_iterator{this, uint32_t(generations.size())}; }
+
+	//--- internals ---
+	struct Page {
+		alignas(T) unsigned char bytes[PageSize * sizeof(T)];
+	};
+	std::vector< std::unique_ptr< Page > > pages;
+	//per slot; odd generations hold an object, even generations are free:
+	std::vector< uint32_t > generations;
+	std::priority_queue< uint32_t, std::vector< uint32_t >, std::greater< uint32_t > > free_slots;
+	std::vector< std::pair< uintptr_t, uint32_t > > page_addresses; //(page start, page index), sorted (for handle_of)
+	size_t count = 0;
+	uint32_t last = -1U; //slot of last emplace_back
+
+	bool alive(uint32_t index) const { return (generations[index] & 1) != 0; }
+	T *element(uint32_t index) const {
+		return reinterpret_cast< T * >(pages[index / PageSize]->bytes) + (index % PageSize);
+	}
+	uint32_t first_alive() const {
+		uint32_t index = 0;
+		while (index < generations.size() && !alive(index)) ++index;
+		return index;
+	}
+	uint32_t add_slot(); //add a (free) slot at the end, adding a page if needed
+	uint32_t allocate_slot(); //take the lowest free slot (or add one)
+	void erase_index(uint32_t index);
+};
+
+template< typename T >
+uint32_t SlotMap< T >::add_slot() {
+	uint32_t index = uint32_t(generations.size());
+	if (index % PageSize == 0) {
+		pages.emplace_back(new Page); //(not make_unique, which would zero the page first)
+		auto entry = std::make_pair(reinterpret_cast< uintptr_t >(pages.back()->bytes), uint32_t(pages.size() - 1));
+		page_addresses.insert(std::upper_bound(page_addresses.begin(), page_addresses.end(), entry), entry);
+	}
+	generations.emplace_back(0);
+	return index;
+}
+
+template< typename T >
+uint32_t SlotMap< T >::allocate_slot() {
+	if (free_slots.empty()) return add_slot();
+	uint32_t index = free_slots.top();
+	free_slots.pop();
+	assert(!alive(index));
+	return index;
+}
+
+template< typename T >
+template< typename... Args >
+T &SlotMap< T >::emplace_back(Args &&... args) {
+	uint32_t index = allocate_slot();
+	try {
+		new (element(index)) T(std::forward< Args >(args)...);
+	} catch (...) {
+		free_slots.push(index);
+		throw;
+	}
+	generations[index] += 1;
+	count += 1;
+	last = index;
+	return *element(index);
+}
+
+template< typename T >
+void SlotMap< T >::erase_index(uint32_t index) {
+	assert(alive(index));
+	element(index)->~T();
+	generations[index] += 1;
+	count -= 1;
+	free_slots.push(index);
+	if (last == index) last = -1U;
+}
+
+template< typename T >
+void SlotMap< T >::clear() {
+	for (uint32_t index = 0; index < generations.size(); ++index) {
+		if (alive(index)) erase_index(index);
+	}
+	assert(count == 0);
+}
+
+template< typename T >
+uint32_t SlotMap< T >::index_of(T const *object) const {
+	uintptr_t address = reinterpret_cast< uintptr_t >(object);
+	auto after = std::upper_bound(page_addresses.begin(), page_addresses.end(), std::make_pair(address, -1U));
+	assert(after != page_addresses.begin() && "object is stored in this map");
+	--after;
+	assert(address < after->first + sizeof(Page) && "object is stored in this map");
+	uint32_t index = after->second * PageSize + uint32_t((address - after->first) / sizeof(T));
+	assert(index < generations.size() && alive(index) && element(index) == object);
+	return index;
+}
+
+template< typename T >
+SlotMap< T > &SlotMap< T >::operator=(SlotMap const &other) {
+	if (this == &other) return *this;
+	assign(other, [](void *place, T const &object) { new (place) T(object); });
+	return *this;
+}
+
+template< typename T >
+template< typename Construct >
+void SlotMap< T >::assign(SlotMap const &other, Construct const &construct) {
+	assert(this != &other);
+	clear();
+	while (generations.size() < other.generations.size()) {
+		add_slot();
+	}
+	for (uint32_t index = 0; index < other.generations.size(); ++index) {
+		if (other.alive(index)) {
+			construct(static_cast< void * >(element(index)), *other.element(index));
+			count += 1;
+		}
+	}
+	//generations match other's exactly (slots this map had beyond other's size stay free):
+	for (uint32_t index = 0; index < other.generations.size(); ++index) {
+		generations[index] = other.generations[index];
+	}
+	free_slots = decltype(free_slots)();
+	for (uint32_t index = 0; index < generations.size(); ++index) {
+		if (!alive(index)) free_slots.push(index);
+	}
+	last = other.last;
+}
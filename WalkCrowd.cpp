@@ -0,0 +1,294 @@
+#include "WalkCrowd.hpp"
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+WalkCrowd::WalkCrowd(WalkMesh const &walkmesh_, float neighbor_distance_, WorkerPool *workers_)
+	: walkmesh(walkmesh_), workers(workers_), neighbor_distance(neighbor_distance_), cell_size(neighbor_distance_) {
+	assert(neighbor_distance > 0.0f);
+	buckets.resize(64);
+}
+
+uint32_t WalkCrowd::add_agent(WalkPoint const &at, float radius, float max_speed) {
+	uint32_t agent = size();
+	points.resize(agent + 1);
+	points.set(agent, at);
+	positions.emplace_back(walkmesh.to_world_point(at));
+	velocities.emplace_back(0.0f);
+	preferred_velocities.emplace_back(0.0f);
+	radii.emplace_back(radius);
+	max_speeds.emplace_back(max_speed);
+	agent_bucket.emplace_back(-1U);
+	agent_slot.emplace_back(-1U);
+	insert(agent, bucket_of(cell_of(positions[agent])));
+	return agent;
+}
+
+void WalkCrowd::insert(uint32_t agent, uint32_t bucket) {
+	agent_bucket[agent] = bucket;
+	agent_slot[agent] = uint32_t(buckets[bucket].size());
+	buckets[bucket].emplace_back(agent);
+}
+
+void WalkCrowd::remove(uint32_t agent) {
+	//swap-remove, fixing the slot of the agent that moves into the hole:
+	std::vector< uint32_t > &bucket = buckets[agent_bucket[agent]];
+	uint32_t slot = agent_slot[agent];
+	bucket[slot] = bucket.back();
+	agent_slot[bucket[slot]] = slot;
+	bucket.pop_back();
+	agent_bucket[agent] = -1U;
+	agent_slot[agent] = -1U;
+}
+
+void WalkCrowd::update_hash() {
+	//keep (on average) no more than two agents per bucket, so hash collisions stay rare:
+	if (size() > 2 * buckets.size()) {
+		size_t count = buckets.size();
+		while (size() > 2 * count) count *= 2;
+		buckets.assign(count, std::vector< uint32_t >());
+		for (uint32_t agent = 0; agent < size(); ++agent) {
+			insert(agent, bucket_of(cell_of(positions[agent])));
+		}
+		rehashed = size();
+		return;
+	}
+
+	rehashed = 0;
+	for (uint32_t agent = 0; agent < size(); ++agent) {
+		uint32_t bucket = bucket_of(cell_of(positions[agent]));
+		if (bucket == agent_bucket[agent]) continue;
+		remove(agent);
+		insert(agent, bucket);
+		rehashed += 1;
+	}
+}
+
+//--- ORCA ---
+// (following the structure of the RVO2 library's Agent::computeNewVelocity and linearProgram1/2/3)
+
+namespace {
+
+using Line = WalkCrowd::Line;
+
+float det(glm::vec2 const &a, glm::vec2 const &b) {
+	return a.x * b.y - a.y * b.x;
+}
+
+//best point on line 'line' that is inside lines [0, line) and the circle of radius 'radius':
+// (if direction_opt, 'opt' is a direction to go as far as possible in; otherwise the point closest to opt)
+bool linear_program1(std::vector< Line > const &lines, uint32_t line, float radius, glm::vec2 const &opt, bool direction_opt, glm::vec2 *result) {
+	float dot = glm::dot(lines[line].point, lines[line].direction);
+	float discriminant = dot * dot + radius * radius - glm::dot(lines[line].point, lines[line].point);
+	if (discriminant < 0.0f) return false; //circle rules out the whole line
+
+	float root = std::sqrt(discriminant);
+	float t_left = -dot - root;
+	float t_right = -dot + root;
+
+	for (uint32_t i = 0; i < line; ++i) {
+		float denominator = det(lines[line].direction, lines[i].direction);
+		float numerator = det(lines[i].direction, lines[line].point - lines[i].point);
+		if (std::abs(denominator) <= 1e-5f) {
+			//lines are (nearly) parallel:
+			if (numerator < 0.0f) return false;
+			continue;
+		}
+		float t = numerator / denominator;
+		if (denominator >= 0.0f) t_right = std::min(t_right, t);
+		else t_left = std::max(t_left, t);
+		if (t_left > t_right) return false;
+	}
+
+	if (direction_opt) {
+		*result = lines[line].point + (glm::dot(opt, lines[line].direction) > 0.0f ? t_right : t_left) * lines[line].direction;
+	} else {
+		float t = glm::clamp(glm::dot(lines[line].direction, opt - lines[line].point), t_left, t_right);
+		*result = lines[line].point + t * lines[line].direction;
+	}
+	return true;
+}
+
+//best point inside all lines and the circle of radius 'radius'; returns lines.size() on success,
+// or the index of the line that made the program infeasible (with *result the best point before that line):
+uint32_t linear_program2(std::vector< Line > const &lines, float radius, glm::vec2 const &opt, bool direction_opt, glm::vec2 *result_) {
+	assert(result_);
+	auto &result = *result_;
+
+	if (direction_opt) {
+		result = opt * radius;
+	} else if (glm::dot(opt, opt) > radius * radius) {
+		result = glm::normalize(opt) * radius;
+	} else {
+		result = opt;
+	}
+
+	for (uint32_t i = 0; i < lines.size(); ++i) {
+		if (det(lines[i].direction, lines[i].point - result) > 0.0f) {
+			//result is on the wrong side of line i, so the best point is on line i:
+			glm::vec2 before = result;
+			if (!linear_program1(lines, i, radius, opt, direction_opt, &result)) {
+				result = before;
+				return i;
+			}
+		}
+	}
+	return uint32_t(lines.size());
+}
+
+//when linear_program2 fails (starting at line 'begin'), find the point that violates all lines by the least:
+void linear_program3(std::vector< Line > const &lines, uint32_t begin, float radius, std::vector< Line > *projected_, glm::vec2 *result_) {
+	assert(projected_);
+	auto &projected = *projected_;
+	assert(result_);
+	auto &result = *result_;
+
+	float distance = 0.0f;
+	for (uint32_t i = begin; i < lines.size(); ++i) {
+		if (det(lines[i].direction, lines[i].point - result) <= distance) continue;
+
+		//result violates line i by more than the current worst; find the best point with line i relaxed as much as the others:
+		projected.clear();
+		for (uint32_t j = 0; j < i; ++j) {
+			Line line;
+			float determinant = det(lines[i].direction, lines[j].direction);
+			if (std::abs(determinant) <= 1e-5f) {
+				if (glm::dot(lines[i].direction, lines[j].direction) > 0.0f) continue; //same direction
+				line.point = 0.5f * (lines[i].point + lines[j].point); //opposite direction
+			} else {
+				line.point = lines[i].point + (det(lines[j].direction, lines[i].point - lines[j].point) / determinant) * lines[i].direction;
+			}
+			line.direction = glm::normalize(lines[j].direction - lines[i].direction);
+			projected.emplace_back(line);
+		}
+
+		glm::vec2 before = result;
+		if (linear_program2(projected, radius, glm::vec2(-lines[i].direction.y, lines[i].direction.x), true, &result) < projected.size()) {
+			//(only fails because of rounding; keep the previous result)
+			result = before;
+		}
+		distance = det(lines[i].direction, lines[i].point - result);
+	}
+}
+
+//call fn(begin, end) on chunks of [0, count), each 'grain' long: split across workers if there are any, else in order:
+void split(WorkerPool *workers, uint32_t count, uint32_t grain, std::function< void(uint32_t, uint32_t) > const &fn) {
+	if (workers) {
+		workers->parallel_for(count, fn, grain);
+	} else {
+		for (uint32_t begin = 0; begin < count; begin += grain) {
+			fn(begin, std::min(count, begin + grain));
+		}
+	}
+}
+
+} //namespace
+
+void WalkCrowd::step(float elapsed) {
+	assert(elapsed > 0.0f);
+	update_hash();
+
+	//chunks of agents (a few per thread); the grain only changes with the crowd's size, so
+	// each chunk's scratch vectors keep their capacity from step to step:
+	uint32_t grain = std::max(1U, size());
+	if (workers) grain = std::max(16U, (size() + workers->size() * 4 - 1) / (workers->size() * 4));
+	uint32_t chunks = (size() + grain - 1) / grain;
+	if (scratch.size() < chunks) scratch.resize(chunks);
+
+	//pick new velocities (reading only last step's positions and velocities):
+	next_velocities.resize(size());
+	split(workers, size(), grain, [&](uint32_t begin, uint32_t end) {
+		Scratch &chunk = scratch[begin / grain];
+		auto &neighbors = chunk.neighbors;
+		auto &lines = chunk.lines;
+		auto &projected = chunk.projected;
+		for (uint32_t a = begin; a < end; ++a) {
+			if (!avoidance) {
+				glm::vec2 v = preferred_velocities[a];
+				float speed = glm::length(v);
+				next_velocities[a] = (speed > max_speeds[a] ? v * (max_speeds[a] / speed) : v);
+				continue;
+			}
+
+			//closest neighbors:
+			neighbors.clear();
+			for_each_near(positions[a], neighbor_distance, [&](uint32_t b) {
+				if (b == a) return;
+				glm::vec3 to = positions[b] - positions[a];
+				float dis2 = glm::dot(to, to);
+				if (neighbors.size() == max_neighbors && dis2 >= neighbors.back().first) return;
+				if (neighbors.size() == max_neighbors) neighbors.pop_back();
+				auto at = std::upper_bound(neighbors.begin(), neighbors.end(), std::make_pair(dis2, b));
+				neighbors.insert(at, std::make_pair(dis2, b));
+			});
+
+			//one half-plane of allowed velocities per neighbor (each agent takes half the responsibility):
+			lines.clear();
+			glm::vec2 velocity = velocities[a];
+			for (auto const &[dis2_3d, b] : neighbors) {
+				glm::vec2 relative_position = glm::vec2(positions[b] - positions[a]);
+				glm::vec2 relative_velocity = velocity - velocities[b];
+				float dis2 = glm::dot(relative_position, relative_position);
+				float combined_radius = radii[a] + radii[b];
+				float combined_radius2 = combined_radius * combined_radius;
+
+				Line line;
+				glm::vec2 u;
+				if (dis2 > combined_radius2) {
+					//no collision yet; vector from cutoff center to relative velocity:
+					glm::vec2 w = relative_velocity - relative_position / time_horizon;
+					float w_length2 = glm::dot(w, w);
+					float dot1 = glm::dot(w, relative_position);
+					if (dot1 < 0.0f && dot1 * dot1 > combined_radius2 * w_length2) {
+						//project on cut-off circle:
+						float w_length = std::sqrt(w_length2);
+						glm::vec2 unit_w = w / w_length;
+						line.direction = glm::vec2(unit_w.y, -unit_w.x);
+						u = (combined_radius / time_horizon - w_length) * unit_w;
+					} else {
+						//project on legs:
+						float leg = std::sqrt(dis2 - combined_radius2);
+						if (det(relative_position, w) > 0.0f) {
+							line.direction = glm::vec2(relative_position.x * leg - relative_position.y * combined_radius, relative_position.x * combined_radius + relative_position.y * leg) / dis2;
+						} else {
+							line.direction = -glm::vec2(relative_position.x * leg + relative_position.y * combined_radius, -relative_position.x * combined_radius + relative_position.y * leg) / dis2;
+						}
+						u = glm::dot(relative_velocity, line.direction) * line.direction - relative_velocity;
+					}
+				} else {
+					//already overlapping; get apart within this step:
+					glm::vec2 w = relative_velocity - relative_position / elapsed;
+					float w_length = glm::length(w);
+					//(agents exactly on top of each other with matching velocities split along x, by index)
+					glm::vec2 unit_w = (w_length > 0.0f ? w / w_length : glm::vec2(a < b ? 1.0f : -1.0f, 0.0f));
+					line.direction = glm::vec2(unit_w.y, -unit_w.x);
+					u = (combined_radius / elapsed - w_length) * unit_w;
+				}
+				line.point = velocity + 0.5f * u;
+				lines.emplace_back(line);
+			}
+
+			glm::vec2 result;
+			uint32_t failed = linear_program2(lines, max_speeds[a], preferred_velocities[a], false, &result);
+			if (failed < lines.size()) {
+				linear_program3(lines, failed, max_speeds[a], &projected, &result);
+			}
+			next_velocities[a] = result;
+		}
+	});
+
+	//walk (each agent only touches its own state):
+	split(workers, size(), grain, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t a = begin; a < end; ++a) {
+			WalkPoint at = points.get(a);
+			walkmesh.walk(&at, glm::vec3(next_velocities[a] * elapsed, 0.0f));
+			points.set(a, at);
+			glm::vec3 position = walkmesh.to_world_point(at);
+			//(actual velocity, after sliding along walls:)
+			velocities[a] = glm::vec2(position - positions[a]) / elapsed;
+			positions[a] = position;
+		}
+	});
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+/*
+ * A "WalkCrowd" moves many agents over a WalkMesh while keeping them from
+ *  walking through each other.
+ *
+ * Each call to step():
+ *  1. updates the spatial hash -- a uniform grid of cells (in xy) hashed into a
+ *     fixed number of buckets -- moving only the agents that changed cells
+ *  2. picks each agent a new velocity, as close as possible to its preferred
+ *     velocity, that avoids its nearest neighbors for 'time_horizon' seconds,
+ *     using optimal reciprocal collision avoidance ("ORCA": van den Berg, Guy,
+ *     Lin, and Manocha, "Reciprocal n-Body Collision Avoidance", 2011) in xy;
+ *     agents that already overlap pick velocities that push them apart
+ *  3. walks each agent along the mesh at its new velocity
+ *
+ * Steps 2 and 3 only read the previous step's positions and velocities, so they
+ *  are split across a WorkerPool's threads, and results don't depend on the
+ *  thread count.
+ *
+ */
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct WorkerPool;
+
+struct WalkCrowd {
+	//crowd on 'walkmesh', looking for neighbors within 'neighbor_distance':
+	// (workers, if given, run each step -- pass the program's long-lived pool; they must outlive the crowd)
+	WalkCrowd(WalkMesh const &walkmesh, float neighbor_distance, WorkerPool *workers = nullptr);
+
+	WalkMesh const &walkmesh;
+	WorkerPool *workers;
+
+	//parameters:
+	float neighbor_distance; //agents farther apart than this don't react to each other (also the hash's cell size)
+	uint32_t max_neighbors = 10; //each agent avoids (at most) this many of its closest neighbors
+	float time_horizon = 1.0f; //seconds ahead that velocities are chosen to be collision-free
+	bool avoidance = true; //false walks every agent at its preferred velocity (for comparison)
+
+	//add an agent at 'at' and return its index:
+	uint32_t add_agent(WalkPoint const &at, float radius, float max_speed);
+	uint32_t size() const { return uint32_t(radii.size()); }
+
+	//per-agent state (indexed by agent):
+	WalkPoints points; //location on walkmesh
+	std::vector< glm::vec3 > positions; //world position (walkmesh.to_world_point(points.get(i)))
+	std::vector< glm::vec2 > velocities; //velocity over the last step (in xy)
+	std::vector< glm::vec2 > preferred_velocities; //where each agent wants to go (in xy); set before calling step
+	std::vector< float > radii;
+	std::vector< float > max_speeds;
+
+	//advance all agents by 'elapsed' seconds:
+	void step(float elapsed);
+
+	//call fn(agent) for every agent within 'distance' (<= neighbor_distance) of 'position':
+	template< typename F >
+	void for_each_near(glm::vec3 const &position, float distance, F const &fn) const;
+
+	//--- counters (for benchmarking) ---
+	uint32_t rehashed = 0; //agents that changed buckets in the last step
+
+	//--- internals ---
+
+	//spatial hash; agent i is at buckets[agent_bucket[i]][agent_slot[i]]:
+	float cell_size;
+	std::vector< std::vector< uint32_t > > buckets; //size is a power of two
+	std::vector< uint32_t > agent_bucket, agent_slot;
+	glm::ivec2 cell_of(glm::vec3 const &position) const {
+		return glm::ivec2(glm::floor(glm::vec2(position) / cell_size));
+	}
+	uint32_t bucket_of(glm::ivec2 const &cell) const {
+		//(large odd constants mix x and y, as in Teschner et al.'s spatial hash)
+		return (uint32_t(cell.x) * 73856093U ^ uint32_t(cell.y) * 19349663U) & uint32_t(buckets.size() - 1);
+	}
+	void insert(uint32_t agent, uint32_t bucket);
+	void remove(uint32_t agent);
+	void update_hash(); //move agents that changed buckets (and grow the table if it got crowded)
+
+	std::vector< glm::vec2 > next_velocities; //chosen by step() from the previous step's state
+
+	//velocities allowed by one neighbor: the half-plane to the left of 'direction' through 'point':
+	struct Line {
+		glm::vec2 point;
+		glm::vec2 direction;
+	};
+	//scratch space for choosing velocities, one per chunk of agents (chunk begin / grain), kept between steps:
+	struct Scratch {
+		std::vector< std::pair< float, uint32_t > > neighbors; //(distance squared, agent), closest first
+		std::vector< Line > lines, projected;
+	};
+	std::vector< Scratch > scratch;
+};
+
+template< typename F >
+void WalkCrowd::for_each_near(glm::vec3 const &position, float distance, F const &fn) const {
+	assert(distance <= cell_size);
+	glm::ivec2 center = cell_of(position);
+	float distance2 = distance * distance;
+	//(cells are visited by bucket, and neighbouring cells can share a bucket, so skip repeats)
+	uint32_t seen[9];
+	uint32_t seen_count = 0;
+	for (int32_t dy = -1; dy <= 1; ++dy) {
+		for (int32_t dx = -1; dx <= 1; ++dx) {
+			uint32_t bucket = bucket_of(center + glm::ivec2(dx, dy));
+			bool repeat = false;
+			for (uint32_t s = 0; s < seen_count; ++s) repeat = repeat || (seen[s] == bucket);
+			if (repeat) continue;
+			seen[seen_count++] = bucket;
+			for (uint32_t agent : buckets[bucket]) {
+				glm::vec3 to = positions[agent] - position;
+				if (glm::dot(to, to) <= distance2) fn(agent);
+			}
+		}
+	}
+}
@@ -0,0 +1,304 @@
+#include "WalkFlow.hpp"
+#include "WorkerPool.hpp"
+
+#include <glm/gtx/norm.hpp>
+
+#include <cstring>
+#include <limits>
+#include <functional>
+
+//distance at c, given distances da at a and db at b, for a straight path arriving through segment ab:
+// (the fast marching update, in the plane: the path comes from a "virtual source" at distance da from a and
+//  db from b on the other side of ab from c; if that path would miss ab, it goes through a or b instead)
+static float planar_update(glm::vec2 const &a, float da, glm::vec2 const &b, float db, glm::vec2 const &c) {
+	float best = std::min(da + glm::length(c - a), db + glm::length(c - b));
+	if (da == std::numeric_limits< float >::infinity() || db == std::numeric_limits< float >::infinity()) return best;
+
+	//coordinates with a at the origin, b along +x, and c above:
+	float len = glm::length(b - a);
+	if (len == 0.0f) return best;
+	glm::vec2 x = (b - a) / len;
+	float cx = glm::dot(c - a, x);
+	float cy = std::abs(x.x * (c - a).y - x.y * (c - a).x);
+
+	//virtual source (below ab):
+	float sx = (da * da - db * db + len * len) / (2.0f * len);
+	float sy2 = da * da - sx * sx;
+	if (sy2 < 0.0f) return best;
+	float sy = -std::sqrt(sy2);
+
+	//where the line from source to c crosses ab:
+	float cross_x = sx + (cx - sx) * (-sy / (cy - sy));
+	if (!(0.0f <= cross_x && cross_x <= len)) return best;
+
+	return std::min(best, glm::length(glm::vec2(cx - sx, cy - sy)));
+}
+
+//best distance at vertex c over the triangle c,a,b (where a->b is a half-edge of the triangle):
+// (at obtuse corners, updates from a and b alone miss paths that arrive between them, so the triangles
+//  beyond ab are unfolded until one has a vertex in the corner's angle, as suggested by Kimmel and Sethian)
+static float corner_update(WalkMesh const &walkmesh, std::vector< float > const &distances, uint32_t c, uint32_t a, uint32_t b) {
+	auto const &vertices = walkmesh.vertices;
+
+	//lay out triangle in the plane:
+	glm::vec3 ab = vertices[b] - vertices[a];
+	glm::vec3 ac = vertices[c] - vertices[a];
+	float len = glm::length(ab);
+	if (len == 0.0f) return std::min(distances[a] + glm::length(ac), distances[b] + glm::length(vertices[c] - vertices[b]));
+	float along = glm::dot(ac, ab) / len;
+	glm::vec2 A = glm::vec2(0.0f);
+	glm::vec2 B = glm::vec2(len, 0.0f);
+	glm::vec2 C = glm::vec2(along, glm::length(ac - ab * (along / len)));
+
+	float best = planar_update(A, distances[a], B, distances[b], C);
+	if (glm::dot(A - C, B - C) >= 0.0f) return best; //not obtuse
+
+	auto cross = [](glm::vec2 const &u, glm::vec2 const &v) { return u.x * v.y - u.y * v.x; };
+	float turn = cross(A - C, B - C);
+
+	//walk over the triangles beyond ab, keeping p (at P) on a's side of the corner's angle and q (at Q) on b's side:
+	uint32_t p = a, q = b;
+	glm::vec2 P = A, Q = B;
+	for (uint32_t step = 0; step < 8; ++step) {
+		WalkMesh::HalfEdge const *he = walkmesh.find_half_edge(q, p);
+		if (!he) break; //boundary
+		uint32_t r = he->next;
+
+		//unfold r across pq, away from C:
+		glm::vec3 pq = vertices[q] - vertices[p];
+		glm::vec3 pr = vertices[r] - vertices[p];
+		float pq_len = glm::length(pq);
+		float r_along = glm::dot(pr, pq) / pq_len;
+		float r_height = glm::length(pr - pq * (r_along / pq_len));
+		glm::vec2 dir = (Q - P) / glm::length(Q - P);
+		glm::vec2 perp = glm::vec2(-dir.y, dir.x);
+		if (glm::dot(C - P, perp) < 0.0f) perp = -perp;
+		glm::vec2 R = P + r_along * dir - r_height * perp;
+
+		bool past_a = (cross(A - C, R - C) * turn < 0.0f);
+		bool past_b = (cross(R - C, B - C) * turn < 0.0f);
+		if (!past_a && !past_b) {
+			//r splits the corner into two acute-ish corners:
+			if (distances[r] == std::numeric_limits< float >::infinity()) break;
+			best = std::min(best, planar_update(A, distances[a], R, distances[r], C));
+			best = std::min(best, planar_update(R, distances[r], B, distances[b], C));
+			break;
+		} else if (past_a) {
+			p = r; P = R; //angle continues through rq
+		} else {
+			q = r; Q = R; //angle continues through pr
+		}
+	}
+	return best;
+}
+
+//call fn(begin, end) on ranges of [0, count): split across workers if there are any, else all at once:
+static void split(WorkerPool *workers, uint32_t count, std::function< void(uint32_t, uint32_t) > const &fn) {
+	if (workers) workers->parallel_for(count, fn);
+	else fn(0, count);
+}
+
+WalkFlowField::WalkFlowField(WalkMesh const &walkmesh_, WalkPoint const &goal_, WorkerPool *workers) : walkmesh(walkmesh_), goal(goal_) {
+	goal_triangle = walkmesh.find_triangle(goal.indices);
+	assert(goal_triangle < walkmesh.triangles.size() && "goal must be on a walkmesh triangle");
+	goal_point = walkmesh.to_world_point(goal);
+
+	auto const &vertices = walkmesh.vertices;
+	auto &distances = vertex_distances;
+	distances.assign(vertices.size(), std::numeric_limits< float >::infinity());
+
+	//corners of the goal triangle see the goal in a straight line:
+	enum : uint8_t { Idle = 0, Fixed, Active, Candidate };
+	std::vector< uint8_t > state(vertices.size(), Idle);
+	glm::uvec3 const &goal_tri = walkmesh.triangles[goal_triangle];
+	for (uint32_t i = 0; i < 3; ++i) {
+		distances[goal_tri[i]] = glm::length(vertices[goal_tri[i]] - goal_point);
+		state[goal_tri[i]] = Fixed;
+	}
+
+	//best distance for v given its neighbors' current distances:
+	auto solve = [&](uint32_t v) {
+		float best = distances[v];
+		for (uint32_t i = walkmesh.vertex_half_edges[v]; i < walkmesh.vertex_half_edges[v+1]; ++i) {
+			WalkMesh::HalfEdge const &he = walkmesh.half_edges[i];
+			best = std::min(best, corner_update(walkmesh, distances, v, he.to, he.next));
+		}
+		return best;
+	};
+	//is 'value' enough of an improvement on 'old' to keep going?
+	auto improves = [](float value, float old) {
+		return value < old * (1.0f - 1e-6f);
+	};
+
+	std::vector< uint32_t > active, next_active, converged, candidates;
+	std::vector< float > values, candidate_values;
+
+	//add idle neighbors of v to candidates:
+	auto add_neighbors = [&](uint32_t v) {
+		for (uint32_t i = walkmesh.vertex_half_edges[v]; i < walkmesh.vertex_half_edges[v+1]; ++i) {
+			WalkMesh::HalfEdge const &he = walkmesh.half_edges[i];
+			for (uint32_t n : {he.to, he.next}) {
+				if (state[n] != Idle) continue;
+				state[n] = Candidate;
+				candidates.emplace_back(n);
+			}
+		}
+	};
+	for (uint32_t i = 0; i < 3; ++i) {
+		add_neighbors(goal_tri[i]);
+	}
+	for (uint32_t v : candidates) {
+		state[v] = Active;
+	}
+	active.swap(candidates);
+
+	while (!active.empty()) {
+		sweeps += 1;
+
+		//update all active vertices (reading only last sweep's distances):
+		values.resize(active.size());
+		split(workers, uint32_t(active.size()), [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) {
+				values[i] = solve(active[i]);
+			}
+		});
+
+		//converged vertices leave the active list and nominate their neighbors:
+		next_active.clear();
+		converged.clear();
+		for (uint32_t i = 0; i < active.size(); ++i) {
+			uint32_t v = active[i];
+			if (improves(values[i], distances[v])) {
+				next_active.emplace_back(v);
+			} else {
+				converged.emplace_back(v);
+				state[v] = Idle;
+			}
+			distances[v] = values[i];
+		}
+		candidates.clear();
+		for (uint32_t v : converged) {
+			add_neighbors(v);
+		}
+
+		//neighbors that improve become active:
+		candidate_values.resize(candidates.size());
+		split(workers, uint32_t(candidates.size()), [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) {
+				candidate_values[i] = solve(candidates[i]);
+			}
+		});
+		for (uint32_t i = 0; i < candidates.size(); ++i) {
+			uint32_t v = candidates[i];
+			if (improves(candidate_values[i], distances[v])) {
+				distances[v] = candidate_values[i];
+				state[v] = Active;
+				next_active.emplace_back(v);
+			} else {
+				state[v] = Idle;
+			}
+		}
+
+		active.swap(next_active);
+	}
+
+	//direction in each triangle is down the gradient of the (linearly interpolated) distance:
+	triangle_directions.resize(walkmesh.triangles.size());
+	split(workers, uint32_t(walkmesh.triangles.size()), [&](uint32_t begin, uint32_t end) {
+		for (uint32_t t = begin; t < end; ++t) {
+			glm::uvec3 const &tri = walkmesh.triangles[t];
+			glm::vec3 d = glm::vec3(distances[tri.x], distances[tri.y], distances[tri.z]);
+			glm::vec3 gradient = walkmesh.triangle_frames[t].to_barycentric * d;
+			float length = glm::length(gradient);
+			if (!(length > 0.0f) || length == std::numeric_limits< float >::infinity()) {
+				triangle_directions[t] = glm::vec3(0.0f);
+			} else {
+				triangle_directions[t] = gradient / -length;
+			}
+		}
+	});
+}
+
+float WalkFlowField::distance(WalkPoint const &at) const {
+	uint32_t t = walkmesh.find_triangle(at.indices);
+	assert(t < walkmesh.triangles.size() && "walkpoint must be on a walkmesh triangle");
+	if (t == goal_triangle) {
+		return glm::length(goal_point - walkmesh.to_world_point(at));
+	}
+
+	//rather than interpolating vertex distances (which overestimates inside triangles), apply the
+	// vertex update to 'at' through each edge of its triangle:
+	glm::vec3 const &a = walkmesh.vertices[at.indices.x];
+	glm::vec3 const &b = walkmesh.vertices[at.indices.y];
+	glm::vec3 const &c = walkmesh.vertices[at.indices.z];
+	float len = glm::length(b - a);
+	float along = (len > 0.0f ? glm::dot(c - a, b - a) / len : 0.0f);
+	glm::vec2 A = glm::vec2(0.0f);
+	glm::vec2 B = glm::vec2(len, 0.0f);
+	glm::vec2 C = glm::vec2(along, std::sqrt(std::max(0.0f, glm::dot(c - a, c - a) - along * along)));
+	glm::vec2 P = at.weights.x * A + at.weights.y * B + at.weights.z * C;
+
+	float da = vertex_distances[at.indices.x];
+	float db = vertex_distances[at.indices.y];
+	float dc = vertex_distances[at.indices.z];
+	return std::min(planar_update(A, da, B, db, P), std::min(planar_update(B, db, C, dc, P), planar_update(C, dc, A, da, P)));
+}
+
+glm::vec3 WalkFlowField::direction(WalkPoint const &at) const {
+	uint32_t t = walkmesh.find_triangle(at.indices);
+	assert(t < walkmesh.triangles.size() && "walkpoint must be on a walkmesh triangle");
+	if (t == goal_triangle) {
+		//in the goal's triangle, head straight there:
+		glm::vec3 to = goal_point - walkmesh.to_world_point(at);
+		float length = glm::length(to);
+		if (length < 1e-6f) return glm::vec3(0.0f);
+		return to / length;
+	}
+	return triangle_directions[t];
+}
+
+//------------------------------------------
+
+WalkFlowFields::WalkFlowFields(WalkMesh const &walkmesh_, uint32_t capacity_, WorkerPool *workers_) : walkmesh(walkmesh_), capacity(capacity_), workers(workers_) {
+	assert(capacity > 0);
+}
+
+size_t WalkFlowFields::KeyHash::operator()(Key const &key) const {
+	uint32_t words[6] = { key.indices.x, key.indices.y, key.indices.z };
+	std::memcpy(&words[3], &key.weights, sizeof(key.weights));
+	size_t hash = 0;
+	for (uint32_t w : words) {
+		hash ^= std::hash< uint32_t >()(w) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	}
+	return hash;
+}
+
+WalkFlowField const &WalkFlowFields::lookup(WalkPoint const &goal) {
+	//rotate so that the smallest index comes first:
+	Key key{goal.indices, goal.weights};
+	while (key.indices.x > key.indices.y || key.indices.x > key.indices.z) {
+		key.indices = glm::uvec3(key.indices.y, key.indices.z, key.indices.x);
+		key.weights = glm::vec3(key.weights.y, key.weights.z, key.weights.x);
+	}
+
+	lookups += 1;
+	auto f = fields.find(key);
+	if (f != fields.end()) {
+		f->second.last_used = lookups;
+		return *f->second.field;
+	}
+
+	if (fields.size() >= capacity) {
+		auto oldest = fields.begin();
+		for (auto fi = fields.begin(); fi != fields.end(); ++fi) {
+			if (fi->second.last_used < oldest->second.last_used) oldest = fi;
+		}
+		fields.erase(oldest);
+	}
+
+	Entry entry;
+	entry.field.reset(new WalkFlowField(walkmesh, goal, workers));
+	entry.last_used = lookups;
+	auto ret = fields.emplace(key, std::move(entry));
+	return *ret.first->second.field;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+/*
+ * A "WalkFlowField" stores, for one goal on a WalkMesh, the walking distance
+ *  to the goal from every vertex and the direction to head in every triangle.
+ * Many agents heading to the same goal can then each look up their next step
+ *  in O(1) instead of running their own path query.
+ *
+ * Distances are computed with the "fast iterative method" (Jeong and Whitaker):
+ *  fast marching's triangle update applied to an active list of vertices, with
+ *  the updates in each sweep split across a WorkerPool's threads. Each sweep reads
+ *  only the previous sweep's distances, so results don't depend on the thread count.
+ *
+ * "WalkFlowFields" caches fields by goal so they can be reused across frames.
+ *
+ */
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+
+struct WorkerPool;
+
+struct WalkFlowField {
+	//build a field leading to 'goal' on 'walkmesh':
+	// (workers, if given, run the sweeps -- pass the program's long-lived pool; without them, sweeps run on the calling thread)
+	WalkFlowField(WalkMesh const &walkmesh, WalkPoint const &goal, WorkerPool *workers = nullptr);
+
+	WalkMesh const &walkmesh;
+	WalkPoint goal;
+	glm::vec3 goal_point; //goal in world space
+	uint32_t goal_triangle;
+
+	//walking distance from each vertex to the goal (infinity if the goal can't be reached):
+	std::vector< float > vertex_distances;
+	//unit direction to walk in each triangle (glm::vec3(0.0f) if the goal can't be reached):
+	std::vector< glm::vec3 > triangle_directions;
+
+	//walking distance from 'at' to the goal:
+	float distance(WalkPoint const &at) const;
+	//unit direction to walk from 'at' (glm::vec3(0.0f) at the goal or if the goal can't be reached):
+	glm::vec3 direction(WalkPoint const &at) const;
+	//step (to pass to WalkMesh::walk) that moves at most 'max_length' toward the goal:
+	glm::vec3 desired_step(WalkPoint const &at, float max_length) const {
+		return direction(at) * std::min(max_length, distance(at));
+	}
+
+	//number of sweeps the distance computation took (for benchmarking):
+	uint32_t sweeps = 0;
+};
+
+struct WalkFlowFields {
+	//cache up to 'capacity' fields for 'walkmesh', building them with 'workers' (if given; they must outlive the cache):
+	WalkFlowFields(WalkMesh const &walkmesh, uint32_t capacity = 16, WorkerPool *workers = nullptr);
+
+	WalkMesh const &walkmesh;
+	uint32_t capacity;
+	WorkerPool *workers;
+
+	//get the field leading to 'goal', building it if it isn't cached:
+	// (the least recently used field is dropped when the cache is full, so the returned reference
+	//  stays valid until at least 'capacity' other goals have been looked up)
+	WalkFlowField const &lookup(WalkPoint const &goal);
+
+	//drop all cached fields (e.g., after changing walkmesh):
+	void clear() { fields.clear(); }
+
+	//--- internals ---
+
+	//goals are keyed exactly, with indices rotated so the smallest index comes first:
+	struct Key {
+		glm::uvec3 indices;
+		glm::vec3 weights;
+		bool operator==(Key const &other) const { return indices == other.indices && weights == other.weights; }
+	};
+	struct KeyHash {
+		size_t operator()(Key const &key) const;
+	};
+	struct Entry {
+		std::unique_ptr< WalkFlowField > field;
+		uint64_t last_used = 0;
+	};
+	std::unordered_map< Key, Entry, KeyHash > fields;
+	uint64_t lookups = 0;
+};
@@ -0,0 +1,178 @@
+#include "WalkHeightGrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	//twice the signed area of triangle (o, a, b) in xy:
+	float cross2(glm::vec2 const &a, glm::vec2 const &b) {
+		return a.x * b.y - a.y * b.x;
+	}
+}
+
+WalkHeightGrid::WalkHeightGrid(WalkMesh const &walkmesh_, float cell_size_) : walkmesh(walkmesh_), cell_size(cell_size_) {
+	glm::vec2 max = glm::vec2(-std::numeric_limits< float >::infinity());
+	min = glm::vec2( std::numeric_limits< float >::infinity());
+	for (auto const &v : walkmesh.vertices) {
+		min = glm::min(min, glm::vec2(v));
+		max = glm::max(max, glm::vec2(v));
+	}
+	if (walkmesh.vertices.empty()) {
+		min = max = glm::vec2(0.0f);
+	}
+
+	glm::vec2 size = max - min;
+	if (cell_size <= 0.0f) {
+		//about one cell per triangle:
+		cell_size = std::sqrt(size.x * size.y / float(std::max< size_t >(1, walkmesh.triangles.size())));
+		if (!(cell_size > 0.0f)) cell_size = std::max(std::max(size.x, size.y), 1.0f); //(flat line or empty mesh)
+	}
+	//(keep the cell table a sensible size even if asked for tiny cells)
+	const float MaxCells = float(1 << 22);
+	if ((size.x / cell_size + 1.0f) * (size.y / cell_size + 1.0f) > MaxCells) {
+		cell_size = std::sqrt(size.x * size.y / MaxCells) * 1.01f;
+	}
+	cells = glm::uvec2(glm::floor(size / cell_size)) + glm::uvec2(1);
+
+	//cells overlapped by a triangle's xy bounds (triangles with no area from above can't be stood on, so are skipped):
+	auto cell_range = [&](uint32_t triangle, glm::uvec2 *lo, glm::uvec2 *hi) -> bool {
+		glm::uvec3 const &tri = walkmesh.triangles[triangle];
+		glm::vec2 a = glm::vec2(walkmesh.vertices[tri.x]);
+		glm::vec2 b = glm::vec2(walkmesh.vertices[tri.y]);
+		glm::vec2 c = glm::vec2(walkmesh.vertices[tri.z]);
+		if (cross2(b - a, c - a) == 0.0f) return false;
+		glm::vec2 tmin = glm::min(a, glm::min(b, c));
+		glm::vec2 tmax = glm::max(a, glm::max(b, c));
+		*lo = glm::min(glm::uvec2(glm::max((tmin - min) / cell_size, glm::vec2(0.0f))), cells - glm::uvec2(1));
+		*hi = glm::min(glm::uvec2(glm::max((tmax - min) / cell_size, glm::vec2(0.0f))), cells - glm::uvec2(1));
+		return true;
+	};
+
+	//count triangles per cell, then fill (in triangle order):
+	cell_begin.assign(size_t(cells.x) * cells.y + 1, 0);
+	for (uint32_t t = 0; t < walkmesh.triangles.size(); ++t) {
+		glm::uvec2 lo, hi;
+		if (!cell_range(t, &lo, &hi)) continue;
+		for (uint32_t y = lo.y; y <= hi.y; ++y) {
+			for (uint32_t x = lo.x; x <= hi.x; ++x) {
+				cell_begin[y * cells.x + x + 1] += 1;
+			}
+		}
+	}
+	for (uint32_t c = 0; c + 1 < cell_begin.size(); ++c) {
+		cell_begin[c + 1] += cell_begin[c];
+	}
+	cell_triangles.resize(cell_begin.back());
+	std::vector< uint32_t > fill(cell_begin.begin(), cell_begin.end() - 1);
+	for (uint32_t t = 0; t < walkmesh.triangles.size(); ++t) {
+		glm::uvec2 lo, hi;
+		if (!cell_range(t, &lo, &hi)) continue;
+		for (uint32_t y = lo.y; y <= hi.y; ++y) {
+			for (uint32_t x = lo.x; x <= hi.x; ++x) {
+				cell_triangles[fill[y * cells.x + x]++] = t;
+			}
+		}
+	}
+}
+
+uint32_t WalkHeightGrid::cell_of(glm::vec2 const &xy) const {
+	glm::vec2 at = (xy - min) / cell_size;
+	//(written so NaN lands outside too)
+	if (!(at.x >= 0.0f && at.y >= 0.0f && at.x < float(cells.x) && at.y < float(cells.y))) return -1U;
+	glm::uvec2 cell = glm::min(glm::uvec2(at), cells - glm::uvec2(1));
+	return cell.y * cells.x + cell.x;
+}
+
+void WalkHeightGrid::check_triangle(uint32_t triangle, glm::vec2 const &xy, float max_z, float *best_z, WalkPoint *at) const {
+	glm::uvec3 const &tri = walkmesh.triangles[triangle];
+	glm::vec3 const &a = walkmesh.vertices[tri.x];
+	glm::vec3 const &b = walkmesh.vertices[tri.y];
+	glm::vec3 const &c = walkmesh.vertices[tri.z];
+
+	//signed areas opposite each corner; a shared edge gives exactly opposite values in the triangles on each side,
+	// so points on it are never missed by both:
+	float wa = cross2(glm::vec2(b) - xy, glm::vec2(c) - xy);
+	float wb = cross2(glm::vec2(c) - xy, glm::vec2(a) - xy);
+	float wc = cross2(glm::vec2(a) - xy, glm::vec2(b) - xy);
+	float sum = wa + wb + wc;
+	//(triangles facing down, e.g. under an overhang, wind the other way from above)
+	if (sum > 0.0f) {
+		if (wa < 0.0f || wb < 0.0f || wc < 0.0f) return;
+	} else if (sum < 0.0f) {
+		if (wa > 0.0f || wb > 0.0f || wc > 0.0f) return;
+	} else {
+		return;
+	}
+
+	glm::vec3 weights = glm::vec3(wa, wb, wc) / sum;
+	float z = weights.x * a.z + weights.y * b.z + weights.z * c.z;
+	if (z > max_z || z <= *best_z) return;
+	*best_z = z;
+	*at = WalkPoint(tri, weights);
+}
+
+bool WalkHeightGrid::ground(glm::vec2 const &xy, WalkPoint *at, float max_z) const {
+	assert(at);
+	uint32_t cell = cell_of(xy);
+	if (cell == -1U) return false;
+
+	float best_z = -std::numeric_limits< float >::infinity();
+	for (uint32_t i = cell_begin[cell]; i < cell_begin[cell + 1]; ++i) {
+		check_triangle(cell_triangles[i], xy, max_z, &best_z, at);
+	}
+	return best_z != -std::numeric_limits< float >::infinity();
+}
+
+bool WalkHeightGrid::ground_linear(glm::vec2 const &xy, WalkPoint *at, float max_z) const {
+	assert(at);
+	float best_z = -std::numeric_limits< float >::infinity();
+	for (uint32_t t = 0; t < walkmesh.triangles.size(); ++t) {
+		check_triangle(t, xy, max_z, &best_z, at);
+	}
+	return best_z != -std::numeric_limits< float >::infinity();
+}
+
+bool WalkHeightGrid::height_at(glm::vec2 const &xy, float *height, glm::vec3 *normal, float max_z) const {
+	assert(height);
+	WalkPoint at;
+	if (!ground(xy, &at, max_z)) return false;
+	*height = walkmesh.to_world_point(at).z;
+	if (normal) *normal = walkmesh.to_world_smooth_normal(at);
+	return true;
+}
+
+void WalkHeightGrid::height_batch(std::vector< glm::vec3 > const &points, std::vector< float > *heights_, std::vector< glm::vec3 > *normals) const {
+	assert(heights_);
+	auto &heights = *heights_;
+
+	heights.assign(points.size(), -std::numeric_limits< float >::infinity());
+	if (normals) normals->assign(points.size(), glm::vec3(0.0f));
+
+	//sort queries by cell (counting sort; points outside the grid are dropped since they can't hit anything):
+	std::vector< uint32_t > point_cell(points.size());
+	std::vector< uint32_t > cell_count(cell_begin.size(), 0);
+	for (uint32_t p = 0; p < points.size(); ++p) {
+		point_cell[p] = cell_of(glm::vec2(points[p]));
+		if (point_cell[p] != -1U) cell_count[point_cell[p] + 1] += 1;
+	}
+	for (uint32_t c = 0; c + 1 < cell_count.size(); ++c) {
+		cell_count[c + 1] += cell_count[c];
+	}
+	std::vector< uint32_t > order(cell_count.back());
+	for (uint32_t p = 0; p < points.size(); ++p) {
+		if (point_cell[p] != -1U) order[cell_count[point_cell[p]]++] = p;
+	}
+
+	for (uint32_t p : order) {
+		uint32_t cell = point_cell[p];
+		glm::vec2 xy = glm::vec2(points[p]);
+		float best_z = -std::numeric_limits< float >::infinity();
+		WalkPoint at;
+		for (uint32_t i = cell_begin[cell]; i < cell_begin[cell + 1]; ++i) {
+			check_triangle(cell_triangles[i], xy, points[p].z, &best_z, &at);
+		}
+		if (best_z == -std::numeric_limits< float >::infinity()) continue;
+		heights[p] = walkmesh.to_world_point(at).z;
+		if (normals) (*normals)[p] = walkmesh.to_world_smooth_normal(at);
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+ * A "WalkHeightGrid" answers "where is the walkmesh at (x,y)?" -- e.g., for
+ *  placing props, spawning pickups, or snapping particles to the floor.
+ *
+ * It is a uniform grid over the walkmesh's xy bounds, with each cell listing
+ *  the triangles whose xy bounds overlap it. A query checks only the triangles
+ *  in one cell, so it takes near-constant time however big the mesh is.
+ *
+ * Where the mesh overlaps itself as seen from above (bridges, stairs over
+ *  floors), queries take a 'max_z' and return the highest surface at or below it.
+ *
+ */
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <limits>
+
+struct WalkHeightGrid {
+	//build a grid over 'walkmesh' with square cells 'cell_size' on a side:
+	// (cell_size == 0 picks a size that puts about one triangle in each cell)
+	WalkHeightGrid(WalkMesh const &walkmesh, float cell_size = 0.0f);
+
+	WalkMesh const &walkmesh;
+
+	//find the highest point of the walkmesh at 'xy' that is no higher than 'max_z':
+	// returns true and sets *at if there is one; returns false (leaving *at alone) otherwise
+	bool ground(glm::vec2 const &xy, WalkPoint *at, float max_z = std::numeric_limits< float >::infinity()) const;
+
+	//height and (smoothed) normal of the ground at 'xy' (as in ground()):
+	// returns false, leaving *height and *normal alone, if there is no ground there
+	bool height_at(glm::vec2 const &xy, float *height, glm::vec3 *normal = nullptr, float max_z = std::numeric_limits< float >::infinity()) const;
+
+	//height and normal at many points at once, using each point's z as its max_z:
+	// - equivalent to calling height_at for each point, except that misses get height -infinity and normal glm::vec3(0.0f)
+	// - queries are answered in cell order, so each cell's triangles are read once per batch rather than once per query
+	// (normals may be nullptr)
+	void height_batch(std::vector< glm::vec3 > const &points, std::vector< float > *heights, std::vector< glm::vec3 > *normals = nullptr) const;
+
+	//reference version of ground that checks every triangle:
+	// (useful for testing and benchmarking)
+	bool ground_linear(glm::vec2 const &xy, WalkPoint *at, float max_z = std::numeric_limits< float >::infinity()) const;
+
+	//--- internals ---
+
+	glm::vec2 min; //corner of cell (0,0)
+	float cell_size;
+	glm::uvec2 cells; //number of cells in x and y
+	//triangles overlapping cell (x,y) are cell_triangles[cell_begin[c]] .. cell_triangles[cell_begin[c+1]-1], c = y * cells.x + x:
+	// (in increasing order, so ties between triangles go the same way as in ground_linear)
+	std::vector< uint32_t > cell_begin;
+	std::vector< uint32_t > cell_triangles;
+
+	//cell containing 'xy' (-1U if outside the grid):
+	uint32_t cell_of(glm::vec2 const &xy) const;
+
+	//check whether 'xy' is on triangle 'triangle' as seen from above, below max_z, and higher than *best_z;
+	// if so, update *best_z and *at:
+	void check_triangle(uint32_t triangle, glm::vec2 const &xy, float max_z, float *best_z, WalkPoint *at) const;
+};
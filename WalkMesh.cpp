@@ -1,29 +1,60 @@
 #include "WalkMesh.hpp"
 
 #include "read_write_chunk.hpp"
+#include "Lanes4.hpp"
 
 #include <glm/gtx/norm.hpp>
+#include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/string_cast.hpp>
 
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cmath>
 #include <string>
+#include <functional>
+#include <type_traits>
 
-WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_)
-	: vertices(vertices_), normals(normals_), triangles(triangles_) {
+WalkMesh::WalkMesh(WalkArray< glm::vec3 > vertices_, WalkArray< glm::vec3 > normals_, WalkArray< glm::uvec3 > triangles_, WalkArray< TriangleFrame > triangle_frames_, Clusters clusters_)
+	: vertices(std::move(vertices_)), normals(std::move(normals_)), triangles(std::move(triangles_)), triangle_frames(std::move(triangle_frames_)), clusters(std::move(clusters_)) {
 
-	//construct next_vertex map (maps each edge to the next vertex in the triangle):
-	next_vertex.reserve(triangles.size()*3);
-	auto do_next = [this](uint32_t a, uint32_t b, uint32_t c) {
-		auto ret = next_vertex.insert(std::make_pair(glm::uvec2(a,b), c));
-		assert(ret.second);
-	};
+	//build half-edge table with a counting sort on origin vertex:
+	std::vector< uint32_t > vertex_half_edges_(vertices.size() + 1, 0);
 	for (auto const &tri : triangles) {
-		do_next(tri.x, tri.y, tri.z);
-		do_next(tri.y, tri.z, tri.x);
-		do_next(tri.z, tri.x, tri.y);
+		assert(tri.x < vertices.size() && tri.y < vertices.size() && tri.z < vertices.size());
+		vertex_half_edges_[tri.x + 1] += 1;
+		vertex_half_edges_[tri.y + 1] += 1;
+		vertex_half_edges_[tri.z + 1] += 1;
+	}
+	for (uint32_t v = 0; v < vertices.size(); ++v) {
+		vertex_half_edges_[v+1] += vertex_half_edges_[v];
+	}
+	std::vector< HalfEdge > half_edges_(triangles.size() * 3);
+	{
+		std::vector< uint32_t > fill(vertex_half_edges_.begin(), vertex_half_edges_.end() - 1);
+		for (uint32_t ti = 0; ti < triangles.size(); ++ti) {
+			glm::uvec3 const &tri = triangles[ti];
+			half_edges_[fill[tri.x]++] = HalfEdge{ tri.y, tri.z, ti };
+			half_edges_[fill[tri.y]++] = HalfEdge{ tri.z, tri.x, ti };
+			half_edges_[fill[tri.z]++] = HalfEdge{ tri.x, tri.y, ti };
+		}
+	}
+	vertex_half_edges = std::move(vertex_half_edges_);
+	half_edges = std::move(half_edges_);
+
+	//triangle across each edge is the triangle containing the opposite half-edge:
+	std::vector< glm::uvec3 > triangle_neighbors_(triangles.size(), glm::uvec3(-1U));
+	for (uint32_t ti = 0; ti < triangles.size(); ++ti) {
+		glm::uvec3 const &tri = triangles[ti];
+		for (uint32_t i = 0; i < 3; ++i) {
+			uint32_t a = tri[i];
+			uint32_t b = tri[(i+1)%3];
+			assert(find_half_edge(a, b)->triangle == ti && "each half-edge appears in only one triangle");
+			HalfEdge const *opposite = find_half_edge(b, a);
+			if (opposite) triangle_neighbors_[ti][i] = opposite->triangle;
+		}
 	}
+	triangle_neighbors = std::move(triangle_neighbors_);
 
 	//DEBUG: are vertex normals consistent with geometric normals?
 	for (auto const &tri : triangles) {
@@ -38,6 +69,26 @@ WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::
 
 		assert(da > 0.1f && db > 0.1f && dc > 0.1f);
 	}
+
+	//compute triangle frames if they weren't supplied:
+	if (triangle_frames.empty()) {
+		std::vector< TriangleFrame > triangle_frames_;
+		triangle_frames_.reserve(triangles.size());
+		for (auto const &tri : triangles) {
+			triangle_frames_.emplace_back(make_triangle_frame(vertices[tri.x], vertices[tri.y], vertices[tri.z]));
+		}
+		triangle_frames = std::move(triangle_frames_);
+	}
+	assert(triangle_frames.size() == triangles.size());
+
+	//build bounding volume hierarchy for nearest_walk_point:
+	build_bvh();
+
+	//build clusters for hierarchical pathfinding if they weren't supplied:
+	if (clusters.triangle_cluster.empty()) {
+		build_clusters();
+	}
+	assert(clusters.triangle_cluster.size() == triangles.size());
 }
 
 //project pt to the plane of triangle a,b,c and return the barycentric weights of the projected point:
@@ -53,64 +104,602 @@ glm::vec3 barycentric_weights(glm::vec3 const &a, glm::vec3 const &b, glm::vec3
 	return glm::vec3(A, B, C) / S;
 }
 
+//find the closest point to world_point on triangle tri of walkmesh wm:
+// (dis2 gets the squared distance; if several points tie, the first one checked wins)
+static void closest_on_triangle(WalkMesh const &wm, glm::uvec3 const &tri, glm::vec3 const &world_point, WalkPoint *closest_, float *closest_dis2_) {
+	assert(closest_);
+	auto &closest = *closest_;
+	assert(closest_dis2_);
+	auto &closest_dis2 = *closest_dis2_;
+
+	closest_dis2 = std::numeric_limits< float >::infinity();
+
+	glm::vec3 const &a = wm.vertices[tri.x];
+	glm::vec3 const &b = wm.vertices[tri.y];
+	glm::vec3 const &c = wm.vertices[tri.z];
+
+	//get barycentric coordinates of closest point in the plane of (a,b,c):
+	glm::vec3 coords = barycentric_weights(a,b,c, world_point);
+
+	//is that point inside the triangle?
+	if (coords.x >= 0.0f && coords.y >= 0.0f && coords.z >= 0.0f) {
+		//yes, point is inside triangle.
+		closest_dis2 = glm::length2(world_point - wm.to_world_point(WalkPoint(tri, coords)));
+		closest.indices = tri;
+		closest.weights = coords;
+	} else {
+		//check triangle vertices and edges:
+		auto check_edge = [&world_point, &closest, &closest_dis2, &wm](uint32_t ai, uint32_t bi, uint32_t ci) {
+			glm::vec3 const &a = wm.vertices[ai];
+			glm::vec3 const &b = wm.vertices[bi];
+
+			//find closest point on line segment ab:
+			float along = glm::dot(world_point-a, b-a);
+			float max = glm::dot(b-a, b-a);
+			glm::vec3 pt;
+			glm::vec3 coords;
+			if (along < 0.0f) {
+				pt = a;
+				coords = glm::vec3(1.0f, 0.0f, 0.0f);
+			} else if (along > max) {
+				pt = b;
+				coords = glm::vec3(0.0f, 1.0f, 0.0f);
+			} else {
+				float amt = along / max;
+				pt = glm::mix(a, b, amt);
+				coords = glm::vec3(1.0f - amt, amt, 0.0f);
+			}
+
+			float dis2 = glm::length2(world_point - pt);
+			if (dis2 < closest_dis2) {
+				closest_dis2 = dis2;
+				closest.indices = glm::uvec3(ai, bi, ci);
+				closest.weights = coords;
+			}
+		};
+		check_edge(tri.x, tri.y, tri.z);
+		check_edge(tri.y, tri.z, tri.x);
+		check_edge(tri.z, tri.x, tri.y);
+	}
+}
+
+void WalkMesh::build_bvh() {
+	bvh_nodes = WalkArray< BVHNode >();
+	bvh_triangles = WalkArray< uint32_t >();
+	if (triangles.empty()) return;
+
+	//(built in local vectors, then moved into bvh_nodes and bvh_triangles)
+	std::vector< BVHNode > nodes;
+	std::vector< uint32_t > order;
+
+	//triangle bounds and centroids (used to decide splits):
+	std::vector< glm::vec3 > tri_min, tri_max, tri_center;
+	tri_min.reserve(triangles.size());
+	tri_max.reserve(triangles.size());
+	tri_center.reserve(triangles.size());
+	for (auto const &tri : triangles) {
+		glm::vec3 const &a = vertices[tri.x];
+		glm::vec3 const &b = vertices[tri.y];
+		glm::vec3 const &c = vertices[tri.z];
+		tri_min.emplace_back(glm::min(a, glm::min(b, c)));
+		tri_max.emplace_back(glm::max(a, glm::max(b, c)));
+		tri_center.emplace_back((a + b + c) / 3.0f);
+	}
+
+	order.resize(triangles.size());
+	for (uint32_t ti = 0; ti < triangles.size(); ++ti) {
+		order[ti] = ti;
+	}
+	nodes.reserve(2 * (triangles.size() / LeafSize + 1));
+
+	//recursively split [begin,end) of bvh_triangles at the centroid median along the longest axis:
+	// (nodes are stored depth-first, so the first child of a node always immediately follows it)
+	std::function< void(uint32_t, uint32_t) > build = [&](uint32_t begin, uint32_t end) {
+		uint32_t ni = uint32_t(nodes.size());
+		nodes.emplace_back();
+
+		BVHNode node;
+		glm::vec3 center_min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 center_max = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (uint32_t i = begin; i < end; ++i) {
+			uint32_t ti = order[i];
+			node.min = glm::min(node.min, tri_min[ti]);
+			node.max = glm::max(node.max, tri_max[ti]);
+			center_min = glm::min(center_min, tri_center[ti]);
+			center_max = glm::max(center_max, tri_center[ti]);
+		}
+		//pad bounds a bit so that rounding in the closest-point math never makes pruning drop a triangle:
+		glm::vec3 pad = 1e-5f * (glm::abs(node.min) + glm::abs(node.max) + (node.max - node.min)) + glm::vec3(1e-30f);
+		node.min -= pad;
+		node.max += pad;
+
+		glm::vec3 extent = center_max - center_min;
+		if (end - begin <= LeafSize || (extent.x == 0.0f && extent.y == 0.0f && extent.z == 0.0f)) {
+			node.first = begin;
+			node.count = end - begin;
+			nodes[ni] = node;
+			return;
+		}
+
+		int axis = 0;
+		if (extent.y > extent[axis]) axis = 1;
+		if (extent.z > extent[axis]) axis = 2;
+
+		uint32_t mid = begin + (end - begin) / 2;
+		std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+			[&tri_center, axis](uint32_t a, uint32_t b) {
+				return tri_center[a][axis] < tri_center[b][axis];
+			}
+		);
+
+		build(begin, mid);
+		node.first = uint32_t(nodes.size());
+		node.count = 0;
+		build(mid, end);
+		nodes[ni] = node;
+	};
+	build(0, uint32_t(triangles.size()));
+	assert(std::ceil(std::log2(double(triangles.size()))) + 2 < BVHStack && "queries' stacks are deep enough for this BVH");
+
+	bvh_nodes = std::move(nodes);
+	bvh_triangles = std::move(order);
+}
+
+void WalkMesh::sort_for_locality(std::vector< glm::vec3 > *vertices_, std::vector< glm::vec3 > *normals_, std::vector< glm::uvec3 > *triangles_, std::vector< uint32_t > *triangle_order_, std::vector< uint32_t > *vertex_order_) {
+	assert(vertices_);
+	auto &vertices = *vertices_;
+	assert(normals_);
+	auto &normals = *normals_;
+	assert(triangles_);
+	auto &triangles = *triangles_;
+	assert(normals.size() == vertices.size());
+
+	//Morton code of each triangle's centroid (10 bits per axis, over the bounds of the centroids):
+	std::vector< glm::vec3 > centroids;
+	centroids.reserve(triangles.size());
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (auto const &tri : triangles) {
+		centroids.emplace_back((vertices[tri.x] + vertices[tri.y] + vertices[tri.z]) / 3.0f);
+		min = glm::min(min, centroids.back());
+		max = glm::max(max, centroids.back());
+	}
+	glm::vec3 scale = 1024.0f / glm::max(max - min, glm::vec3(1e-6f));
+
+	//spread the low 10 bits of x out to every third bit:
+	auto spread = [](uint32_t x) {
+		x &= 0x3ff;
+		x = (x | (x << 16)) & 0x030000ff;
+		x = (x | (x << 8)) & 0x0300f00f;
+		x = (x | (x << 4)) & 0x030c30c3;
+		x = (x | (x << 2)) & 0x09249249;
+		return x;
+	};
+
+	std::vector< std::pair< uint32_t, uint32_t > > order; //(code, old index)
+	order.reserve(triangles.size());
+	for (uint32_t ti = 0; ti < triangles.size(); ++ti) {
+		glm::uvec3 q = glm::uvec3(glm::clamp((centroids[ti] - min) * scale, glm::vec3(0.0f), glm::vec3(1023.0f)));
+		order.emplace_back(spread(q.x) | (spread(q.y) << 1) | (spread(q.z) << 2), ti);
+	}
+	std::sort(order.begin(), order.end()); //(ties stay in old order)
+
+	//renumber vertices in order of first use by the sorted triangles:
+	// (corners keep their order, so triangles stay CCW and start at the same corner)
+	std::vector< uint32_t > new_index(vertices.size(), -1U);
+	std::vector< uint32_t > vertex_order;
+	vertex_order.reserve(vertices.size());
+	std::vector< glm::uvec3 > sorted_triangles;
+	sorted_triangles.reserve(triangles.size());
+	for (auto const &[code, ti] : order) {
+		glm::uvec3 tri = triangles[ti];
+		for (uint32_t i = 0; i < 3; ++i) {
+			if (new_index[tri[i]] == -1U) {
+				new_index[tri[i]] = uint32_t(vertex_order.size());
+				vertex_order.emplace_back(tri[i]);
+			}
+			tri[i] = new_index[tri[i]];
+		}
+		sorted_triangles.emplace_back(tri);
+	}
+	//(vertices not used by any triangle go at the end)
+	for (uint32_t v = 0; v < vertices.size(); ++v) {
+		if (new_index[v] == -1U) {
+			new_index[v] = uint32_t(vertex_order.size());
+			vertex_order.emplace_back(v);
+		}
+	}
+
+	std::vector< glm::vec3 > sorted_vertices, sorted_normals;
+	sorted_vertices.reserve(vertices.size());
+	sorted_normals.reserve(normals.size());
+	for (uint32_t v : vertex_order) {
+		sorted_vertices.emplace_back(vertices[v]);
+		sorted_normals.emplace_back(normals[v]);
+	}
+
+	vertices.swap(sorted_vertices);
+	normals.swap(sorted_normals);
+	triangles.swap(sorted_triangles);
+	if (triangle_order_) {
+		triangle_order_->clear();
+		triangle_order_->reserve(order.size());
+		for (auto const &[code, ti] : order) {
+			triangle_order_->emplace_back(ti);
+		}
+	}
+	if (vertex_order_) {
+		vertex_order_->swap(vertex_order);
+	}
+}
+
+WalkMesh::TriangleFrame WalkMesh::make_triangle_frame(glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c) {
+	//with n = (b-a)x(c-a), moving by 'step' changes the weight of each corner by
+	// dot(step, n x (edge opposite the corner, in CCW order)) / |n|^2:
+	glm::vec3 n = glm::cross(b - a, c - a);
+	float inv_n2 = 1.0f / glm::dot(n, n);
+	TriangleFrame frame;
+	frame.to_barycentric = glm::mat3(
+		glm::cross(n, c - b) * inv_n2,
+		glm::cross(n, a - c) * inv_n2,
+		glm::cross(n, b - a) * inv_n2
+	);
+	frame.normal = glm::normalize(n);
+	return frame;
+}
+
+void WalkMesh::build_clusters() {
+	clusters = Clusters();
+	std::vector< uint32_t > triangle_cluster(triangles.size(), -1U);
+
+	//grow clusters breadth-first from seeds taken in triangle order:
+	// (loaded meshes have their triangles in Morton order -- sorted by the exporter or by sort_for_locality --
+	//  so clusters come out spatially compact; scenes/export-walkmeshes.py seeds the same way, so baked and
+	//  runtime-built clusters of the same triangles are identical)
+	std::vector< uint32_t > members; //triangles, grouped by cluster
+	std::vector< uint32_t > members_begin; //start of each cluster's triangles in members
+	members.reserve(triangles.size());
+	for (uint32_t seed = 0; seed < triangles.size(); ++seed) {
+		if (triangle_cluster[seed] != -1U) continue;
+		uint32_t cluster = uint32_t(members_begin.size());
+		uint32_t begin = uint32_t(members.size());
+		members_begin.emplace_back(begin);
+
+		triangle_cluster[seed] = cluster;
+		members.emplace_back(seed);
+		for (uint32_t i = begin; i < members.size(); ++i) {
+			glm::uvec3 const &neighbors = triangle_neighbors[members[i]];
+			for (uint32_t e = 0; e < 3; ++e) {
+				if (members.size() - begin >= ClusterSize) break;
+				if (neighbors[e] == -1U || triangle_cluster[neighbors[e]] != -1U) continue;
+				triangle_cluster[neighbors[e]] = cluster;
+				members.emplace_back(neighbors[e]);
+			}
+		}
+	}
+	members_begin.emplace_back(uint32_t(members.size()));
+	assert(members.size() == triangles.size());
+
+	//each pair of neighboring clusters gets one portal on each side, placed at the shared edge
+	// closest to the middle of their boundary (this keeps the cluster graph small):
+	struct BoundaryEdge {
+		uint32_t cluster, other; //cluster < other
+		uint32_t triangle, edge; //edge of a triangle in 'cluster'
+	};
+	std::vector< BoundaryEdge > boundary;
+	for (uint32_t t = 0; t < triangles.size(); ++t) {
+		for (uint32_t e = 0; e < 3; ++e) {
+			uint32_t n = triangle_neighbors[t][e];
+			if (n != -1U && triangle_cluster[t] < triangle_cluster[n]) {
+				boundary.emplace_back(BoundaryEdge{triangle_cluster[t], triangle_cluster[n], t, e});
+			}
+		}
+	}
+	std::stable_sort(boundary.begin(), boundary.end(), [](BoundaryEdge const &a, BoundaryEdge const &b) {
+		return std::make_pair(a.cluster, a.other) < std::make_pair(b.cluster, b.other);
+	});
+
+	std::vector< ClusterPortal > portals; //both sides of each chosen edge, not yet grouped by cluster
+	for (uint32_t begin = 0; begin < boundary.size(); ) {
+		uint32_t end = begin + 1;
+		while (end < boundary.size() && boundary[end].cluster == boundary[begin].cluster && boundary[end].other == boundary[begin].other) ++end;
+
+		glm::vec3 middle = glm::vec3(0.0f);
+		for (uint32_t i = begin; i < end; ++i) {
+			middle += edge_midpoint(boundary[i].triangle, boundary[i].edge);
+		}
+		middle /= float(end - begin);
+		uint32_t best = begin;
+		float best_dis2 = std::numeric_limits< float >::infinity();
+		for (uint32_t i = begin; i < end; ++i) {
+			float dis2 = glm::length2(edge_midpoint(boundary[i].triangle, boundary[i].edge) - middle);
+			if (dis2 < best_dis2) {
+				best = i;
+				best_dis2 = dis2;
+			}
+		}
+
+		uint32_t t = boundary[best].triangle;
+		uint32_t e = boundary[best].edge;
+		uint32_t n = triangle_neighbors[t][e];
+		uint32_t to = triangles[t][(e+1)%3];
+		glm::uvec3 const &other = triangles[n];
+		portals.emplace_back(ClusterPortal{t, e, -1U});
+		portals.emplace_back(ClusterPortal{n, (other.x == to ? 0U : (other.y == to ? 1U : 2U)), -1U});
+
+		begin = end;
+	}
+
+	//group portals by cluster:
+	std::stable_sort(portals.begin(), portals.end(), [&triangle_cluster](ClusterPortal const &a, ClusterPortal const &b) {
+		return triangle_cluster[a.triangle] < triangle_cluster[b.triangle];
+	});
+	std::vector< uint32_t > half_edge_portal(triangles.size() * 3, -1U);
+	for (uint32_t p = 0; p < portals.size(); ++p) {
+		half_edge_portal[portals[p].triangle * 3 + portals[p].edge] = p;
+	}
+	std::vector< Cluster > cluster_list;
+	cluster_list.reserve(members_begin.size() - 1);
+	uint32_t distance_count = 0;
+	for (uint32_t c = 0, p = 0; c + 1 < members_begin.size(); ++c) {
+		Cluster cluster;
+		cluster.portal_begin = p;
+		while (p < portals.size() && triangle_cluster[portals[p].triangle] == c) ++p;
+		cluster.portal_end = p;
+		cluster.distance_begin = distance_count;
+		distance_count += (cluster.portal_end - cluster.portal_begin) * (cluster.portal_end - cluster.portal_begin);
+		cluster_list.emplace_back(cluster);
+	}
+
+	//twin portal is on the edge running the opposite direction:
+	for (auto &portal : portals) {
+		uint32_t n = triangle_neighbors[portal.triangle][portal.edge];
+		uint32_t to = triangles[portal.triangle][(portal.edge+1)%3];
+		glm::uvec3 const &other = triangles[n];
+		uint32_t e = (other.x == to ? 0 : (other.y == to ? 1 : 2));
+		portal.twin = half_edge_portal[n * 3 + e];
+		assert(portal.twin != -1U);
+	}
+
+	clusters.triangle_cluster = std::move(triangle_cluster);
+	clusters.clusters = std::move(cluster_list);
+	clusters.portals = std::move(portals);
+
+	//distance tables, one row per portal:
+	std::vector< float > distances(distance_count);
+	PortalDistancesScratch scratch;
+	for (auto const &cluster : clusters.clusters) {
+		uint32_t count = cluster.portal_end - cluster.portal_begin;
+		for (uint32_t i = 0; i < count; ++i) {
+			ClusterPortal const &portal = clusters.portals[cluster.portal_begin + i];
+			portal_distances(portal.triangle, edge_midpoint(portal.triangle, portal.edge), &scratch, &distances[cluster.distance_begin + i * count]);
+		}
+	}
+	clusters.distances = std::move(distances);
+}
+
+void WalkMesh::portal_distances(uint32_t triangle, glm::vec3 const &point, PortalDistancesScratch *scratch_, float *distances) const {
+	assert(scratch_);
+	auto &scratch = *scratch_;
+	assert(triangle < triangles.size());
+	assert(distances);
+
+	if (scratch.visit_stamp.size() != triangles.size() * 3) {
+		scratch.visit_stamp.assign(triangles.size() * 3, 0);
+		scratch.portal_stamp.assign(triangles.size() * 3, 0);
+		scratch.cost.resize(triangles.size() * 3);
+		scratch.stamp = 0;
+	}
+	scratch.stamp += 1;
+	if (scratch.stamp == 0) {
+		std::fill(scratch.visit_stamp.begin(), scratch.visit_stamp.end(), 0);
+		std::fill(scratch.portal_stamp.begin(), scratch.portal_stamp.end(), 0);
+		scratch.stamp = 1;
+	}
+
+	//Dijkstra's algorithm over half-edges (triangle * 3 + edge), each standing for its edge's midpoint:
+	uint32_t cluster = clusters.triangle_cluster[triangle];
+	auto cmp = std::greater< std::pair< float, uint32_t > >(); //makes open into a min-heap
+	scratch.open.clear();
+	auto reach = [&](uint32_t he, float cost) {
+		if (scratch.visit_stamp[he] == scratch.stamp && scratch.cost[he] <= cost) return;
+		scratch.visit_stamp[he] = scratch.stamp;
+		scratch.cost[he] = cost;
+		scratch.open.emplace_back(cost, he);
+		std::push_heap(scratch.open.begin(), scratch.open.end(), cmp);
+	};
+
+	Cluster const &c = clusters.clusters[cluster];
+	uint32_t unsettled = c.portal_end - c.portal_begin; //search stops once all portals are reached
+	//(mark the portals' half-edges, so each settled half-edge is checked with one lookup)
+	for (uint32_t p = c.portal_begin; p < c.portal_end; ++p) {
+		scratch.portal_stamp[clusters.portals[p].triangle * 3 + clusters.portals[p].edge] = scratch.stamp;
+	}
+
+	for (uint32_t e = 0; e < 3; ++e) {
+		reach(triangle * 3 + e, glm::length(edge_midpoint(triangle, e) - point));
+	}
+	while (!scratch.open.empty() && unsettled > 0) {
+		std::pop_heap(scratch.open.begin(), scratch.open.end(), cmp);
+		std::pair< float, uint32_t > at = scratch.open.back();
+		scratch.open.pop_back();
+		if (at.first > scratch.cost[at.second]) continue; //stale entry
+		if (scratch.portal_stamp[at.second] == scratch.stamp) unsettled -= 1;
+
+		uint32_t t = at.second / 3;
+		uint32_t e = at.second % 3;
+		glm::vec3 mid = edge_midpoint(t, e);
+
+		//move across the triangle to its other edges:
+		for (uint32_t e2 = 0; e2 < 3; ++e2) {
+			if (e2 == e) continue;
+			reach(t * 3 + e2, at.first + glm::length(edge_midpoint(t, e2) - mid));
+		}
+
+		//move through the edge into the neighboring triangle (if it is in the same cluster):
+		uint32_t n = triangle_neighbors[t][e];
+		if (n != -1U && clusters.triangle_cluster[n] == cluster) {
+			uint32_t to = triangles[t][(e+1)%3];
+			glm::uvec3 const &other = triangles[n];
+			reach(n * 3 + (other.x == to ? 0 : (other.y == to ? 1 : 2)), at.first);
+		}
+	}
+
+	for (uint32_t p = c.portal_begin; p < c.portal_end; ++p) {
+		uint32_t he = clusters.portals[p].triangle * 3 + clusters.portals[p].edge;
+		distances[p - c.portal_begin] = (scratch.visit_stamp[he] == scratch.stamp ? scratch.cost[he] : std::numeric_limits< float >::infinity());
+	}
+}
+
 WalkPoint WalkMesh::nearest_walk_point(glm::vec3 const &world_point) const {
 	assert(!triangles.empty() && "Cannot start on an empty walkmesh");
+	assert(!bvh_nodes.empty());
 
 	WalkPoint closest;
 	float closest_dis2 = std::numeric_limits< float >::infinity();
+	uint32_t closest_ti = -1U;
 
-	for (auto const &tri : triangles) {
-		//find closest point on triangle:
+	//squared distance from world_point to a node's box:
+	auto box_dis2 = [&world_point](BVHNode const &node) {
+		glm::vec3 d = glm::max(node.min - world_point, glm::max(glm::vec3(0.0f), world_point - node.max));
+		return glm::dot(d, d);
+	};
 
-		glm::vec3 const &a = vertices[tri.x];
-		glm::vec3 const &b = vertices[tri.y];
-		glm::vec3 const &c = vertices[tri.z];
+	//depth-first traversal, nearer child first, skipping boxes further than the best point so far:
+	// (ties are broken by triangle index, which makes the result match nearest_walk_point_linear exactly)
+	std::pair< float, uint32_t > stack[BVHStack];
+	uint32_t top = 0;
+	stack[top++] = std::make_pair(box_dis2(bvh_nodes[0]), 0U);
+	while (top > 0) {
+		--top;
+		float node_dis2 = stack[top].first;
+		BVHNode const *node = &bvh_nodes[stack[top].second];
+		if (node_dis2 > closest_dis2) continue;
+
+		while (node->count == 0) {
+			uint32_t ai = uint32_t(node - &bvh_nodes[0]) + 1;
+			uint32_t bi = node->first;
+			float a_dis2 = box_dis2(bvh_nodes[ai]);
+			float b_dis2 = box_dis2(bvh_nodes[bi]);
+			if (b_dis2 < a_dis2) {
+				std::swap(ai, bi);
+				std::swap(a_dis2, b_dis2);
+			}
+			if (b_dis2 <= closest_dis2) {
+				assert(top < BVHStack && "BVH is shallower than BVHStack");
+				stack[top++] = std::make_pair(b_dis2, bi);
+			}
+			if (a_dis2 > closest_dis2) break;
+			node = &bvh_nodes[ai];
+		}
+		if (node->count == 0) continue;
+
+		for (uint32_t i = node->first; i < node->first + node->count; ++i) {
+			uint32_t ti = bvh_triangles[i];
+			WalkPoint wp;
+			float dis2;
+			closest_on_triangle(*this, triangles[ti], world_point, &wp, &dis2);
+			if (dis2 < closest_dis2 || (dis2 == closest_dis2 && ti < closest_ti)) {
+				closest_dis2 = dis2;
+				closest = wp;
+				closest_ti = ti;
+			}
+		}
+	}
 
-		//get barycentric coordinates of closest point in the plane of (a,b,c):
-		glm::vec3 coords = barycentric_weights(a,b,c, world_point);
+	assert(closest.indices.x < vertices.size());
+	assert(closest.indices.y < vertices.size());
+	assert(closest.indices.z < vertices.size());
+	return closest;
+}
 
-		//is that point inside the triangle?
-		if (coords.x >= 0.0f && coords.y >= 0.0f && coords.z >= 0.0f) {
-			//yes, point is inside triangle.
-			float dis2 = glm::length2(world_point - to_world_point(WalkPoint(tri, coords)));
+WalkPoint WalkMesh::relocate(WalkPoint const &hint, glm::vec3 const &world_point) const {
+	uint32_t ti = (hint.indices.x < vertices.size() && hint.indices.y < vertices.size() ? find_triangle(hint.indices) : -1U);
+	if (ti == -1U) return nearest_walk_point(world_point);
+
+	//walk toward world_point, crossing the edge opposite the corner whose barycentric weight is most negative:
+	// (weights of world_point projected to each triangle's plane come from triangle_frames, so each step is cheap)
+	uint32_t from = -1U;
+	uint32_t steps = 0;
+	bool stopped = false; //did the walk stop short, at a boundary or turning back?
+	while (true) {
+		glm::uvec3 const &tri = triangles[ti];
+		glm::vec3 weights = glm::vec3(1.0f, 0.0f, 0.0f) + (world_point - vertices[tri.x]) * triangle_frames[ti].to_barycentric;
+		uint32_t corner = 0;
+		if (weights.y < weights[corner]) corner = 1;
+		if (weights.z < weights[corner]) corner = 2;
+		if (weights[corner] >= 0.0f) break; //projects inside triangle
+
+		uint32_t next = triangle_neighbors[ti][(corner + 1) % 3];
+		if (next == -1U || next == from) { //at a boundary, or turning back (e.g., over a ridge)
+			stopped = true;
+			break;
+		}
+		if (++steps == RelocateVisits) return nearest_walk_point(world_point);
+		from = ti;
+		ti = next;
+	}
+
+	//on a bumpy or bent mesh, projections can stop the walk one triangle short,
+	// so also check triangles around the end that are at least as close as the best so far:
+	// (ties matter: when the closest point is a vertex, the way forward may be around that vertex's fan)
+	// (visited triangles are kept in a short list, since only a handful are checked)
+	WalkPoint closest;
+	float closest_dis2;
+	closest_on_triangle(*this, triangles[ti], world_point, &closest, &closest_dis2);
+
+	uint32_t visited[RelocateVisits];
+	uint32_t visited_count = 0;
+	uint32_t todo[RelocateVisits];
+	uint32_t todo_count = 0;
+	visited[visited_count++] = ti;
+	todo[todo_count++] = ti;
+	while (todo_count > 0 && closest_dis2 > 0.0f) {
+		uint32_t at = todo[--todo_count];
+		glm::uvec3 const &neighbors = triangle_neighbors[at];
+		for (uint32_t e = 0; e < 3; ++e) {
+			uint32_t ni = neighbors[e];
+			if (ni == -1U) continue;
+			if (std::find(visited, visited + visited_count, ni) != visited + visited_count) continue;
+			if (visited_count == RelocateVisits) return nearest_walk_point(world_point);
+			visited[visited_count++] = ni;
+
+			WalkPoint wp;
+			float dis2;
+			closest_on_triangle(*this, triangles[ni], world_point, &wp, &dis2);
+			if (dis2 > closest_dis2 * (1.0f + 1e-5f)) continue;
 			if (dis2 < closest_dis2) {
 				closest_dis2 = dis2;
-				closest.indices = tri;
-				closest.weights = coords;
+				closest = wp;
 			}
-		} else {
-			//check triangle vertices and edges:
-			auto check_edge = [&world_point, &closest, &closest_dis2, this](uint32_t ai, uint32_t bi, uint32_t ci) {
-				glm::vec3 const &a = vertices[ai];
-				glm::vec3 const &b = vertices[bi];
-
-				//find closest point on line segment ab:
-				float along = glm::dot(world_point-a, b-a);
-				float max = glm::dot(b-a, b-a);
-				glm::vec3 pt;
-				glm::vec3 coords;
-				if (along < 0.0f) {
-					pt = a;
-					coords = glm::vec3(1.0f, 0.0f, 0.0f);
-				} else if (along > max) {
-					pt = b;
-					coords = glm::vec3(0.0f, 1.0f, 0.0f);
-				} else {
-					float amt = along / max;
-					pt = glm::mix(a, b, amt);
-					coords = glm::vec3(1.0f - amt, amt, 0.0f);
-				}
+			todo[todo_count++] = ni;
+		}
+	}
 
-				float dis2 = glm::length2(world_point - pt);
-				if (dis2 < closest_dis2) {
-					closest_dis2 = dis2;
-					closest.indices = glm::uvec3(ai, bi, ci);
-					closest.weights = coords;
-				}
-			};
-			check_edge(tri.x, tri.y, tri.z);
-			check_edge(tri.y, tri.z, tri.x);
-			check_edge(tri.z, tri.x, tri.y);
+	//a walk that stopped short of world_point may be on the wrong part of the mesh (e.g., the near arm of a U,
+	// with world_point on the far arm), so unless it ended right at world_point, search the whole mesh:
+	if (stopped && closest_dis2 > RelocateSnap * RelocateSnap) return nearest_walk_point(world_point);
+
+	assert(closest.indices.x < vertices.size());
+	assert(closest.indices.y < vertices.size());
+	assert(closest.indices.z < vertices.size());
+	return closest;
+}
+
+WalkPoint WalkMesh::nearest_walk_point_linear(glm::vec3 const &world_point) const {
+	assert(!triangles.empty() && "Cannot start on an empty walkmesh");
+
+	WalkPoint closest;
+	float closest_dis2 = std::numeric_limits< float >::infinity();
+
+	for (auto const &tri : triangles) {
+		//find closest point on triangle:
+		WalkPoint wp;
+		float dis2;
+		closest_on_triangle(*this, tri, world_point, &wp, &dis2);
+		if (dis2 < closest_dis2) {
+			closest_dis2 = dis2;
+			closest = wp;
 		}
 	}
 	assert(closest.indices.x < vertices.size());
@@ -120,6 +709,385 @@ WalkPoint WalkMesh::nearest_walk_point(glm::vec3 const &world_point) const {
 }
 
 
+//intersect ray origin + t * direction with triangle a,b,c (either side), Moller-Trumbore style:
+// on a hit, *t gets t and *weights gets barycentric coordinates of the hit point
+static bool ray_triangle(glm::vec3 const &origin, glm::vec3 const &direction, glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c, float *t, glm::vec3 *weights) {
+	glm::vec3 ab = b - a;
+	glm::vec3 ac = c - a;
+	glm::vec3 p = glm::cross(direction, ac);
+	float det = glm::dot(ab, p);
+	if (det == 0.0f) return false; //parallel to triangle (or triangle is degenerate)
+	float inv_det = 1.0f / det;
+
+	glm::vec3 ao = origin - a;
+	float u = glm::dot(ao, p) * inv_det;
+	if (!(u >= 0.0f && u <= 1.0f)) return false;
+	glm::vec3 q = glm::cross(ao, ab);
+	float v = glm::dot(direction, q) * inv_det;
+	if (!(v >= 0.0f && u + v <= 1.0f)) return false;
+
+	*t = glm::dot(ac, q) * inv_det;
+	*weights = glm::vec3(1.0f - u - v, u, v);
+	return true;
+}
+
+//1 / direction, with zero components replaced by tiny ones (so slab tests never compute 0 * infinity):
+static glm::vec3 safe_inverse(glm::vec3 const &direction) {
+	glm::vec3 inv;
+	for (uint32_t i = 0; i < 3; ++i) {
+		float d = direction[i];
+		if (std::abs(d) < 1e-30f) d = (d < 0.0f ? -1e-30f : 1e-30f);
+		inv[i] = 1.0f / d;
+	}
+	return inv;
+}
+
+bool WalkMesh::ray_cast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, WalkPoint *hit_, float *hit_t_) const {
+	assert(hit_);
+	auto &hit = *hit_;
+	assert(hit_t_);
+	auto &hit_t = *hit_t_;
+
+	if (bvh_nodes.empty()) return false;
+
+	float best_t = max_t;
+	uint32_t best_ti = -1U;
+	glm::vec3 best_weights;
+
+	//ray parameter at which the ray enters a node's box (infinity if it misses, or enters after best_t):
+	glm::vec3 inv = safe_inverse(direction);
+	auto box_t = [&](BVHNode const &node) {
+		glm::vec3 t0 = (node.min - origin) * inv;
+		glm::vec3 t1 = (node.max - origin) * inv;
+		glm::vec3 near = glm::min(t0, t1);
+		glm::vec3 far = glm::max(t0, t1);
+		float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+		float exit = std::min(std::min(far.x, far.y), std::min(far.z, best_t));
+		return (enter <= exit ? enter : std::numeric_limits< float >::infinity());
+	};
+
+	//depth-first traversal, nearer child first, skipping boxes entered after the closest hit so far:
+	// (ties are broken by triangle index, which makes the result match ray_cast_linear exactly)
+	std::pair< float, uint32_t > stack[BVHStack];
+	uint32_t top = 0;
+	float root_t = box_t(bvh_nodes[0]);
+	if (root_t != std::numeric_limits< float >::infinity()) stack[top++] = std::make_pair(root_t, 0U);
+	while (top > 0) {
+		--top;
+		float node_t = stack[top].first;
+		BVHNode const *node = &bvh_nodes[stack[top].second];
+		if (node_t > best_t) continue;
+
+		while (node->count == 0) {
+			uint32_t ai = uint32_t(node - &bvh_nodes[0]) + 1;
+			uint32_t bi = node->first;
+			float a_t = box_t(bvh_nodes[ai]);
+			float b_t = box_t(bvh_nodes[bi]);
+			if (b_t < a_t) {
+				std::swap(ai, bi);
+				std::swap(a_t, b_t);
+			}
+			if (b_t != std::numeric_limits< float >::infinity()) {
+				assert(top < BVHStack && "BVH is shallower than BVHStack");
+				stack[top++] = std::make_pair(b_t, bi);
+			}
+			if (a_t == std::numeric_limits< float >::infinity()) break;
+			node = &bvh_nodes[ai];
+		}
+		if (node->count == 0) continue;
+
+		for (uint32_t i = node->first; i < node->first + node->count; ++i) {
+			uint32_t ti = bvh_triangles[i];
+			glm::uvec3 const &tri = triangles[ti];
+			float t;
+			glm::vec3 weights;
+			if (!ray_triangle(origin, direction, vertices[tri.x], vertices[tri.y], vertices[tri.z], &t, &weights)) continue;
+			if (t >= 0.0f && (t < best_t || (t == best_t && ti < best_ti))) {
+				best_t = t;
+				best_ti = ti;
+				best_weights = weights;
+			}
+		}
+	}
+
+	if (best_ti == -1U) return false;
+	hit = WalkPoint(triangles[best_ti], best_weights);
+	hit_t = best_t;
+	return true;
+}
+
+bool WalkMesh::ray_cast_linear(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, WalkPoint *hit_, float *hit_t_) const {
+	assert(hit_);
+	auto &hit = *hit_;
+	assert(hit_t_);
+	auto &hit_t = *hit_t_;
+
+	float best_t = max_t;
+	uint32_t best_ti = -1U;
+	glm::vec3 best_weights;
+	for (uint32_t ti = 0; ti < triangles.size(); ++ti) {
+		glm::uvec3 const &tri = triangles[ti];
+		float t;
+		glm::vec3 weights;
+		if (!ray_triangle(origin, direction, vertices[tri.x], vertices[tri.y], vertices[tri.z], &t, &weights)) continue;
+		if (t >= 0.0f && (t < best_t || (t == best_t && ti < best_ti))) {
+			best_t = t;
+			best_ti = ti;
+			best_weights = weights;
+		}
+	}
+
+	if (best_ti == -1U) return false;
+	hit = WalkPoint(triangles[best_ti], best_weights);
+	hit_t = best_t;
+	return true;
+}
+
+void WalkMesh::ray_cast_batch(WalkRays const &rays, WalkPoints *hits_, std::vector< float > *hit_ts_) const {
+	assert(hits_);
+	auto &hits = *hits_;
+	assert(hit_ts_);
+	auto &hit_ts = *hit_ts_;
+
+	hits.resize(rays.size());
+	hit_ts.resize(rays.size());
+
+	uint32_t stack[BVHStack];
+
+	for (uint32_t base = 0; base < rays.size(); base += BatchLanes) {
+		uint32_t lanes = std::min(uint32_t(BatchLanes), uint32_t(rays.size()) - base);
+
+		//packets only pay off when rays head the same way (e.g., from a camera); otherwise cast one at a time:
+		bool coherent = true;
+		for (uint32_t l = 1; l < lanes; ++l) {
+			uint32_t r = base + l;
+			coherent = coherent && (rays.direction_x[r] < 0.0f) == (rays.direction_x[base] < 0.0f)
+			                    && (rays.direction_y[r] < 0.0f) == (rays.direction_y[base] < 0.0f)
+			                    && (rays.direction_z[r] < 0.0f) == (rays.direction_z[base] < 0.0f);
+		}
+		if (!coherent) {
+			for (uint32_t r = base; r < base + lanes; ++r) {
+				WalkPoint hit;
+				float hit_t;
+				if (ray_cast(glm::vec3(rays.origin_x[r], rays.origin_y[r], rays.origin_z[r]), glm::vec3(rays.direction_x[r], rays.direction_y[r], rays.direction_z[r]), rays.max_t[r], &hit, &hit_t)) {
+					hits.set(r, hit);
+					hit_ts[r] = hit_t;
+				} else {
+					hits.set(r, WalkPoint());
+					hit_ts[r] = std::numeric_limits< float >::infinity();
+				}
+			}
+			continue;
+		}
+
+		//packet of rays (unused lanes get rays that miss everything):
+		float ox[BatchLanes], oy[BatchLanes], oz[BatchLanes];
+		float ix[BatchLanes], iy[BatchLanes], iz[BatchLanes];
+		float best_t[BatchLanes];
+		uint32_t best_ti[BatchLanes];
+		glm::vec3 best_weights[BatchLanes];
+		for (uint32_t l = 0; l < BatchLanes; ++l) {
+			uint32_t r = base + std::min(l, lanes - 1);
+			glm::vec3 inv = safe_inverse(glm::vec3(rays.direction_x[r], rays.direction_y[r], rays.direction_z[r]));
+			ox[l] = rays.origin_x[r]; oy[l] = rays.origin_y[r]; oz[l] = rays.origin_z[r];
+			ix[l] = inv.x; iy[l] = inv.y; iz[l] = inv.z;
+			best_t[l] = (l < lanes ? rays.max_t[r] : -1.0f);
+			best_ti[l] = -1U;
+		}
+
+		//which lanes enter a node's box before their closest hit so far (slab test, four lanes at a time with Lanes4.hpp):
+		static_assert(BatchLanes % 4 == 0, "BatchLanes must be whole sets of four lanes");
+		auto box_mask = [&](BVHNode const &node) {
+			//(as std::min and std::max, which return their first argument on ties and NaNs)
+			auto min = [](Float4 a, Float4 b) { return select(b < a, b, a); };
+			auto max = [](Float4 a, Float4 b) { return select(a < b, b, a); };
+			uint32_t mask = 0;
+			for (uint32_t l = 0; l < BatchLanes; l += 4) {
+				Float4 tx0 = (Float4(node.min.x) - Float4::load(ox + l)) * Float4::load(ix + l);
+				Float4 tx1 = (Float4(node.max.x) - Float4::load(ox + l)) * Float4::load(ix + l);
+				Float4 ty0 = (Float4(node.min.y) - Float4::load(oy + l)) * Float4::load(iy + l);
+				Float4 ty1 = (Float4(node.max.y) - Float4::load(oy + l)) * Float4::load(iy + l);
+				Float4 tz0 = (Float4(node.min.z) - Float4::load(oz + l)) * Float4::load(iz + l);
+				Float4 tz1 = (Float4(node.max.z) - Float4::load(oz + l)) * Float4::load(iz + l);
+				Float4 enter = max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), Float4(0.0f)));
+				Float4 exit = min(min(max(tx0, tx1), max(ty0, ty1)), min(max(tz0, tz1), Float4::load(best_t + l)));
+				mask |= bits(enter <= exit) << l;
+			}
+			return mask;
+		};
+
+		//depth-first traversal, visiting the child nearer the first live lane's origin first:
+		uint32_t top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			BVHNode const &node = bvh_nodes[stack[--top]];
+			uint32_t mask = box_mask(node);
+			if (mask == 0) continue;
+
+			if (node.count == 0) {
+				uint32_t ai = uint32_t(&node - &bvh_nodes[0]) + 1;
+				uint32_t bi = node.first;
+				uint32_t l = 0;
+				while (!(mask & (1U << l))) ++l;
+				glm::vec3 o = glm::vec3(ox[l], oy[l], oz[l]);
+				glm::vec3 a_center = 0.5f * (bvh_nodes[ai].min + bvh_nodes[ai].max);
+				glm::vec3 b_center = 0.5f * (bvh_nodes[bi].min + bvh_nodes[bi].max);
+				if (glm::dot(b_center - o, b_center - o) < glm::dot(a_center - o, a_center - o)) std::swap(ai, bi);
+				assert(top + 1 < BVHStack && "BVH is shallower than BVHStack");
+				stack[top++] = bi;
+				stack[top++] = ai;
+				continue;
+			}
+
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				uint32_t ti = bvh_triangles[i];
+				glm::uvec3 const &tri = triangles[ti];
+				for (uint32_t l = 0; l < lanes; ++l) {
+					if (!(mask & (1U << l))) continue;
+					uint32_t r = base + l;
+					float t;
+					glm::vec3 weights;
+					glm::vec3 direction = glm::vec3(rays.direction_x[r], rays.direction_y[r], rays.direction_z[r]);
+					if (!ray_triangle(glm::vec3(ox[l], oy[l], oz[l]), direction, vertices[tri.x], vertices[tri.y], vertices[tri.z], &t, &weights)) continue;
+					if (t >= 0.0f && (t < best_t[l] || (t == best_t[l] && ti < best_ti[l]))) {
+						best_t[l] = t;
+						best_ti[l] = ti;
+						best_weights[l] = weights;
+					}
+				}
+			}
+		}
+
+		for (uint32_t l = 0; l < lanes; ++l) {
+			if (best_ti[l] == -1U) {
+				hits.set(base + l, WalkPoint());
+				hit_ts[base + l] = std::numeric_limits< float >::infinity();
+			} else {
+				hits.set(base + l, WalkPoint(triangles[best_ti[l]], best_weights[l]));
+				hit_ts[base + l] = best_t[l];
+			}
+		}
+	}
+}
+
+//one trace_straight in progress: a line from 'from' to 'from + step' (in the xy plane), currently in 'triangle':
+struct StraightTrace {
+	uint32_t triangle;
+	glm::vec2 from;
+	glm::vec2 step;
+	uint32_t steps_left; //(guards against rounding sending the trace around in circles)
+};
+
+//advance a trace through its current triangle:
+// returns 0 if the trace moved to the next triangle, 1 if it reached its end, 2 if it hit a boundary (*end is set in the last two cases)
+static uint32_t advance_straight_trace(WalkMesh const &wm, StraightTrace *trace_, WalkPoint *end_) {
+	assert(trace_);
+	auto &trace = *trace_;
+	assert(end_);
+	auto &end = *end_;
+
+	glm::uvec3 const &tri = wm.triangles[trace.triangle];
+	glm::vec2 corners[3] = {
+		glm::vec2(wm.vertices[tri.x]),
+		glm::vec2(wm.vertices[tri.y]),
+		glm::vec2(wm.vertices[tri.z])
+	};
+	auto cross = [](glm::vec2 const &a, glm::vec2 const &b) { return a.x * b.y - a.y * b.x; };
+	float area = cross(corners[1] - corners[0], corners[2] - corners[0]);
+	float flip = (area < 0.0f ? -1.0f : 1.0f); //(triangles seen from below are clockwise)
+
+	//the line leaves through the edge it reaches first while heading outward:
+	float exit_s = 1.0f;
+	uint32_t exit_e = -1U;
+	for (uint32_t e = 0; e < 3; ++e) {
+		glm::vec2 const &a = corners[e];
+		glm::vec2 const &b = corners[(e+1)%3];
+		glm::vec2 out = flip * glm::vec2(b.y - a.y, a.x - b.x);
+		float rate = glm::dot(trace.step, out);
+		if (!(rate > 0.0f)) continue;
+		float s = glm::dot(a - trace.from, out) / rate;
+		if (s < exit_s) {
+			exit_s = s;
+			exit_e = e;
+		}
+	}
+
+	if (exit_e == -1U) {
+		//end is in this triangle:
+		glm::vec2 at = trace.from + trace.step;
+		glm::vec3 weights = glm::vec3(0.0f);
+		if (area != 0.0f) {
+			weights.x = cross(corners[1] - at, corners[2] - at) / area;
+			weights.y = cross(corners[2] - at, corners[0] - at) / area;
+			weights = glm::max(weights, glm::vec3(0.0f));
+			weights.z = std::max(0.0f, 1.0f - weights.x - weights.y);
+			weights /= weights.x + weights.y + weights.z;
+		} else {
+			weights = glm::vec3(1.0f, 0.0f, 0.0f);
+		}
+		end = WalkPoint(tri, weights);
+		return 1;
+	}
+
+	//the next triangle is a fold if it is seen from the other side (or edge-on) from above:
+	uint32_t next = wm.triangle_neighbors[trace.triangle][exit_e];
+	bool fold = false;
+	if (next != -1U) {
+		glm::uvec3 const &next_tri = wm.triangles[next];
+		glm::vec2 a = glm::vec2(wm.vertices[next_tri.x]);
+		float next_area = cross(glm::vec2(wm.vertices[next_tri.y]) - a, glm::vec2(wm.vertices[next_tri.z]) - a);
+		fold = !(next_area * flip > 0.0f);
+	}
+
+	if (next == -1U || fold || trace.steps_left == 0) {
+		//hit a boundary edge (or a fold, which a straight line can't cross either):
+		glm::vec2 const &a = corners[exit_e];
+		glm::vec2 const &b = corners[(exit_e+1)%3];
+		glm::vec2 at = trace.from + std::max(0.0f, exit_s) * trace.step;
+		float len2 = glm::dot(b - a, b - a);
+		float along = (len2 > 0.0f ? glm::clamp(glm::dot(at - a, b - a) / len2, 0.0f, 1.0f) : 0.0f);
+		end = WalkPoint(glm::uvec3(tri[exit_e], tri[(exit_e+1)%3], tri[(exit_e+2)%3]), glm::vec3(1.0f - along, along, 0.0f));
+		return 2;
+	}
+
+	trace.triangle = next;
+	trace.steps_left -= 1;
+	return 0;
+}
+
+bool WalkMesh::trace_straight(WalkPoint const &start, glm::vec3 const &step, WalkPoint *end) const {
+	assert(end);
+	uint32_t ti = find_triangle(start.indices);
+	assert(ti < triangles.size() && "walk points must be on walkmesh triangles");
+
+	StraightTrace trace;
+	trace.triangle = ti;
+	trace.from = glm::vec2(to_world_point(start));
+	trace.step = glm::vec2(step);
+	trace.steps_left = uint32_t(triangles.size());
+	while (true) {
+		uint32_t result = advance_straight_trace(*this, &trace, end);
+		if (result != 0) return result == 1;
+	}
+}
+
+void WalkMesh::trace_straight_batch(WalkPoints const &starts, WalkSteps const &steps, WalkPoints *ends_, std::vector< uint8_t > *reached_) const {
+	assert(ends_);
+	auto &ends = *ends_;
+	assert(reached_);
+	auto &reached = *reached_;
+	assert(starts.size() == steps.size());
+
+	ends.resize(starts.size());
+	reached.resize(starts.size());
+
+	for (uint32_t i = 0; i < starts.size(); ++i) {
+		WalkPoint end;
+		reached[i] = trace_straight(starts.get(i), steps.get(i), &end);
+		ends.set(i, end);
+	}
+}
+
 void WalkMesh::walk_in_triangle(WalkPoint const &start, glm::vec3 const &step, WalkPoint *end_, float *time_) const {
 	
 	assert(end_);
@@ -142,11 +1110,14 @@ void WalkMesh::walk_in_triangle(WalkPoint const &start, glm::vec3 const &step, W
 	assert (start.weights.y >= 0);
 	assert (start.weights.z >= 0);
 
-    glm::vec3 const &a = vertices[start.indices.x];
-	glm::vec3 const &b = vertices[start.indices.y];
-	glm::vec3 const &c = vertices[start.indices.z];
-	
-	glm::vec3 step_coords =  barycentric_weights(a, b, c, step) - barycentric_weights(a, b, c, glm::vec3(0.0f, 0.0f, 0.0f));
+	//project step to a change in barycentric coordinates:
+	uint32_t corner = 0;
+	uint32_t ti = find_triangle(start.indices, &corner);
+	assert(ti < triangles.size() && "walk points must be on walkmesh triangles");
+	glm::vec3 step_coords = step * triangle_frames[ti].to_barycentric;
+	//(frame rows are in the order of the triangle's corners; rotate to match start.indices)
+	if (corner == 1) step_coords = glm::vec3(step_coords.y, step_coords.z, step_coords.x);
+	else if (corner == 2) step_coords = glm::vec3(step_coords.z, step_coords.x, step_coords.y);
 
 	//if no edge is crossed, event will just be taking the whole step:
 	time = 1.0f;
@@ -260,53 +1231,31 @@ bool WalkMesh::cross_edge(WalkPoint const &start, WalkPoint *end_, glm::quat *ro
 	auto &rotation = *rotation_;
 
 	assert(start.weights.z == 0.0f); //*must* be on an edge.
-    auto v = next_vertex.find(glm::uvec2(start.indices.x, start.indices.y));
+
+	//the triangle on the other side of edge (x,y) is the one with half-edge y->x:
+	HalfEdge const *opposite = find_half_edge(start.indices.y, start.indices.x);
 
 	//check if 'edge' is a non-boundary edge:
-	if (v != next_vertex.end()) {
-        //it is!
-		glm::uvec3 tri(start.indices.y, start.indices.x, v->second);
+	if (opposite) {
+		//it is!
+		assert(opposite->next < vertices.size());
+		glm::uvec3 tri(start.indices.y, start.indices.x, opposite->next);
 
 		//make 'end' represent the same (world) point, but on triangle (edge.y, edge.x, [other point]):
 		end.indices = tri;
-        end.weights = glm::vec3(start.weights.y, start.weights.x, 0.0f);
+		end.weights = glm::vec3(start.weights.y, start.weights.x, 0.0f);
 		assert(end.weights.x == end.weights.x);
 		assert(end.weights.y == end.weights.y);
-		assert(end.weights.z == end.weights.z);
 
 		//make 'rotation' the rotation that takes (start.indices)'s normal to (end.indices)'s normal:
-		glm::vec3 const &a = vertices[start.indices.x];
-        glm::vec3 const &b = vertices[start.indices.y];
-        glm::vec3 const &c = vertices[start.indices.z];
-		assert(0 <= v->second && v->second < vertices.size());
-        glm::vec3 const &d = vertices[v->second];
-		assert(d.x == d.x);
-		assert(d.y == d.y);
-		assert(d.z == d.z);
-
-		glm::vec3 c1 = glm::cross(b - a, c - a);
-		assert (c1.x == c1.x);
-		assert (c1.y == c1.y);
-		assert (c1.z == c1.z);
-		
-		glm::vec3 c2 = glm::cross(b - c, d - b);
-		assert(c2.x == c2.x);
-		assert(c2.y == c2.y);
-		assert(c2.z == c2.z);
-
-        glm::vec3 n1 = c1 == glm::vec3(0, 0, 0) ? c1 : glm::normalize(c1);
-		assert(n1.x == n1.x);
-		assert(n1.y == n1.y);
-		assert(n1.z == n1.z);
+		uint32_t ti = find_triangle(start.indices);
+		assert(ti < triangles.size() && "walk points must be on walkmesh triangles");
+		glm::vec3 const &n1 = triangle_frames[ti].normal;
+		glm::vec3 const &n2 = triangle_frames[opposite->triangle].normal;
 
-        glm::vec3 n2 = c2 == glm::vec3(0, 0, 0) ? c2 : glm::normalize(c2);
-		assert(n2.x == n2.x);
-		assert(n2.y == n2.y);
-		assert(n2.z == n2.z);
+		rotation = glm::rotation(n1, n2);
 
-        rotation = glm::rotation(n1, n2);
-
-		return true; 
+		return true;
 	} else {
 		end = start;
 		rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
@@ -315,9 +1264,328 @@ bool WalkMesh::cross_edge(WalkPoint const &start, WalkPoint *end_, glm::quat *ro
 }
 
 
+bool WalkMesh::walk(WalkPoint *at_, glm::vec3 const &step, uint32_t max_iterations) const {
+	assert(at_);
+	auto &at = *at_;
+
+	glm::vec3 remain = step;
+
+	//using a for() instead of a while() here so that if walkpoint gets stuck in
+	// some awkward case, code will not infinite loop:
+	for (uint32_t iter = 0; iter < max_iterations; ++iter) {
+		if (remain == glm::vec3(0.0f)) break;
+		WalkPoint end;
+		float time;
+		walk_in_triangle(at, remain, &end, &time);
+		at = end;
+		if (time == 1.0f) {
+			//finished within triangle:
+			remain = glm::vec3(0.0f);
+			break;
+		}
+		//some step remains:
+		remain *= (1.0f - time);
+		//try to step over edge:
+		glm::quat rotation;
+		if (cross_edge(at, &end, &rotation)) {
+			//stepped to a new triangle:
+			at = end;
+			//rotate step to follow surface:
+			remain = rotation * remain;
+		} else {
+			//ran into a wall, bounce / slide along it:
+			remain = slide_along_edge(at, remain);
+		}
+	}
+
+	return remain == glm::vec3(0.0f);
+}
+
+//three floats (F = float) or three sets of lanes (F = Float4), so slide_along is written once for walk() and walk_batch():
+template< typename F >
+struct Lanes3 {
+	F x, y, z;
+};
+template< typename F >
+static Lanes3< F > operator+(Lanes3< F > const &a, Lanes3< F > const &b) { return Lanes3< F >{ a.x + b.x, a.y + b.y, a.z + b.z }; }
+template< typename F >
+static Lanes3< F > operator-(Lanes3< F > const &a, Lanes3< F > const &b) { return Lanes3< F >{ a.x - b.x, a.y - b.y, a.z - b.z }; }
+template< typename F >
+static Lanes3< F > operator*(F s, Lanes3< F > const &a) { return Lanes3< F >{ s * a.x, s * a.y, s * a.z }; }
+//(same operation order as glm::dot and glm::cross)
+template< typename F >
+static F dot(Lanes3< F > const &a, Lanes3< F > const &b) { return (a.x * b.x + a.y * b.y) + a.z * b.z; }
+template< typename F >
+static Lanes3< F > cross(Lanes3< F > const &a, Lanes3< F > const &b) { return Lanes3< F >{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+template< typename F >
+static Lanes3< F > normalize(Lanes3< F > const &a) {
+	using std::sqrt;
+	return (F(1.0f) / sqrt(dot(a, a))) * a;
+}
+static float select(bool m, float a, float b) { return (m ? a : b); }
+
+//bend 'remain' away from boundary edge a-b of triangle a,b,c (shared by slide_along_edge and walk_batch):
+template< typename F >
+static Lanes3< F > slide_along(Lanes3< F > const &a, Lanes3< F > const &b, Lanes3< F > const &c, Lanes3< F > const &remain) {
+	Lanes3< F > along = normalize(b-a);
+	Lanes3< F > normal = normalize(cross(b-a, c-a));
+	Lanes3< F > in = cross(normal, along);
+
+	//check how much 'remain' is pointing out of the triangle:
+	F d = dot(remain, in);
+	//if it points out, bounce off of the wall; if it's just pointing along the edge, bend slightly away from wall:
+	F push = select(d < F(0.0f), F(-1.25f) * d, F(0.01f) * d);
+	return remain + push * in;
+}
+
+glm::vec3 WalkMesh::slide_along_edge(WalkPoint const &at, glm::vec3 const &remain) const {
+	auto lanes = [](glm::vec3 const &v) { return Lanes3< float >{ v.x, v.y, v.z }; };
+	Lanes3< float > ret = slide_along(lanes(vertices[at.indices.x]), lanes(vertices[at.indices.y]), lanes(vertices[at.indices.z]), lanes(remain));
+	return glm::vec3(ret.x, ret.y, ret.z);
+}
+
+void WalkMesh::walk_batch(WalkPoints *points_, WalkSteps const &steps, uint32_t max_iterations) const {
+	assert(points_);
+	auto &points = *points_;
+	assert(points.size() == steps.size());
+
+	static_assert(WalkGroup % 4 == 0, "WalkGroup must be whole sets of four lanes");
+
+	//state of each lane (one walking point) in the current group; lanes [0, active) are still walking:
+	// (the math runs on sets of four lanes, so lanes up to the next multiple of four are computed and ignored;
+	//  zero-initialized so those lanes never hold garbage)
+	uint32_t agent[WalkGroup]; //index in points
+	uint32_t ti[WalkGroup]; //triangle (tracked by index, so walk() and cross_edge()'s half-edge searches aren't needed)
+	uint32_t ix[WalkGroup], iy[WalkGroup], iz[WalkGroup];
+	float wx[WalkGroup] = {}, wy[WalkGroup] = {}, wz[WalkGroup] = {};
+	float rx[WalkGroup] = {}, ry[WalkGroup] = {}, rz[WalkGroup] = {}; //remaining step
+
+	//per-iteration scratch:
+	float row[3][3][WalkGroup] = {}; //row[r][c][l]: component c of lane l's triangle frame row r, rows in walk point corner order
+	uint32_t corner[WalkGroup]; //corner of ti that is ix (after a lane reaches an edge: the corner that starts the edge)
+	uint32_t shift_bits[WalkGroup / 4][2]; //per set of four lanes, which lanes' corners rotate by one / by two
+	uint32_t done_bits[WalkGroup / 4];
+	uint32_t across[WalkGroup]; //triangle across the edge a lane reached (-1U for a wall)
+	float crossing[WalkGroup] = {}; //1.0f where across is a triangle
+	float gather[3][3][WalkGroup] = {}; //gather[v][c][l]: normals of ti and across (crossing) or corners x,y,z (wall)
+
+	auto write_back = [&](uint32_t l) {
+		uint32_t i = agent[l];
+		points.index_x[i] = ix[l]; points.index_y[i] = iy[l]; points.index_z[i] = iz[l];
+		points.weight_x[i] = wx[l]; points.weight_y[i] = wy[l]; points.weight_z[i] = wz[l];
+	};
+	auto load3 = [](float const (&from)[3][WalkGroup], uint32_t l) {
+		return Lanes3< Float4 >{ Float4::load(from[0] + l), Float4::load(from[1] + l), Float4::load(from[2] + l) };
+	};
+
+	for (uint32_t base = 0; base < points.size(); base += WalkGroup) {
+		uint32_t active = std::min(uint32_t(WalkGroup), uint32_t(points.size()) - base);
+		for (uint32_t l = 0; l < active; ++l) {
+			uint32_t i = base + l;
+			agent[l] = i;
+			ix[l] = points.index_x[i]; iy[l] = points.index_y[i]; iz[l] = points.index_z[i];
+			wx[l] = points.weight_x[i]; wy[l] = points.weight_y[i]; wz[l] = points.weight_z[i];
+			rx[l] = steps.x[i]; ry[l] = steps.y[i]; rz[l] = steps.z[i];
+			ti[l] = find_triangle(glm::uvec3(ix[l], iy[l], iz[l]));
+			assert(ti[l] < triangles.size() && "walk points must be on walkmesh triangles");
+		}
+
+		//same iteration budget as walk(); lanes still walking when it runs out stop where they are, as in walk():
+		for (uint32_t iter = 0; iter < max_iterations && active > 0; ++iter) {
+			uint32_t sets = (active + 3) / 4;
+
+			//look up each lane's triangle frame, with rows rotated to match the walk point's corner order:
+			for (uint32_t l = 0; l < active; ++l) {
+				glm::uvec3 const &tri = triangles[ti[l]];
+				corner[l] = (tri.x == ix[l] ? 0 : (tri.y == ix[l] ? 1 : 2));
+				glm::mat3 const &m = triangle_frames[ti[l]].to_barycentric;
+				for (uint32_t r = 0; r < 3; ++r) {
+					glm::vec3 const &m_row = m[(corner[l] + r) % 3];
+					row[r][0][l] = m_row.x; row[r][1][l] = m_row.y; row[r][2][l] = m_row.z;
+				}
+			}
+
+			//walk_in_triangle, four lanes at a time:
+			for (uint32_t s = 0; s < sets; ++s) {
+				uint32_t l = 4 * s;
+				Float4 const zero(0.0f), one(1.0f);
+				Lanes3< Float4 > remain{ Float4::load(rx + l), Float4::load(ry + l), Float4::load(rz + l) };
+				Float4 w_x = Float4::load(wx + l), w_y = Float4::load(wy + l), w_z = Float4::load(wz + l);
+				Float4 step_x = dot(remain, load3(row[0], l));
+				Float4 step_y = dot(remain, load3(row[1], l));
+				Float4 step_z = dot(remain, load3(row[2], l));
+
+				//time of first edge crossed (non-positive and NaN times don't count):
+				Float4 tx = -w_x / step_x;
+				Float4 ty = -w_y / step_y;
+				Float4 tz = -w_z / step_z;
+				tx = select(tx > zero, tx, Float4(1000000000.0f));
+				ty = select(ty > zero, ty, Float4(1000000000.0f));
+				tz = select(tz > zero, tz, Float4(1000000000.0f));
+				Float4 time = select(tz < ty, tz, ty);
+				time = select(time < tx, time, tx);
+				time = select(time >= one, one, time);
+
+				Float4 ex = w_x + step_x * time;
+				Float4 ey = w_y + step_y * time;
+				Float4 ez = w_z + step_z * time;
+
+				//at an edge, rotate the corners so the edge is (x,y):
+				Mask4 edge = (time != one);
+				Mask4 shift1 = edge & (ex <= Float4(0.0001f));
+				Mask4 shift2 = edge & ~shift1 & (ey <= Float4(0.0001f));
+				Float4 nx = select(shift1, ey, select(shift2, ez, ex));
+				Float4 ny = select(shift1, ez, select(shift2, ex, ey));
+				Float4 nz = select(shift1 | shift2 | (edge & (ez <= Float4(0.0001f))), zero, ez);
+
+				//inside the triangle, clamp small negative weights to zero:
+				Mask4 inside = ~edge;
+				nx = select(inside & (nx <= zero), zero, nx);
+				ny = select(inside & (ny <= zero), zero, ny);
+				nz = select(inside & (nz <= zero), zero, nz);
+				//(as std::max(std::min(n, 1.0f), 0.0f))
+				nx = select(one < nx, one, nx); nx = select(nx < zero, zero, nx);
+				ny = select(one < ny, one, ny); ny = select(ny < zero, zero, ny);
+				nz = select(one < nz, one, nz); nz = select(nz < zero, zero, nz);
+
+				//(walk() stops without moving when no step remains)
+				Mask4 still = (remain.x == zero) & (remain.y == zero) & (remain.z == zero);
+				select(still, w_x, nx).store(wx + l);
+				select(still, w_y, ny).store(wy + l);
+				select(still, w_z, nz).store(wz + l);
+				done_bits[s] = bits(still | inside);
+				shift_bits[s][0] = bits(shift1 & ~still);
+				shift_bits[s][1] = bits(shift2 & ~still);
+
+				Float4 left = one - time;
+				(remain.x * left).store(rx + l);
+				(remain.y * left).store(ry + l);
+				(remain.z * left).store(rz + l);
+			}
+
+			//rotate corner indices of lanes that reached an edge:
+			for (uint32_t l = 0; l < active; ++l) {
+				uint32_t bit = 1U << (l % 4);
+				if (shift_bits[l / 4][0] & bit) {
+					uint32_t t = ix[l]; ix[l] = iy[l]; iy[l] = iz[l]; iz[l] = t;
+					corner[l] = (corner[l] + 1) % 3;
+				} else if (shift_bits[l / 4][1] & bit) {
+					uint32_t t = ix[l]; ix[l] = iz[l]; iz[l] = iy[l]; iy[l] = t;
+					corner[l] = (corner[l] + 2) % 3;
+				}
+			}
+
+			//retire lanes that finished, packing the rest to the front:
+			uint32_t kept = 0;
+			for (uint32_t l = 0; l < active; ++l) {
+				if (done_bits[l / 4] & (1U << (l % 4))) {
+					write_back(l);
+					continue;
+				}
+				agent[kept] = agent[l]; ti[kept] = ti[l]; corner[kept] = corner[l];
+				ix[kept] = ix[l]; iy[kept] = iy[l]; iz[kept] = iz[l];
+				wx[kept] = wx[l]; wy[kept] = wy[l]; wz[kept] = wz[l];
+				rx[kept] = rx[l]; ry[kept] = ry[l]; rz[kept] = rz[l];
+				++kept;
+			}
+			active = kept;
+			sets = (active + 3) / 4;
+
+			//look up what is across each lane's edge (x,y) -- another triangle, or a wall:
+			for (uint32_t l = 0; l < active; ++l) {
+				across[l] = triangle_neighbors[ti[l]][corner[l]];
+				glm::vec3 a, b, c;
+				if (across[l] != -1U) {
+					a = triangle_frames[ti[l]].normal;
+					b = triangle_frames[across[l]].normal;
+					//(cross_edge's new walk point: edge reversed, plus the corner that isn't on the edge; wraps harmlessly)
+					glm::uvec3 const &tri = triangles[across[l]];
+					iz[l] = tri.x + tri.y + tri.z - ix[l] - iy[l];
+					std::swap(ix[l], iy[l]);
+					ti[l] = across[l];
+					crossing[l] = 1.0f;
+				} else {
+					a = vertices[ix[l]];
+					b = vertices[iy[l]];
+					c = vertices[iz[l]];
+					crossing[l] = 0.0f;
+				}
+				for (uint32_t k = 0; k < 3; ++k) {
+					gather[0][k][l] = a[k]; gather[1][k][l] = b[k]; gather[2][k][l] = c[k];
+				}
+			}
+
+			//cross_edge or slide_along_edge, four lanes at a time:
+			for (uint32_t s = 0; s < sets; ++s) {
+				uint32_t l = 4 * s;
+				Float4 const zero(0.0f), one(1.0f);
+				Mask4 cross_mask = (Float4::load(crossing + l) != zero);
+				Lanes3< Float4 > remain{ Float4::load(rx + l), Float4::load(ry + l), Float4::load(rz + l) };
+				Lanes3< Float4 > a = load3(gather[0], l), b = load3(gather[1], l), c = load3(gather[2], l);
+				float remain_x[4], remain_y[4], remain_z[4];
+				remain.x.store(remain_x); remain.y.store(remain_y); remain.z.store(remain_z);
+
+				//stepped to a new triangle; rotate step to follow surface:
+				// (glm::rotation(a, b) * remain, with the same operations; a and b are the two triangle normals)
+				Float4 cos_theta = dot(a, b);
+				Float4 q_s = sqrt((one + cos_theta) * Float4(2.0f));
+				Float4 q_w = q_s * Float4(0.5f);
+				Lanes3< Float4 > q = (one / q_s) * cross(a, b);
+				Lanes3< Float4 > uv = cross(q, remain);
+				Lanes3< Float4 > uuv = cross(q, uv);
+				Lanes3< Float4 > turned = remain + Float4(2.0f) * (q_w * uv + uuv);
+				Mask4 same = (cos_theta >= Float4(1.0f - std::numeric_limits< float >::epsilon()));
+				turned.x = select(same, remain.x, turned.x);
+				turned.y = select(same, remain.y, turned.y);
+				turned.z = select(same, remain.z, turned.z);
+
+				//ran into a wall, bounce / slide along it:
+				Lanes3< Float4 > slid = slide_along(a, b, c, remain);
+
+				select(cross_mask, turned.x, slid.x).store(rx + l);
+				select(cross_mask, turned.y, slid.y).store(ry + l);
+				select(cross_mask, turned.z, slid.z).store(rz + l);
+
+				Float4 w_x = Float4::load(wx + l), w_y = Float4::load(wy + l), w_z = Float4::load(wz + l);
+				select(cross_mask, w_y, w_x).store(wx + l);
+				select(cross_mask, w_x, w_y).store(wy + l);
+				select(cross_mask, zero, w_z).store(wz + l);
+
+				//normals facing (nearly) opposite ways take glm::rotation's special case:
+				uint32_t flipped = bits(cross_mask & (cos_theta < Float4(-1.0f + std::numeric_limits< float >::epsilon())));
+				for (uint32_t k = 0; k < 4; ++k) {
+					if (!(flipped & (1U << k))) continue;
+					uint32_t fl = l + k;
+					glm::vec3 n1(gather[0][0][fl], gather[0][1][fl], gather[0][2][fl]);
+					glm::vec3 n2(gather[1][0][fl], gather[1][1][fl], gather[1][2][fl]);
+					glm::vec3 turned_fl = glm::rotation(n1, n2) * glm::vec3(remain_x[k], remain_y[k], remain_z[k]);
+					rx[fl] = turned_fl.x; ry[fl] = turned_fl.y; rz[fl] = turned_fl.z;
+				}
+			}
+		}
+
+		//lanes that ran out of iterations:
+		for (uint32_t l = 0; l < active; ++l) {
+			write_back(l);
+		}
+	}
+}
+
 WalkMeshes::WalkMeshes(std::string const &filename) {
 	std::ifstream file(filename, std::ios::binary);
 
+	//prebuilt files (see write_prebuilt) are mapped instead of read:
+	{
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		if (file.read(magic, 4) && std::string(magic, 4) == "wmp0") {
+			file.close();
+			load_prebuilt(filename);
+			return;
+		}
+		file.clear();
+		file.seekg(0);
+	}
+
 	std::vector< glm::vec3 > vertices;
 	read_chunk(file, "p...", &vertices);
 
@@ -339,6 +1607,38 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 	std::vector< IndexEntry > index;
 	read_chunk(file, "idxA", &index);
 
+	//optional: precomputed triangle frames (computed when WalkMesh is constructed if missing):
+	std::vector< WalkMesh::TriangleFrame > frames;
+	if (read_chunk_if_present(file, "frm0", &frames)) {
+		if (frames.size() != triangles.size()) {
+			throw std::runtime_error("Mis-matched triangle and triangle frame sizes in '" + filename + "'");
+		}
+	}
+
+	//optional: clusters for hierarchical pathfinding (built when WalkMesh is constructed if missing):
+	struct ClusterIndexEntry {
+		uint32_t cluster_begin, cluster_end;
+		uint32_t portal_begin, portal_end;
+		uint32_t distance_begin, distance_end;
+	};
+	std::vector< uint32_t > triangle_clusters;
+	std::vector< WalkMesh::Cluster > clusters;
+	std::vector< WalkMesh::ClusterPortal > portals;
+	std::vector< float > distances;
+	std::vector< ClusterIndexEntry > cluster_index;
+	if (read_chunk_if_present(file, "clt0", &triangle_clusters)) {
+		read_chunk(file, "clu0", &clusters);
+		read_chunk(file, "clp0", &portals);
+		read_chunk(file, "cld0", &distances);
+		read_chunk(file, "idxC", &cluster_index);
+		if (triangle_clusters.size() != triangles.size()) {
+			throw std::runtime_error("Mis-matched triangle and triangle cluster sizes in '" + filename + "'");
+		}
+		if (cluster_index.size() != index.size()) {
+			throw std::runtime_error("Mis-matched index and cluster index sizes in '" + filename + "'");
+		}
+	}
+
 	if (file.peek() != EOF) {
 		std::cerr << "WARNING: trailing data in walkmesh file '" << filename << "'" << std::endl;
 	}
@@ -349,7 +1649,8 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 		throw std::runtime_error("Mis-matched position and normal sizes in '" + filename + "'");
 	}
 
-	for (auto const &e : index) {
+	for (uint32_t i = 0; i < index.size(); ++i) {
+		IndexEntry const &e = index[i];
 		if (!(e.name_begin <= e.name_end && e.name_end <= names.size())) {
 			throw std::runtime_error("Invalid name indices in index of '" + filename + "'");
 		}
@@ -379,9 +1680,74 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 			);
 		}
 		
+		std::vector< WalkMesh::TriangleFrame > wm_frames;
+		if (!frames.empty()) {
+			wm_frames.assign(frames.begin() + e.triangle_begin, frames.begin() + e.triangle_end);
+		}
+		
+		//copy clusters (making indices relative to this mesh):
+		WalkMesh::Clusters wm_clusters;
+		if (!cluster_index.empty()) {
+			ClusterIndexEntry const &c = cluster_index[i];
+			if (!( (c.cluster_begin <= c.cluster_end && c.cluster_end <= clusters.size())
+			    && (c.portal_begin <= c.portal_end && c.portal_end <= portals.size())
+			    && (c.distance_begin <= c.distance_end && c.distance_end <= distances.size()) )) {
+				throw std::runtime_error("Invalid cluster indices in cluster index of '" + filename + "'");
+			}
+
+			std::vector< uint32_t > wm_triangle_cluster;
+			wm_triangle_cluster.reserve(e.triangle_end - e.triangle_begin);
+			for (uint32_t ti = e.triangle_begin; ti != e.triangle_end; ++ti) {
+				if (!(c.cluster_begin <= triangle_clusters[ti] && triangle_clusters[ti] < c.cluster_end)) {
+					throw std::runtime_error("Invalid triangle cluster in '" + filename + "'");
+				}
+				wm_triangle_cluster.emplace_back(triangle_clusters[ti] - c.cluster_begin);
+			}
+			wm_clusters.triangle_cluster = std::move(wm_triangle_cluster);
+
+			std::vector< WalkMesh::Cluster > wm_cluster_list;
+			wm_cluster_list.reserve(c.cluster_end - c.cluster_begin);
+			for (uint32_t ci = c.cluster_begin; ci != c.cluster_end; ++ci) {
+				WalkMesh::Cluster cluster = clusters[ci];
+				uint32_t count = cluster.portal_end - cluster.portal_begin;
+				if (!( (c.portal_begin <= cluster.portal_begin && cluster.portal_begin <= cluster.portal_end && cluster.portal_end <= c.portal_end)
+				    && (c.distance_begin <= cluster.distance_begin && uint64_t(cluster.distance_begin) + uint64_t(count) * count <= c.distance_end) )) {
+					throw std::runtime_error("Invalid cluster in '" + filename + "'");
+				}
+				cluster.portal_begin -= c.portal_begin;
+				cluster.portal_end -= c.portal_begin;
+				cluster.distance_begin -= c.distance_begin;
+				wm_cluster_list.emplace_back(cluster);
+			}
+			wm_clusters.clusters = std::move(wm_cluster_list);
+
+			std::vector< WalkMesh::ClusterPortal > wm_portals;
+			wm_portals.reserve(c.portal_end - c.portal_begin);
+			for (uint32_t pi = c.portal_begin; pi != c.portal_end; ++pi) {
+				WalkMesh::ClusterPortal portal = portals[pi];
+				if (!( (e.triangle_begin <= portal.triangle && portal.triangle < e.triangle_end)
+				    && portal.edge < 3
+				    && (c.portal_begin <= portal.twin && portal.twin < c.portal_end) )) {
+					throw std::runtime_error("Invalid cluster portal in '" + filename + "'");
+				}
+				portal.triangle -= e.triangle_begin;
+				portal.twin -= c.portal_begin;
+				wm_portals.emplace_back(portal);
+			}
+			wm_clusters.portals = std::move(wm_portals);
+
+			wm_clusters.distances = std::vector< float >(distances.begin() + c.distance_begin, distances.begin() + c.distance_end);
+		}
+
+		//meshes without baked tables may come from an older exporter, which didn't sort them:
+		// (baked tables refer to triangles by index, so meshes that have them are left alone)
+		if (wm_frames.empty() && wm_clusters.triangle_cluster.empty()) {
+			WalkMesh::sort_for_locality(&wm_vertices, &wm_normals, &wm_triangles);
+		}
+
 		std::string name(names.begin() + e.name_begin, names.begin() + e.name_end);
 
-		auto ret = meshes.emplace(name, WalkMesh(wm_vertices, wm_normals, wm_triangles));
+		auto ret = meshes.emplace(name, WalkMesh(std::move(wm_vertices), std::move(wm_normals), std::move(wm_triangles), std::move(wm_frames), std::move(wm_clusters)));
 		if (!ret.second) {
 			throw std::runtime_error("WalkMesh with duplicated name '" + name + "' in '" + filename + "'");
 		}
@@ -389,6 +1755,113 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 	}
 }
 
+//Prebuilt files have an index chunk ("wmp0") of name ranges in a names chunk ("str0"), followed by each
+// mesh's arrays, in index order, as one chunk per array (see prebuilt_arrays below).
+// Every chunk's size is a multiple of four bytes, so mapped array data is aligned.
+struct PrebuiltIndexEntry {
+	uint32_t name_begin, name_end;
+};
+
+//call fn(magic, array) for each of a WalkMesh's arrays, in the order they appear in prebuilt files:
+template< typename WM, typename F >
+static void prebuilt_arrays(WM &wm, F const &fn) {
+	fn("p...", wm.vertices);
+	fn("n...", wm.normals);
+	fn("tri0", wm.triangles);
+	fn("frm0", wm.triangle_frames);
+	fn("veh0", wm.vertex_half_edges);
+	fn("hed0", wm.half_edges);
+	fn("nbr0", wm.triangle_neighbors);
+	fn("bvn0", wm.bvh_nodes);
+	fn("bvt0", wm.bvh_triangles);
+	fn("clt0", wm.clusters.triangle_cluster);
+	fn("clu0", wm.clusters.clusters);
+	fn("clp0", wm.clusters.portals);
+	fn("cld0", wm.clusters.distances);
+}
+
+void WalkMeshes::load_prebuilt(std::string const &filename) {
+	mapped = std::make_unique< MappedFile >(filename);
+	char const *at = mapped->data;
+	char const *end = mapped->data + mapped->size;
+
+	size_t index_count = 0;
+	PrebuiltIndexEntry const *index = view_chunk< PrebuiltIndexEntry >(&at, end, "wmp0", &index_count);
+
+	size_t names_count = 0;
+	char const *names = view_chunk< char >(&at, end, "str0", &names_count);
+
+	for (uint32_t i = 0; i < index_count; ++i) {
+		PrebuiltIndexEntry const &e = index[i];
+		if (!(e.name_begin <= e.name_end && e.name_end <= names_count)) {
+			throw std::runtime_error("Invalid name indices in index of '" + filename + "'");
+		}
+		std::string name(names + e.name_begin, names + e.name_end);
+
+		WalkMesh wm{WalkMesh::Prebuilt()};
+		prebuilt_arrays(wm, [&at, end](char const *magic, auto &array) {
+			using T = typename std::remove_reference< decltype(array[0]) >::type;
+			using Element = typename std::remove_const< T >::type;
+			size_t count = 0;
+			Element const *elements = view_chunk< Element >(&at, end, magic, &count);
+			array = WalkArray< Element >::view(elements, count);
+		});
+
+		//only sizes are checked (checking contents would page in the whole file):
+		if (!( wm.normals.size() == wm.vertices.size()
+		    && wm.triangle_frames.size() == wm.triangles.size()
+		    && wm.vertex_half_edges.size() == wm.vertices.size() + 1
+		    && wm.half_edges.size() == wm.triangles.size() * 3
+		    && wm.vertex_half_edges[wm.vertices.size()] == wm.half_edges.size()
+		    && wm.triangle_neighbors.size() == wm.triangles.size()
+		    && wm.bvh_triangles.size() == wm.triangles.size()
+		    && wm.bvh_nodes.empty() == wm.triangles.empty()
+		    && wm.clusters.triangle_cluster.size() == wm.triangles.size() )) {
+			throw std::runtime_error("Mis-matched array sizes for WalkMesh '" + name + "' in '" + filename + "'");
+		}
+
+		auto ret = meshes.emplace(name, std::move(wm));
+		if (!ret.second) {
+			throw std::runtime_error("WalkMesh with duplicated name '" + name + "' in '" + filename + "'");
+		}
+	}
+
+	if (at != end) {
+		std::cerr << "WARNING: trailing data in walkmesh file '" << filename << "'" << std::endl;
+	}
+}
+
+void WalkMeshes::write_prebuilt(std::ostream *to_) const {
+	assert(to_);
+	auto &to = *to_;
+
+	//write meshes in name order, so output doesn't depend on hash table order:
+	std::vector< std::pair< std::string, WalkMesh const * > > sorted;
+	for (auto const &[name, wm] : meshes) {
+		sorted.emplace_back(name, &wm);
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	std::vector< PrebuiltIndexEntry > index;
+	std::vector< char > names;
+	for (auto const &[name, wm] : sorted) {
+		index.emplace_back(PrebuiltIndexEntry{ uint32_t(names.size()), uint32_t(names.size() + name.size()) });
+		names.insert(names.end(), name.begin(), name.end());
+	}
+	//pad names so that the chunks after them stay aligned:
+	while (names.size() % 4 != 0) names.emplace_back('\0');
+
+	write_chunk("wmp0", index, &to);
+	write_chunk("str0", names, &to);
+	for (auto const &[name, wm] : sorted) {
+		prebuilt_arrays(*wm, [&to](char const *magic, auto const &array) {
+			using T = typename std::remove_const< typename std::remove_reference< decltype(array[0]) >::type >::type;
+			static_assert(sizeof(T) % 4 == 0 && alignof(T) <= 4, "array chunks keep mapped data aligned");
+			write_chunk(magic, array.data(), array.size(), &to);
+		});
+	}
+}
+
 WalkMesh const &WalkMeshes::lookup(std::string const &name) const {
 	auto f = meshes.find(name);
 	if (f == meshes.end()) {
@@ -1,11 +1,15 @@
 #pragma once
 
+#include "MappedFile.hpp"
+
 #include <glm/glm.hpp>
-#include <glm/gtx/hash.hpp> //allows the use of 'uvec2' as an unordered_map key
+#include <glm/gtc/quaternion.hpp>
 
+#include <memory>
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <limits>
 
 //"WalkPoint" represents location on the WalkMesh as barycentric coordinates on a triangle:
 struct WalkPoint {
@@ -18,22 +22,285 @@ struct WalkPoint {
 	WalkPoint() = default;
 };
 
+//"WalkPoints" stores many WalkPoints as a structure of arrays (for WalkMesh::walk_batch):
+struct WalkPoints {
+	std::vector< uint32_t > index_x, index_y, index_z; //WalkPoint::indices
+	std::vector< float > weight_x, weight_y, weight_z; //WalkPoint::weights
+
+	size_t size() const { return index_x.size(); }
+	void resize(size_t count) {
+		index_x.resize(count, -1U); index_y.resize(count, -1U); index_z.resize(count, -1U);
+		weight_x.resize(count, 0.0f); weight_y.resize(count, 0.0f); weight_z.resize(count, 0.0f);
+	}
+	WalkPoint get(size_t i) const {
+		return WalkPoint(glm::uvec3(index_x[i], index_y[i], index_z[i]), glm::vec3(weight_x[i], weight_y[i], weight_z[i]));
+	}
+	void set(size_t i, WalkPoint const &wp) {
+		index_x[i] = wp.indices.x; index_y[i] = wp.indices.y; index_z[i] = wp.indices.z;
+		weight_x[i] = wp.weights.x; weight_y[i] = wp.weights.y; weight_z[i] = wp.weights.z;
+	}
+};
+
+//"WalkSteps" stores one world-space step per WalkPoints entry:
+struct WalkSteps {
+	std::vector< float > x, y, z;
+
+	size_t size() const { return x.size(); }
+	void resize(size_t count) { x.resize(count, 0.0f); y.resize(count, 0.0f); z.resize(count, 0.0f); }
+	glm::vec3 get(size_t i) const { return glm::vec3(x[i], y[i], z[i]); }
+	void set(size_t i, glm::vec3 const &step) { x[i] = step.x; y[i] = step.y; z[i] = step.z; }
+};
+
+//"WalkRays" stores many rays as a structure of arrays (for WalkMesh::ray_cast_batch):
+struct WalkRays {
+	std::vector< float > origin_x, origin_y, origin_z;
+	std::vector< float > direction_x, direction_y, direction_z;
+	std::vector< float > max_t; //each ray runs from origin to origin + max_t * direction
+
+	size_t size() const { return origin_x.size(); }
+	void resize(size_t count) {
+		origin_x.resize(count, 0.0f); origin_y.resize(count, 0.0f); origin_z.resize(count, 0.0f);
+		direction_x.resize(count, 0.0f); direction_y.resize(count, 0.0f); direction_z.resize(count, 0.0f);
+		max_t.resize(count, 0.0f);
+	}
+	void set(size_t i, glm::vec3 const &origin, glm::vec3 const &direction, float max_t_) {
+		origin_x[i] = origin.x; origin_y[i] = origin.y; origin_z[i] = origin.z;
+		direction_x[i] = direction.x; direction_y[i] = direction.y; direction_z[i] = direction.z;
+		max_t[i] = max_t_;
+	}
+};
+
+//"WalkArray" is a read-only array that either owns its elements or refers to elements owned by something else:
+// (WalkMeshes uses the latter to point WalkMesh data straight into a memory-mapped file)
+template< typename T >
+struct WalkArray {
+	WalkArray() = default;
+	WalkArray(std::vector< T > &&from) : storage(std::move(from)), elements(storage.data()), count(storage.size()) { }
+	WalkArray(std::vector< T > const &from) : WalkArray(std::vector< T >(from)) { }
+
+	//refer to 'count_' elements at 'elements_' (which must stay alive as long as this array, and any copies, are used):
+	static WalkArray view(T const *elements_, size_t count_) {
+		WalkArray ret;
+		ret.elements = elements_;
+		ret.count = count_;
+		return ret;
+	}
+
+	//(moving a vector keeps its buffer, so moved arrays keep pointing at the right elements)
+	WalkArray(WalkArray const &other) : storage(other.storage), elements(other.storage.empty() ? other.elements : storage.data()), count(other.count) { }
+	WalkArray(WalkArray &&other) : storage(std::move(other.storage)), elements(other.elements), count(other.count) {
+		other.elements = nullptr;
+		other.count = 0;
+	}
+	WalkArray &operator=(WalkArray const &other) {
+		if (this != &other) *this = WalkArray(other);
+		return *this;
+	}
+	WalkArray &operator=(WalkArray &&other) {
+		storage = std::move(other.storage);
+		elements = other.elements;
+		count = other.count;
+		other.elements = nullptr;
+		other.count = 0;
+		return *this;
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	T const &operator[](size_t i) const { return elements[i]; }
+	T const *data() const { return elements; }
+	T const *begin() const { return elements; }
+	T const *end() const { return elements + count; }
+
+	//is this array viewing elements it doesn't own?
+	bool is_view() const { return storage.empty() && count != 0; }
+
+	std::vector< T > storage; //owned elements (empty for views)
+	T const *elements = nullptr;
+	size_t count = 0;
+};
+
 struct WalkMesh {
 	//Walk mesh will keep track of triangles, vertices:
-	std::vector< glm::vec3 > vertices;
-	std::vector< glm::vec3 > normals; //normals for interpolated 'up' direction
-	std::vector< glm::uvec3 > triangles; //CCW-oriented
+	WalkArray< glm::vec3 > vertices;
+	WalkArray< glm::vec3 > normals; //normals for interpolated 'up' direction
+	WalkArray< glm::uvec3 > triangles; //CCW-oriented
 
-	//This "next vertex" map includes [a,b]->c, [b,c]->a, and [c,a]->b for each triangle (a,b,c), and is useful for checking what's over an edge from a given point:
-	std::unordered_map< glm::uvec2, uint32_t > next_vertex;
+	//Half-edge table: each triangle (a,b,c) contributes half-edges a->b, b->c, and c->a.
+	// Half-edges are grouped by origin vertex, so the ones leaving vertex v are
+	//  half_edges[vertex_half_edges[v]] .. half_edges[vertex_half_edges[v+1]-1]
+	struct HalfEdge {
+		uint32_t to; //destination vertex
+		uint32_t next; //remaining vertex of the triangle, i.e. [from,to]->next
+		uint32_t triangle; //index of the triangle in 'triangles'
+	};
+	WalkArray< uint32_t > vertex_half_edges; //size is vertices.size() + 1
+	WalkArray< HalfEdge > half_edges;
 
-	//Construct new WalkMesh and build next_vertex structure:
-	WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_);
+	//Triangle adjacency: for triangle (a,b,c), the triangles across edges (a,b), (b,c), and (c,a):
+	// (-1U marks a boundary edge)
+	WalkArray< glm::uvec3 > triangle_neighbors;
+
+	//find the half-edge from->to, or nullptr if there isn't one:
+	HalfEdge const *find_half_edge(uint32_t from, uint32_t to) const {
+		for (uint32_t i = vertex_half_edges[from]; i < vertex_half_edges[from+1]; ++i) {
+			if (half_edges[i].to == to) return &half_edges[i];
+		}
+		return nullptr;
+	}
+
+	//Per-triangle data used by walk_in_triangle (same order as triangles):
+	struct TriangleFrame {
+		//to_barycentric[i] is the gradient of the barycentric weight of corner i,
+		// so 'step * to_barycentric' is the change in weights caused by a world-space step:
+		glm::mat3 to_barycentric;
+		glm::vec3 normal; //unit face normal
+	};
+	static_assert(sizeof(TriangleFrame) == 4*9 + 4*3, "TriangleFrame is packed.");
+	WalkArray< TriangleFrame > triangle_frames;
+
+	//compute the TriangleFrame for triangle a,b,c:
+	static TriangleFrame make_triangle_frame(glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c);
+
+	//find the index of the triangle with corners 'indices' (in any rotation), and which of its corners is indices.x:
+	// (returns -1U if there is no such triangle)
+	uint32_t find_triangle(glm::uvec3 const &indices, uint32_t *corner = nullptr) const {
+		HalfEdge const *he = find_half_edge(indices.x, indices.y);
+		if (!he || he->next != indices.z) return -1U;
+		if (corner) {
+			glm::uvec3 const &tri = triangles[he->triangle];
+			*corner = (tri.x == indices.x ? 0 : (tri.y == indices.x ? 1 : 2));
+		}
+		return he->triangle;
+	}
+
+	//Clusters of connected triangles, used for hierarchical pathfinding (see WalkPath.hpp):
+	// Paths between clusters go through portals -- edges with a different cluster on the other side --
+	//  and each cluster stores the distances between all pairs of its portals.
+	struct Cluster {
+		uint32_t portal_begin, portal_end; //range of this cluster's portals in clusters.portals
+		uint32_t distance_begin; //start of this cluster's (portal count) x (portal count) table in clusters.distances
+	};
+	struct ClusterPortal {
+		uint32_t triangle; //triangle (inside the cluster) with the portal edge
+		uint32_t edge; //which edge of triangle (numbered as in triangle_neighbors) leaves the cluster
+		uint32_t twin; //the portal on the other side of the edge
+	};
+	struct Clusters {
+		WalkArray< uint32_t > triangle_cluster; //cluster of each triangle
+		WalkArray< Cluster > clusters;
+		WalkArray< ClusterPortal > portals; //grouped by cluster
+		WalkArray< float > distances; //row-major portal-to-portal distances, infinity if not connected inside the cluster
+	};
+	Clusters clusters;
+	enum : uint32_t { ClusterSize = 128 }; //maximum triangles per cluster (when building clusters)
+	void build_clusters(); //(re-)build clusters from triangles (seeded in triangle order, as the exporter does)
+
+	//midpoint of edge 'edge' of triangle 'triangle' (edges numbered as in triangle_neighbors):
+	glm::vec3 edge_midpoint(uint32_t triangle, uint32_t edge) const {
+		glm::uvec3 const &tri = triangles[triangle];
+		return 0.5f * (vertices[tri[edge]] + vertices[tri[(edge+1)%3]]);
+	}
+
+	//working storage for portal_distances:
+	struct PortalDistancesScratch {
+		std::vector< uint32_t > visit_stamp; //per half-edge (triangle * 3 + edge)
+		std::vector< uint32_t > portal_stamp; //per half-edge; == stamp for the portals of the cluster being searched
+		std::vector< float > cost;
+		std::vector< std::pair< float, uint32_t > > open;
+		uint32_t stamp = 0;
+	};
+	//shortest distances from 'point' (on 'triangle') to each portal of triangle's cluster, staying inside the cluster:
+	// - paths are measured as moving between edge midpoints
+	// - distances[i] gets the distance to portal (portal_begin + i), or infinity if it can't be reached
+	void portal_distances(uint32_t triangle, glm::vec3 const &point, PortalDistancesScratch *scratch, float *distances) const;
+
+	//Construct new WalkMesh and build half-edge, adjacency, BVH, and cluster structures:
+	// (triangle_frames_ may be empty, in which case triangle frames are computed)
+	// (clusters_ may be empty, in which case clusters are built)
+	WalkMesh(WalkArray< glm::vec3 > vertices_, WalkArray< glm::vec3 > normals_, WalkArray< glm::uvec3 > triangles_, WalkArray< TriangleFrame > triangle_frames_ = WalkArray< TriangleFrame >(), Clusters clusters_ = Clusters());
+
+	//Construct an empty WalkMesh, for a loader to fill in every array (including half-edges, BVH, and clusters) directly:
+	// (used by WalkMeshes to view prebuilt walkmeshes in a memory-mapped file)
+	struct Prebuilt { };
+	explicit WalkMesh(Prebuilt) { }
+
+	//reorder triangles along a Morton (Z-order) curve through their centroids and renumber vertices in order of
+	// first use, so that triangles near each other in space are (mostly) near each other in memory:
+	// (call before constructing a WalkMesh; query results are the same in world space, only indices change)
+	// (if given, (*triangle_order)[new] and (*vertex_order)[new] get the old index of each triangle and vertex)
+	static void sort_for_locality(std::vector< glm::vec3 > *vertices, std::vector< glm::vec3 > *normals, std::vector< glm::uvec3 > *triangles, std::vector< uint32_t > *triangle_order = nullptr, std::vector< uint32_t > *vertex_order = nullptr);
+
+	//Bounding volume hierarchy over triangles (built in constructor), used to speed up nearest_walk_point:
+	struct BVHNode {
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity()); //bounds of all triangles below this node
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		uint32_t first = 0; //leaf: first index in bvh_triangles; interior: index of second child (first child is at this node's index + 1)
+		uint32_t count = 0; //leaf: number of triangles; interior: 0
+	};
+	WalkArray< BVHNode > bvh_nodes; //bvh_nodes[0] is the root
+	WalkArray< uint32_t > bvh_triangles; //triangle indices, grouped by leaf
+	enum : uint32_t { LeafSize = 4 }; //maximum triangles per leaf
+	//queries walk the BVH with a fixed-size stack, so they allocate nothing:
+	// (median splits keep the depth under log2(triangles) + 1, and each level pushes at most one node -- net --
+	//  so this covers any mesh that fits in 32-bit indices, with room to spare)
+	enum : uint32_t { BVHStack = 64 };
+	void build_bvh(); //(re-)build bvh_nodes and bvh_triangles from triangles
 
 	//used to initialize walking -- finds the closest point on the walk mesh:
-	// (should only need to call this at the start of a level)
+	// (uses the BVH; result is identical to nearest_walk_point_linear)
 	WalkPoint nearest_walk_point(glm::vec3 const &world_point) const;
 
+	//find the closest point to world_point on the part of the walk mesh around 'hint':
+	// (e.g., when re-snapping something that teleported, rode a platform, or got a network correction)
+	// - walks triangle adjacency from hint's triangle toward world_point, usually visiting only a few triangles
+	// - the result is the closest point locally; if world_point is off the mesh and another part of the
+	//   mesh (e.g., a bridge overhead) is closer, nearest_walk_point would jump there but relocate doesn't
+	// - falls back to nearest_walk_point if hint is not on the mesh or the walk takes RelocateVisits steps
+	// - also falls back if the walk stops at a boundary edge (or turns back) and the closest point it found is more
+	//   than RelocateSnap from world_point, since world_point may be on another part of the mesh (e.g., across a gap)
+	enum : uint32_t { RelocateVisits = 64 };
+	static constexpr float RelocateSnap = 1e-4f;
+	WalkPoint relocate(WalkPoint const &hint, glm::vec3 const &world_point) const;
+
+	//reference version of nearest_walk_point that checks every triangle:
+	// (useful for testing and benchmarking)
+	WalkPoint nearest_walk_point_linear(glm::vec3 const &world_point) const;
+
+
+	//cast a ray from 'origin' along 'direction' (need not be unit length), hitting either side of triangles:
+	// - if it hits the mesh at origin + t * direction for some 0 <= t <= max_t, *hit gets the closest hit,
+	//   *hit_t gets its t, and the function returns true
+	// - otherwise *hit and *hit_t are left alone and the function returns false
+	// (uses the BVH; result is identical to ray_cast_linear)
+	bool ray_cast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, WalkPoint *hit, float *hit_t) const;
+
+	//reference version of ray_cast that checks every triangle:
+	// (useful for testing and benchmarking)
+	bool ray_cast_linear(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, WalkPoint *hit, float *hit_t) const;
+
+	//cast many rays; equivalent to calling ray_cast for each ray, except that misses set hits entry to
+	// WalkPoint() and hit_ts entry to infinity:
+	// (rays go through the BVH in packets of BatchLanes, so nearby rays share node visits)
+	enum : uint32_t { BatchLanes = 8 };
+	void ray_cast_batch(WalkRays const &rays, WalkPoints *hits, std::vector< float > *hit_ts) const;
+
+	//trace a straight line over the mesh from 'start' to (start + step), as seen from above (ignoring z):
+	// ("can I walk straight there?" -- unlike walk(), the line doesn't slide along walls)
+	//  if the end is reached without leaving the mesh:
+	//   - *end is the walk point there
+	//   - function returns true
+	//  if the line hits a boundary edge first:
+	//   - *end is the point where it hits, on boundary edge (end->indices.x, end->indices.y) (so end->weights.z == 0.0f)
+	//   - function returns false
+	//  (edges where the mesh folds back under itself, as seen from above, count as boundary edges)
+	bool trace_straight(WalkPoint const &start, glm::vec3 const &step, WalkPoint *end) const;
+
+	//trace many lines; equivalent to calling trace_straight for each, with (*reached)[i] getting its result:
+	// (each trace is a chain of dependent triangle lookups with little to share between traces -- interleaving
+	//  BatchLanes of them was measured at only ~2% faster on a 1M-triangle mesh -- so this is a plain loop,
+	//  for callers that keep agents in WalkPoints)
+	void trace_straight_batch(WalkPoints const &starts, WalkSteps const &steps, WalkPoints *ends, std::vector< uint8_t > *reached) const;
 
 	//take a step on a triangle, stopping at edges:
 	//  if the step stays within the triangle:
@@ -64,6 +331,24 @@ struct WalkMesh {
 		glm::quat *rotation     //[out] rotation over edge
 	) const;
 
+	//walk 'step' (in world space) along the mesh starting at *at, crossing edges and sliding along walls:
+	// (this is the same loop the player uses; at most 'max_iterations' triangle steps are taken)
+	// returns true if the whole step was taken, false if the iteration budget ran out first
+	bool walk(WalkPoint *at, glm::vec3 const &step, uint32_t max_iterations = 10) const;
+
+	//bend the rest of a step so that it bounces off / slides along boundary edge (at.indices.x, at.indices.y):
+	// (used by walk when it runs into a wall)
+	glm::vec3 slide_along_edge(WalkPoint const &at, glm::vec3 const &remain) const;
+
+	//walk many points at once; equivalent to calling walk() for each point with its step:
+	// (points go in groups of WalkGroup, and each pass over a group takes one triangle step for every point
+	//  still walking -- stepping within the triangle, crossing edges, and sliding along walls four points at
+	//  a time with Lanes4.hpp -- then packs the points that are still walking to the front for the next pass;
+	//  points keep their triangle index between passes, so frames and neighbors are read directly instead of
+	//  found by searching half-edges as walk() does)
+	enum : uint32_t { WalkGroup = 128 };
+	void walk_batch(WalkPoints *points, WalkSteps const &steps, uint32_t max_iterations = 10) const;
+
 	//used to read back results of walking:
 	glm::vec3 to_world_point(WalkPoint const &wp) const {
 		//if you were looking here for the lesson solution, well, here you go:
@@ -94,11 +379,20 @@ struct WalkMesh {
 
 struct WalkMeshes {
 	//load a list of named WalkMeshes from a file:
+	// - files from export-walkmeshes.py are read and each WalkMesh is built (half-edges, BVH, ...) as it is loaded
+	// - "prebuilt" files from write_prebuilt are memory-mapped, and each WalkMesh's arrays point straight into
+	//   the mapping, so loading is just checking chunk headers (pages are read as queries first touch them)
 	WalkMeshes(std::string const &filename);
 
 	//retrieve a WalkMesh by name:
 	WalkMesh const &lookup(std::string const &name) const;
 
+	//write every mesh, with all of its built arrays, in the prebuilt format:
+	// (prebuilt files are trusted: only array sizes are checked when loading, so only load files written here)
+	void write_prebuilt(std::ostream *to) const;
+
 	//internals:
+	void load_prebuilt(std::string const &filename);
+	std::unique_ptr< MappedFile > mapped; //file viewed by prebuilt meshes (declared first, so it outlives them)
 	std::unordered_map< std::string, WalkMesh > meshes;
 };
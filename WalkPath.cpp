@@ -0,0 +1,422 @@
+#include "WalkPath.hpp"
+
+#include <glm/gtx/norm.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+WalkPathfinder::WalkPathfinder(WalkMesh const &walkmesh_) : walkmesh(walkmesh_) {
+	size_t count = walkmesh.triangles.size();
+	visit_stamp.assign(count, 0);
+	cost.resize(count);
+	entry.resize(count);
+	came_from.resize(count);
+
+	WalkMesh::Clusters const &clusters = walkmesh.clusters;
+	portal_visit_stamp.assign(clusters.portals.size() + 1, 0);
+	portal_cost.resize(clusters.portals.size() + 1);
+	portal_came_from.resize(clusters.portals.size() + 1);
+	portal_midpoints.reserve(clusters.portals.size());
+	portal_clusters.reserve(clusters.portals.size());
+	for (auto const &portal : clusters.portals) {
+		portal_midpoints.emplace_back(walkmesh.edge_midpoint(portal.triangle, portal.edge));
+		portal_clusters.emplace_back(clusters.triangle_cluster[portal.triangle]);
+	}
+}
+
+bool WalkPathfinder::find_path(WalkPoint const &start, WalkPoint const &goal, std::vector< WalkPoint > *path_) {
+	assert(path_);
+	auto &path = *path_;
+	path.clear();
+	path_length = 0.0f;
+
+	uint32_t start_triangle = walkmesh.find_triangle(start.indices);
+	uint32_t goal_triangle = walkmesh.find_triangle(goal.indices);
+	assert(start_triangle < walkmesh.triangles.size() && "start must be on a walkmesh triangle");
+	assert(goal_triangle < walkmesh.triangles.size() && "goal must be on a walkmesh triangle");
+
+	glm::vec3 start_point = walkmesh.to_world_point(start);
+	glm::vec3 goal_point = walkmesh.to_world_point(goal);
+	if (use_clusters && is_long_range(start_triangle, goal_triangle)) {
+		//long-range query: plan over clusters, then find the corridor inside them:
+		if (!find_cluster_route(start_triangle, start_point, goal_triangle, goal_point)) return false;
+		refine_cluster_route(start_triangle, start_point, goal_triangle, goal_point);
+	} else {
+		if (!find_corridor(start_triangle, start_point, goal_triangle, goal_point)) return false;
+	}
+	unfold_corridor(start, goal);
+	pull_string(start, goal, &path);
+
+	for (uint32_t i = 1; i < path.size(); ++i) {
+		path_length += glm::length(walkmesh.to_world_point(path[i]) - walkmesh.to_world_point(path[i-1]));
+	}
+	return true;
+}
+
+//point on edge a-b closest to the line from 'from' toward 'goal':
+// (paths that aim straight at the goal get a cost equal to their length on flat ground, so A*
+//  prefers corridors that contain the straight-line path, which is what the funnel wants)
+static glm::vec3 edge_entry(glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &from, glm::vec3 const &goal) {
+	glm::vec3 ab = b - a;
+	glm::vec3 dir = goal - from;
+	glm::vec3 af = from - a;
+	float ab2 = glm::dot(ab, ab);
+	float dir2 = glm::dot(dir, dir);
+	float ab_dir = glm::dot(ab, dir);
+	float denom = ab2 * dir2 - ab_dir * ab_dir;
+	float s = 0.5f; //midpoint if lines are (nearly) parallel
+	if (denom > 1e-6f * ab2 * dir2) {
+		s = (glm::dot(af, ab) * dir2 - glm::dot(af, dir) * ab_dir) / denom;
+		s = glm::clamp(s, 0.0f, 1.0f);
+	}
+	return a + s * ab;
+}
+
+bool WalkPathfinder::is_long_range(uint32_t start_triangle, uint32_t goal_triangle) const {
+	WalkMesh::Clusters const &clusters = walkmesh.clusters;
+	uint32_t start_cluster = clusters.triangle_cluster[start_triangle];
+	uint32_t goal_cluster = clusters.triangle_cluster[goal_triangle];
+	if (start_cluster == goal_cluster) return false;
+	WalkMesh::Cluster const &sc = clusters.clusters[start_cluster];
+	for (uint32_t p = sc.portal_begin; p < sc.portal_end; ++p) {
+		if (portal_clusters[clusters.portals[p].twin] == goal_cluster) return false;
+	}
+	return true;
+}
+
+bool WalkPathfinder::find_cluster_route(uint32_t start_triangle, glm::vec3 const &start_point, uint32_t goal_triangle, glm::vec3 const &goal_point) {
+	WalkMesh::Clusters const &clusters = walkmesh.clusters;
+
+	route_stamp += 1;
+	if (route_stamp == 0) {
+		std::fill(portal_visit_stamp.begin(), portal_visit_stamp.end(), 0);
+		route_stamp = 1;
+	}
+
+	//distances from start and goal to the portals of their clusters:
+	uint32_t start_cluster = clusters.triangle_cluster[start_triangle];
+	uint32_t goal_cluster = clusters.triangle_cluster[goal_triangle];
+	WalkMesh::Cluster const &sc = clusters.clusters[start_cluster];
+	WalkMesh::Cluster const &gc = clusters.clusters[goal_cluster];
+	start_distances.resize(sc.portal_end - sc.portal_begin);
+	walkmesh.portal_distances(start_triangle, start_point, &portal_scratch, start_distances.data());
+	goal_distances.resize(gc.portal_end - gc.portal_begin);
+	walkmesh.portal_distances(goal_triangle, goal_point, &portal_scratch, goal_distances.data());
+
+	uint32_t const goal_node = uint32_t(clusters.portals.size());
+	auto estimate = [&](uint32_t node) {
+		if (node == goal_node) return portal_cost[node];
+		return portal_cost[node] + route_heuristic_weight * glm::length(goal_point - portal_midpoints[node]);
+	};
+	typedef std::pair< float, uint32_t > Open;
+	auto cmp = std::greater< Open >(); //makes open into a min-heap
+	open.clear();
+	auto reach = [&](uint32_t node, float node_cost, uint32_t from) {
+		if (node_cost == std::numeric_limits< float >::infinity()) return;
+		if (portal_visit_stamp[node] == route_stamp && portal_cost[node] <= node_cost) return;
+		portal_visit_stamp[node] = route_stamp;
+		portal_cost[node] = node_cost;
+		portal_came_from[node] = from;
+		open.emplace_back(estimate(node), node);
+		std::push_heap(open.begin(), open.end(), cmp);
+	};
+
+	for (uint32_t i = 0; i < start_distances.size(); ++i) {
+		reach(sc.portal_begin + i, start_distances[i], -1U);
+	}
+
+	bool found = false;
+	while (!open.empty()) {
+		std::pop_heap(open.begin(), open.end(), cmp);
+		Open at = open.back();
+		open.pop_back();
+
+		uint32_t node = at.second;
+		if (at.first > estimate(node)) continue; //stale entry; node was reached more cheaply since
+		if (node == goal_node) {
+			found = true;
+			break;
+		}
+
+		float node_cost = portal_cost[node];
+		uint32_t c = portal_clusters[node];
+		WalkMesh::Cluster const &cluster = clusters.clusters[c];
+
+		//step through the portal into the neighboring cluster:
+		reach(clusters.portals[node].twin, node_cost, node);
+
+		//move to the other portals of this cluster:
+		uint32_t count = cluster.portal_end - cluster.portal_begin;
+		float const *row = &clusters.distances[cluster.distance_begin + (node - cluster.portal_begin) * count];
+		for (uint32_t i = 0; i < count; ++i) {
+			if (cluster.portal_begin + i == node) continue;
+			reach(cluster.portal_begin + i, node_cost + row[i], node);
+		}
+
+		//finish at the goal:
+		if (c == goal_cluster) {
+			reach(goal_node, node_cost + goal_distances[node - gc.portal_begin], node);
+		}
+	}
+	if (!found) return false;
+
+	route.clear();
+	for (uint32_t node = portal_came_from[goal_node]; node != -1U; node = portal_came_from[node]) {
+		route.emplace_back(node);
+	}
+	std::reverse(route.begin(), route.end());
+	return true;
+}
+
+void WalkPathfinder::refine_cluster_route(uint32_t start_triangle, glm::vec3 const &start_point, uint32_t goal_triangle, glm::vec3 const &goal_point) {
+	WalkMesh::Clusters const &clusters = walkmesh.clusters;
+	assert(!route.empty());
+
+	//append the corridor from 'from' to 'to' (both in the same cluster), sharing the first triangle with the corridor so far:
+	route_corridor.clear();
+	route_corridor.emplace_back(start_triangle);
+	auto append = [&](uint32_t from_triangle, glm::vec3 const &from_point, uint32_t to_triangle, glm::vec3 const &to_point) {
+		assert(route_corridor.back() == from_triangle);
+		bool found = find_corridor(from_triangle, from_point, to_triangle, to_point, clusters.triangle_cluster[from_triangle]);
+		assert(found && "portal distance tables say the cluster connects these points");
+		(void)found;
+		route_corridor.insert(route_corridor.end(), corridor.begin() + 1, corridor.end());
+	};
+
+	uint32_t at_triangle = start_triangle;
+	glm::vec3 at_point = start_point;
+	for (uint32_t i = 0; i < route.size(); ++i) {
+		WalkMesh::ClusterPortal const &portal = clusters.portals[route[i]];
+		glm::vec3 const &mid = portal_midpoints[route[i]];
+		if (i > 0 && route[i] == clusters.portals[route[i-1]].twin) {
+			//stepped through the previous portal into this cluster:
+			route_corridor.emplace_back(portal.triangle);
+		} else {
+			//moved across a cluster to this portal:
+			append(at_triangle, at_point, portal.triangle, mid);
+		}
+		at_triangle = portal.triangle;
+		at_point = mid;
+	}
+	append(at_triangle, at_point, goal_triangle, goal_point);
+
+	corridor.swap(route_corridor);
+}
+
+bool WalkPathfinder::find_corridor(uint32_t start_triangle, glm::vec3 const &start_point, uint32_t goal_triangle, glm::vec3 const &goal_point, uint32_t only_cluster) {
+	//new stamp invalidates all per-triangle state from the last query:
+	stamp += 1;
+	if (stamp == 0) {
+		std::fill(visit_stamp.begin(), visit_stamp.end(), 0);
+		stamp = 1;
+	}
+	auto visit = [this](uint32_t t) {
+		if (visit_stamp[t] != stamp) {
+			visit_stamp[t] = stamp;
+			cost[t] = std::numeric_limits< float >::infinity();
+			came_from[t] = -1U;
+		}
+	};
+	auto estimate = [this, &goal_point](uint32_t t) {
+		return cost[t] + glm::length(goal_point - entry[t]);
+	};
+	typedef std::pair< float, uint32_t > Open;
+	auto cmp = std::greater< Open >(); //makes open into a min-heap
+
+	open.clear();
+	visit(start_triangle);
+	cost[start_triangle] = 0.0f;
+	entry[start_triangle] = start_point;
+	open.emplace_back(estimate(start_triangle), start_triangle);
+
+	bool found = false;
+	while (!open.empty()) {
+		std::pop_heap(open.begin(), open.end(), cmp);
+		Open at = open.back();
+		open.pop_back();
+
+		uint32_t t = at.second;
+		if (at.first > estimate(t)) continue; //stale entry; triangle was reached more cheaply since
+		if (t == goal_triangle) {
+			found = true;
+			break;
+		}
+
+		glm::uvec3 const &tri = walkmesh.triangles[t];
+		for (uint32_t e = 0; e < 3; ++e) {
+			uint32_t n = walkmesh.triangle_neighbors[t][e];
+			if (n == -1U) continue;
+			if (only_cluster != -1U && walkmesh.clusters.triangle_cluster[n] != only_cluster) continue;
+			glm::vec3 through = edge_entry(walkmesh.vertices[tri[e]], walkmesh.vertices[tri[(e+1)%3]], entry[t], goal_point);
+			float next_cost = cost[t] + glm::length(through - entry[t]);
+			visit(n);
+			if (next_cost < cost[n]) {
+				cost[n] = next_cost;
+				entry[n] = through;
+				came_from[n] = t;
+				open.emplace_back(estimate(n), n);
+				std::push_heap(open.begin(), open.end(), cmp);
+			}
+		}
+	}
+	if (!found) return false;
+
+	corridor.clear();
+	for (uint32_t t = goal_triangle; t != -1U; t = came_from[t]) {
+		corridor.emplace_back(t);
+	}
+	std::reverse(corridor.begin(), corridor.end());
+	assert(corridor[0] == start_triangle);
+	return true;
+}
+
+void WalkPathfinder::unfold_corridor(WalkPoint const &start, WalkPoint const &goal) {
+	assert(!corridor.empty());
+	auto const &vertices = walkmesh.vertices;
+
+	//unfolded positions of the corners of the current corridor triangle (in triangles[] corner order):
+	glm::vec2 at[3];
+	{ //lay out first triangle with corner 0 at the origin and corner 1 along +x:
+		glm::uvec3 const &tri = walkmesh.triangles[corridor[0]];
+		glm::vec3 ab = vertices[tri.y] - vertices[tri.x];
+		glm::vec3 ac = vertices[tri.z] - vertices[tri.x];
+		float len = glm::length(ab);
+		float along = glm::dot(ac, ab) / len;
+		at[0] = glm::vec2(0.0f);
+		at[1] = glm::vec2(len, 0.0f);
+		at[2] = glm::vec2(along, glm::length(ac - ab * (along / len)));
+	}
+
+	//position of a walk point on the current corridor triangle:
+	auto unfold_point = [&](uint32_t t, WalkPoint const &wp) {
+		glm::uvec3 const &tri = walkmesh.triangles[t];
+		glm::vec2 ret = glm::vec2(0.0f);
+		for (uint32_t i = 0; i < 3; ++i) {
+			uint32_t c = (tri.x == wp.indices[i] ? 0 : (tri.y == wp.indices[i] ? 1 : 2));
+			ret += wp.weights[i] * at[c];
+		}
+		return ret;
+	};
+
+	portals.clear();
+	{
+		glm::vec2 pt = unfold_point(corridor[0], start);
+		portals.emplace_back(Portal{pt, pt, -1U, -1U, corridor[0]});
+	}
+
+	for (uint32_t i = 0; i + 1 < corridor.size(); ++i) {
+		uint32_t t = corridor[i];
+		uint32_t next = corridor[i+1];
+		glm::uvec3 const &tri = walkmesh.triangles[t];
+		glm::uvec3 const &next_tri = walkmesh.triangles[next];
+
+		//find the shared edge u->v (CCW in t, so t is on its left):
+		uint32_t e = 0;
+		while (e < 3 && walkmesh.triangle_neighbors[t][e] != next) ++e;
+		assert(e < 3 && "corridor triangles must be adjacent");
+		uint32_t u = tri[e];
+		uint32_t v = tri[(e+1)%3];
+		glm::vec2 U = at[e];
+		glm::vec2 V = at[(e+1)%3];
+
+		//walking from t into next, v is on the left and u is on the right:
+		portals.emplace_back(Portal{V, U, v, u, t});
+
+		//unfold the remaining corner 'w' of next to the right of u->v:
+		uint32_t cu = (next_tri.x == u ? 0 : (next_tri.y == u ? 1 : 2));
+		uint32_t cv = (next_tri.x == v ? 0 : (next_tri.y == v ? 1 : 2));
+		uint32_t cw = 3 - cu - cv;
+		glm::vec3 uv = vertices[v] - vertices[u];
+		glm::vec3 uw = vertices[next_tri[cw]] - vertices[u];
+		float len = glm::length(uv);
+		float along = glm::dot(uw, uv) / len;
+		float height = glm::length(uw - uv * (along / len));
+		glm::vec2 dir = (V - U) / glm::length(V - U);
+		glm::vec2 perp = glm::vec2(-dir.y, dir.x);
+
+		at[cu] = U;
+		at[cv] = V;
+		at[cw] = U + along * dir - height * perp;
+	}
+
+	{
+		glm::vec2 pt = unfold_point(corridor.back(), goal);
+		portals.emplace_back(Portal{pt, pt, -1U, -1U, corridor.back()});
+	}
+}
+
+void WalkPathfinder::pull_string(WalkPoint const &start, WalkPoint const &goal, std::vector< WalkPoint > *path_) {
+	assert(path_);
+	auto &path = *path_;
+	assert(portals.size() >= 2);
+
+	//twice the signed area of triangle a,b,c (positive if c is to the left of a->b):
+	auto area2 = [](glm::vec2 const &a, glm::vec2 const &b, glm::vec2 const &c) {
+		glm::vec2 ab = b - a;
+		glm::vec2 ac = c - a;
+		return ab.x * ac.y - ab.y * ac.x;
+	};
+
+	//add a corner at one side of a portal to the path:
+	auto add_corner = [&](uint32_t p, bool left) {
+		if (p == 0 || p + 1 == portals.size()) return; //start and goal are added separately
+		Portal const &portal = portals[p];
+		uint32_t vertex = (left ? portal.left_vertex : portal.right_vertex);
+		glm::uvec3 const &tri = walkmesh.triangles[portal.triangle];
+		uint32_t c = (tri.x == vertex ? 0 : (tri.y == vertex ? 1 : 2));
+		WalkPoint wp(glm::uvec3(tri[c], tri[(c+1)%3], tri[(c+2)%3]), glm::vec3(1.0f, 0.0f, 0.0f));
+		if (path.back().indices.x == wp.indices.x && path.back().weights == wp.weights) return;
+		path.emplace_back(wp);
+	};
+
+	path.emplace_back(start);
+
+	//"simple stupid funnel algorithm", following Mikko Mononen's description:
+	// http://digestingduck.blogspot.com/2010/03/simple-stupid-funnel-algorithm.html
+	glm::vec2 apex = portals[0].left;
+	glm::vec2 funnel_left = portals[0].left;
+	glm::vec2 funnel_right = portals[0].right;
+	uint32_t apex_index = 0, left_index = 0, right_index = 0;
+
+	for (uint32_t i = 1; i < portals.size(); ++i) {
+		glm::vec2 const &left = portals[i].left;
+		glm::vec2 const &right = portals[i].right;
+
+		//try to narrow funnel from the right:
+		if (area2(apex, funnel_right, right) >= 0.0f) {
+			if (apex == funnel_right || area2(apex, funnel_left, right) < 0.0f) {
+				funnel_right = right;
+				right_index = i;
+			} else {
+				//right crossed over left, so left is a corner:
+				add_corner(left_index, true);
+				apex = funnel_left;
+				apex_index = left_index;
+				funnel_left = funnel_right = apex;
+				left_index = right_index = apex_index;
+				i = apex_index;
+				continue;
+			}
+		}
+
+		//try to narrow funnel from the left:
+		if (area2(apex, funnel_left, left) <= 0.0f) {
+			if (apex == funnel_left || area2(apex, funnel_right, left) > 0.0f) {
+				funnel_left = left;
+				left_index = i;
+			} else {
+				//left crossed over right, so right is a corner:
+				add_corner(right_index, false);
+				apex = funnel_right;
+				apex_index = right_index;
+				funnel_left = funnel_right = apex;
+				left_index = right_index = apex_index;
+				i = apex_index;
+				continue;
+			}
+		}
+	}
+
+	path.emplace_back(goal);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+/*
+ * A "WalkPathfinder" answers "how do I get from here to there" queries on a
+ *  WalkMesh.
+ *
+ * Queries run A* over the triangle adjacency graph (WalkMesh::triangle_neighbors)
+ *  to find a corridor of triangles, unfold that corridor into a plane, and
+ *  straighten it with the "simple stupid funnel" algorithm.
+ *
+ * When the start and goal are in different clusters (WalkMesh::clusters), the
+ *  search first runs over the much smaller graph of cluster portals, then
+ *  refines that route with a small A* inside each cluster it passes through.
+ *
+ * All working storage lives in the WalkPathfinder and is reused between queries,
+ *  so (once warmed up) queries do not allocate.
+ *
+ */
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct WalkPathfinder {
+	WalkPathfinder(WalkMesh const &walkmesh);
+
+	WalkMesh const &walkmesh;
+
+	//find a path from 'start' to 'goal':
+	// - on success, *path gets a polyline from start to goal (inclusive) with a point at each corner, and the function returns true
+	// - if goal is not reachable from start, *path is cleared and the function returns false
+	//  (*path is cleared and filled in place, so reusing the same vector avoids allocation)
+	bool find_path(WalkPoint const &start, WalkPoint const &goal, std::vector< WalkPoint > *path);
+
+	//length (in world units) of the last path found by find_path:
+	float path_length = 0.0f;
+
+	//search the cluster graph first for long-range queries (start and goal clusters are not the same or neighbors):
+	// (false searches every triangle, which is slower on large meshes but can find slightly shorter paths)
+	bool use_clusters = true;
+
+	//weight on the cluster route search's distance-to-goal estimate:
+	// (portal-to-portal distances zig-zag through edge midpoints, so are well above straight-line
+	//  distance; without extra weight the route search expands most of the cluster graph)
+	float route_heuristic_weight = 1.5f;
+
+	//--- internals (kept between queries to avoid allocation) ---
+
+	//per-triangle A* state; entries are valid only if visit_stamp[t] == stamp:
+	std::vector< uint32_t > visit_stamp;
+	std::vector< float > cost; //cost to reach triangle
+	std::vector< glm::vec3 > entry; //where the best path enters the triangle
+	std::vector< uint32_t > came_from; //previous triangle along best path
+	uint32_t stamp = 0;
+
+	//A* open set, as a heap of (estimated total cost, triangle):
+	std::vector< std::pair< float, uint32_t > > open;
+
+	//cluster route search state; portal entries are valid only if portal_visit_stamp[p] == route_stamp:
+	// (node portals.size() stands for the goal)
+	WalkMesh::PortalDistancesScratch portal_scratch;
+	std::vector< float > start_distances, goal_distances; //from start/goal to the portals of their clusters
+	std::vector< uint32_t > portal_visit_stamp;
+	std::vector< float > portal_cost;
+	std::vector< uint32_t > portal_came_from;
+	std::vector< glm::vec3 > portal_midpoints; //edge midpoint of each portal (copied here so the search stays in cache)
+	std::vector< uint32_t > portal_clusters; //cluster of each portal
+	uint32_t route_stamp = 0;
+
+	//portals along the cluster route, from start's cluster to goal's cluster:
+	std::vector< uint32_t > route;
+
+	//triangle corridor from start to goal:
+	std::vector< uint32_t > corridor;
+	std::vector< uint32_t > route_corridor; //corridor being assembled from per-cluster pieces
+
+	//corridor edges unfolded into the plane, for the funnel:
+	struct Portal {
+		glm::vec2 left, right; //unfolded positions of edge endpoints (as seen walking along the corridor)
+		uint32_t left_vertex, right_vertex; //walkmesh vertex indices (-1U for the start/goal portals)
+		uint32_t triangle; //corridor triangle just before the portal
+	};
+	std::vector< Portal > portals;
+
+	//are start and goal clusters different and not neighbors?
+	bool is_long_range(uint32_t start_triangle, uint32_t goal_triangle) const;
+	//find route through cluster portals with A*; returns false if there isn't one:
+	bool find_cluster_route(uint32_t start_triangle, glm::vec3 const &start_point, uint32_t goal_triangle, glm::vec3 const &goal_point);
+	//find triangle corridor along the route, one cluster at a time:
+	void refine_cluster_route(uint32_t start_triangle, glm::vec3 const &start_point, uint32_t goal_triangle, glm::vec3 const &goal_point);
+	//find triangle corridor with A* (optionally staying inside one cluster); returns false if there isn't one:
+	bool find_corridor(uint32_t start_triangle, glm::vec3 const &start_point, uint32_t goal_triangle, glm::vec3 const &goal_point, uint32_t only_cluster = -1U);
+	//unfold corridor and fill in portals:
+	void unfold_corridor(WalkPoint const &start, WalkPoint const &goal);
+	//string-pull through portals, appending corner walk points to *path:
+	void pull_string(WalkPoint const &start, WalkPoint const &goal, std::vector< WalkPoint > *path);
+};
@@ -0,0 +1,412 @@
+#include "WalkTiles.hpp"
+
+#include "read_write_chunk.hpp"
+
+#include <glm/gtx/norm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <map>
+
+void WalkTiles::write(WalkMesh const &walkmesh, float tile_size, std::ostream *to_) {
+	assert(to_);
+	auto &to = *to_;
+	assert(tile_size > 0.0f);
+
+	WalkArray< glm::uvec3 > const &triangles = walkmesh.triangles;
+
+	//assign each triangle to the tile containing its centroid (in xy):
+	std::vector< glm::ivec2 > triangle_cell;
+	triangle_cell.reserve(triangles.size());
+	std::map< std::pair< int32_t, int32_t >, uint32_t > cell_tile; //(y,x) => tile index
+	for (auto const &tri : triangles) {
+		glm::vec3 centroid = (walkmesh.vertices[tri.x] + walkmesh.vertices[tri.y] + walkmesh.vertices[tri.z]) / 3.0f;
+		glm::ivec2 cell = glm::ivec2(glm::floor(glm::vec2(centroid) / tile_size));
+		triangle_cell.emplace_back(cell);
+		cell_tile.emplace(std::make_pair(cell.y, cell.x), 0);
+	}
+
+	//number tiles in row-major order:
+	std::vector< TileInfo > tiles;
+	tiles.reserve(cell_tile.size());
+	for (auto &[yx, index] : cell_tile) {
+		index = uint32_t(tiles.size());
+		TileInfo info;
+		info.min = glm::vec3( std::numeric_limits< float >::infinity());
+		info.max = glm::vec3(-std::numeric_limits< float >::infinity());
+		info.x = yx.second;
+		info.y = yx.first;
+		info.offset = 0;
+		tiles.emplace_back(info);
+	}
+
+	//triangles of each tile (in walkmesh order), and where each triangle ends up:
+	std::vector< std::vector< uint32_t > > tile_triangles(tiles.size());
+	std::vector< uint32_t > triangle_tile(triangles.size());
+	std::vector< uint32_t > triangle_local(triangles.size());
+	for (uint32_t ti = 0; ti < triangles.size(); ++ti) {
+		uint32_t tile = cell_tile[std::make_pair(triangle_cell[ti].y, triangle_cell[ti].x)];
+		triangle_tile[ti] = tile;
+		triangle_local[ti] = uint32_t(tile_triangles[tile].size());
+		tile_triangles[tile].emplace_back(ti);
+	}
+
+	//write each tile's chunks, numbering its vertices in order of first use:
+	std::ostringstream data;
+	std::vector< uint32_t > vertex_local(walkmesh.vertices.size(), -1U);
+	for (uint32_t tile = 0; tile < tiles.size(); ++tile) {
+		TileInfo &info = tiles[tile];
+
+		std::vector< uint32_t > tile_vertices; //walkmesh index of each tile vertex
+		std::vector< glm::uvec3 > tile_tris;
+		std::vector< WalkMesh::TriangleFrame > tile_frames;
+		std::vector< Stitch > stitches;
+		tile_tris.reserve(tile_triangles[tile].size());
+		tile_frames.reserve(tile_triangles[tile].size());
+		for (uint32_t ti : tile_triangles[tile]) {
+			glm::uvec3 const &tri = triangles[ti];
+			glm::uvec3 local;
+			for (uint32_t i = 0; i < 3; ++i) {
+				if (vertex_local[tri[i]] == -1U) {
+					vertex_local[tri[i]] = uint32_t(tile_vertices.size());
+					tile_vertices.emplace_back(tri[i]);
+				}
+				local[i] = vertex_local[tri[i]];
+				info.min = glm::min(info.min, walkmesh.vertices[tri[i]]);
+				info.max = glm::max(info.max, walkmesh.vertices[tri[i]]);
+			}
+			tile_tris.emplace_back(local);
+			tile_frames.emplace_back(walkmesh.triangle_frames[ti]);
+
+			//stitch edges whose neighbor is in another tile:
+			for (uint32_t e = 0; e < 3; ++e) {
+				uint32_t other = walkmesh.triangle_neighbors[ti][e];
+				if (other == -1U || triangle_tile[other] == tile) continue;
+				//the same edge in the other triangle runs the other way:
+				glm::uvec3 const &other_tri = triangles[other];
+				uint32_t other_edge = 0;
+				while (other_edge < 3 && !(other_tri[other_edge] == tri[(e+1)%3] && other_tri[(other_edge+1)%3] == tri[e])) ++other_edge;
+				assert(other_edge < 3 && "neighbors share an edge");
+				stitches.emplace_back(Stitch{ triangle_local[ti], e, triangle_tile[other], triangle_local[other], other_edge });
+			}
+		}
+
+		std::vector< glm::vec3 > tile_positions, tile_normals;
+		tile_positions.reserve(tile_vertices.size());
+		tile_normals.reserve(tile_vertices.size());
+		for (uint32_t v : tile_vertices) {
+			tile_positions.emplace_back(walkmesh.vertices[v]);
+			tile_normals.emplace_back(walkmesh.normals[v]);
+			vertex_local[v] = -1U; //reset for the next tile
+		}
+
+		info.offset = uint64_t(data.tellp());
+		write_chunk("p...", tile_positions, &data);
+		write_chunk("n...", tile_normals, &data);
+		write_chunk("tri0", tile_tris, &data);
+		write_chunk("frm0", tile_frames, &data);
+		write_chunk("sti0", stitches, &data); //already sorted by (triangle, edge)
+	}
+
+	write_chunk("til0", tiles, &to);
+	to << data.str();
+}
+
+WalkTiles::WalkTiles(std::string const &filename_) : filename(filename_) {
+	std::ifstream file(filename, std::ios::binary);
+	read_chunk(file, "til0", &tiles);
+	data_begin = uint64_t(file.tellg());
+
+	for (auto const &info : tiles) {
+		if (!(info.min.x <= info.max.x && info.min.y <= info.max.y && info.min.z <= info.max.z)) {
+			throw std::runtime_error("Invalid tile bounds in '" + filename + "'");
+		}
+	}
+
+	resident.resize(tiles.size());
+	state.assign(tiles.size(), Unloaded);
+
+	//background thread loads requested tiles one at a time:
+	worker = std::thread([this](){
+		std::ifstream from(filename, std::ios::binary);
+		std::unique_lock< std::mutex > lock(mutex);
+		while (true) {
+			wake.wait(lock, [this](){ return quit || !requests.empty(); });
+			if (quit) break;
+			loading = requests.front();
+			requests.pop_front();
+			lock.unlock();
+
+			Loaded done_loading;
+			done_loading.index = loading;
+			try {
+				done_loading.tile = load_tile(from, loading);
+			} catch (std::exception const &e) {
+				done_loading.error = e.what();
+			} catch (...) {
+				done_loading.error = "unknown exception";
+			}
+
+			lock.lock();
+			loaded.emplace_back(std::move(done_loading));
+			loading = -1U;
+			done.notify_all();
+		}
+	});
+}
+
+WalkTiles::~WalkTiles() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+WalkTiles::Stitch const *WalkTiles::Tile::find_stitch(uint32_t triangle, uint32_t edge) const {
+	auto it = std::lower_bound(stitches.begin(), stitches.end(), std::make_pair(triangle, edge), [](Stitch const &s, std::pair< uint32_t, uint32_t > const &key) {
+		return std::make_pair(s.triangle, s.edge) < key;
+	});
+	if (it == stitches.end() || it->triangle != triangle || it->edge != edge) return nullptr;
+	return &*it;
+}
+
+std::unique_ptr< WalkTiles::Tile > WalkTiles::load_tile(std::istream &from, uint32_t index) const {
+	assert(index < tiles.size());
+	std::string where = "tile " + std::to_string(index) + " of '" + filename + "'";
+
+	from.clear();
+	if (!from.seekg(std::streamoff(data_begin + tiles[index].offset))) {
+		throw std::runtime_error("Failed to seek to " + where);
+	}
+
+	std::vector< glm::vec3 > vertices;
+	read_chunk(from, "p...", &vertices);
+
+	std::vector< glm::vec3 > normals;
+	read_chunk(from, "n...", &normals);
+
+	std::vector< glm::uvec3 > triangles;
+	read_chunk(from, "tri0", &triangles);
+
+	std::vector< WalkMesh::TriangleFrame > frames;
+	read_chunk(from, "frm0", &frames);
+
+	std::vector< Stitch > stitches;
+	read_chunk(from, "sti0", &stitches);
+
+	if (vertices.size() != normals.size()) {
+		throw std::runtime_error("Mis-matched position and normal sizes in " + where);
+	}
+	if (frames.size() != triangles.size()) {
+		throw std::runtime_error("Mis-matched triangle and triangle frame sizes in " + where);
+	}
+	for (auto const &tri : triangles) {
+		if (!(tri.x < vertices.size() && tri.y < vertices.size() && tri.z < vertices.size())) {
+			throw std::runtime_error("Invalid triangle in " + where);
+		}
+	}
+	for (uint32_t i = 0; i < stitches.size(); ++i) {
+		Stitch const &s = stitches[i];
+		if (!(s.triangle < triangles.size() && s.edge < 3 && s.other_tile < tiles.size() && s.other_edge < 3)) {
+			throw std::runtime_error("Invalid stitch in " + where);
+		}
+		if (i > 0 && !(std::make_pair(stitches[i-1].triangle, stitches[i-1].edge) < std::make_pair(s.triangle, s.edge))) {
+			throw std::runtime_error("Unsorted stitches in " + where);
+		}
+	}
+
+	return std::make_unique< Tile >(WalkMesh(std::move(vertices), std::move(normals), std::move(triangles), std::move(frames)), std::move(stitches));
+}
+
+static std::string describe_failures(std::vector< WalkTiles::LoadError::Failure > const &failures) {
+	std::string message = "Failed to load " + std::to_string(failures.size()) + " tile(s):";
+	for (auto const &f : failures) {
+		message += "\n  tile " + std::to_string(f.tile) + ": " + f.what;
+	}
+	return message;
+}
+
+WalkTiles::LoadError::LoadError(std::vector< Failure > &&failures_) : std::runtime_error(describe_failures(failures_)), failures(std::move(failures_)) {
+}
+
+void WalkTiles::install_loaded() {
+	std::vector< Loaded > finished;
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		finished.swap(loaded);
+	}
+
+	for (auto &l : finished) {
+		if (!l.tile) {
+			//load failed; don't try again, even if the request was cancelled meanwhile:
+			assert(state[l.index] != Resident);
+			state[l.index] = Failed;
+			failed += 1;
+			failures.emplace_back(LoadError::Failure{ l.index, std::move(l.error) });
+		} else if (state[l.index] == Requested) {
+			resident[l.index] = std::move(l.tile);
+			state[l.index] = Resident;
+			loads += 1;
+		} else {
+			//request was cancelled (or repeated) while the tile was loading:
+			discarded += 1;
+		}
+	}
+}
+
+void WalkTiles::throw_failures() {
+	if (failures.empty()) return;
+	std::vector< LoadError::Failure > thrown;
+	thrown.swap(failures);
+	throw LoadError(std::move(thrown));
+}
+
+void WalkTiles::update(glm::vec3 const &position, float radius, float margin) {
+	install_loaded();
+
+	//distance (in xy) from position to each tile, used to decide what to load / drop:
+	std::vector< std::pair< float, uint32_t > > wanted; //(distance, tile) for all requested tiles
+	glm::vec2 at = glm::vec2(position);
+	for (uint32_t i = 0; i < tiles.size(); ++i) {
+		glm::vec2 closest = glm::clamp(at, glm::vec2(tiles[i].min), glm::vec2(tiles[i].max));
+		float distance = glm::length(closest - at);
+		if (distance <= radius) {
+			if (state[i] == Unloaded) state[i] = Requested;
+		} else if (distance > radius + margin) {
+			if (state[i] == Resident) {
+				resident[i].reset();
+				unloads += 1;
+			}
+			if (state[i] != Failed) state[i] = Unloaded;
+		}
+		if (state[i] == Requested) wanted.emplace_back(distance, i);
+	}
+	std::sort(wanted.begin(), wanted.end());
+
+	//replace the request queue, so the nearest tiles load first and cancelled tiles are skipped:
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		requests.clear();
+		for (auto const &[distance, i] : wanted) {
+			if (i == loading) continue;
+			if (std::any_of(loaded.begin(), loaded.end(), [i=i](Loaded const &l){ return l.index == i; })) continue;
+			requests.emplace_back(i);
+		}
+	}
+	if (!wanted.empty()) wake.notify_one();
+
+	throw_failures();
+}
+
+void WalkTiles::finish_loading() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		done.wait(lock, [this](){ return requests.empty() && loading == -1U; });
+	}
+	install_loaded();
+	throw_failures();
+}
+
+WalkTilePoint WalkTiles::nearest_walk_point(glm::vec3 const &world_point) const {
+	//check resident tiles in order of distance to their bounds, stopping once no tile could be closer:
+	std::vector< std::pair< float, uint32_t > > order;
+	for (uint32_t i = 0; i < tiles.size(); ++i) {
+		if (!resident[i]) continue;
+		glm::vec3 closest = glm::clamp(world_point, tiles[i].min, tiles[i].max);
+		order.emplace_back(glm::length2(closest - world_point), i);
+	}
+	std::sort(order.begin(), order.end());
+
+	WalkTilePoint best;
+	float best_dis2 = std::numeric_limits< float >::infinity();
+	for (auto const &[bounds_dis2, i] : order) {
+		if (bounds_dis2 > best_dis2) break;
+		WalkMesh const &mesh = resident[i]->mesh;
+		WalkPoint wp = mesh.nearest_walk_point(world_point);
+		float dis2 = glm::length2(mesh.to_world_point(wp) - world_point);
+		if (dis2 < best_dis2) {
+			best_dis2 = dis2;
+			best = WalkTilePoint(i, wp);
+		}
+	}
+	return best;
+}
+
+bool WalkTiles::cross_edge(WalkTilePoint const &start, WalkTilePoint *end_, glm::quat *rotation_) const {
+	assert(end_);
+	auto &end = *end_;
+
+	assert(rotation_);
+	auto &rotation = *rotation_;
+
+	WalkMesh const &mesh = tile(start.tile).mesh;
+
+	//edges inside the tile:
+	if (mesh.cross_edge(start.point, &end.point, &rotation)) {
+		end.tile = start.tile;
+		return true;
+	}
+
+	//edges stitched to a resident tile:
+	uint32_t corner = 0;
+	uint32_t ti = mesh.find_triangle(start.point.indices, &corner);
+	assert(ti < mesh.triangles.size() && "walk points must be on walkmesh triangles");
+	//(edge (indices.x, indices.y) is edge number 'corner' of the triangle)
+	Stitch const *stitch = resident[start.tile]->find_stitch(ti, corner);
+	if (!stitch || !is_resident(stitch->other_tile)) {
+		end = start;
+		rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		return false;
+	}
+
+	WalkMesh const &other = tile(stitch->other_tile).mesh;
+	glm::uvec3 const &tri = other.triangles[stitch->other_triangle];
+	uint32_t e = stitch->other_edge;
+
+	//same (world) point, on the other triangle with the edge reversed, as in WalkMesh::cross_edge:
+	end.tile = stitch->other_tile;
+	end.point.indices = glm::uvec3(tri[e], tri[(e+1)%3], tri[(e+2)%3]);
+	end.point.weights = glm::vec3(start.point.weights.y, start.point.weights.x, 0.0f);
+
+	rotation = glm::rotation(mesh.triangle_frames[ti].normal, other.triangle_frames[stitch->other_triangle].normal);
+
+	return true;
+}
+
+bool WalkTiles::walk(WalkTilePoint *at_, glm::vec3 const &step, uint32_t max_iterations) const {
+	assert(at_);
+	auto &at = *at_;
+
+	//same loop as WalkMesh::walk, with edge crossings that can change tiles:
+	glm::vec3 remain = step;
+	for (uint32_t iter = 0; iter < max_iterations; ++iter) {
+		if (remain == glm::vec3(0.0f)) break;
+		WalkMesh const &mesh = tile(at.tile).mesh;
+		WalkPoint end;
+		float time;
+		mesh.walk_in_triangle(at.point, remain, &end, &time);
+		at.point = end;
+		if (time == 1.0f) {
+			//finished within triangle:
+			remain = glm::vec3(0.0f);
+			break;
+		}
+		//some step remains:
+		remain *= (1.0f - time);
+		//try to step over edge:
+		WalkTilePoint crossed;
+		glm::quat rotation;
+		if (cross_edge(at, &crossed, &rotation)) {
+			at = crossed;
+			remain = rotation * remain;
+		} else {
+			remain = mesh.slide_along_edge(at.point, remain);
+		}
+	}
+
+	return remain == glm::vec3(0.0f);
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+/*
+ * "WalkTiles" streams a large walkmesh as square (in xy) tiles, keeping only
+ *  the tiles around the player in memory.
+ *
+ * Tiles are cut from a WalkMesh ahead of time by WalkTiles::write. Each tile is
+ *  a complete WalkMesh over the triangles whose centroids fall in its square,
+ *  plus a "stitch" table giving, for each edge it shares with another tile, the
+ *  matching triangle and edge on the other side.
+ *
+ * A background thread reads and builds tiles as update() requests them; finished
+ *  tiles are only installed (and far tiles only dropped) during update(), so
+ *  queries on the main thread never see tiles appear or disappear underneath them.
+ *
+ * A WalkTilePoint is a WalkPoint on one tile. It stays valid as long as its tile
+ *  is resident. Walking off a tile crosses its stitched edges into the
+ *  neighbouring tile; edges into tiles that aren't resident act as walls.
+ *
+ */
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <iostream>
+#include <cassert>
+
+//"WalkTilePoint" is a WalkPoint on one tile of a WalkTiles:
+struct WalkTilePoint {
+	uint32_t tile = -1U; //index in WalkTiles::tiles
+	WalkPoint point; //indices are vertices of the tile's mesh
+	WalkTilePoint(uint32_t tile_, WalkPoint const &point_) : tile(tile_), point(point_) { }
+	WalkTilePoint() = default;
+};
+
+struct WalkTiles {
+	//cut 'walkmesh' into tiles 'tile_size' on a side (in xy) and write them to 'to':
+	static void write(WalkMesh const &walkmesh, float tile_size, std::ostream *to);
+
+	//open a file written by WalkTiles::write (no tiles are resident until update() is called):
+	WalkTiles(std::string const &filename);
+	~WalkTiles();
+
+	WalkTiles(WalkTiles const &) = delete;
+	WalkTiles &operator=(WalkTiles const &) = delete;
+
+	//Edge shared with another tile:
+	struct Stitch {
+		uint32_t triangle; //triangle in this tile
+		uint32_t edge; //edge of triangle (numbered as in WalkMesh::triangle_neighbors)
+		uint32_t other_tile; //tile on the other side
+		uint32_t other_triangle; //triangle in other_tile
+		uint32_t other_edge; //edge of other_triangle (runs the opposite way)
+	};
+	static_assert(sizeof(Stitch) == 4*5, "Stitch is packed.");
+
+	struct Tile {
+		Tile(WalkMesh &&mesh_, std::vector< Stitch > &&stitches_) : mesh(std::move(mesh_)), stitches(std::move(stitches_)) { }
+		WalkMesh mesh;
+		std::vector< Stitch > stitches; //sorted by (triangle, edge)
+
+		//find the stitch for edge 'edge' of triangle 'triangle', or nullptr if that edge isn't stitched:
+		Stitch const *find_stitch(uint32_t triangle, uint32_t edge) const;
+	};
+
+	//Tile index (read from the file when opened):
+	struct TileInfo {
+		glm::vec3 min, max; //bounds of the tile's triangles
+		int32_t x, y; //tile covers [x,x+1) * tile_size by [y,y+1) * tile_size
+		uint64_t offset; //start of tile's chunks (relative to the end of the index)
+	};
+	static_assert(sizeof(TileInfo) == 4*3 + 4*3 + 4*2 + 8, "TileInfo is packed.");
+	std::vector< TileInfo > tiles;
+
+	//resident tiles (nullptr if not loaded):
+	std::vector< std::unique_ptr< Tile const > > resident;
+	bool is_resident(uint32_t tile) const { return tile < resident.size() && resident[tile]; }
+	Tile const &tile(uint32_t tile) const { assert(is_resident(tile)); return *resident[tile]; }
+
+	//stream tiles around 'position':
+	// - tiles within 'radius' (in xy) of position are requested from the background thread (nearest first)
+	// - tiles farther than 'radius + margin' are dropped (or their requests are cancelled)
+	// - tiles the background thread finished since the last update are installed
+	// (throws LoadError, after doing all of the above, if tiles failed to load since the last update)
+	void update(glm::vec3 const &position, float radius, float margin);
+
+	//block until every requested tile is resident or failed (e.g., when starting a level, or if the player outran streaming):
+	// (throws LoadError if tiles failed to load)
+	void finish_loading();
+
+	//Thrown by update() and finish_loading() for tiles that failed to load:
+	// - each failure is thrown once; the tile is marked Failed and never requested again, so its edges stay walls
+	//   (a caller that catches this and keeps calling update() won't reload the broken tile every frame)
+	struct LoadError : std::runtime_error {
+		struct Failure {
+			uint32_t tile; //index in tiles
+			std::string what; //what loading it threw
+		};
+		LoadError(std::vector< Failure > &&failures);
+		std::vector< Failure > failures;
+	};
+
+	//--- queries over resident tiles ---
+
+	//closest point on any resident tile (tile is -1U if no tiles are resident):
+	WalkTilePoint nearest_walk_point(glm::vec3 const &world_point) const;
+
+	//like WalkMesh::cross_edge, but edges stitched to a resident tile lead into that tile:
+	bool cross_edge(WalkTilePoint const &start, WalkTilePoint *end, glm::quat *rotation) const;
+
+	//like WalkMesh::walk, crossing stitched edges into neighbouring resident tiles:
+	bool walk(WalkTilePoint *at, glm::vec3 const &step, uint32_t max_iterations = 10) const;
+
+	glm::vec3 to_world_point(WalkTilePoint const &wp) const {
+		return tile(wp.tile).mesh.to_world_point(wp.point);
+	}
+
+	//--- counters (for benchmarking) ---
+	uint32_t loads = 0; //tiles installed
+	uint32_t unloads = 0; //tiles dropped
+	uint32_t discarded = 0; //tiles loaded but no longer wanted when installed
+	uint32_t failed = 0; //tiles that failed to load
+
+	//--- internals ---
+	enum State : uint8_t { Unloaded, Requested, Resident, Failed };
+	std::vector< State > state; //per tile (only touched by the main thread)
+
+	//read tile 'index' from 'from' (used by the background thread):
+	std::unique_ptr< Tile > load_tile(std::istream &from, uint32_t index) const;
+	//move finished tiles into 'resident' and mark failed ones Failed (adding them to 'failures'):
+	void install_loaded();
+	//throw LoadError for 'failures', if there are any:
+	void throw_failures();
+	std::vector< LoadError::Failure > failures; //failed since last thrown (only touched by the main thread)
+
+	std::string filename;
+	uint64_t data_begin = 0; //file offset of the end of the index
+
+	//shared with the background thread (guarded by 'mutex'):
+	std::mutex mutex;
+	std::condition_variable wake; //signalled when requests are added or quit is set
+	std::condition_variable done; //signalled when a tile finishes loading
+	std::deque< uint32_t > requests; //tiles to load, in order
+	uint32_t loading = -1U; //tile the background thread is loading right now
+	struct Loaded {
+		uint32_t index;
+		std::unique_ptr< Tile > tile; //nullptr if loading failed
+		std::string error; //what loading threw, if it failed
+	};
+	std::vector< Loaded > loaded; //finished tiles, waiting for install_loaded
+	bool quit = false;
+
+	std::thread worker;
+};
@@ -0,0 +1,106 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(uint32_t threads) : thread_count(std::max(1U, threads)) {
+	shares = std::make_unique< Share[] >(thread_count);
+	for (uint32_t i = 1; i < thread_count; ++i) {
+		workers.emplace_back([this,i](){ work(i); });
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+		generation += 1;
+	}
+	start.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void WorkerPool::parallel_for(uint32_t count, std::function< void(uint32_t, uint32_t) > const &fn, uint32_t grain) {
+	if (grain == 0) {
+		grain = (count < 256 ? count : std::max(32U, (count + thread_count * 8 - 1) / (thread_count * 8)));
+		grain = std::max(1U, grain);
+	}
+	uint32_t chunks = (count + grain - 1) / grain;
+	if (workers.empty() || chunks <= 1) {
+		for (uint32_t begin = 0; begin < count; begin += grain) {
+			fn(begin, std::min(count, begin + grain));
+		}
+		return;
+	}
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		for (uint32_t i = 0; i < thread_count; ++i) {
+			uint64_t begin = uint64_t(chunks) * i / thread_count;
+			uint64_t end = uint64_t(chunks) * (i + 1) / thread_count;
+			shares[i].range.store(begin | (end << 32), std::memory_order_relaxed);
+		}
+		job = &fn;
+		job_count = count;
+		job_grain = grain;
+		remaining = uint32_t(workers.size());
+		generation += 1;
+	}
+	start.notify_all();
+	run_chunks(0);
+	std::unique_lock< std::mutex > lock(mutex);
+	done.wait(lock, [this](){ return remaining == 0; });
+}
+
+bool WorkerPool::take_chunk(uint32_t index, uint32_t *chunk) {
+	//own share, from the front:
+	{
+		std::atomic< uint64_t > &range = shares[index].range;
+		uint64_t r = range.load(std::memory_order_acquire);
+		while (uint32_t(r) < uint32_t(r >> 32)) {
+			if (range.compare_exchange_weak(r, r + 1, std::memory_order_acq_rel)) {
+				*chunk = uint32_t(r);
+				return true;
+			}
+		}
+	}
+	//others' shares, from the back:
+	for (uint32_t offset = 1; offset < thread_count; ++offset) {
+		std::atomic< uint64_t > &range = shares[(index + offset) % thread_count].range;
+		uint64_t r = range.load(std::memory_order_acquire);
+		while (uint32_t(r) < uint32_t(r >> 32)) {
+			uint32_t end = uint32_t(r >> 32) - 1;
+			if (range.compare_exchange_weak(r, uint32_t(r) | (uint64_t(end) << 32), std::memory_order_acq_rel)) {
+				*chunk = end;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void WorkerPool::run_chunks(uint32_t index) {
+	uint32_t chunk;
+	while (take_chunk(index, &chunk)) {
+		uint32_t begin = chunk * job_grain;
+		(*job)(begin, std::min(job_count, begin + job_grain));
+	}
+}
+
+void WorkerPool::work(uint32_t index) {
+	uint64_t seen = 0;
+	while (true) {
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			start.wait(lock, [&](){ return generation != seen; });
+			seen = generation;
+			if (quit) return;
+		}
+		run_chunks(index);
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			remaining -= 1;
+			if (remaining == 0) done.notify_one();
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ * A "WorkerPool" keeps a few threads alive to run parallel loops, so that
+ *  code with many short parallel loops (e.g., sweeps of a WalkFlowField build,
+ *  each frame of a WalkCrowd, or a Scene's per-frame transform updates and
+ *  culling) doesn't pay to start threads every time.
+ *
+ * Loops are split into chunks. Each thread starts with an even share of the
+ *  chunks and takes them from the front of its share; a thread that runs out
+ *  steals chunks from the back of another thread's share, so threads that got
+ *  cheap chunks help with the rest instead of waiting ("work stealing").
+ *
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct WorkerPool {
+	//run loops on 'threads' threads, including the calling thread (so threads - 1 workers are started):
+	WorkerPool(uint32_t threads);
+	~WorkerPool();
+
+	WorkerPool(WorkerPool const &) = delete;
+	WorkerPool &operator=(WorkerPool const &) = delete;
+
+	//call fn(begin, end) on chunks of [0, count), each 'grain' items long (except perhaps the last):
+	// - grain 0 picks a size that gives each thread several chunks
+	// - chunks run in no particular order, on any thread, so fn should only write results for its own items
+	//   (chunk begin / grain is a handy index for per-chunk results that need to be combined in order)
+	// (one loop runs at a time: call this from one thread at a time, and not from inside fn)
+	// (loops with one chunk -- grain 0 makes short loops one chunk -- just run on the calling thread)
+	void parallel_for(uint32_t count, std::function< void(uint32_t, uint32_t) > const &fn, uint32_t grain = 0);
+
+	uint32_t size() const { return thread_count; }
+
+	//--- internals ---
+	bool take_chunk(uint32_t index, uint32_t *chunk); //claim a chunk from thread index's share, or steal one
+	void run_chunks(uint32_t index);
+	void work(uint32_t index);
+
+	uint32_t thread_count;
+	std::vector< std::thread > workers;
+	//per thread: chunks [begin, end) not yet claimed, packed as begin | (end << 32):
+	struct alignas(64) Share {
+		std::atomic< uint64_t > range{0};
+	};
+	std::unique_ptr< Share[] > shares;
+	std::mutex mutex;
+	std::condition_variable start, done;
+	std::function< void(uint32_t, uint32_t) > const *job = nullptr;
+	uint32_t job_count = 0;
+	uint32_t job_grain = 0;
+	uint32_t remaining = 0;
+	uint64_t generation = 0;
+	bool quit = false;
+};
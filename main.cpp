@@ -10,6 +10,9 @@
 //For sound init:
 #include "Sound.hpp"
 
+//threads to split each frame's scene work across:
+#include "WorkerPool.hpp"
+
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
@@ -28,6 +31,7 @@
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <thread>
 
 #include <iostream>
 #include <fstream>
@@ -131,8 +135,12 @@ int main(int argc, char **argv) {
 	//------------ load assets --------------
 	call_load_functions();
 
+	//------------ start worker threads --------------
+	//(the game mode's scene splits transform updates and culling across every core with these)
+	WorkerPool workers(std::thread::hardware_concurrency());
+
 	//------------ create game mode + make current --------------
-	Mode::set_current(std::make_shared< PlayMode >());
+	Mode::set_current(std::make_shared< PlayMode >(&workers));
 
 	//------------ main loop ------------
 
@@ -0,0 +1,27 @@
+//Convert a walkmesh file (as written by scenes/export-walkmeshes.py) to the prebuilt format,
+// which WalkMeshes memory-maps instead of reading and building.
+//Usage: prebuild-walkmeshes <in.w> <out.w>
+
+#include "WalkMesh.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.w> <out.w>" << std::endl;
+		return 1;
+	}
+	try {
+		WalkMeshes walkmeshes(argv[1]);
+		std::ofstream out(argv[2], std::ios::binary);
+		walkmeshes.write_prebuilt(&out);
+		if (!out) throw std::runtime_error("Failed to write '" + std::string(argv[2]) + "'");
+		std::cout << "Wrote " << walkmeshes.meshes.size() << " prebuilt walkmesh(es) to '" << argv[2] << "'." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
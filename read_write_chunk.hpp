@@ -4,6 +4,9 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <string>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -40,10 +43,77 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 	}
 }
 
+//helper function that reads a chunk only if the next chunk in the stream has the given magic number:
+// returns false (leaving the stream where it was) if the stream is at its end or has a different chunk next
+template< typename T >
+bool read_chunk_if_present(std::istream &from, std::string const &magic, std::vector< T > *to) {
+	if (from.peek() == EOF) return false;
+
+	std::streampos before = from.tellg();
+	char next_magic[4] = {'\0', '\0', '\0', '\0'};
+	bool got = bool(from.read(next_magic, 4));
+	from.clear();
+	from.seekg(before);
+	if (!got || std::string(next_magic, 4) != magic) return false;
+
+	read_chunk(from, magic, to);
+	return true;
+}
+
+//helper function like view_chunk (below), for chunks that might not be aligned for T (e.g., ones after a chunk of chars):
+// - returns a pointer to the chunk's bytes; copy element i out with std::memcpy from data + i * sizeof(T)
+template< typename T >
+char const *view_unaligned_chunk(char const **at_, char const *end, std::string const &magic, size_t *count_) {
+	assert(at_);
+	auto &at = *at_;
+	assert(count_);
+	auto &count = *count_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	ChunkHeader header;
+	if (size_t(end - at) < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, at, sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+
+	char const *data = at + sizeof(header);
+	if (size_t(end - data) < header.size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	at = data + header.size;
+	count = header.size / sizeof(T);
+	return data;
+}
+
+//helper function that finds a chunk (in the same format as read_chunk) in memory, without copying it:
+// - *at_ points at the chunk header, and is advanced past the chunk
+// - returns a pointer to the chunk's data, and sets *count_ to the number of T's in it
+// (the data must be aligned for T -- e.g., in a memory-mapped file where every chunk's size is a multiple of alignof(T))
+template< typename T >
+T const *view_chunk(char const **at_, char const *end, std::string const &magic, size_t *count_) {
+	char const *data = view_unaligned_chunk< T >(at_, end, magic, count_);
+	if (reinterpret_cast< uintptr_t >(data) % alignof(T) != 0) {
+		throw std::runtime_error("Chunk data is not aligned for its element type.");
+	}
+	return reinterpret_cast< T const * >(data);
+}
 
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
-void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
+void write_chunk(std::string const &magic, T const *from, size_t count, std::ostream *to_) {
 	assert(magic.size() == 4);
 	assert(to_);
 	auto &to = *to_;
@@ -58,8 +128,13 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	header.magic[1] = magic[1];
 	header.magic[2] = magic[2];
 	header.magic[3] = magic[3];
-	header.size = uint32_t(from.size() * sizeof(T));
+	header.size = uint32_t(count * sizeof(T));
 
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
-	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
+	to.write(reinterpret_cast< const char * >(from), count * sizeof(T));
+}
+
+template< typename T >
+void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to) {
+	write_chunk(magic, from.data(), from.size(), to);
 }
@@ -0,0 +1,1126 @@
+//Benchmarks for Scene bookkeeping (transform hierarchy, culling, draw order, instancing, uniforms, command lists,
+// splitting frames across a worker pool, loading);
+// nothing here touches OpenGL.
+//Run from anywhere (scenes are found via data_path); pass 'quick' to use a smaller synthetic scene.
+
+#include "Scene.hpp"
+#include "WorkerPool.hpp"
+#include "data_path.hpp"
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//run 'fn' and return elapsed time in seconds:
+template< typename F >
+static double time_seconds(F const &fn) {
+	auto before = std::chrono::high_resolution_clock::now();
+	fn();
+	auto after = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration< double >(after - before).count();
+}
+
+//make 'drawable' look drawable (nothing is sent to GL here):
+static void fake_pipeline(Scene::Drawable *drawable) {
+	Scene::Drawable::Pipeline &pipeline = drawable->pipeline.write();
+	pipeline.program = 1;
+	pipeline.vao = 1;
+	pipeline.count = 3;
+	pipeline.textures[0].texture = 1; //(like lit_color_texture_program_pipeline's white texture)
+	pipeline.uniform_blocks = true;
+}
+
+//load a scene, giving every mesh a Drawable:
+// (bounds are unit cubes, since mesh buffers -- and so mesh bounds -- need a GL context to load)
+static void load_scene(Scene *scene, std::string const &filename) {
+	scene->load(filename, [](Scene &scene, Scene::Transform *transform, std::string const &mesh_name) {
+		Scene::Drawable &drawable = scene.drawables.emplace_back(transform);
+		fake_pipeline(&drawable);
+		drawable.pipeline.write().start = 3 * uint32_t(std::hash< std::string >()(mesh_name) % 1000); //(one vertex range per mesh)
+		drawable.min = glm::vec3(-1.0f);
+		drawable.max = glm::vec3( 1.0f);
+	});
+}
+
+//synthetic level: 'groups' groups of 10 sub-groups of 'props' drawables each, under one root:
+static void make_synthetic_scene(Scene *scene_, uint32_t groups, uint32_t props) {
+	assert(scene_);
+	auto &scene = *scene_;
+
+	std::mt19937 mt(0x5cede);
+	std::uniform_real_distribution< float > u(-1.0f, 1.0f);
+	auto add = [&](Scene::Transform *parent, float spread) {
+		scene.transforms.emplace_back();
+		Scene::Transform *t = &scene.transforms.back();
+		t->set_parent(parent);
+		t->set_position(spread * glm::vec3(u(mt), u(mt), 0.1f * u(mt)));
+		t->set_rotation(glm::angleAxis(3.1415926f * u(mt), glm::vec3(0.0f, 0.0f, 1.0f)));
+		t->set_scale(glm::vec3(1.0f + 0.5f * u(mt)));
+		return t;
+	};
+
+	Scene::Transform *root = add(nullptr, 0.0f);
+	for (uint32_t g = 0; g < groups; ++g) {
+		Scene::Transform *group = add(root, 100.0f);
+		for (uint32_t s = 0; s < 10; ++s) {
+			Scene::Transform *sub = add(group, 10.0f);
+			for (uint32_t p = 0; p < props; ++p) {
+				Scene::Drawable &drawable = scene.drawables.emplace_back(add(sub, 2.0f));
+				fake_pipeline(&drawable);
+				drawable.pipeline.write().start = 3 * (p % 20); //(20 different meshes)
+				drawable.min = glm::vec3(-0.5f, -0.5f, 0.0f) * (1.0f + 0.5f * u(mt));
+				drawable.max = glm::vec3( 0.5f,  0.5f, 1.0f) * (1.0f + 0.5f * u(mt));
+			}
+		}
+	}
+}
+
+//reference (uncached) world matrices, computed the way Transform did before caching:
+static glm::mat4x3 uncached_local_to_world(Scene::Transform const &t) {
+	if (!t.parent) return t.make_local_to_parent();
+	return uncached_local_to_world(*t.parent) * glm::mat4(t.make_local_to_parent());
+}
+static glm::mat4x3 uncached_world_to_local(Scene::Transform const &t) {
+	if (!t.parent) return t.make_parent_to_local();
+	return t.make_parent_to_local() * glm::mat4(uncached_world_to_local(*t.parent));
+}
+
+//per-frame cost of fetching every drawable's world matrix, with and without cached matrices:
+// (the 'moving' fraction of transforms are moved each frame before matrices are fetched)
+static bool bench_world_matrices(std::string const &name, Scene &scene, uint32_t frames, float moving) {
+	std::vector< Scene::Transform * > transforms;
+	for (auto &t : scene.transforms) {
+		transforms.emplace_back(&t);
+	}
+	std::mt19937 mt(0xd1127);
+	std::uniform_int_distribution< uint32_t > pick(0, uint32_t(transforms.size()) - 1);
+	uint32_t moves = uint32_t(moving * transforms.size());
+
+	glm::vec3 sum = glm::vec3(0.0f); //(keeps the compiler from dropping unused matrices)
+
+	double uncached_time = time_seconds([&](){
+		for (uint32_t f = 0; f < frames; ++f) {
+			for (auto const &drawable : scene.drawables) {
+				sum += uncached_local_to_world(*drawable.transform)[3];
+			}
+		}
+	});
+
+	scene.update_transforms();
+	double static_time = time_seconds([&](){
+		for (uint32_t f = 0; f < frames; ++f) {
+			scene.update_transforms();
+			for (auto const &drawable : scene.drawables) {
+				sum += drawable.transform->make_local_to_world()[3];
+			}
+		}
+	});
+
+	double moving_time = time_seconds([&](){
+		for (uint32_t f = 0; f < frames; ++f) {
+			for (uint32_t m = 0; m < moves; ++m) {
+				Scene::Transform *t = transforms[pick(mt)];
+				t->set_position(t->get_position() + glm::vec3(0.0f, 0.0f, 0.01f));
+			}
+			scene.update_transforms();
+			for (auto const &drawable : scene.drawables) {
+				sum += drawable.transform->make_local_to_world()[3];
+			}
+		}
+	});
+
+	//cached matrices should be exactly what the uncached computation gives:
+	uint32_t mismatches = 0;
+	for (auto const &t : scene.transforms) {
+		glm::mat4x3 a = t.make_local_to_world(), b = uncached_local_to_world(t);
+		glm::mat4x3 c = t.make_world_to_local(), d = uncached_world_to_local(t);
+		if (std::memcmp(&a, &b, sizeof(a)) != 0 || std::memcmp(&c, &d, sizeof(c)) != 0) ++mismatches;
+	}
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(8) << scene.transforms.size() << " transforms " << std::setw(8) << scene.drawables.size() << " drawables | "
+	          << "uncached " << std::fixed << std::setprecision(3) << std::setw(8) << uncached_time / frames * 1e3 << " ms/frame | "
+	          << "cached, static " << std::setw(8) << static_time / frames * 1e3 << " ms/frame | "
+	          << "cached, " << std::setprecision(0) << moving * 100.0f << "% moving " << std::setprecision(3) << std::setw(8) << moving_time / frames * 1e3 << " ms/frame"
+	          << (sum.x == 12345.0f ? " " : "");
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+//scene storage: copying a scene, iterating drawables the way draw() does, and checking handles across erases:
+static bool bench_storage(std::string const &name, Scene const &scene, uint32_t copies) {
+	std::unique_ptr< Scene > copy;
+	double copy_time = time_seconds([&](){
+		for (uint32_t c = 0; c < copies; ++c) {
+			copy.reset(new Scene(scene));
+		}
+	});
+
+	//(copies keep the original's drawable tree, so this shouldn't have to rebuild it)
+	double update_time = time_seconds([&](){ copy->update_transforms(); });
+
+	glm::vec3 sum = glm::vec3(0.0f); //(keeps the compiler from dropping the loop)
+	uint32_t iterations = std::max(1U, 1000000U / uint32_t(std::max< size_t >(1, copy->drawables.size())));
+	double iterate_time = time_seconds([&](){
+		for (uint32_t i = 0; i < iterations; ++i) {
+			for (auto const &drawable : copy->drawables) {
+				sum += drawable.transform->local_to_world[3];
+			}
+		}
+	});
+
+	uint32_t errors = 0;
+
+	//copies refer to their own transforms, at the same world positions, and share the original's pipelines:
+	{
+		auto a = scene.drawables.begin();
+		for (auto const &drawable : copy->drawables) {
+			Scene::TransformHandle handle = copy->transforms.handle_of(drawable.transform);
+			if (copy->transforms.get(handle) != drawable.transform) ++errors;
+			if (a->transform->make_local_to_world() != drawable.transform->make_local_to_world()) ++errors;
+			if (!drawable.pipeline.shares_with(a->pipeline)) ++errors;
+			++a;
+		}
+	}
+	//..with every transform in the same slot as in the original (so handles work in both), and the same hierarchy:
+	for (auto const &t : scene.transforms) {
+		Scene::TransformHandle handle = scene.transforms.handle_of(&t);
+		Scene::Transform const *c = copy->transforms.get(handle);
+		if (!c || c == &t || c->name != t.name || c->dirty != t.dirty) { ++errors; continue; }
+		if ((c->parent == nullptr) != (t.parent == nullptr)) ++errors;
+		else if (t.parent && copy->transforms.handle_of(c->parent) != scene.transforms.handle_of(t.parent)) ++errors;
+		if (c->children.size() != t.children.size()) { ++errors; continue; }
+		for (uint32_t i = 0; i < t.children.size(); ++i) {
+			if (copy->transforms.handle_of(c->children[i]) != scene.transforms.handle_of(t.children[i])) ++errors;
+		}
+	}
+	//changing a copy's pipeline leaves the original's alone:
+	if (!copy->drawables.empty()) {
+		Scene::Drawable &drawable = *copy->drawables.begin();
+		Scene::Drawable const &original = *scene.drawables.begin();
+		GLuint start = original.pipeline->start;
+		drawable.pipeline.write().start = start + 3;
+		if (original.pipeline->start != start || drawable.pipeline->start != start + 3) ++errors;
+		if (drawable.pipeline.shares_with(original.pipeline)) ++errors;
+	}
+
+	//erase every third drawable; handles to erased drawables should be detected, others should still work:
+	std::vector< Scene::DrawableHandle > handles;
+	for (auto const &drawable : copy->drawables) {
+		handles.emplace_back(copy->drawables.handle_of(&drawable));
+	}
+	for (uint32_t i = 0; i < handles.size(); i += 3) {
+		copy->drawables.erase(handles[i]);
+	}
+	size_t slots = copy->drawables.generations.size();
+	for (uint32_t i = 0; i < handles.size(); ++i) {
+		if ((copy->drawables.get(handles[i]) == nullptr) != (i % 3 == 0)) ++errors;
+	}
+	uint32_t counted = 0;
+	for (auto const &drawable : copy->drawables) {
+		(void)drawable;
+		++counted;
+	}
+	if (counted != copy->drawables.size()) ++errors;
+	//re-adding reuses the freed slots (and old handles stay stale):
+	for (uint32_t i = 0; i < handles.size(); i += 3) {
+		copy->drawables.emplace_back(&copy->transforms.back());
+	}
+	if (copy->drawables.generations.size() != slots) ++errors;
+	for (uint32_t i = 0; i < handles.size(); i += 3) {
+		if (copy->drawables.get(handles[i]) != nullptr) ++errors;
+	}
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(8) << scene.transforms.size() << " transforms " << std::setw(8) << scene.drawables.size() << " drawables | "
+	          << "copy " << std::fixed << std::setprecision(3) << std::setw(8) << copy_time / copies * 1e3 << " ms | "
+	          << "first update " << std::setw(8) << update_time * 1e3 << " ms | "
+	          << "iterate drawables " << std::setprecision(2) << std::setw(6) << iterate_time / iterations / std::max< size_t >(1, scene.drawables.size()) * 1e9 << " ns/drawable"
+	          << (sum.x == 12345.0f ? " " : "");
+	if (errors) {
+		std::cout << " | " << errors << " ERRORS";
+	}
+	std::cout << std::endl;
+	return errors == 0;
+}
+
+//frustum culling: Scene::cull_drawables (walking the drawable tree, and testing blocks of drawables) vs. testing one
+// drawable at a time, from a few camera positions:
+static bool bench_culling(std::string const &name, Scene &scene, uint32_t repeats) {
+	scene.update_transforms();
+
+	//scene bounds, to place cameras:
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (auto const &t : scene.transforms) {
+		min = glm::min(min, t.local_to_world[3]);
+		max = glm::max(max, t.local_to_world[3]);
+	}
+	glm::vec3 center = 0.5f * (min + max);
+	float radius = 0.5f * glm::length(max - min) + 1.0f;
+
+	Scene::Transform camera_transform;
+	Scene::Camera camera(&camera_transform);
+	camera.aspect = 16.0f / 9.0f;
+
+	//reference: the same test, one drawable at a time:
+	auto cull_one = [](glm::vec4 const (&planes)[6], Scene::Drawable const &drawable) {
+		glm::mat4x3 const &m = drawable.transform->local_to_world;
+		glm::vec3 center = m * glm::vec4(0.5f * (drawable.max + drawable.min), 1.0f);
+		glm::vec3 extent = 0.5f * (drawable.max - drawable.min);
+		extent = glm::abs(m[0]) * extent.x + glm::abs(m[1]) * extent.y + glm::abs(m[2]) * extent.z;
+		for (glm::vec4 const &plane : planes) {
+			glm::vec3 abs_plane = glm::abs(glm::vec3(plane));
+			float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+			float r = abs_plane.x * extent.x + abs_plane.y * extent.y + abs_plane.z * extent.z;
+			if (distance + r < 0.0f) return true;
+		}
+		return false;
+	};
+
+	double tree_time = 0.0, batch_time = 0.0, single_time = 0.0;
+	uint64_t tested = 0, culled = 0;
+	uint32_t mismatches = 0;
+	std::vector< Scene::Drawable const * > visible, reference;
+	glm::vec3 sum = glm::vec3(0.0f); //(keeps the compiler from dropping the reference loop)
+	for (uint32_t view = 0; view < 8; ++view) {
+		//even views look across the scene from a ring around it (placed like ShowSceneMode's orbit camera);
+		//odd views look outward from the middle of the scene (as a player standing in a level would):
+		float azimuth = view / 8.0f * 2.0f * 3.1415926f;
+		float elevation = 0.2f;
+		camera_transform.set_rotation(
+			glm::angleAxis(azimuth, glm::vec3(0.0f, 0.0f, 1.0f))
+			* glm::angleAxis(0.5f * 3.1415926f + -elevation, glm::vec3(1.0f, 0.0f, 0.0f))
+		);
+		float distance = (view % 2 == 0 ? radius : 0.0f);
+		camera_transform.set_position(center + distance * (camera_transform.get_rotation() * glm::vec3(0.0f, 0.0f, 1.0f)));
+		glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera_transform.make_world_to_local());
+
+		Scene::DrawCounters counters, tree_counters;
+		std::vector< Scene::Drawable const * > tree_visible;
+		scene.cull_with_tree = true;
+		tree_time += time_seconds([&](){
+			for (uint32_t r = 0; r < repeats; ++r) {
+				scene.cull_drawables(world_to_clip, &tree_visible, &tree_counters);
+			}
+		});
+		scene.cull_with_tree = false;
+		batch_time += time_seconds([&](){
+			for (uint32_t r = 0; r < repeats; ++r) {
+				scene.cull_drawables(world_to_clip, &visible, &counters);
+			}
+		});
+		scene.cull_with_tree = true;
+		tested += counters.tested;
+		culled += counters.culled;
+		if (tree_visible != visible || tree_counters.tested != counters.tested || tree_counters.culled != counters.culled) ++mismatches;
+
+		glm::mat4 rows = glm::transpose(world_to_clip);
+		glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+		single_time += time_seconds([&](){
+			for (uint32_t r = 0; r < repeats; ++r) {
+				reference.clear();
+				for (auto const &drawable : scene.drawables) {
+					if (!cull_one(planes, drawable)) reference.emplace_back(&drawable);
+				}
+				if (!reference.empty()) sum += reference.back()->transform->local_to_world[3];
+			}
+		});
+		if (visible != reference) ++mismatches;
+
+		//culled boxes should really be out of view: every corner outside the same clip plane:
+		for (auto const &drawable : scene.drawables) {
+			if (std::find(visible.begin(), visible.end(), &drawable) != visible.end()) continue;
+			uint32_t out_all = 0x3f;
+			for (uint32_t c = 0; c < 8; ++c) {
+				glm::vec3 corner = glm::vec3((c & 1 ? drawable.max : drawable.min).x, (c & 2 ? drawable.max : drawable.min).y, (c & 4 ? drawable.max : drawable.min).z);
+				glm::vec4 clip = world_to_clip * glm::vec4(drawable.transform->local_to_world * glm::vec4(corner, 1.0f), 1.0f);
+				float slack = 1e-4f * std::abs(clip.w);
+				uint32_t out = 0;
+				out |= (clip.x < -clip.w + slack ? 1 : 0) | (clip.x > clip.w - slack ? 2 : 0);
+				out |= (clip.y < -clip.w + slack ? 4 : 0) | (clip.y > clip.w - slack ? 8 : 0);
+				out |= (clip.z < -clip.w + slack ? 16 : 0) | (clip.z > clip.w - slack ? 32 : 0);
+				out_all &= out;
+			}
+			if (out_all == 0) ++mismatches;
+		}
+		if (scene.drawables.size() > 10000 && view == 1) break; //(the corner check is slow; two views are plenty for big scenes)
+	}
+	uint32_t views = (scene.drawables.size() > 10000 ? 2 : 8);
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(8) << scene.drawables.size() << " drawables | "
+	          << "culled " << std::fixed << std::setprecision(1) << std::setw(5) << 100.0 * culled / std::max< uint64_t >(1, tested) << "% | "
+	          << "tree " << std::setprecision(3) << std::setw(8) << tree_time / (views * repeats) * 1e3 << " ms/view | "
+	          << "blocks of " << Scene::CullLanes << " " << std::setw(8) << batch_time / (views * repeats) * 1e3 << " ms/view | "
+	          << "one at a time " << std::setw(8) << single_time / (views * repeats) * 1e3 << " ms/view"
+	          << (sum.x == 12345.0f ? " " : "");
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+//count the state-setting GL calls (glUseProgram, glBindVertexArray, glActiveTexture, glBindTexture) needed to draw
+// 'order', either setting and resetting everything every draw (as Scene::draw used to) or only setting what differs
+// from the previous draw (as Scene::draw does now):
+static uint64_t count_state_calls(std::vector< Scene::Drawable const * > const &order, bool skip_redundant) {
+	uint64_t calls = 0;
+	if (!skip_redundant) {
+		for (Scene::Drawable const *drawable : order) {
+			calls += 2; //program, vertex array
+			for (auto const &texture : drawable->pipeline->textures) {
+				if (texture.texture != 0) calls += 4; //active texture + bind, then again to un-bind
+			}
+			calls += 1; //active texture back to unit 0
+		}
+		return calls + 2; //program, vertex array back to 0
+	}
+
+	GLuint program = 0, vao = 0;
+	Scene::Drawable::Pipeline::TextureInfo textures[Scene::Drawable::Pipeline::TextureCount];
+	uint32_t unit = -1U;
+	auto bind = [&](uint32_t i) {
+		calls += (unit != i ? 2 : 1);
+		unit = i;
+	};
+	for (Scene::Drawable const *drawable : order) {
+		auto const &pipeline = *drawable->pipeline;
+		if (pipeline.program != program) { calls += 1; program = pipeline.program; }
+		if (pipeline.vao != vao) { calls += 1; vao = pipeline.vao; }
+		for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+			auto const &want = pipeline.textures[i];
+			auto &have = textures[i];
+			if (want.texture == have.texture && (want.texture == 0 || want.target == have.target)) continue;
+			if (have.texture != 0 && (want.texture == 0 || want.target != have.target)) bind(i);
+			if (want.texture != 0) bind(i);
+			have = want;
+		}
+	}
+	for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+		if (textures[i].texture != 0) bind(i);
+	}
+	return calls + 3; //active texture back to unit 0, program, vertex array back to 0
+}
+
+//world-to-clip matrix for a camera looking out from the middle of the scene (turned 'azimuth' radians from +y):
+static glm::mat4 inside_view(Scene const &scene, float azimuth = 0.0f) {
+	scene.update_transforms();
+
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (auto const &t : scene.transforms) {
+		min = glm::min(min, t.local_to_world[3]);
+		max = glm::max(max, t.local_to_world[3]);
+	}
+	Scene::Transform camera_transform;
+	Scene::Camera camera(&camera_transform);
+	camera.aspect = 16.0f / 9.0f;
+	camera_transform.set_position(0.5f * (min + max));
+	camera_transform.set_rotation(
+		glm::angleAxis(azimuth, glm::vec3(0.0f, 0.0f, 1.0f))
+		* glm::angleAxis(0.5f * 3.1415926f - 0.2f, glm::vec3(1.0f, 0.0f, 0.0f))
+	);
+	return camera.make_projection() * glm::mat4(camera_transform.make_world_to_local());
+}
+
+//draw order: sort key cost and state-setting GL calls saved, looking out from the middle of the scene:
+static bool bench_draw_order(std::string const &name, Scene &scene, uint32_t repeats) {
+	glm::mat4 world_to_clip = inside_view(scene);
+
+	std::vector< Scene::Drawable const * > visible;
+	Scene::DrawCounters counters;
+	scene.cull_drawables(world_to_clip, &visible, &counters);
+
+	std::vector< Scene::DrawItem > queue;
+	double sort_time = time_seconds([&](){
+		for (uint32_t r = 0; r < repeats; ++r) {
+			scene.queue_drawables(world_to_clip, visible, &queue);
+		}
+	});
+
+	//the queue should hold every visible drawable once, in key order:
+	uint32_t mismatches = 0;
+	std::vector< Scene::Drawable const * > order;
+	for (auto const &item : queue) {
+		order.emplace_back(item.drawable);
+		if (item.key != Scene::draw_key(*item.drawable, world_to_clip)) ++mismatches;
+		if (&item != &queue[0] && (&item)[-1].key > item.key) ++mismatches;
+	}
+	{
+		std::vector< Scene::Drawable const * > a = visible, b = order;
+		std::sort(a.begin(), a.end());
+		std::sort(b.begin(), b.end());
+		if (a != b) ++mismatches;
+	}
+
+	uint64_t before = count_state_calls(visible, false);
+	uint64_t after = count_state_calls(order, true);
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(8) << visible.size() << " drawn | "
+	          << "key+sort " << std::fixed << std::setprecision(3) << std::setw(8) << sort_time / repeats * 1e3 << " ms/frame | "
+	          << "state calls " << std::setw(8) << before << " -> " << std::setw(6) << after;
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+//instancing: draw calls saved by drawing copies of a mesh together, and the per-instance data's cost and accuracy:
+static bool bench_instancing(std::string const &name, Scene const &scene_in, uint32_t repeats) {
+	Scene scene = scene_in;
+	for (auto &drawable : scene.drawables) {
+		Scene::Drawable::Pipeline &pipeline = drawable.pipeline.write();
+		pipeline.instanced.program = 2;
+		pipeline.instanced.vao = 2;
+		pipeline.instanced.buffer = 1;
+	}
+	glm::mat4 world_to_clip = inside_view(scene);
+
+	//record the draw list, which works out the runs to instance and their per-instance data:
+	Scene::DrawList list;
+	double record_time = time_seconds([&](){
+		for (uint32_t r = 0; r < repeats; ++r) {
+			scene.record(world_to_clip, glm::mat4x3(1.0f), &list);
+		}
+	});
+	std::vector< Scene::Drawable const * > const &visible = list.visible;
+
+	//commands use the queue in order; copies in a run should share a mesh, and the instanced vertex shader's math
+	// (WORLD_TO_CLIP * vec4(OBJECT_TO_WORLD * Position, Position.w)) should match the plain one's (OBJECT_TO_CLIP * Position):
+	uint32_t mismatches = 0;
+	uint32_t q = 0;
+	for (auto const &command : list.commands) {
+		for (uint32_t k = 0; k < command.count; ++k) {
+			Scene::Drawable const &drawable = *list.queue[q + k].drawable;
+			if (&*drawable.pipeline != command.pipeline && command.matrices != Scene::DrawList::Command::Instances) ++mismatches;
+			if (command.matrices != Scene::DrawList::Command::Instances) continue;
+			if (drawable.pipeline->start != command.pipeline->start) ++mismatches;
+			glm::mat4 object_to_clip = world_to_clip * glm::mat4(drawable.transform->make_local_to_world());
+			glm::vec4 position = glm::vec4(drawable.max, 1.0f);
+			glm::vec4 plain = object_to_clip * position;
+			glm::vec4 instanced = world_to_clip * glm::vec4(list.instances[command.first + k].OBJECT_TO_WORLD * position, position.w);
+			if (glm::length(plain - instanced) > 1e-4f * (1.0f + glm::length(plain))) ++mismatches;
+		}
+		q += command.count;
+	}
+	if (q != list.queue.size()) ++mismatches;
+	uint32_t draws = uint32_t(list.commands.size());
+	uint32_t instances = list.counters.instances;
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(8) << visible.size() << " drawn | "
+	          << "draw calls " << std::setw(6) << visible.size() << " -> " << std::setw(6) << draws
+	          << " (" << std::fixed << std::setprecision(1) << std::setw(5) << 100.0 * instances / std::max< size_t >(1, visible.size()) << "% instanced) | "
+	          << "record " << std::setprecision(3) << std::setw(8) << record_time / repeats * 1e3 << " ms/frame";
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+//per-object uniforms: building each drawable's matrices the old way (three products and an inverse per drawable,
+// sent with three glUniform* calls) vs. packing cached matrices into std140 object blocks (one glBindBufferRange):
+static bool bench_uniforms(std::string const &name, Scene &scene, uint32_t repeats) {
+	glm::mat4 world_to_clip = inside_view(scene);
+	//a light space that isn't the identity, so the normal matrix factoring is really checked:
+	glm::mat3 light_rotation = glm::mat3_cast(glm::angleAxis(0.3f, glm::normalize(glm::vec3(1.0f, 2.0f, 3.0f))));
+	glm::mat4x3 world_to_light = glm::mat4x3(1.5f * light_rotation[0], 1.5f * light_rotation[1], 1.5f * light_rotation[2], glm::vec3(1.0f, -2.0f, 0.5f));
+	glm::mat3 normal_world_to_light = glm::inverse(glm::transpose(glm::mat3(world_to_light)));
+
+	std::vector< Scene::Drawable const * > visible;
+	Scene::DrawCounters counters;
+	scene.cull_drawables(world_to_clip, &visible, &counters);
+
+	struct Uniforms {
+		glm::mat4 object_to_clip;
+		glm::mat4x3 object_to_light;
+		glm::mat3 normal_to_light;
+	};
+	std::vector< Uniforms > uniforms(visible.size());
+	double uniform_time = time_seconds([&](){
+		for (uint32_t r = 0; r < repeats; ++r) {
+			for (uint32_t i = 0; i < visible.size(); ++i) {
+				glm::mat4x3 object_to_world = visible[i]->transform->make_local_to_world();
+				uniforms[i].object_to_clip = world_to_clip * glm::mat4(object_to_world);
+				uniforms[i].object_to_light = world_to_light * glm::mat4(object_to_world);
+				uniforms[i].normal_to_light = glm::inverse(glm::transpose(glm::mat3(uniforms[i].object_to_light)));
+			}
+		}
+	});
+
+	std::vector< Scene::ObjectBlock > blocks(visible.size());
+	double block_time = time_seconds([&](){
+		for (uint32_t r = 0; r < repeats; ++r) {
+			for (uint32_t i = 0; i < visible.size(); ++i) {
+				glm::mat4x3 object_to_world = visible[i]->transform->make_local_to_world();
+				glm::mat3 normal_to_world = visible[i]->transform->make_normal_to_world();
+				for (uint32_t c = 0; c < 4; ++c) blocks[i].OBJECT_TO_WORLD[c] = glm::vec4(object_to_world[c], 0.0f);
+				for (uint32_t c = 0; c < 3; ++c) blocks[i].NORMAL_TO_WORLD[c] = glm::vec4(normal_to_world[c], 0.0f);
+			}
+		}
+	});
+
+	//the shaders' math on the blocks should match the old uniforms:
+	uint32_t mismatches = 0;
+	float worst = 0.0f;
+	for (uint32_t i = 0; i < visible.size(); ++i) {
+		glm::mat4x3 object_to_world = glm::mat4x3(glm::vec3(blocks[i].OBJECT_TO_WORLD[0]), glm::vec3(blocks[i].OBJECT_TO_WORLD[1]), glm::vec3(blocks[i].OBJECT_TO_WORLD[2]), glm::vec3(blocks[i].OBJECT_TO_WORLD[3]));
+		glm::mat3 normal_to_world = glm::mat3(glm::vec3(blocks[i].NORMAL_TO_WORLD[0]), glm::vec3(blocks[i].NORMAL_TO_WORLD[1]), glm::vec3(blocks[i].NORMAL_TO_WORLD[2]));
+		glm::vec4 position = glm::vec4(visible[i]->max, 1.0f);
+		glm::vec3 normal = glm::normalize(glm::vec3(1.0f, -2.0f, 0.5f));
+		glm::vec4 world = glm::vec4(object_to_world * position, position.w);
+		auto relative = [](auto const &a, auto const &b) { return glm::length(a - b) / (1.0f + glm::length(b)); };
+		float error = std::max({
+			relative(world_to_clip * world, uniforms[i].object_to_clip * position),
+			relative(world_to_light * world, uniforms[i].object_to_light * position),
+			relative(normal_world_to_light * (normal_to_world * normal), uniforms[i].normal_to_light * normal)
+		});
+		worst = std::max(worst, error);
+		if (!(error < 1e-4f)) ++mismatches;
+	}
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(8) << visible.size() << " drawn | "
+	          << "uniforms " << std::fixed << std::setprecision(3) << std::setw(8) << uniform_time / repeats * 1e3 << " ms/frame, "
+	          << std::setw(6) << 3 * visible.size() << " calls | "
+	          << "object blocks " << std::setw(8) << block_time / repeats * 1e3 << " ms/frame, "
+	          << std::setw(6) << visible.size() << " calls | "
+	          << "max error " << std::scientific << std::setprecision(1) << worst << std::fixed;
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+//command lists: recording several views one after another vs. on one thread per view (as a renderer drawing, e.g.,
+// shadow and reflection views might), and checking that the lists don't depend on which thread recorded them:
+static bool bench_command_list(std::string const &name, Scene &scene, uint32_t repeats) {
+	enum : uint32_t { Views = 4 };
+	glm::mat4 world_to_clip[Views];
+	for (uint32_t v = 0; v < Views; ++v) {
+		world_to_clip[v] = inside_view(scene, v / float(Views) * 2.0f * 3.1415926f);
+	}
+	scene.update_transforms(); //(record() only reads the scene, so views can be recorded at once)
+
+	Scene::DrawList serial[Views], parallel[Views];
+	double serial_time = time_seconds([&](){
+		for (uint32_t r = 0; r < repeats; ++r) {
+			for (uint32_t v = 0; v < Views; ++v) {
+				scene.record(world_to_clip[v], glm::mat4x3(1.0f), &serial[v]);
+			}
+		}
+	});
+	double parallel_time = time_seconds([&](){
+		for (uint32_t r = 0; r < repeats; ++r) {
+			std::vector< std::thread > threads;
+			for (uint32_t v = 0; v < Views; ++v) {
+				threads.emplace_back([&,v](){
+					scene.record(world_to_clip[v], glm::mat4x3(1.0f), &parallel[v]);
+				});
+			}
+			for (auto &thread : threads) thread.join();
+		}
+	});
+
+	uint32_t mismatches = 0;
+	size_t commands = 0;
+	for (uint32_t v = 0; v < Views; ++v) {
+		Scene::DrawList const &a = serial[v], &b = parallel[v];
+		commands += a.commands.size();
+		if (a.commands.size() != b.commands.size() || a.objects.size() != b.objects.size()
+		 || a.uniforms.size() != b.uniforms.size() || a.instances.size() != b.instances.size()) {
+			++mismatches;
+			continue;
+		}
+		for (uint32_t i = 0; i < a.commands.size(); ++i) {
+			auto const &ca = a.commands[i], &cb = b.commands[i];
+			if (ca.pipeline != cb.pipeline || ca.matrices != cb.matrices || ca.first != cb.first || ca.count != cb.count) ++mismatches;
+		}
+		if (std::memcmp(a.objects.data(), b.objects.data(), a.objects.size() * sizeof(Scene::ObjectBlock)) != 0) ++mismatches;
+		if (std::memcmp(&a.frame, &b.frame, sizeof(a.frame)) != 0) ++mismatches;
+		if (a.counters.drawn != b.counters.drawn || a.counters.culled != b.counters.culled) ++mismatches;
+	}
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(8) << commands / Views << " commands/view | "
+	          << Views << " views: one after another " << std::fixed << std::setprecision(3) << std::setw(8) << serial_time / repeats * 1e3 << " ms | "
+	          << "thread per view " << std::setw(8) << parallel_time / repeats * 1e3 << " ms"
+	          << " (" << std::thread::hardware_concurrency() << " hardware threads)";
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+//drawable tree upkeep when many drawables move each frame (bobbing up and down, like PlayMode's Phone0):
+// moving boxes one at a time (AABBTree::move, as Scene does), setting every leaf then refitting the tree once, and
+// rebuilding the tree from scratch -- each followed by a view query, to show what the tree's shape costs;
+// also checks Scene::pick and Scene::drawables_near against brute force
+static bool bench_drawable_tree(std::string const &name, Scene const &scene_in, float moving, uint32_t frames) {
+	Scene scene = scene_in;
+	scene.update_transforms();
+	glm::mat4 world_to_clip = inside_view(scene);
+	glm::mat4 rows = glm::transpose(world_to_clip);
+	glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+
+	//the drawables that move:
+	std::vector< Scene::Drawable * > drawables;
+	for (auto &drawable : scene.drawables) {
+		if (drawable.has_bounds()) drawables.emplace_back(&drawable);
+	}
+	std::mt19937 mt(0xb0b);
+	std::shuffle(drawables.begin(), drawables.end(), mt);
+	std::vector< Scene::Drawable * > movers(drawables.begin(), drawables.begin() + uint32_t(moving * drawables.size()));
+	std::vector< glm::vec3 > bases;
+	for (Scene::Drawable *drawable : movers) {
+		bases.emplace_back(drawable->transform->get_position());
+	}
+
+	auto world_box = [](Scene::Drawable const &drawable, glm::vec3 *min, glm::vec3 *max) {
+		glm::mat4x3 const &m = drawable.transform->local_to_world;
+		glm::vec3 center = m * glm::vec4(0.5f * (drawable.max + drawable.min), 1.0f);
+		glm::vec3 half = 0.5f * (drawable.max - drawable.min);
+		glm::vec3 extent = glm::abs(m[0]) * half.x + glm::abs(m[1]) * half.y + glm::abs(m[2]) * half.z;
+		*min = center - extent;
+		*max = center + extent;
+	};
+
+	enum Strategy { Move, Refit, Rebuild, Strategies };
+	double update_time[Strategies] = { }, query_time[Strategies] = { };
+	float cost[Strategies] = { };
+	uint32_t reinserted = 0;
+	uint32_t visible_count[Strategies] = { };
+	for (uint32_t strategy = 0; strategy < Strategies; ++strategy) {
+		//a fresh tree and fresh positions for each strategy:
+		for (uint32_t i = 0; i < movers.size(); ++i) {
+			movers[i]->transform->set_position(bases[i]);
+		}
+		for (auto const &t : scene.transforms) t.update_world();
+		AABBTree tree;
+		std::vector< uint32_t > proxies(movers.size());
+		for (uint32_t i = 0; i < drawables.size(); ++i) {
+			glm::vec3 min, max;
+			world_box(*drawables[i], &min, &max);
+			uint32_t proxy = tree.insert(min, max, i);
+			if (i < movers.size()) proxies[i] = proxy; //(movers are the first drawables)
+		}
+
+		for (uint32_t f = 0; f < frames; ++f) {
+			float time = f / 60.0f;
+			for (uint32_t i = 0; i < movers.size(); ++i) {
+				movers[i]->transform->set_position(bases[i] + glm::vec3(0.0f, 0.0f, 0.25f * std::sin(2.0f * time + 0.1f * i)));
+			}
+			for (auto const &t : scene.transforms) t.update_world();
+
+			update_time[strategy] += time_seconds([&](){
+				for (uint32_t i = 0; i < movers.size(); ++i) {
+					glm::vec3 min, max;
+					world_box(*movers[i], &min, &max);
+					if (strategy == Move) reinserted += tree.move(proxies[i], min, max);
+					else tree.set_leaf(proxies[i], min, max);
+				}
+				if (strategy == Refit) tree.refit();
+				if (strategy == Rebuild) tree.rebuild();
+			});
+			query_time[strategy] += time_seconds([&](){
+				visible_count[strategy] = 0;
+				tree.query_planes(planes, 6, [&](uint32_t, bool) { visible_count[strategy] += 1; });
+			});
+		}
+		tree.validate();
+		cost[strategy] = tree.cost();
+	}
+
+	//the scene's own queries vs. checking every drawable:
+	uint32_t mismatches = 0;
+	scene.update_transforms();
+	for (uint32_t q = 0; q < 100; ++q) {
+		std::uniform_int_distribution< uint32_t > pick_one(0, uint32_t(drawables.size()) - 1);
+		Scene::Drawable const &target = *drawables[pick_one(mt)];
+		glm::vec3 at = target.transform->local_to_world * glm::vec4(0.5f * (target.min + target.max), 1.0f);
+		glm::vec3 from = at + glm::vec3(3.0f, -2.0f, 5.0f);
+		glm::vec3 direction = at - from;
+
+		float t = 0.0f;
+		Scene::Drawable const *hit = scene.pick(from, direction, &t);
+		float best_t = std::numeric_limits< float >::infinity();
+		for (auto const &drawable : scene.drawables) {
+			glm::vec3 o = drawable.transform->world_to_local * glm::vec4(from, 1.0f);
+			glm::vec3 d = drawable.transform->world_to_local * glm::vec4(direction, 0.0f);
+			glm::vec3 t0 = (drawable.min - o) / d, t1 = (drawable.max - o) / d;
+			glm::vec3 lo = glm::min(t0, t1), hi = glm::max(t0, t1);
+			float enter = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+			float exit = std::min(std::min(hi.x, hi.y), hi.z);
+			if (enter <= exit) best_t = std::min(best_t, enter);
+		}
+		if (!hit || t != best_t) ++mismatches;
+
+		std::vector< Scene::Drawable const * > near, brute;
+		scene.drawables_near(at, 3.0f, &near);
+		for (auto const &drawable : scene.drawables) {
+			uint32_t slot = scene.drawables.handle_of(&drawable).index;
+			glm::vec3 outside = glm::max(glm::abs(at - scene.world_boxes.center(slot)) - scene.world_boxes.extent(slot), glm::vec3(0.0f));
+			if (drawable.has_bounds() && glm::dot(outside, outside) <= 9.0f) brute.emplace_back(&drawable);
+		}
+		if (near != brute) ++mismatches;
+	}
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(8) << drawables.size() << " boxes, " << std::setprecision(0) << std::fixed << std::setw(3) << moving * 100.0f << "% moving | "
+	          << std::setprecision(3)
+	          << "move " << std::setw(7) << update_time[Move] / frames * 1e3 << " ms (" << std::setw(5) << std::setprecision(1) << 100.0 * reinserted / std::max< size_t >(1, frames * movers.size()) << "% reinserted) + query " << std::setprecision(3) << std::setw(6) << query_time[Move] / frames * 1e3 << " ms | "
+	          << "refit " << std::setw(7) << update_time[Refit] / frames * 1e3 << " ms + query " << std::setw(6) << query_time[Refit] / frames * 1e3 << " ms | "
+	          << "rebuild " << std::setw(7) << update_time[Rebuild] / frames * 1e3 << " ms + query " << std::setw(6) << query_time[Rebuild] / frames * 1e3 << " ms | "
+	          << "area " << std::setprecision(2) << cost[Refit] / cost[Move] << "x / " << cost[Rebuild] / cost[Move] << "x of move's";
+	if (visible_count[Move] != visible_count[Refit] || visible_count[Move] != visible_count[Rebuild]) {
+		//(fat boxes differ between strategies, so candidate counts may too; only report it)
+		std::cout << " | candidates " << visible_count[Move] << "/" << visible_count[Refit] << "/" << visible_count[Rebuild];
+	}
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+//frames split across a worker pool: every group of a synthetic level scaled to 'drawables' drawables turns a little
+// each frame (so nearly every transform changes), then the frame is updated and recorded with and without workers:
+static bool bench_worker_pool(uint32_t drawables, uint32_t frames, WorkerPool &pool) {
+	Scene serial_scene;
+	make_synthetic_scene(&serial_scene, std::max(1U, drawables / 1000), 100);
+	Scene pooled_scene = serial_scene;
+	pooled_scene.workers = &pool;
+	glm::mat4 world_to_clip = inside_view(serial_scene);
+
+	//groups are the root's children:
+	auto groups_of = [](Scene &scene) {
+		std::vector< Scene::Transform * > groups;
+		for (auto &t : scene.transforms) {
+			if (t.parent && !t.parent->parent) groups.emplace_back(&t);
+		}
+		return groups;
+	};
+	auto frame = [&](Scene &scene, std::vector< Scene::Transform * > const &groups, Scene::DrawList *list) {
+		for (Scene::Transform *group : groups) {
+			group->set_rotation(glm::angleAxis(0.01f, glm::vec3(0.0f, 0.0f, 1.0f)) * group->get_rotation());
+		}
+		scene.update_transforms();
+		scene.record(world_to_clip, glm::mat4x3(1.0f), list);
+	};
+
+	Scene::DrawList serial, pooled;
+	//(warm up: build drawable trees and grow draw lists before timing)
+	serial_scene.update_transforms();
+	pooled_scene.update_transforms();
+	std::vector< Scene::Transform * > serial_groups = groups_of(serial_scene);
+	std::vector< Scene::Transform * > pooled_groups = groups_of(pooled_scene);
+	frame(serial_scene, serial_groups, &serial);
+	frame(pooled_scene, pooled_groups, &pooled);
+	double serial_time = time_seconds([&](){
+		for (uint32_t f = 0; f < frames; ++f) frame(serial_scene, serial_groups, &serial);
+	});
+	double pooled_time = time_seconds([&](){
+		for (uint32_t f = 0; f < frames; ++f) frame(pooled_scene, pooled_groups, &pooled);
+	});
+
+	//the pool should change nothing but the time taken:
+	uint32_t mismatches = 0;
+	{
+		auto a = serial_scene.transforms.begin();
+		for (auto const &b : pooled_scene.transforms) {
+			if (std::memcmp(&a->local_to_world, &b.local_to_world, sizeof(b.local_to_world)) != 0
+			 || std::memcmp(&a->world_to_local, &b.world_to_local, sizeof(b.world_to_local)) != 0) ++mismatches;
+			++a;
+		}
+	}
+	if (serial.commands.size() != pooled.commands.size() || serial.objects.size() != pooled.objects.size()
+	 || serial.instances.size() != pooled.instances.size() || serial.uniforms.size() != pooled.uniforms.size()) {
+		++mismatches;
+	} else {
+		for (uint32_t i = 0; i < serial.commands.size(); ++i) {
+			auto const &a = serial.commands[i], &b = pooled.commands[i];
+			//(copies of a scene share pipelines, so compare which drawable each command came from)
+			if (serial_scene.drawables.handle_of(serial.queue[serial.command_items[i]].drawable).index
+			 != pooled_scene.drawables.handle_of(pooled.queue[pooled.command_items[i]].drawable).index) ++mismatches;
+			if (a.matrices != b.matrices || a.first != b.first || a.count != b.count) ++mismatches;
+		}
+		if (std::memcmp(serial.objects.data(), pooled.objects.data(), serial.objects.size() * sizeof(Scene::ObjectBlock)) != 0) ++mismatches;
+		if (std::memcmp(serial.instances.data(), pooled.instances.data(), serial.instances.size() * sizeof(Scene::Instance)) != 0) ++mismatches;
+	}
+	if (serial.counters.tested != pooled.counters.tested || serial.counters.culled != pooled.counters.culled
+	 || serial.counters.drawn != pooled.counters.drawn) ++mismatches;
+
+	std::cout << "  " << std::setw(8) << serial_scene.drawables.size() << " drawables " << std::setw(8) << serial_scene.transforms.size() << " transforms | "
+	          << std::setw(8) << serial.commands.size() << " commands | "
+	          << "one thread " << std::fixed << std::setprecision(3) << std::setw(8) << serial_time / frames * 1e3 << " ms/frame | "
+	          << pool.size() << " threads " << std::setw(8) << pooled_time / frames * 1e3 << " ms/frame";
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+//write 'scene' in the format Scene::load reads: transforms in slot order (so parents must come before children, as in
+// loaded and synthetic scenes), named "Transform.<index>" if unnamed; drawables named "Mesh.<vertex range start>":
+static void write_scene(Scene const &scene, std::string const &path) {
+	struct HierarchyEntry {
+		uint32_t parent;
+		uint32_t name_begin;
+		uint32_t name_end;
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+	struct MeshEntry {
+		uint32_t transform;
+		uint32_t name_begin;
+		uint32_t name_end;
+	};
+	std::vector< char > names;
+	auto add_name = [&names](std::string const &name, uint32_t *begin, uint32_t *end) {
+		*begin = uint32_t(names.size());
+		names.insert(names.end(), name.begin(), name.end());
+		*end = uint32_t(names.size());
+	};
+
+	std::vector< uint32_t > index(scene.transforms.slots(), -1U); //file index of each transform slot
+	std::vector< HierarchyEntry > hierarchy;
+	for (auto const &t : scene.transforms) {
+		index[scene.transforms.index_of(&t)] = uint32_t(hierarchy.size());
+		HierarchyEntry h;
+		h.parent = (t.parent ? index[scene.transforms.index_of(t.parent)] : -1U);
+		assert(!t.parent || h.parent != -1U);
+		add_name(t.name.empty() ? "Transform." + std::to_string(hierarchy.size()) : std::string(t.name), &h.name_begin, &h.name_end);
+		h.position = t.get_position();
+		h.rotation = t.get_rotation();
+		h.scale = t.get_scale();
+		hierarchy.emplace_back(h);
+	}
+	std::vector< MeshEntry > meshes;
+	for (auto const &drawable : scene.drawables) {
+		MeshEntry m;
+		m.transform = index[scene.transforms.index_of(drawable.transform)];
+		add_name("Mesh." + std::to_string(drawable.pipeline->start), &m.name_begin, &m.name_end);
+		meshes.emplace_back(m);
+	}
+
+	std::ofstream out(path, std::ios::binary);
+	write_chunk("str0", names, &out);
+	write_chunk("xfh0", hierarchy, &out);
+	write_chunk("msh0", meshes, &out);
+	write_chunk("cam0", std::vector< uint32_t >(), &out);
+	write_chunk("lmp0", std::vector< uint32_t >(), &out);
+}
+
+//loading: where Scene::load's time goes, and (for a scene written by write_scene) whether it reads back what was written:
+static bool bench_load(std::string const &name, std::string const &path, Scene const *written, uint32_t repeats) {
+	Scene::LoadTimes sum;
+	double per_drawable_time = 0.0;
+	size_t transform_count = 0, drawable_count = 0;
+	uint32_t mismatches = 0;
+	for (uint32_t r = 0; r < repeats; ++r) {
+		{ //make all the drawables in one call (with one pipeline per mesh, shared by its drawables):
+			Scene scene;
+			std::vector< Scene::MeshInstance > instances;
+			scene.load(path, [&instances](Scene &scene, std::vector< Scene::MeshInstance > const &instances_) {
+				std::unordered_map< std::string_view, CopyOnWrite< Scene::Drawable::Pipeline > > mesh_pipelines;
+				for (Scene::MeshInstance const &instance : instances_) {
+					Scene::Drawable &drawable = scene.drawables.emplace_back(instance.transform);
+					auto f = mesh_pipelines.find(instance.mesh_name);
+					if (f == mesh_pipelines.end()) {
+						fake_pipeline(&drawable);
+						f = mesh_pipelines.emplace(instance.mesh_name, drawable.pipeline).first;
+					}
+					drawable.pipeline = f->second;
+				}
+				instances = instances_;
+			});
+			Scene::LoadTimes const &t = scene.load_times;
+			sum.map += t.map; sum.chunks += t.chunks; sum.xfh0 += t.xfh0; sum.msh0 += t.msh0;
+			sum.cam0 += t.cam0; sum.lmp0 += t.lmp0; sum.drawables += t.drawables; sum.extra += t.extra; sum.total += t.total;
+			transform_count = scene.transforms.size();
+			drawable_count = scene.drawables.size();
+
+			if (written && r == 0) {
+				//transforms and mesh entries come back in the order they were written:
+				if (scene.transforms.size() != written->transforms.size() || instances.size() != written->drawables.size()) {
+					++mismatches;
+				} else {
+					std::vector< uint32_t > index(written->transforms.slots(), -1U);
+					uint32_t i = 0;
+					auto t = scene.transforms.begin();
+					for (auto const &w : written->transforms) {
+						index[written->transforms.index_of(&w)] = i;
+						std::string expected = (w.name.empty() ? "Transform." + std::to_string(i) : std::string(w.name));
+						if (t->name != expected || t->get_position() != w.get_position() || t->get_rotation() != w.get_rotation() || t->get_scale() != w.get_scale()) ++mismatches;
+						if ((t->parent == nullptr) != (w.parent == nullptr)) ++mismatches;
+						else if (t->parent && scene.transforms.index_of(t->parent) != index[written->transforms.index_of(w.parent)]) ++mismatches;
+						++t;
+						++i;
+					}
+					auto instance = instances.begin();
+					for (auto const &w : written->drawables) {
+						if (instance->mesh_name != "Mesh." + std::to_string(w.pipeline->start)) ++mismatches;
+						if (scene.transforms.index_of(instance->transform) != index[written->transforms.index_of(w.transform)]) ++mismatches;
+						++instance;
+					}
+				}
+				//names point into the mapped file, which copies of the scene keep alive:
+				std::unique_ptr< Scene > copy(new Scene(scene));
+				Scene::Transform const &last = copy->transforms.back();
+				std::string last_name(scene.transforms.back().name);
+				scene = Scene();
+				if (last.name != last_name) ++mismatches;
+			}
+		}
+		{ //..or one call per drawable:
+			Scene scene;
+			load_scene(&scene, path);
+			per_drawable_time += scene.load_times.drawables;
+		}
+	}
+
+	double scale = 1e3 / repeats;
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(8) << transform_count << " transforms " << std::setw(8) << drawable_count << " drawables | "
+	          << "load " << std::fixed << std::setprecision(3) << std::setw(8) << sum.total * scale << " ms = "
+	          << "map " << sum.map * scale << " + chunks " << sum.chunks * scale
+	          << " + xfh0 " << sum.xfh0 * scale << " + msh0 " << sum.msh0 * scale
+	          << " + drawables " << sum.drawables * scale
+	          << " + cam0/lmp0 " << (sum.cam0 + sum.lmp0) * scale << " + extra " << sum.extra * scale << " | "
+	          << "drawables one call each " << per_drawable_time * scale << " ms";
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+int main(int argc, char **argv) {
+	bool quick = (argc > 1 && std::string(argv[1]) == "quick");
+	bool ok = true;
+
+	std::vector< std::string > files = { "ring.scene", "islands.scene", "phone-bank.scene", "myscene.scene" };
+	std::vector< std::pair< std::string, Scene > > shipped;
+	shipped.reserve(files.size()); //(so scenes aren't copied as the vector grows)
+	for (auto const &file : files) {
+		shipped.emplace_back(file, Scene());
+		load_scene(&shipped.back().second, data_path(file));
+	}
+
+	Scene synthetic;
+	make_synthetic_scene(&synthetic, quick ? 10 : 100, 100);
+	std::string synthetic_name = "synthetic";
+
+	std::cout << "world matrices:" << std::endl;
+	for (auto &[file, scene] : shipped) {
+		ok = bench_world_matrices(file, scene, 1000, 0.01f) && ok;
+	}
+	ok = bench_world_matrices(synthetic_name, synthetic, quick ? 100 : 20, 0.01f) && ok;
+
+	std::cout << "storage:" << std::endl;
+	for (auto &[file, scene] : shipped) {
+		ok = bench_storage(file, scene, 1000) && ok;
+	}
+	ok = bench_storage(synthetic_name, synthetic, quick ? 10 : 3) && ok;
+
+	std::cout << "frustum culling:" << std::endl;
+	for (auto &[file, scene] : shipped) {
+		ok = bench_culling(file, scene, 1000) && ok;
+	}
+	ok = bench_culling(synthetic_name, synthetic, quick ? 100 : 20) && ok;
+
+	std::cout << "draw order:" << std::endl;
+	for (auto &[file, scene] : shipped) {
+		ok = bench_draw_order(file, scene, 1000) && ok;
+	}
+	ok = bench_draw_order(synthetic_name, synthetic, quick ? 100 : 20) && ok;
+	{ //synthetic level with a mix of programs, vertex arrays, and textures:
+		Scene mixed = synthetic;
+		std::mt19937 mt(0xd2a3);
+		for (auto &drawable : mixed.drawables) {
+			Scene::Drawable::Pipeline &pipeline = drawable.pipeline.write();
+			pipeline.program = 1 + mt() % 4;
+			pipeline.vao = 1 + mt() % 8;
+			pipeline.textures[0].texture = 1 + mt() % 16;
+			pipeline.textures[1].texture = (mt() % 4 == 0 ? 17 + mt() % 4 : 0);
+		}
+		ok = bench_draw_order("synthetic (mixed state)", mixed, quick ? 100 : 20) && ok;
+	}
+
+	std::cout << "instancing:" << std::endl;
+	for (auto &[file, scene] : shipped) {
+		ok = bench_instancing(file, scene, 1000) && ok;
+	}
+	ok = bench_instancing(synthetic_name, synthetic, quick ? 100 : 20) && ok;
+
+	std::cout << "uniforms:" << std::endl;
+	for (auto &[file, scene] : shipped) {
+		ok = bench_uniforms(file, scene, 1000) && ok;
+	}
+	ok = bench_uniforms(synthetic_name, synthetic, quick ? 100 : 20) && ok;
+
+	std::cout << "command lists:" << std::endl;
+	for (auto &[file, scene] : shipped) {
+		ok = bench_command_list(file, scene, 100) && ok;
+	}
+	ok = bench_command_list(synthetic_name, synthetic, quick ? 20 : 5) && ok;
+
+	std::cout << "drawable tree:" << std::endl;
+	for (auto &[file, scene] : shipped) {
+		ok = bench_drawable_tree(file, scene, 0.25f, 200) && ok;
+	}
+	for (float moving : { 0.01f, 0.1f, 0.5f, 1.0f }) {
+		ok = bench_drawable_tree(synthetic_name, synthetic, moving, quick ? 20 : 10) && ok;
+	}
+
+	std::cout << "loading:" << std::endl;
+	for (auto const &file : files) {
+		ok = bench_load(file, data_path(file), nullptr, 100) && ok;
+	}
+	{
+		std::string path = data_path("scene-bench-synthetic.scene");
+		write_scene(synthetic, path);
+		ok = bench_load(synthetic_name, path, &synthetic, quick ? 5 : 3) && ok;
+		std::remove(path.c_str());
+	}
+
+	{
+		//(at least a few threads, so work is split -- and stolen -- even on machines with few cores)
+		WorkerPool pool(std::max(4U, std::thread::hardware_concurrency()));
+		std::cout << "worker pool (" << std::thread::hardware_concurrency() << " hardware threads):" << std::endl;
+		for (uint32_t drawables : { 1000U, 10000U, 100000U }) {
+			if (quick && drawables > 10000) break;
+			ok = bench_worker_pool(drawables, std::max(4U, 200000U / drawables), pool) && ok;
+		}
+	}
+
+	if (!ok) {
+		std::cerr << "ERROR: accelerated results differ from reference results." << std::endl;
+		return 1;
+	}
+	return 0;
+}
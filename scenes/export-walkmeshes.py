@@ -44,6 +44,7 @@ print(" of '" + infile + "', matching pattern /" + pattern + "/ to '" + outfile
 import bpy
 import struct
 import re
+import heapq
 
 bpy.ops.wm.open_mainfile(filepath=infile)
 
@@ -94,15 +95,159 @@ positions = b''
 normals = b''
 triangles = b''
 
+#frames holds precomputed per-triangle data for walking (WalkMesh::TriangleFrame):
+frames = b''
+
 #strings contains the mesh names:
 strings = b''
 
 #index gives offsets into the data (and names) for each mesh:
 index = b''
 
+#cluster data for hierarchical pathfinding (WalkMesh::Clusters), and its per-mesh index:
+triangle_clusters = b''
+clusters = b''
+cluster_portals = b''
+cluster_distances = b''
+cluster_index = b''
+
 position_count = 0
 normal_count = 0
 triangle_count = 0
+cluster_count = 0
+portal_count = 0
+distance_count = 0
+
+CLUSTER_SIZE = 128 #maximum triangles per cluster (matches WalkMesh::ClusterSize)
+
+#partition triangles into connected clusters, with portals and portal-to-portal distance tables:
+# (this is the same algorithm as WalkMesh::build_clusters, with seeds taken in the same (triangle) order,
+#  so baked clusters match the ones WalkMesh would build from the same triangles)
+# tris are (a,b,c) tuples of indices into verts
+# returns (cluster of each triangle, [(portal_begin, portal_end, distance_begin)], [(triangle, edge, twin)], [distance])
+def build_clusters(verts, tris):
+	#triangle neighbors across edges (a,b), (b,c), (c,a):
+	half_edge = dict()
+	for t, tri in enumerate(tris):
+		for e in range(0,3):
+			half_edge[(tri[e], tri[(e+1)%3])] = (t, e)
+	def across(t, e):
+		tri = tris[t]
+		return half_edge.get((tri[(e+1)%3], tri[e]), (None, None))
+	def midpoint(t, e):
+		return 0.5 * (verts[tris[t][e]] + verts[tris[t][(e+1)%3]])
+
+	#grow clusters breadth-first:
+	cluster = [None] * len(tris)
+	members = []
+	members_begin = []
+	for seed in range(0, len(tris)):
+		if cluster[seed] != None: continue
+		c = len(members_begin)
+		begin = len(members)
+		members_begin.append(begin)
+		cluster[seed] = c
+		members.append(seed)
+		i = begin
+		while i < len(members):
+			for e in range(0,3):
+				if len(members) - begin >= CLUSTER_SIZE: break
+				n, _ = across(members[i], e)
+				if n == None or cluster[n] != None: continue
+				cluster[n] = c
+				members.append(n)
+			i += 1
+	cluster_total = len(members_begin)
+
+	#one portal on each side of the shared edge nearest the middle of each pair of clusters' boundary:
+	boundary = dict()
+	for t in range(0, len(tris)):
+		for e in range(0,3):
+			n, _ = across(t, e)
+			if n != None and cluster[t] < cluster[n]:
+				boundary.setdefault((cluster[t], cluster[n]), []).append((t, e))
+	portals = []
+	for key in sorted(boundary.keys()):
+		edges = boundary[key]
+		middle = sum((midpoint(t, e) for (t, e) in edges), verts[0] * 0.0) / len(edges)
+		best = min(range(0, len(edges)), key=lambda i: (midpoint(*edges[i]) - middle).length_squared)
+		t, e = edges[best]
+		n, ne = across(t, e)
+		portals.append((t, e))
+		portals.append((n, ne))
+	portals.sort(key=lambda te: cluster[te[0]]) #(stable)
+	portal_of = dict()
+	for p, te in enumerate(portals):
+		portal_of[te] = p
+
+	ranges = []
+	p = 0
+	for c in range(0, cluster_total):
+		begin = p
+		while p < len(portals) and cluster[portals[p][0]] == c: p += 1
+		ranges.append((begin, p))
+
+	#shortest distances between portals, moving between edge midpoints inside a cluster:
+	def distances_from(t0, e0):
+		c = cluster[t0]
+		start = midpoint(t0, e0)
+		cost = dict()
+		todo = []
+		for e in range(0,3):
+			heapq.heappush(todo, ((midpoint(t0, e) - start).length, (t0, e)))
+		while len(todo):
+			d, (t, e) = heapq.heappop(todo)
+			if (t, e) in cost: continue
+			cost[(t, e)] = d
+			mid = midpoint(t, e)
+			for e2 in range(0,3):
+				if e2 != e and (t, e2) not in cost:
+					heapq.heappush(todo, (d + (midpoint(t, e2) - mid).length, (t, e2)))
+			n, ne = across(t, e)
+			if n != None and cluster[n] == c and (n, ne) not in cost:
+				heapq.heappush(todo, (d, (n, ne)))
+		return cost
+
+	cluster_list = []
+	distances = []
+	for (begin, end) in ranges:
+		cluster_list.append((begin, end, len(distances)))
+		for i in range(begin, end):
+			cost = distances_from(*portals[i])
+			for j in range(begin, end):
+				distances.append(cost.get(portals[j], float('inf')))
+
+	portal_list = []
+	for (t, e) in portals:
+		portal_list.append((t, e, portal_of[across(t, e)]))
+
+	return (cluster, cluster_list, portal_list, distances)
+
+#order triangles along a Morton (Z-order) curve through their centroids, so triangles near each other
+# in space are (mostly) near each other in the file (and in memory when walking):
+# (same curve as WalkMesh::sort_for_locality; ties keep their original order)
+# (the math is rounded to 32-bit floats step by step, as WalkMesh.cpp does it, so centroids near cell
+#  boundaries land in the same cells both ways)
+def morton_order(mesh):
+	def f32(x):
+		return struct.unpack('f', struct.pack('f', x))[0]
+	centroids = []
+	for poly in mesh.polygons:
+		a, b, c = (mesh.vertices[v].co for v in poly.vertices)
+		centroids.append(tuple(f32(f32(f32(a[i] + b[i]) + c[i]) / 3.0) for i in range(0,3)))
+	if len(centroids) == 0: return []
+	lo = [min(c[i] for c in centroids) for i in range(0,3)]
+	hi = [max(c[i] for c in centroids) for i in range(0,3)]
+	scale = [f32(1024.0 / max(f32(hi[i] - lo[i]), f32(1e-6))) for i in range(0,3)]
+	def spread(x):
+		bits = 0
+		for b in range(0,10):
+			bits |= ((x >> b) & 1) << (3 * b)
+		return bits
+	def code(c):
+		q = [int(min(1023.0, max(0.0, f32(f32(c[i] - lo[i]) * scale[i])))) for i in range(0,3)]
+		return spread(q[0]) | (spread(q[1]) << 1) | (spread(q[2]) << 2)
+	return sorted(range(0, len(centroids)), key=lambda p: code(centroids[p]))
 
 for obj in bpy.data.objects:
 	if obj.data in to_write:
@@ -147,18 +292,22 @@ for obj in bpy.data.objects:
 	#Helper to write referenced vertices:
 	vertex_inds = dict() #for each referenced vertex, store new index
 	vertex_normals = [] #for each referenced vertex, store list of normals
+	vertex_positions = [] #for each referenced vertex, store position (for building clusters)
+	local_triangles = [] #triangles, as indices into vertex_positions
 	def write_vertex(index, normal):
 		global positions, position_count, vertex_refs, vertex_normals
 		if index not in vertex_inds:
 			vertex_inds[index] = len(vertex_inds)
 			vertex_normals.append([])
+			vertex_positions.append(mesh.vertices[index].co.copy())
 			positions += struct.pack('fff', *mesh.vertices[index].co)
 			position_count += 1
 		vertex_normals[vertex_inds[index]].append(normal)
 		return struct.pack('I', vertex_begin + vertex_inds[index])
 
-	#write the mesh triangles:
-	for poly in mesh.polygons:
+	#write the mesh triangles (in Morton order, so vertices are numbered in order of first use along the curve):
+	for p in morton_order(mesh):
+		poly = mesh.polygons[p]
 		assert(len(poly.loop_indices) == 3)
 
 		#check that faces are CCW-oriented:
@@ -172,6 +321,18 @@ for obj in bpy.data.objects:
 			assert(mesh.loops[poly.loop_indices[i]].vertex_index == poly.vertices[i])
 			triangles += write_vertex(poly.vertices[i], mesh.loops[poly.loop_indices[i]].normal)
 		triangle_count += 1
+		local_triangles.append(tuple(vertex_inds[v] for v in poly.vertices))
+
+		#triangle frame: gradient of each corner's barycentric weight, then unit normal:
+		a = mesh.vertices[poly.vertices[0]].co
+		b = mesh.vertices[poly.vertices[1]].co
+		c = mesh.vertices[poly.vertices[2]].co
+		n = (b-a).cross(c-a)
+		inv_n2 = 1.0 / n.dot(n)
+		frames += struct.pack('fff', *(n.cross(c-b) * inv_n2))
+		frames += struct.pack('fff', *(n.cross(a-c) * inv_n2))
+		frames += struct.pack('fff', *(n.cross(b-a) * inv_n2))
+		frames += struct.pack('fff', *n.normalized())
 	
 	#write (and possibly average) the normals:
 	for ns in vertex_normals:
@@ -194,6 +355,24 @@ for obj in bpy.data.objects:
 
 	assert(vertex_end - vertex_begin == len(vertex_inds))
 
+	#build clusters, and write them with indices relative to the whole file:
+	(tri_cluster, mesh_clusters, mesh_portals, mesh_distances) = build_clusters(vertex_positions, local_triangles)
+	for c in tri_cluster:
+		triangle_clusters += struct.pack('I', cluster_count + c)
+	for (p_begin, p_end, d_begin) in mesh_clusters:
+		clusters += struct.pack('III', portal_count + p_begin, portal_count + p_end, distance_count + d_begin)
+	for (t, e, twin) in mesh_portals:
+		cluster_portals += struct.pack('III', triangle_begin + t, e, portal_count + twin)
+	for d in mesh_distances:
+		cluster_distances += struct.pack('f', d)
+	cluster_index += struct.pack('II', cluster_count, cluster_count + len(mesh_clusters))
+	cluster_index += struct.pack('II', portal_count, portal_count + len(mesh_portals))
+	cluster_index += struct.pack('II', distance_count, distance_count + len(mesh_distances))
+	cluster_count += len(mesh_clusters)
+	portal_count += len(mesh_portals)
+	distance_count += len(mesh_distances)
+	print("  " + str(len(mesh_clusters)) + " clusters with " + str(len(mesh_portals)) + " portals.")
+
 	#record mesh name, vertex range, and triangle range:
 	name_begin = len(strings)
 	strings += bytes(name, "utf8")
@@ -206,6 +385,11 @@ for obj in bpy.data.objects:
 #check that we wrote as much data as anticipated:
 assert(position_count * 3*4 == len(positions))
 assert(normal_count * 3*4 == len(normals))
+assert(triangle_count * 12*4 == len(frames))
+assert(triangle_count * 4 == len(triangle_clusters))
+assert(cluster_count * 3*4 == len(clusters))
+assert(portal_count * 3*4 == len(cluster_portals))
+assert(distance_count * 4 == len(cluster_distances))
 
 #write the data chunk and index chunk to an output blob:
 blob = open(outfile, 'wb')
@@ -221,6 +405,12 @@ write_chunk(b'n...', normals)
 write_chunk(b'tri0', triangles)
 write_chunk(b'str0', strings)
 write_chunk(b'idxA', index)
+write_chunk(b'frm0', frames)
+write_chunk(b'clt0', triangle_clusters)
+write_chunk(b'clu0', clusters)
+write_chunk(b'clp0', cluster_portals)
+write_chunk(b'cld0', cluster_distances)
+write_chunk(b'idxC', cluster_index)
 wrote = blob.tell()
 blob.close()
 
@@ -229,4 +419,6 @@ print("Wrote " + str(wrote) + " bytes [== " +
 	str(len(normals)+8) + " bytes of normals + " +
 	str(len(triangles)+8) + " bytes of triangles + " +
 	str(len(strings)+8) + " bytes of strings + " +
-	str(len(index)+8) + " bytes of index] to '" + outfile + "'")
+	str(len(index)+8) + " bytes of index + " +
+	str(len(frames)+8) + " bytes of triangle frames + " +
+	str(len(triangle_clusters)+len(clusters)+len(cluster_portals)+len(cluster_distances)+len(cluster_index)+5*8) + " bytes of clusters] to '" + outfile + "'")
@@ -116,10 +116,14 @@ int main(int argc, char **argv) {
 
 				drawable.pipeline = show_scene_program_pipeline;
 
-				drawable.pipeline.vao = buffer_vao;
-				drawable.pipeline.type = mesh.type;
-				drawable.pipeline.start = mesh.start;
-				drawable.pipeline.count = mesh.count;
+				Scene::Drawable::Pipeline &pipeline = drawable.pipeline.write();
+				pipeline.vao = buffer_vao;
+				pipeline.type = mesh.type;
+				pipeline.start = mesh.start;
+				pipeline.count = mesh.count;
+
+				drawable.min = mesh.min;
+				drawable.max = mesh.max;
 
 			});
 		} catch (std::exception &e) {
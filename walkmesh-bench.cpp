@@ -0,0 +1,1317 @@
+//Benchmarks for WalkMesh queries.
+//Run from anywhere (walkmeshes are found via data_path); pass 'quick' to skip the large synthetic mesh.
+
+#include "WalkMesh.hpp"
+#include "WalkPath.hpp"
+#include "WalkFlow.hpp"
+#include "WalkTiles.hpp"
+#include "WalkCrowd.hpp"
+#include "WalkHeightGrid.hpp"
+#include "WorkerPool.hpp"
+#include "data_path.hpp"
+#include "read_write_chunk.hpp"
+
+#include <glm/gtx/norm.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <thread>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//run 'fn' and return elapsed time in seconds:
+template< typename F >
+static double time_seconds(F const &fn) {
+	auto before = std::chrono::high_resolution_clock::now();
+	fn();
+	auto after = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration< double >(after - before).count();
+}
+
+//run 'fn' and return the number of hardware cache misses it caused:
+// (Linux only; returns -1 where counters aren't available, e.g. on other platforms or in many VMs)
+template< typename F >
+static int64_t count_cache_misses(F const &fn) {
+#if defined(__linux__)
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+	if (fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		fn();
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		int64_t count = -1;
+		if (read(fd, &count, sizeof(count)) != sizeof(count)) count = -1;
+		close(fd);
+		return count;
+	}
+#endif
+	fn();
+	return -1;
+}
+
+//build a bumpy heightfield walkmesh with (about) 'triangle_count' triangles:
+static WalkMesh make_synthetic_walkmesh(uint32_t triangle_count) {
+	uint32_t size = uint32_t(std::sqrt(triangle_count / 2.0)); //quads along each side
+	auto height = [](float x, float y) {
+		return 0.5f * std::sin(0.3f * x) * std::cos(0.2f * y);
+	};
+
+	std::vector< glm::vec3 > vertices;
+	std::vector< glm::vec3 > normals;
+	vertices.reserve((size+1) * (size+1));
+	normals.reserve((size+1) * (size+1));
+	for (uint32_t y = 0; y <= size; ++y) {
+		for (uint32_t x = 0; x <= size; ++x) {
+			float fx = float(x), fy = float(y);
+			vertices.emplace_back(fx, fy, height(fx, fy));
+			glm::vec3 dx = glm::vec3(2.0f, 0.0f, height(fx+1.0f, fy) - height(fx-1.0f, fy));
+			glm::vec3 dy = glm::vec3(0.0f, 2.0f, height(fx, fy+1.0f) - height(fx, fy-1.0f));
+			normals.emplace_back(glm::normalize(glm::cross(dx, dy)));
+		}
+	}
+
+	std::vector< glm::uvec3 > triangles;
+	triangles.reserve(size * size * 2);
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			uint32_t a = y * (size+1) + x;
+			uint32_t b = a + 1;
+			uint32_t c = a + (size+1);
+			uint32_t d = c + 1;
+			triangles.emplace_back(a, b, d);
+			triangles.emplace_back(a, d, c);
+		}
+	}
+
+	return WalkMesh(vertices, normals, triangles);
+}
+
+//random points in (a slightly inflated version of) the walkmesh's bounding box:
+static std::vector< glm::vec3 > random_points(WalkMesh const &wm, uint32_t count, uint32_t seed) {
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (auto const &v : wm.vertices) {
+		min = glm::min(min, v);
+		max = glm::max(max, v);
+	}
+	glm::vec3 pad = 0.1f * (max - min) + glm::vec3(1.0f);
+	min -= pad;
+	max += pad;
+
+	std::mt19937 mt(seed);
+	std::uniform_real_distribution< float > u(0.0f, 1.0f);
+	std::vector< glm::vec3 > points;
+	points.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		points.emplace_back(glm::mix(min, max, glm::vec3(u(mt), u(mt), u(mt))));
+	}
+	return points;
+}
+
+static bool same_walk_point(WalkPoint const &a, WalkPoint const &b) {
+	return a.indices == b.indices && std::memcmp(&a.weights, &b.weights, sizeof(a.weights)) == 0;
+}
+
+//compare nearest_walk_point (BVH) with nearest_walk_point_linear:
+static bool bench_nearest(std::string const &name, WalkMesh const &wm, uint32_t linear_queries, uint32_t bvh_queries) {
+	std::vector< glm::vec3 > points = random_points(wm, std::max(linear_queries, bvh_queries), 0xfeed);
+
+	std::vector< WalkPoint > linear(linear_queries);
+	double linear_time = time_seconds([&](){
+		for (uint32_t i = 0; i < linear_queries; ++i) {
+			linear[i] = wm.nearest_walk_point_linear(points[i]);
+		}
+	});
+
+	std::vector< WalkPoint > bvh(bvh_queries);
+	double bvh_time = time_seconds([&](){
+		for (uint32_t i = 0; i < bvh_queries; ++i) {
+			bvh[i] = wm.nearest_walk_point(points[i]);
+		}
+	});
+
+	uint32_t mismatches = 0;
+	for (uint32_t i = 0; i < std::min(linear_queries, bvh_queries); ++i) {
+		if (!same_walk_point(linear[i], bvh[i])) ++mismatches;
+	}
+
+	double linear_us = 1e6 * linear_time / linear_queries;
+	double bvh_us = 1e6 * bvh_time / bvh_queries;
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(9) << wm.triangles.size() << " tris | "
+	          << "linear " << std::setw(10) << std::fixed << std::setprecision(3) << linear_us << " us/query | "
+	          << "bvh " << std::setw(8) << bvh_us << " us/query | "
+	          << "speedup " << std::setw(8) << std::setprecision(1) << linear_us / bvh_us << "x";
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+//compare relocate (from a nearby hint) with nearest_walk_point:
+// (targets are 'offset' above a point reached by walking 'distance' from the hint)
+static bool bench_relocate(std::string const &name, WalkMesh const &wm, uint32_t queries, float distance, float offset) {
+	std::mt19937 mt(0xc0de);
+	std::uniform_real_distribution< float > u(0.0f, 1.0f);
+
+	std::vector< WalkPoint > hints;
+	std::vector< glm::vec3 > targets;
+	hints.reserve(queries);
+	targets.reserve(queries);
+	std::uniform_int_distribution< uint32_t > pick(0, uint32_t(wm.triangles.size()) - 1);
+	for (uint32_t i = 0; i < queries; ++i) {
+		glm::vec2 r = glm::vec2(u(mt), u(mt));
+		if (r.x + r.y > 1.0f) r = glm::vec2(1.0f) - r;
+		WalkPoint hint(wm.triangles[pick(mt)], glm::vec3(1.0f - r.x - r.y, r.x, r.y));
+		WalkPoint moved = hint;
+		float ang = u(mt) * 2.0f * 3.1415926f;
+		wm.walk(&moved, glm::vec3(distance * std::cos(ang), distance * std::sin(ang), 0.0f), 100);
+		moved.weights /= moved.weights.x + moved.weights.y + moved.weights.z; //(walk can leave weights a bit off at corners)
+		hints.emplace_back(hint);
+		targets.emplace_back(wm.to_world_point(moved) + offset * wm.to_world_triangle_normal(moved));
+	}
+
+	std::vector< WalkPoint > global(queries);
+	double global_time = time_seconds([&](){
+		for (uint32_t i = 0; i < queries; ++i) {
+			global[i] = wm.nearest_walk_point(targets[i]);
+		}
+	});
+
+	std::vector< WalkPoint > local(queries);
+	double local_time = time_seconds([&](){
+		for (uint32_t i = 0; i < queries; ++i) {
+			local[i] = wm.relocate(hints[i], targets[i]);
+		}
+	});
+
+	//for targets on the mesh, results should be as close as nearest_walk_point's;
+	// for targets above it, relocate may (by design) stay on a locally-closest part of the mesh:
+	uint32_t farther = 0;
+	for (uint32_t i = 0; i < queries; ++i) {
+		float global_dis = glm::length(wm.to_world_point(global[i]) - targets[i]);
+		float local_dis = glm::length(wm.to_world_point(local[i]) - targets[i]);
+		if (local_dis > global_dis + 1e-4f) ++farther;
+	}
+
+	double global_us = 1e6 * global_time / queries;
+	double local_us = 1e6 * local_time / queries;
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(9) << wm.triangles.size() << " tris | "
+	          << "move " << std::fixed << std::setprecision(2) << distance << " up " << offset << " | "
+	          << "nearest_walk_point " << std::setw(7) << std::setprecision(3) << global_us << " us/query | "
+	          << "relocate " << std::setw(7) << local_us << " us/query | "
+	          << "speedup " << std::setw(6) << std::setprecision(1) << global_us / local_us << "x";
+	if (farther) {
+		std::cout << " | " << farther << (offset == 0.0f ? " MISMATCHES" : " stayed on a farther part");
+	}
+	std::cout << std::endl;
+	return offset != 0.0f || farther == 0;
+}
+
+//relocate on a flat U-shaped mesh, from hints on one arm to targets on the other:
+// (the walk toward each target runs into the gap between the arms, so relocate must fall back to nearest_walk_point
+//  rather than stop at the near arm's edge)
+static bool bench_relocate_across_gap(uint32_t queries) {
+	//12x12 grid of unit quads, without the quads of the gap (4 <= x < 8, y >= 3):
+	uint32_t const size = 12;
+	auto in_gap = [](uint32_t x, uint32_t y) { return x >= 4 && x < 8 && y >= 3; };
+	std::vector< glm::vec3 > vertices;
+	std::vector< glm::vec3 > normals;
+	for (uint32_t y = 0; y <= size; ++y) {
+		for (uint32_t x = 0; x <= size; ++x) {
+			vertices.emplace_back(float(x), float(y), 0.0f);
+			normals.emplace_back(0.0f, 0.0f, 1.0f);
+		}
+	}
+	std::vector< glm::uvec3 > triangles;
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			if (in_gap(x, y)) continue;
+			uint32_t a = y * (size+1) + x;
+			uint32_t b = a + 1;
+			uint32_t c = a + (size+1);
+			uint32_t d = c + 1;
+			triangles.emplace_back(a, b, d);
+			triangles.emplace_back(a, d, c);
+		}
+	}
+	WalkMesh wm(vertices, normals, triangles);
+
+	//hints in the left arm, targets (on the mesh) in the right arm:
+	std::mt19937 mt(0x0d0d);
+	std::uniform_real_distribution< float > u(0.0f, 1.0f);
+	uint32_t farther = 0;
+	for (uint32_t i = 0; i < queries; ++i) {
+		WalkPoint hint = wm.nearest_walk_point(glm::vec3(4.0f * u(mt), 4.0f + 8.0f * u(mt), 0.0f));
+		glm::vec3 target = glm::vec3(8.0f + 4.0f * u(mt), 4.0f + 8.0f * u(mt), 0.0f);
+		WalkPoint local = wm.relocate(hint, target);
+		WalkPoint global = wm.nearest_walk_point(target);
+		float local_dis = glm::length(wm.to_world_point(local) - target);
+		float global_dis = glm::length(wm.to_world_point(global) - target);
+		if (local_dis > global_dis + 1e-4f) ++farther;
+	}
+
+	std::cout << "  " << std::setw(24) << std::left << "U-shaped (across gap)" << std::right
+	          << std::setw(9) << wm.triangles.size() << " tris | "
+	          << queries << " queries";
+	if (farther) {
+		std::cout << " | " << farther << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return farther == 0;
+}
+
+//compare ray_cast (BVH) with ray_cast_linear and ray_cast_batch:
+// - "pick" rays come from a camera above the mesh (like mouse picking), so neighbors in the batch are coherent
+// - "sight" rays go between random points near the mesh (like line-of-sight checks between agents)
+static bool bench_ray(std::string const &name, WalkMesh const &wm, bool pick, uint32_t linear_queries, uint32_t queries) {
+	std::vector< glm::vec3 > points = random_points(wm, 2 * queries, pick ? 0x1ce : 0x5ee);
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (auto const &v : wm.vertices) {
+		min = glm::min(min, v);
+		max = glm::max(max, v);
+	}
+
+	WalkRays rays;
+	rays.resize(queries);
+	for (uint32_t i = 0; i < queries; ++i) {
+		if (pick) {
+			//camera above the middle of the mesh, looking at points on a grid (in scan order) on the floor of the bounding box:
+			uint32_t side = uint32_t(std::ceil(std::sqrt(double(queries))));
+			glm::vec3 eye = glm::vec3(0.5f * (min.x + max.x), 0.5f * (min.y + max.y), max.z + glm::length(max - min));
+			glm::vec3 at = glm::vec3(glm::mix(min.x, max.x, (i % side + 0.5f) / side), glm::mix(min.y, max.y, (i / side + 0.5f) / side), min.z);
+			rays.set(i, eye, at - eye, 1.0f);
+		} else {
+			rays.set(i, points[2*i], points[2*i+1] - points[2*i], 1.0f);
+		}
+	}
+	auto ray_origin = [&rays](uint32_t i) { return glm::vec3(rays.origin_x[i], rays.origin_y[i], rays.origin_z[i]); };
+	auto ray_direction = [&rays](uint32_t i) { return glm::vec3(rays.direction_x[i], rays.direction_y[i], rays.direction_z[i]); };
+
+	std::vector< WalkPoint > linear(linear_queries);
+	std::vector< float > linear_t(linear_queries, std::numeric_limits< float >::infinity());
+	double linear_time = time_seconds([&](){
+		for (uint32_t i = 0; i < linear_queries; ++i) {
+			wm.ray_cast_linear(ray_origin(i), ray_direction(i), rays.max_t[i], &linear[i], &linear_t[i]);
+		}
+	});
+
+	std::vector< WalkPoint > bvh(queries);
+	std::vector< float > bvh_t(queries, std::numeric_limits< float >::infinity());
+	uint32_t hit_count = 0;
+	double bvh_time = time_seconds([&](){
+		for (uint32_t i = 0; i < queries; ++i) {
+			if (wm.ray_cast(ray_origin(i), ray_direction(i), rays.max_t[i], &bvh[i], &bvh_t[i])) ++hit_count;
+		}
+	});
+
+	WalkPoints batch;
+	std::vector< float > batch_t;
+	double batch_time = time_seconds([&](){
+		wm.ray_cast_batch(rays, &batch, &batch_t);
+	});
+
+	uint32_t mismatches = 0;
+	for (uint32_t i = 0; i < queries; ++i) {
+		if (i < linear_queries && (!same_walk_point(linear[i], bvh[i]) || linear_t[i] != bvh_t[i])) ++mismatches;
+		if (bvh_t[i] != batch_t[i] || (bvh_t[i] != std::numeric_limits< float >::infinity() && !same_walk_point(bvh[i], batch.get(i)))) ++mismatches;
+	}
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(9) << wm.triangles.size() << " tris | "
+	          << (pick ? "pick " : "sight") << " " << std::setw(3) << (100 * hit_count / queries) << "% hit | "
+	          << "linear " << std::setw(9) << std::fixed << std::setprecision(3) << 1e6 * linear_time / linear_queries << " us/ray | "
+	          << "bvh " << std::setw(6) << 1e6 * bvh_time / queries << " us/ray | "
+	          << "batch " << std::setw(6) << 1e6 * batch_time / queries << " us/ray";
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+//compare trace_straight with trace_straight_batch, for agents looking 'distance' away in random directions:
+static bool bench_trace(std::string const &name, WalkMesh const &wm, uint32_t agents, float distance) {
+	std::mt19937 mt(0x7ace);
+	std::uniform_real_distribution< float > u(0.0f, 1.0f);
+	std::uniform_int_distribution< uint32_t > pick(0, uint32_t(wm.triangles.size()) - 1);
+
+	WalkPoints starts;
+	WalkSteps steps;
+	starts.resize(agents);
+	steps.resize(agents);
+	for (uint32_t i = 0; i < agents; ++i) {
+		glm::vec2 r = glm::vec2(u(mt), u(mt));
+		if (r.x + r.y > 1.0f) r = glm::vec2(1.0f) - r;
+		starts.set(i, WalkPoint(wm.triangles[pick(mt)], glm::vec3(1.0f - r.x - r.y, r.x, r.y)));
+		float ang = u(mt) * 2.0f * 3.1415926f;
+		steps.set(i, glm::vec3(distance * std::cos(ang), distance * std::sin(ang), 0.0f));
+	}
+
+	std::vector< WalkPoint > scalar(agents);
+	std::vector< uint8_t > scalar_reached(agents);
+	double scalar_time = time_seconds([&](){
+		for (uint32_t i = 0; i < agents; ++i) {
+			scalar_reached[i] = wm.trace_straight(starts.get(i), steps.get(i), &scalar[i]);
+		}
+	});
+
+	WalkPoints batch;
+	std::vector< uint8_t > batch_reached;
+	double batch_time = time_seconds([&](){
+		wm.trace_straight_batch(starts, steps, &batch, &batch_reached);
+	});
+
+	//results should match; traces should end where they were headed (as seen from above) or on a boundary edge:
+	uint32_t mismatches = 0;
+	uint32_t wrong = 0;
+	uint32_t reached_count = 0;
+	for (uint32_t i = 0; i < agents; ++i) {
+		if (scalar_reached[i] != batch_reached[i] || !same_walk_point(scalar[i], batch.get(i))) ++mismatches;
+		if (scalar_reached[i]) {
+			reached_count += 1;
+			glm::vec2 target = glm::vec2(wm.to_world_point(starts.get(i))) + glm::vec2(steps.get(i));
+			if (glm::length(glm::vec2(wm.to_world_point(scalar[i])) - target) > 1e-3f) ++wrong;
+		} else {
+			//(blocking edge is a boundary, or a fold where the triangle beyond is seen from the other side)
+			WalkMesh::HalfEdge const *beyond = wm.find_half_edge(scalar[i].indices.y, scalar[i].indices.x);
+			if (beyond && wm.triangle_frames[beyond->triangle].normal.z * wm.to_world_triangle_normal(scalar[i]).z > 0.0f) ++wrong;
+		}
+	}
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(9) << wm.triangles.size() << " tris | "
+	          << "distance " << std::fixed << std::setprecision(2) << distance << " | "
+	          << std::setw(3) << (100 * reached_count / agents) << "% reached | "
+	          << "scalar " << std::setw(7) << std::setprecision(3) << 1e6 * scalar_time / agents << " us/trace | "
+	          << "batch " << std::setw(7) << 1e6 * batch_time / agents << " us/trace";
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	if (wrong) {
+		std::cout << " | " << wrong << " WRONG";
+	}
+	std::cout << std::endl;
+	return mismatches == 0 && wrong == 0;
+}
+
+//compare walk_batch with calling walk for each agent:
+static bool bench_walk(std::string const &name, WalkMesh const &wm, uint32_t agents, uint32_t steps) {
+	std::mt19937 mt(0xbeef);
+	std::uniform_real_distribution< float > u(0.0f, 1.0f);
+
+	//start agents at random spots, heading in random directions:
+	std::vector< WalkPoint > start;
+	std::vector< glm::vec3 > step;
+	start.reserve(agents);
+	step.reserve(agents);
+	for (glm::vec3 const &pt : random_points(wm, agents, 0xf00d)) {
+		start.emplace_back(wm.nearest_walk_point(pt));
+		float ang = u(mt) * 2.0f * 3.1415926f;
+		step.emplace_back(0.05f * std::cos(ang), 0.05f * std::sin(ang), 0.0f);
+	}
+
+	WalkPoints points;
+	WalkSteps walk_steps;
+	points.resize(agents);
+	walk_steps.resize(agents);
+	for (uint32_t i = 0; i < agents; ++i) {
+		points.set(i, start[i]);
+		walk_steps.set(i, step[i]);
+	}
+
+	//single step should match the scalar path:
+	float max_error = 0.0f;
+	{
+		WalkPoints check = points;
+		wm.walk_batch(&check, walk_steps);
+		for (uint32_t i = 0; i < agents; ++i) {
+			WalkPoint wp = start[i];
+			wm.walk(&wp, step[i]);
+			max_error = std::max(max_error, glm::length(wm.to_world_point(wp) - wm.to_world_point(check.get(i))));
+		}
+	}
+
+	std::vector< WalkPoint > scalar = start;
+	double scalar_time = time_seconds([&](){
+		for (uint32_t s = 0; s < steps; ++s) {
+			for (uint32_t i = 0; i < agents; ++i) {
+				wm.walk(&scalar[i], step[i]);
+			}
+		}
+	});
+
+	double batch_time = time_seconds([&](){
+		for (uint32_t s = 0; s < steps; ++s) {
+			wm.walk_batch(&points, walk_steps);
+		}
+	});
+
+	//...and so should agents that took every step (crossing edges and sliding along walls along the way):
+	for (uint32_t i = 0; i < agents; ++i) {
+		max_error = std::max(max_error, glm::length(wm.to_world_point(scalar[i]) - wm.to_world_point(points.get(i))));
+	}
+
+	double total = double(agents) * double(steps);
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(6) << agents << " agents x " << steps << " steps | "
+	          << "scalar " << std::setw(7) << std::fixed << std::setprecision(2) << total / scalar_time * 1e-6 << " M agent-steps/s | "
+	          << "batch " << std::setw(7) << total / batch_time * 1e-6 << " M agent-steps/s | "
+	          << "max error " << std::scientific << std::setprecision(1) << max_error << std::fixed
+	          << std::endl;
+	return max_error < 1e-3f;
+}
+
+//time WalkPathfinder::find_path between random points, searching all triangles ("flat") and using clusters:
+static bool bench_path(std::string const &name, WalkMesh const &wm, uint32_t queries) {
+	std::mt19937 mt(0xabcd);
+	std::uniform_int_distribution< uint32_t > pick(0, uint32_t(wm.triangles.size()) - 1);
+	std::uniform_real_distribution< float > u(0.05f, 1.0f);
+	auto random_walk_point = [&]() {
+		glm::vec3 weights = glm::vec3(u(mt), u(mt), u(mt));
+		return WalkPoint(wm.triangles[pick(mt)], weights / (weights.x + weights.y + weights.z));
+	};
+	std::vector< std::pair< WalkPoint, WalkPoint > > ends;
+	ends.reserve(queries);
+	for (uint32_t i = 0; i < queries; ++i) {
+		ends.emplace_back(random_walk_point(), random_walk_point());
+	}
+
+	WalkPathfinder pathfinder(wm);
+	std::vector< WalkPoint > path;
+	struct Result {
+		double time = 0.0;
+		std::vector< float > lengths; //-1.0f if not found
+		uint32_t found = 0, corners = 0, too_short = 0;
+	};
+	auto run = [&](bool use_clusters) {
+		Result result;
+		result.lengths.reserve(queries);
+		pathfinder.use_clusters = use_clusters;
+		result.time = time_seconds([&](){
+			for (auto const &[start, goal] : ends) {
+				if (!pathfinder.find_path(start, goal, &path)) {
+					result.lengths.emplace_back(-1.0f);
+					continue;
+				}
+				result.lengths.emplace_back(pathfinder.path_length);
+				result.found += 1;
+				result.corners += uint32_t(path.size()) - 2;
+				//paths can't be shorter than a straight line:
+				float straight = glm::length(wm.to_world_point(goal) - wm.to_world_point(start));
+				if (pathfinder.path_length < 0.999f * straight - 1e-4f) ++result.too_short;
+			}
+		});
+		return result;
+	};
+	Result flat = run(false);
+	Result clustered = run(true);
+
+	//both versions should agree on reachability; clustered paths can be a bit longer:
+	uint32_t disagree = 0;
+	double length_ratio = 0.0;
+	for (uint32_t i = 0; i < queries; ++i) {
+		if ((flat.lengths[i] < 0.0f) != (clustered.lengths[i] < 0.0f)) ++disagree;
+		else if (flat.lengths[i] > 0.0f) length_ratio += clustered.lengths[i] / flat.lengths[i];
+	}
+	length_ratio /= std::max(1U, flat.found);
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(9) << wm.triangles.size() << " tris | "
+	          << std::setw(4) << wm.clusters.clusters.size() << " clusters | "
+	          << "flat " << std::setw(9) << std::fixed << std::setprecision(0) << queries / flat.time << " queries/s | "
+	          << "clustered " << std::setw(9) << queries / clustered.time << " queries/s | "
+	          << "found " << clustered.found << "/" << queries << " | "
+	          << "avg corners " << std::setprecision(2) << (clustered.found ? float(clustered.corners) / clustered.found : 0.0f) << " | "
+	          << "length vs. flat " << std::setprecision(3) << length_ratio;
+	if (flat.too_short || clustered.too_short) {
+		std::cout << " | " << flat.too_short + clustered.too_short << " TOO SHORT";
+	}
+	if (disagree) {
+		std::cout << " | " << disagree << " REACHABILITY MISMATCHES";
+	}
+	std::cout << std::endl;
+	return flat.too_short == 0 && clustered.too_short == 0 && disagree == 0;
+}
+
+//build flow fields with one thread and with all of 'workers' threads, then time lookups:
+static bool bench_flow(std::string const &name, WalkMesh const &wm, WorkerPool *workers, uint32_t agents, uint32_t steps) {
+	std::mt19937 mt(0x5eed);
+	std::uniform_int_distribution< uint32_t > pick(0, uint32_t(wm.triangles.size()) - 1);
+	WalkPoint goal(wm.triangles[pick(mt)], glm::vec3(1.0f / 3.0f));
+
+	uint32_t threads = workers->size();
+	std::unique_ptr< WalkFlowField > single, multi;
+	double single_time = time_seconds([&](){ single.reset(new WalkFlowField(wm, goal)); });
+	double multi_time = time_seconds([&](){ multi.reset(new WalkFlowField(wm, goal, workers)); });
+
+	//results should not depend on thread count:
+	bool same = single->vertex_distances == multi->vertex_distances;
+
+	//walking distance can't be shorter than a straight line; compare to path queries for scale:
+	// (path lengths are straight-line distances between corners, so run short on meshes that bend up and down)
+	uint32_t too_short = 0;
+	glm::vec3 goal_point = wm.to_world_point(goal);
+	for (uint32_t v = 0; v < wm.vertices.size(); ++v) {
+		if (multi->vertex_distances[v] < 0.999f * glm::length(wm.vertices[v] - goal_point) - 1e-4f) ++too_short;
+	}
+	WalkPathfinder pathfinder(wm);
+	pathfinder.use_clusters = false; //(cluster routes run a bit long)
+	std::vector< WalkPoint > path;
+	double path_ratio = 0.0;
+	uint32_t path_count = 0;
+	for (uint32_t i = 0; i < 100; ++i) {
+		WalkPoint start(wm.triangles[pick(mt)], glm::vec3(1.0f / 3.0f));
+		if (!pathfinder.find_path(start, goal, &path) || pathfinder.path_length < 1e-3f) continue;
+		path_ratio += multi->distance(start) / pathfinder.path_length;
+		path_count += 1;
+	}
+
+	//agents all heading for the goal:
+	std::vector< WalkPoint > at;
+	at.reserve(agents);
+	for (uint32_t i = 0; i < agents; ++i) {
+		at.emplace_back(wm.triangles[pick(mt)], glm::vec3(1.0f / 3.0f));
+	}
+	double walk_time = time_seconds([&](){
+		for (uint32_t s = 0; s < steps; ++s) {
+			for (auto &wp : at) {
+				wm.walk(&wp, multi->desired_step(wp, 0.05f));
+			}
+		}
+	});
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(9) << wm.triangles.size() << " tris | "
+	          << "build " << std::setw(8) << std::fixed << std::setprecision(2) << single_time * 1e3 << " ms (1 thread) "
+	          << std::setw(8) << multi_time * 1e3 << " ms (" << threads << " threads), " << multi->sweeps << " sweeps | "
+	          << "distance vs. path " << std::setprecision(3) << (path_count ? path_ratio / path_count : 0.0) << " | "
+	          << "lookup+walk " << std::setprecision(2) << double(agents) * steps / walk_time * 1e-6 << " M agent-steps/s";
+	if (!same) {
+		std::cout << " | THREAD COUNT CHANGES RESULT";
+	}
+	if (too_short) {
+		std::cout << " | " << too_short << " TOO SHORT";
+	}
+	std::cout << std::endl;
+	return same && too_short == 0;
+}
+
+//compare walking and pathfinding on the same mesh with triangles and vertices in different orders:
+// - "as built": order the mesh was made in
+// - "shuffled": random order (like an exporter that emits faces in editing order)
+// - "sorted": shuffled, then WalkMesh::sort_for_locality
+static bool bench_layout(std::string const &name, WalkMesh const &source, uint32_t agents, uint32_t steps, uint32_t queries) {
+	std::mt19937 mt(0xabba);
+	std::uniform_real_distribution< float > u(0.0f, 1.0f);
+
+	//agents start at the same world positions and take the same steps in every layout:
+	// (starting inside triangles, so no layout has to break a tie between triangles)
+	std::uniform_int_distribution< uint32_t > pick(0, uint32_t(source.triangles.size()) - 1);
+	std::vector< glm::vec3 > agent_points;
+	std::vector< glm::vec3 > agent_steps;
+	agent_points.reserve(agents);
+	agent_steps.reserve(agents);
+	for (uint32_t i = 0; i < agents; ++i) {
+		glm::vec2 r = glm::vec2(u(mt), u(mt));
+		if (r.x + r.y > 1.0f) r = glm::vec2(1.0f) - r;
+		glm::vec3 weights = glm::vec3(0.05f) + 0.85f * glm::vec3(1.0f - r.x - r.y, r.x, r.y); //(at least 0.05 from every edge)
+		agent_points.emplace_back(source.to_world_point(WalkPoint(source.triangles[pick(mt)], weights)));
+		float ang = u(mt) * 2.0f * 3.1415926f;
+		agent_steps.emplace_back(0.05f * std::cos(ang), 0.05f * std::sin(ang), 0.0f);
+	}
+	std::vector< glm::vec3 > path_points = random_points(source, 2 * queries, 0xcafe);
+
+	struct Result {
+		uint32_t median_gap; //median index distance between neighboring triangles
+		double walk_time, path_time;
+		int64_t walk_misses, path_misses;
+		std::vector< glm::vec3 > walked; //final agent positions
+		double path_total; //total length of found paths
+	};
+
+	auto run = [&](WalkArray< glm::vec3 > const &vertices, WalkArray< glm::vec3 > const &normals, WalkArray< glm::uvec3 > const &triangles) {
+		Result result;
+		WalkMesh wm(vertices, normals, triangles);
+
+		std::vector< uint32_t > gaps;
+		gaps.reserve(wm.triangles.size() * 3);
+		for (uint32_t t = 0; t < wm.triangles.size(); ++t) {
+			for (uint32_t e = 0; e < 3; ++e) {
+				uint32_t n = wm.triangle_neighbors[t][e];
+				if (n != -1U) gaps.emplace_back(n > t ? n - t : t - n);
+			}
+		}
+		std::nth_element(gaps.begin(), gaps.begin() + gaps.size() / 2, gaps.end());
+		result.median_gap = (gaps.empty() ? 0 : gaps[gaps.size() / 2]);
+
+		std::vector< WalkPoint > at;
+		at.reserve(agents);
+		for (glm::vec3 const &pt : agent_points) {
+			at.emplace_back(wm.nearest_walk_point(pt));
+		}
+		result.walk_time = time_seconds([&](){
+			result.walk_misses = count_cache_misses([&](){
+				for (uint32_t s = 0; s < steps; ++s) {
+					for (uint32_t i = 0; i < agents; ++i) {
+						wm.walk(&at[i], agent_steps[i]);
+					}
+				}
+			});
+		});
+		result.walked.reserve(agents);
+		for (auto const &wp : at) {
+			result.walked.emplace_back(wm.to_world_point(wp));
+		}
+
+		WalkPathfinder pathfinder(wm);
+		pathfinder.use_clusters = false; //(searching every triangle touches the most memory)
+		std::vector< WalkPoint > path;
+		result.path_total = 0.0;
+		result.path_time = time_seconds([&](){
+			result.path_misses = count_cache_misses([&](){
+				for (uint32_t q = 0; q < queries; ++q) {
+					WalkPoint start = wm.nearest_walk_point(path_points[2*q]);
+					WalkPoint goal = wm.nearest_walk_point(path_points[2*q+1]);
+					if (pathfinder.find_path(start, goal, &path)) result.path_total += pathfinder.path_length;
+				}
+			});
+		});
+		return result;
+	};
+
+	auto report = [&](char const *layout, Result const &result) {
+		auto misses = [](int64_t count) {
+			return (count < 0 ? std::string("n/a") : std::to_string(count / 1000) + "k");
+		};
+		std::cout << "  " << std::setw(24) << std::left << name << std::right
+		          << std::setw(9) << source.triangles.size() << " tris | "
+		          << std::setw(8) << layout << " | "
+		          << "neighbor gap " << std::setw(7) << result.median_gap << " | "
+		          << "walk " << std::setw(6) << std::fixed << std::setprecision(2) << double(agents) * steps / result.walk_time * 1e-6 << " M agent-steps/s"
+		          << " (" << misses(result.walk_misses) << " cache misses) | "
+		          << "find_path " << std::setw(8) << std::setprecision(1) << queries / result.path_time << " queries/s"
+		          << " (" << misses(result.path_misses) << " cache misses)"
+		          << std::endl;
+	};
+
+	Result built = run(source.vertices, source.normals, source.triangles);
+	report("as built", built);
+
+	//shuffle triangles and renumber vertices randomly:
+	std::vector< glm::vec3 > vertices(source.vertices.size()), normals(source.normals.size());
+	std::vector< glm::uvec3 > triangles(source.triangles.begin(), source.triangles.end());
+	{
+		std::vector< uint32_t > vertex_order(source.vertices.size());
+		for (uint32_t v = 0; v < vertex_order.size(); ++v) vertex_order[v] = v;
+		std::shuffle(vertex_order.begin(), vertex_order.end(), mt);
+		for (uint32_t v = 0; v < vertex_order.size(); ++v) {
+			vertices[vertex_order[v]] = source.vertices[v];
+			normals[vertex_order[v]] = source.normals[v];
+		}
+		for (auto &tri : triangles) {
+			tri = glm::uvec3(vertex_order[tri.x], vertex_order[tri.y], vertex_order[tri.z]);
+		}
+		std::shuffle(triangles.begin(), triangles.end(), mt);
+	}
+	Result shuffled = run(vertices, normals, triangles);
+	report("shuffled", shuffled);
+
+	WalkMesh::sort_for_locality(&vertices, &normals, &triangles);
+	Result sorted = run(vertices, normals, triangles);
+	report("sorted", sorted);
+
+	//layout should not change results (beyond rounding):
+	float max_error = 0.0f;
+	for (uint32_t i = 0; i < agents; ++i) {
+		max_error = std::max(max_error, glm::length(built.walked[i] - shuffled.walked[i]));
+		max_error = std::max(max_error, glm::length(built.walked[i] - sorted.walked[i]));
+	}
+	double path_error = std::max(std::abs(shuffled.path_total - built.path_total), std::abs(sorted.path_total - built.path_total)) / std::max(1.0, built.path_total);
+	if (max_error >= 1e-3f || path_error >= 1e-4) {
+		std::cout << "  LAYOUT CHANGES RESULTS: walk error " << max_error << ", path length error " << path_error << std::endl;
+	}
+	return max_error < 1e-3f && path_error < 1e-4;
+}
+
+//cut a walkmesh into tiles and walk a player around a loop, streaming tiles around them:
+// - the player is walked on both the tiles and the whole mesh; positions should match exactly
+// - a "stall" is a frame where a tile near the player wasn't loaded yet, so the frame waited for it
+static bool bench_tiles(std::string const &name, WalkMesh const &wm, float tile_size, float radius, float margin, uint32_t frames, float speed) {
+	std::string path = data_path("walkmesh-bench.tiles");
+	double write_time = time_seconds([&](){
+		std::ofstream out(path, std::ios::binary);
+		WalkTiles::write(wm, tile_size, &out);
+	});
+	uint64_t file_size = 0;
+	{
+		std::ifstream in(path, std::ios::binary | std::ios::ate);
+		file_size = uint64_t(in.tellg());
+	}
+
+	//(what loading the whole mesh up front costs, with precomputed frames:)
+	double full_time = time_seconds([&](){
+		WalkMesh copy(wm.vertices, wm.normals, wm.triangles, wm.triangle_frames);
+	});
+
+	WalkTiles tiles(path);
+
+	//player walks around a loop through the middle of the mesh:
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (auto const &v : wm.vertices) {
+		min = glm::min(min, v);
+		max = glm::max(max, v);
+	}
+	glm::vec2 center = 0.5f * glm::vec2(min + max);
+	glm::vec2 loop_radius = 0.35f * glm::vec2(max - min);
+	auto loop = [&](float t) {
+		return center + loop_radius * glm::vec2(std::cos(t), std::sin(t));
+	};
+
+	//start at a triangle's centroid (with corners in triangle order), so both meshes start from the same place:
+	WalkPoint full = wm.nearest_walk_point(glm::vec3(loop(0.0f), 0.5f * (min.z + max.z)));
+	full = WalkPoint(wm.triangles[wm.find_triangle(full.indices)], glm::vec3(1.0f / 3.0f));
+	glm::vec3 start = wm.to_world_point(full);
+
+	double initial_time = time_seconds([&](){
+		tiles.update(start, radius, margin);
+		tiles.finish_loading();
+	});
+	uint32_t initial_tiles = tiles.loads;
+	WalkTilePoint player = tiles.nearest_walk_point(start);
+
+	uint32_t mismatches = 0;
+	if (player.tile == -1U) {
+		++mismatches;
+	} else {
+		WalkMesh const &mesh = tiles.tile(player.tile).mesh;
+		player.point = WalkPoint(mesh.triangles[mesh.find_triangle(player.point.indices)], glm::vec3(1.0f / 3.0f));
+		if (tiles.to_world_point(player) != start) ++mismatches;
+	}
+
+	uint32_t stalls = 0;
+	uint32_t crossings = 0;
+	size_t max_resident = 0;
+	double update_time = 0.0, max_update_time = 0.0, stall_time = 0.0;
+	float circumference = 2.0f * 3.1415926f * 0.5f * (loop_radius.x + loop_radius.y);
+	for (uint32_t frame = 0; frame < frames && !mismatches; ++frame) {
+		glm::vec3 at = tiles.to_world_point(player);
+		double t = time_seconds([&](){ tiles.update(at, radius, margin); });
+		update_time += t;
+		max_update_time = std::max(max_update_time, t);
+
+		//if a tile near the player isn't in yet, wait for it:
+		for (uint32_t i = 0; i < tiles.tiles.size(); ++i) {
+			glm::vec2 closest = glm::clamp(glm::vec2(at), glm::vec2(tiles.tiles[i].min), glm::vec2(tiles.tiles[i].max));
+			if (glm::length(closest - glm::vec2(at)) <= 0.5f * radius && !tiles.is_resident(i)) {
+				stalls += 1;
+				stall_time += time_seconds([&](){ tiles.finish_loading(); });
+				break;
+			}
+		}
+		size_t resident = 0;
+		for (uint32_t i = 0; i < tiles.tiles.size(); ++i) {
+			if (tiles.is_resident(i)) resident += tiles.tile(i).mesh.triangles.size();
+		}
+		max_resident = std::max(max_resident, resident);
+
+		//head for a point a little way ahead on the loop:
+		float along = 2.0f * 3.1415926f * (float(frame) * speed / circumference + 0.01f);
+		glm::vec2 to = loop(along) - glm::vec2(at);
+		glm::vec3 step = glm::vec3(speed * glm::normalize(to), 0.0f);
+
+		uint32_t before = player.tile;
+		tiles.walk(&player, step);
+		wm.walk(&full, step);
+		if (player.tile != before) crossings += 1;
+		if (tiles.to_world_point(player) != wm.to_world_point(full)) ++mismatches;
+
+		//(the rest of the frame, which gives the loading thread time to run:)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	//cut off the second half of the tiles' data; each broken tile should be reported once, and never reloaded:
+	bool misreported = false;
+	{
+		std::string broken_path = data_path("walkmesh-bench-broken.tiles");
+		uint64_t cut = tiles.data_begin + tiles.tiles[tiles.tiles.size() / 2].offset;
+		{
+			std::ifstream in(path, std::ios::binary);
+			std::vector< char > data(cut);
+			in.read(data.data(), data.size());
+			std::ofstream out(broken_path, std::ios::binary);
+			out.write(data.data(), data.size());
+		}
+		uint32_t expected = 0;
+		for (auto const &info : tiles.tiles) {
+			if (tiles.data_begin + info.offset >= cut) expected += 1;
+		}
+
+		WalkTiles broken(broken_path);
+		std::vector< uint32_t > reports(broken.tiles.size(), 0);
+		for (uint32_t frame = 0; frame < 3; ++frame) {
+			try {
+				broken.update(start, std::numeric_limits< float >::infinity(), 0.0f);
+				broken.finish_loading();
+			} catch (WalkTiles::LoadError const &e) {
+				for (auto const &f : e.failures) reports[f.tile] += 1;
+			}
+		}
+		for (uint32_t i = 0; i < broken.tiles.size(); ++i) {
+			bool should_fail = (broken.data_begin + broken.tiles[i].offset >= cut);
+			if (reports[i] != (should_fail ? 1U : 0U) || broken.is_resident(i) == should_fail) misreported = true;
+		}
+		if (broken.failed != expected || broken.loads + broken.failed != broken.tiles.size()) misreported = true;
+
+		std::remove(broken_path.c_str());
+	}
+
+	std::remove(path.c_str());
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(9) << wm.triangles.size() << " tris | "
+	          << std::setw(4) << tiles.tiles.size() << " tiles, " << std::setw(5) << (file_size >> 20) << " MiB, "
+	          << "written in " << std::fixed << std::setprecision(1) << std::setw(6) << 1e3 * write_time << " ms | "
+	          << "full build " << std::setw(6) << 1e3 * full_time << " ms, first "
+	          << initial_tiles << " tiles " << std::setw(6) << 1e3 * initial_time << " ms | "
+	          << "resident <= " << std::setw(3) << (100 * max_resident / wm.triangles.size()) << "% of tris | "
+	          << tiles.loads << " loads, " << tiles.unloads << " unloads, " << crossings << " crossings | "
+	          << "update " << std::setprecision(1) << 1e6 * update_time / frames << " us avg, " << 1e6 * max_update_time << " us max | "
+	          << stalls << " stalls (" << 1e3 * stall_time << " ms)";
+	if (mismatches) {
+		std::cout << " | MISMATCH";
+	}
+	if (misreported) {
+		std::cout << " | BROKEN TILES MISREPORTED";
+	}
+	std::cout << std::endl;
+	return mismatches == 0 && !misreported;
+}
+
+//write 'wm' in the format export-walkmeshes.py writes (including triangle frames and clusters):
+static void write_exported(WalkMesh const &wm, std::string const &name, std::string const &path) {
+	std::ofstream out(path, std::ios::binary);
+	auto write = [&out](char const *magic, auto const &array) {
+		write_chunk(magic, array.data(), array.size(), &out);
+	};
+	write("p...", wm.vertices);
+	write("n...", wm.normals);
+	write("tri0", wm.triangles);
+	write_chunk("str0", std::vector< char >(name.begin(), name.end()), &out);
+	uint32_t v = uint32_t(wm.vertices.size()), t = uint32_t(wm.triangles.size());
+	write_chunk("idxA", std::vector< uint32_t >{ 0, uint32_t(name.size()), 0, v, 0, t }, &out);
+	write("frm0", wm.triangle_frames);
+	write("clt0", wm.clusters.triangle_cluster);
+	write("clu0", wm.clusters.clusters);
+	write("clp0", wm.clusters.portals);
+	write("cld0", wm.clusters.distances);
+	write_chunk("idxC", std::vector< uint32_t >{
+		0, uint32_t(wm.clusters.clusters.size()),
+		0, uint32_t(wm.clusters.portals.size()),
+		0, uint32_t(wm.clusters.distances.size())
+	}, &out);
+}
+
+//compare loading an exported walkmesh file with loading the same meshes from a prebuilt (memory-mapped) file:
+// (the first queries on prebuilt meshes also pay for reading in the pages they touch)
+static bool bench_prebuilt(std::string const &name, std::string const &exported_path, uint32_t queries) {
+	std::string prebuilt_path = data_path("walkmesh-bench-prebuilt.w");
+	{
+		WalkMeshes exported(exported_path);
+		std::ofstream out(prebuilt_path, std::ios::binary);
+		exported.write_prebuilt(&out);
+	}
+
+	std::unique_ptr< WalkMeshes > exported, prebuilt;
+	double exported_time = time_seconds([&](){ exported = std::make_unique< WalkMeshes >(exported_path); });
+	double prebuilt_time = time_seconds([&](){ prebuilt = std::make_unique< WalkMeshes >(prebuilt_path); });
+
+	uint32_t mismatches = 0;
+	double exported_query_time = 0.0, prebuilt_query_time = 0.0;
+	size_t triangles = 0;
+	for (auto const &[mesh_name, wm] : exported->meshes) {
+		WalkMesh const &mapped = prebuilt->lookup(mesh_name);
+		triangles += wm.triangles.size();
+		if (!mapped.vertices.is_view()) ++mismatches;
+
+		std::vector< glm::vec3 > points = random_points(wm, queries, 0x10ad);
+		std::vector< WalkPoint > a(queries), b(queries);
+		prebuilt_query_time += time_seconds([&](){
+			for (uint32_t i = 0; i < queries; ++i) b[i] = mapped.nearest_walk_point(points[i]);
+		});
+		exported_query_time += time_seconds([&](){
+			for (uint32_t i = 0; i < queries; ++i) a[i] = wm.nearest_walk_point(points[i]);
+		});
+		for (uint32_t i = 0; i < queries; ++i) {
+			if (!same_walk_point(a[i], b[i])) ++mismatches;
+			//(walking uses the half-edge tables, pathfinding the clusters:)
+			WalkPoint wa = a[i], wb = b[i];
+			glm::vec3 step = 0.1f * (points[(i+1) % queries] - points[i]);
+			wm.walk(&wa, step);
+			mapped.walk(&wb, step);
+			if (!same_walk_point(wa, wb)) ++mismatches;
+		}
+		WalkPathfinder pa(wm), pb(mapped);
+		std::vector< WalkPoint > path_a, path_b;
+		for (uint32_t i = 0; i + 1 < std::min(queries, 100U); ++i) {
+			bool found_a = pa.find_path(a[i], a[i+1], &path_a);
+			bool found_b = pb.find_path(b[i], b[i+1], &path_b);
+			if (found_a != found_b || pa.path_length != pb.path_length) ++mismatches;
+		}
+	}
+
+	uint64_t exported_size = 0, prebuilt_size = 0;
+	{
+		std::ifstream in(exported_path, std::ios::binary | std::ios::ate);
+		exported_size = uint64_t(in.tellg());
+	}
+	{
+		std::ifstream in(prebuilt_path, std::ios::binary | std::ios::ate);
+		prebuilt_size = uint64_t(in.tellg());
+	}
+	prebuilt.reset(); //(unmap before removing)
+	std::remove(prebuilt_path.c_str());
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(9) << triangles << " tris | "
+	          << "exported " << std::setw(6) << (exported_size >> 10) << " KiB, load " << std::fixed << std::setprecision(2) << std::setw(8) << 1e3 * exported_time << " ms | "
+	          << "prebuilt " << std::setw(6) << (prebuilt_size >> 10) << " KiB, load " << std::setw(8) << 1e3 * prebuilt_time << " ms | "
+	          << "first " << queries << " nearest_walk_point " << std::setprecision(1) << 1e3 * exported_query_time << " ms vs. " << 1e3 * prebuilt_query_time << " ms mapped";
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+//height queries: WalkHeightGrid vs. casting a ray down through the BVH vs. nearest_walk_point:
+static bool bench_height(std::string const &name, WalkMesh const &wm, uint32_t linear_queries, uint32_t queries) {
+	std::unique_ptr< WalkHeightGrid > grid;
+	double build_time = time_seconds([&](){ grid.reset(new WalkHeightGrid(wm)); });
+
+	//query points' z is used as max_z, so some queries land under overhangs or miss entirely:
+	std::vector< glm::vec3 > points = random_points(wm, queries, 0x4e16);
+
+	//grid should agree exactly with checking every triangle:
+	uint32_t mismatches = 0;
+	for (uint32_t i = 0; i < linear_queries; ++i) {
+		WalkPoint a, b;
+		bool found_a = grid->ground(glm::vec2(points[i]), &a, points[i].z);
+		bool found_b = grid->ground_linear(glm::vec2(points[i]), &b, points[i].z);
+		if (found_a != found_b || (found_a && !same_walk_point(a, b))) ++mismatches;
+	}
+
+	//(timed queries look down from above the mesh, like scattering objects at load time)
+	float top = -std::numeric_limits< float >::infinity();
+	for (auto const &v : wm.vertices) {
+		top = std::max(top, v.z + 1.0f);
+	}
+	for (auto &pt : points) {
+		pt.z = top;
+	}
+
+	std::vector< float > heights(queries);
+	std::vector< glm::vec3 > normals(queries);
+	uint32_t found = 0;
+	double grid_time = time_seconds([&](){
+		for (uint32_t i = 0; i < queries; ++i) {
+			heights[i] = -std::numeric_limits< float >::infinity();
+			normals[i] = glm::vec3(0.0f);
+			if (grid->height_at(glm::vec2(points[i]), &heights[i], &normals[i], points[i].z)) ++found;
+		}
+	});
+
+	std::vector< float > batch_heights;
+	std::vector< glm::vec3 > batch_normals;
+	double batch_time = time_seconds([&](){ grid->height_batch(points, &batch_heights, &batch_normals); });
+	if (batch_heights != heights || batch_normals != normals) ++mismatches;
+
+	//what callers did before: cast down from max_z (BVH), or snap to the closest point (BVH):
+	double ray_time = time_seconds([&](){
+		for (uint32_t i = 0; i < queries; ++i) {
+			WalkPoint hit;
+			float t;
+			wm.ray_cast(points[i], glm::vec3(0.0f, 0.0f, -1.0f), std::numeric_limits< float >::infinity(), &hit, &t);
+		}
+	});
+	double nearest_time = time_seconds([&](){
+		for (uint32_t i = 0; i < queries; ++i) {
+			wm.nearest_walk_point(points[i]);
+		}
+	});
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(9) << wm.triangles.size() << " tris | "
+	          << "build " << std::fixed << std::setprecision(2) << std::setw(7) << build_time * 1e3 << " ms, "
+	          << grid->cells.x << "x" << grid->cells.y << " cells, " << std::setprecision(1) << float(grid->cell_triangles.size()) / float(grid->cell_begin.size() - 1) << " tris/cell | "
+	          << "grid " << std::setprecision(2) << std::setw(7) << double(queries) / grid_time * 1e-6 << " Mq/s | "
+	          << "batch " << std::setw(7) << double(queries) / batch_time * 1e-6 << " Mq/s | "
+	          << "ray down " << std::setw(6) << double(queries) / ray_time * 1e-6 << " Mq/s | "
+	          << "nearest " << std::setw(6) << double(queries) / nearest_time * 1e-6 << " Mq/s | "
+	          << std::setprecision(0) << 100.0 * found / queries << "% on ground";
+	if (mismatches) {
+		std::cout << " | " << mismatches << " MISMATCHES";
+	}
+	std::cout << std::endl;
+	return mismatches == 0;
+}
+
+//crowd of agents crossing to each other's start positions, with and without avoidance:
+static bool bench_crowd(std::string const &name, WalkMesh const &wm, WorkerPool *workers, uint32_t agents, uint32_t frames, float radius, float speed, float neighbor_distance) {
+	//agents start at random spots spread evenly (by area) over the mesh:
+	std::vector< float > area_before; //total area of triangles before each triangle
+	area_before.reserve(wm.triangles.size() + 1);
+	area_before.emplace_back(0.0f);
+	for (auto const &tri : wm.triangles) {
+		glm::vec3 const &a = wm.vertices[tri.x], &b = wm.vertices[tri.y], &c = wm.vertices[tri.z];
+		area_before.emplace_back(area_before.back() + 0.5f * glm::length(glm::cross(b - a, c - a)));
+	}
+	std::mt19937 mt(0xc10d);
+	std::uniform_real_distribution< float > u(0.0f, 1.0f);
+	std::vector< WalkPoint > starts;
+	starts.reserve(agents);
+	for (uint32_t i = 0; i < agents; ++i) {
+		float at = u(mt) * area_before.back();
+		uint32_t tri = uint32_t(std::upper_bound(area_before.begin() + 1, area_before.end() - 1, at) - (area_before.begin() + 1));
+		float s = u(mt), t = u(mt);
+		if (s + t > 1.0f) { s = 1.0f - s; t = 1.0f - t; }
+		starts.emplace_back(wm.triangles[tri], glm::vec3(1.0f - s - t, s, t));
+	}
+	std::vector< glm::vec3 > goals;
+	goals.reserve(agents);
+	for (uint32_t i = 0; i < agents; ++i) {
+		goals.emplace_back(wm.to_world_point(starts[(i + 1) % agents]));
+	}
+
+	float elapsed = 1.0f / 30.0f;
+	struct Result {
+		double hash_time = 0.0, step_time = 0.0;
+		uint64_t rehashed = 0;
+		uint64_t overlaps = 0; //pairs closer than 90% of their combined radii, summed over frames
+		std::vector< glm::vec3 > positions;
+		uint32_t mismatches = 0; //neighbor queries that disagree with brute force
+	};
+	auto run = [&](WorkerPool *pool, bool avoidance) -> Result {
+		Result result;
+		WalkCrowd crowd(wm, neighbor_distance, pool);
+		crowd.avoidance = avoidance;
+		for (auto const &start : starts) {
+			crowd.add_agent(start, radius, speed);
+		}
+		std::vector< uint32_t > near, brute;
+		for (uint32_t f = 0; f < frames; ++f) {
+			for (uint32_t a = 0; a < crowd.size(); ++a) {
+				glm::vec2 to = glm::vec2(goals[a] - crowd.positions[a]);
+				float length = glm::length(to);
+				//(slow down over the last half second so agents settle on their goals)
+				crowd.preferred_velocities[a] = (length > 1e-4f ? to * (std::min(speed, 2.0f * length) / length) : glm::vec2(0.0f));
+			}
+			//(hash is updated here so it can be timed on its own; step() then finds nothing to move)
+			result.hash_time += time_seconds([&](){ crowd.update_hash(); });
+			result.rehashed += crowd.rehashed;
+			result.step_time += time_seconds([&](){ crowd.step(elapsed); });
+
+			for (uint32_t a = 0; a < crowd.size(); ++a) {
+				crowd.for_each_near(crowd.positions[a], 2.0f * radius, [&](uint32_t b) {
+					if (b <= a) return;
+					if (glm::length(crowd.positions[b] - crowd.positions[a]) < 0.9f * (crowd.radii[a] + crowd.radii[b])) result.overlaps += 1;
+				});
+			}
+		}
+
+		//spatial hash should find exactly the agents a brute-force search does:
+		crowd.update_hash();
+		for (uint32_t a = 0; a < crowd.size(); a += std::max(1U, crowd.size() / 100)) {
+			near.clear();
+			crowd.for_each_near(crowd.positions[a], neighbor_distance, [&](uint32_t b) { near.emplace_back(b); });
+			brute.clear();
+			for (uint32_t b = 0; b < crowd.size(); ++b) {
+				if (glm::length2(crowd.positions[b] - crowd.positions[a]) <= neighbor_distance * neighbor_distance) brute.emplace_back(b);
+			}
+			std::sort(near.begin(), near.end());
+			if (near != brute) result.mismatches += 1;
+		}
+		result.positions = crowd.positions;
+		return result;
+	};
+
+	uint32_t threads = workers->size();
+	Result single = run(nullptr, true);
+	Result multi = run(workers, true);
+	Result off = run(workers, false);
+
+	//results should not depend on thread count:
+	bool same = single.positions == multi.positions;
+	uint32_t mismatches = single.mismatches + multi.mismatches + off.mismatches;
+
+	std::cout << "  " << std::setw(24) << std::left << name << std::right
+	          << std::setw(7) << agents << " agents | "
+	          << "hash " << std::fixed << std::setprecision(3) << std::setw(6) << single.hash_time / frames * 1e3 << " ms/frame (" << std::setprecision(0) << double(single.rehashed) / frames << " moved) | "
+	          << "avoid+walk " << std::setprecision(2) << std::setw(6) << single.step_time / frames * 1e3 << " ms/frame (1 thread) "
+	          << std::setw(6) << multi.step_time / frames * 1e3 << " ms/frame (" << threads << " threads) | "
+	          << "overlaps/frame " << std::setprecision(1) << double(multi.overlaps) / frames << " avoiding vs. " << double(off.overlaps) / frames << " not";
+	if (!same) {
+		std::cout << " | THREAD COUNT CHANGES RESULT";
+	}
+	if (mismatches) {
+		std::cout << " | " << mismatches << " NEIGHBOR MISMATCHES";
+	}
+	std::cout << std::endl;
+	return same && mismatches == 0;
+}
+
+int main(int argc, char **argv) {
+	bool quick = (argc > 1 && std::string(argv[1]) == "quick");
+	bool ok = true;
+
+	std::vector< std::string > files = { "ring.w", "islands.w", "phone-bank.w", "myscene.w" };
+	std::vector< std::pair< std::string, WalkMeshes > > shipped;
+	for (auto const &file : files) {
+		shipped.emplace_back(file, WalkMeshes(data_path(file)));
+	}
+
+	WalkMesh synthetic = make_synthetic_walkmesh(quick ? 10000 : 1000000);
+	std::string synthetic_name = "synthetic";
+
+	//one pool for the whole run, as the game does (at least two threads, to check results match a single thread):
+	WorkerPool workers(std::max(2U, std::thread::hardware_concurrency()));
+
+	std::cout << "nearest_walk_point:" << std::endl;
+	for (auto const &[file, wms] : shipped) {
+		for (auto const &[name, wm] : wms.meshes) {
+			ok = bench_nearest(file + ":" + name, wm, 10000, 10000) && ok;
+		}
+	}
+	ok = bench_nearest(synthetic_name, synthetic, quick ? 1000 : 50, quick ? 10000 : 100000) && ok;
+
+	std::cout << "relocate vs. nearest_walk_point:" << std::endl;
+	for (auto const &[file, wms] : shipped) {
+		for (auto const &[name, wm] : wms.meshes) {
+			ok = bench_relocate(file + ":" + name, wm, 10000, 0.25f, 0.0f) && ok;
+			ok = bench_relocate(file + ":" + name, wm, 10000, 0.25f, 0.5f) && ok;
+		}
+	}
+	ok = bench_relocate(synthetic_name, synthetic, 10000, 2.0f, 0.0f) && ok;
+	ok = bench_relocate(synthetic_name, synthetic, 10000, 2.0f, 0.5f) && ok;
+	ok = bench_relocate_across_gap(1000) && ok;
+
+	std::cout << "ray_cast:" << std::endl;
+	for (auto const &[file, wms] : shipped) {
+		for (auto const &[name, wm] : wms.meshes) {
+			ok = bench_ray(file + ":" + name, wm, true, 10000, 10000) && ok;
+			ok = bench_ray(file + ":" + name, wm, false, 10000, 10000) && ok;
+		}
+	}
+	ok = bench_ray(synthetic_name, synthetic, true, quick ? 1000 : 20, 100000) && ok;
+	ok = bench_ray(synthetic_name, synthetic, false, quick ? 1000 : 20, 100000) && ok;
+
+	std::cout << "trace_straight:" << std::endl;
+	for (auto const &[file, wms] : shipped) {
+		for (auto const &[name, wm] : wms.meshes) {
+			ok = bench_trace(file + ":" + name, wm, 100000, 2.0f) && ok;
+		}
+	}
+	ok = bench_trace(synthetic_name, synthetic, 100000, 10.0f) && ok;
+
+	std::cout << "walk vs. walk_batch:" << std::endl;
+	for (auto const &[file, wms] : shipped) {
+		for (auto const &[name, wm] : wms.meshes) {
+			ok = bench_walk(file + ":" + name, wm, 10000, 100) && ok;
+		}
+	}
+	ok = bench_walk(synthetic_name, synthetic, 10000, 100) && ok;
+
+	std::cout << "triangle/vertex order:" << std::endl;
+	ok = bench_layout(synthetic_name, synthetic, 10000, 100, quick ? 100 : 50) && ok;
+
+	std::cout << "find_path:" << std::endl;
+	for (auto const &[file, wms] : shipped) {
+		if (file != "ring.w" && file != "islands.w") continue;
+		for (auto const &[name, wm] : wms.meshes) {
+			ok = bench_path(file + ":" + name, wm, 100000) && ok;
+		}
+	}
+	ok = bench_path(synthetic_name, synthetic, quick ? 1000 : 200) && ok;
+
+	std::cout << "flow fields:" << std::endl;
+	for (auto const &[file, wms] : shipped) {
+		for (auto const &[name, wm] : wms.meshes) {
+			ok = bench_flow(file + ":" + name, wm, &workers, 1000, 100) && ok;
+		}
+	}
+	ok = bench_flow(synthetic_name, synthetic, &workers, 1000, 100) && ok;
+
+	std::cout << "prebuilt (memory-mapped) loading:" << std::endl;
+	for (auto const &file : files) {
+		ok = bench_prebuilt(file, data_path(file), 1000) && ok;
+	}
+	{
+		std::string path = data_path("walkmesh-bench-exported.w");
+		write_exported(synthetic, "WalkMesh", path);
+		ok = bench_prebuilt(synthetic_name, path, 1000) && ok;
+		std::remove(path.c_str());
+	}
+
+	std::cout << "tiles:" << std::endl;
+	for (auto const &[file, wms] : shipped) {
+		for (auto const &[name, wm] : wms.meshes) {
+			//(tile size and streaming radius scaled to the mesh, so each has several tiles:)
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+			for (auto const &v : wm.vertices) {
+				min = glm::min(min, v);
+				max = glm::max(max, v);
+			}
+			float size = std::max(max.x - min.x, max.y - min.y) / 4.0f;
+			ok = bench_tiles(file + ":" + name, wm, size, 1.5f * size, 0.5f * size, 1000, 0.02f * size) && ok;
+		}
+	}
+	ok = bench_tiles(synthetic_name, synthetic, 32.0f, 64.0f, 16.0f, quick ? 1000 : 3000, 0.25f) && ok;
+
+	std::cout << "height queries:" << std::endl;
+	for (auto const &[file, wms] : shipped) {
+		for (auto const &[name, wm] : wms.meshes) {
+			ok = bench_height(file + ":" + name, wm, 10000, 100000) && ok;
+		}
+	}
+	ok = bench_height(synthetic_name, synthetic, quick ? 1000 : 20, 1000000) && ok;
+
+	std::cout << "crowd:" << std::endl;
+	for (auto const &[file, wms] : shipped) {
+		if (file != "islands.w") continue;
+		for (auto const &[name, wm] : wms.meshes) {
+			ok = bench_crowd(file + ":" + name, wm, &workers, quick ? 2000 : 10000, quick ? 100 : 300, 0.02f, 0.5f, 0.15f) && ok;
+		}
+	}
+
+	if (!ok) {
+		std::cerr << "ERROR: accelerated results differ from reference results." << std::endl;
+		return 1;
+	}
+	return 0;
+}